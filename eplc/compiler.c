@@ -0,0 +1,187 @@
+/**
+ * Copyright (c) 2012, Csirmaz Dávid
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file
+ * The compiler instances. They run the phases of the compilation on a source and
+ * collect the results.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "compiler.h"
+#include "error.h"
+#include "semantic.h"
+#include "timing.h"
+
+/**
+ * The options of the compilers created without options.
+ */
+static const struct EPL_CompilerOptions defaultOptions = {0, 0, 0};
+
+struct EPL_Compiler
+{
+    const struct EPL_CompilerOptions *options; ///< The options of the instance.
+    struct ERR_Context errorContext; ///< The errors of the compilation being run.
+};
+
+struct EPL_Compiler *EPL_create(const struct EPL_CompilerOptions *options)
+{
+    struct EPL_Compiler *compiler = calloc(1, sizeof(struct EPL_Compiler));
+
+    compiler->options = options ? options : &defaultOptions;
+    ERR_initializeContext(&compiler->errorContext);
+    return compiler;
+}
+
+/**
+ * Moves the raised errors into the diagnostics of the result. The errors are caught.
+ *
+ * @param result The result.
+ */
+static void collectDiagnostics(struct EPL_CompileResult *result)
+{
+    const struct ERR_Error *error;
+
+    while ((error = ERR_getFirstError()))
+    {
+        struct EPL_Diagnostic *diagnostic;
+        if (result->diagnosticCount == result->diagnosticsAllocated)
+        {
+            result->diagnosticsAllocated = result->diagnosticsAllocated ? result->diagnosticsAllocated * 2 : 8;
+            result->diagnostics =
+                realloc(result->diagnostics, result->diagnosticsAllocated * sizeof(struct EPL_Diagnostic));
+        }
+        diagnostic = &result->diagnostics[result->diagnosticCount++];
+        diagnostic->errorCode = error->errorCode;
+        diagnostic->severity = ERR_describeError(error->errorCode)->severity;
+        diagnostic->offset = error->offset;
+        diagnostic->nodeId = error->nodeId;
+        ERR_catchError(error->errorCode);
+    }
+}
+
+int EPL_compileBuffer(
+    struct EPL_Compiler *compiler,
+    const char *begin,
+    const char *end,
+    struct EPL_CompileResult *result)
+{
+    return EPL_compileLexer(compiler, LEX_createBufferLexer(begin, end), result);
+}
+
+/**
+ * @param result The result.
+ *
+ * @return Nonzero if the result has no diagnostics of error severity.
+ */
+static int hasNoErrors(const struct EPL_CompileResult *result)
+{
+    int i;
+    for (i = 0; i < result->diagnosticCount; i++)
+    {
+        if (result->diagnostics[i].severity == ERR_SEVERITY_ERROR)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int EPL_compileLexer(
+    struct EPL_Compiler *compiler,
+    struct LEX_Lexer *lexer,
+    struct EPL_CompileResult *result)
+{
+    return EPL_parse(compiler, lexer, result) && EPL_check(compiler, result);
+}
+
+int EPL_parse(
+    struct EPL_Compiler *compiler,
+    struct LEX_Lexer *lexer,
+    struct EPL_CompileResult *result)
+{
+    struct ERR_Context *previousContext;
+    struct STX_ParserResult parserResult;
+    int previousPhase;
+
+    memset(result, 0, sizeof(struct EPL_CompileResult));
+    result->lexer = lexer;
+    result->lexerResult = LEX_getLexerResult(lexer);
+    ERR_initializeContext(&compiler->errorContext);
+    previousContext = ERR_setContext(&compiler->errorContext);
+
+    // Syntax analysis, the parser reads the tokens from the lexer as it goes.
+    previousPhase = TIM_enterPhase(TIM_PARSE);
+    parserResult = STX_buildSyntaxTree(lexer);
+    TIM_leavePhase(previousPhase);
+    if (ERR_isError())
+    {
+        STX_destroySyntaxTree(parserResult.tree);
+        collectDiagnostics(result);
+        ERR_setContext(previousContext);
+        return 0;
+    }
+    result->tree = parserResult.tree;
+    ERR_setContext(previousContext);
+    if (compiler->options->syntaxTreeBuilt)
+    {
+        compiler->options->syntaxTreeBuilt(result, compiler->options->userData);
+    }
+    return 1;
+}
+
+int EPL_check(struct EPL_Compiler *compiler, struct EPL_CompileResult *result)
+{
+    struct ERR_Context *previousContext;
+    int previousPhase;
+
+    ERR_initializeContext(&compiler->errorContext);
+    previousContext = ERR_setContext(&compiler->errorContext);
+    previousPhase = TIM_enterPhase(TIM_CHECK);
+    SMC_checkSyntaxTree(result->tree, compiler->options->scopeDumpFile);
+    TIM_leavePhase(previousPhase);
+    collectDiagnostics(result);
+    ERR_setContext(previousContext);
+    return hasNoErrors(result);
+}
+
+void EPL_cleanUpResult(struct EPL_CompileResult *result)
+{
+    if (result->tree)
+    {
+        STX_destroySyntaxTree(result->tree);
+    }
+    if (result->lexer)
+    {
+        LEX_destroyLexer(result->lexer);
+    }
+    free(result->diagnostics);
+    memset(result, 0, sizeof(struct EPL_CompileResult));
+}
+
+void EPL_destroy(struct EPL_Compiler *compiler)
+{
+    free(compiler);
+}
@@ -0,0 +1,177 @@
+/**
+ * Copyright (c) 2012, Csirmaz Dávid
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef COMPILER_H
+#define COMPILER_H
+
+#include <stdio.h>
+
+#include "lexer.h"
+#include "syntax.h"
+
+/**
+ * A diagnostic of the compilation. It's kept compact, the message is got by
+ * ERR_describeError when the diagnostic is rendered.
+ */
+struct EPL_Diagnostic
+{
+    unsigned short errorCode; ///< The error. (enum ERR_ErrorCode)
+    unsigned char severity; ///< The severity. (enum ERR_Severity)
+    int offset; ///< Source offset of the diagnostic. -1 if unknown.
+    int nodeId; ///< Id of the syntax tree node of the diagnostic. -1 if none.
+};
+
+/**
+ * The result of a compilation. It owns everything it refers to, clean it up with
+ * EPL_cleanUpResult.
+ */
+struct EPL_CompileResult
+{
+    /// The lexer the source was read by. The nodes of the tree refer to its texts.
+    struct LEX_Lexer *lexer;
+    /// The tokens of the source. They are incomplete if the parsing stopped on an error.
+    const struct LEX_LexerResult *lexerResult;
+    /// The syntax tree. Null if it couldn't be built.
+    struct STX_SyntaxTree *tree;
+    struct EPL_Diagnostic *diagnostics; ///< The diagnostics in the order they are raised.
+    int diagnosticCount; ///< Count of the diagnostics.
+    int diagnosticsAllocated; ///< Allocated size of the diagnostics array.
+};
+
+/**
+ * Callback function called between the phases of the compilation.
+ *
+ * @param result The result of the compilation so far.
+ * @param userData The user data of the compiler options.
+ */
+typedef void (*EPL_PhaseCallback)(const struct EPL_CompileResult *result, void *userData);
+
+/**
+ * The options of a compiler instance.
+ */
+struct EPL_CompilerOptions
+{
+    /// Called when the syntax tree is built without errors, before the semantic checking.
+    /// Null if not needed.
+    EPL_PhaseCallback syntaxTreeBuilt;
+    /// The symbols of the scopes are written to it by the semantic checker. Null if not needed.
+    FILE *scopeDumpFile;
+    void *userData; ///< Passed to the callbacks.
+};
+
+/**
+ * A compiler instance. It has all the state of the compilations, the errors are raised
+ * into its own error context, so instances can be used on different threads at the
+ * same time. One instance must be used by one thread at a time. An instance can compile
+ * any number of sources.
+ */
+struct EPL_Compiler;
+
+/**
+ * Creates a compiler instance.
+ *
+ * @param options The options. Null for the defaults: no callbacks, no dumps. They are
+ *      not copied, they must be valid until the compiler is destroyed. Changes of them
+ *      take effect at the next compilation.
+ *
+ * @return The compiler. Destroy it with EPL_destroy.
+ */
+struct EPL_Compiler *EPL_create(const struct EPL_CompilerOptions *options);
+
+/**
+ * Compiles a source in the memory.
+ *
+ * @param compiler The compiler.
+ * @param begin The first character of the source.
+ * @param end The end of the source. The byte at end must be a readable zero.
+ *      (See LEX_createBufferLexer.) The source must be valid until the result is
+ *      cleaned up.
+ * @param [out] result The result. Clean it up with EPL_cleanUpResult.
+ *
+ * @return Nonzero if the source compiled without errors.
+ */
+int EPL_compileBuffer(
+    struct EPL_Compiler *compiler,
+    const char *begin,
+    const char *end,
+    struct EPL_CompileResult *result);
+
+/**
+ * Compiles the source read by a lexer, eg. a chunked lexer or a lexer replaying
+ * cached tokens.
+ *
+ * @param compiler The compiler.
+ * @param lexer A new lexer. The result takes it over, it's destroyed with the result.
+ * @param [out] result The result. Clean it up with EPL_cleanUpResult.
+ *
+ * @return Nonzero if the source compiled without errors.
+ */
+int EPL_compileLexer(
+    struct EPL_Compiler *compiler,
+    struct LEX_Lexer *lexer,
+    struct EPL_CompileResult *result);
+
+/**
+ * Runs the first phases of the compilation: builds the syntax tree from the tokens read
+ * by a lexer. The phases can be run by different compiler instances on different
+ * threads, eg. to process several sources at the same time in a pipeline.
+ *
+ * @param compiler The compiler.
+ * @param lexer A new lexer. The result takes it over, it's destroyed with the result.
+ * @param [out] result The result. Clean it up with EPL_cleanUpResult.
+ *
+ * @return Nonzero if the syntax tree is built, then the result can be checked by
+ *      EPL_check.
+ */
+int EPL_parse(
+    struct EPL_Compiler *compiler,
+    struct LEX_Lexer *lexer,
+    struct EPL_CompileResult *result);
+
+/**
+ * Runs the semantic checking on the syntax tree of a result of EPL_parse. The
+ * diagnostics are appended to the result.
+ *
+ * @param compiler The compiler.
+ * @param result The result of EPL_parse.
+ *
+ * @return Nonzero if the source compiled without errors.
+ */
+int EPL_check(struct EPL_Compiler *compiler, struct EPL_CompileResult *result);
+
+/**
+ * Releases everything the result owns.
+ *
+ * @param result The result.
+ */
+void EPL_cleanUpResult(struct EPL_CompileResult *result);
+
+/**
+ * Destroys a compiler instance. The results of it remain valid.
+ *
+ * @param compiler The compiler.
+ */
+void EPL_destroy(struct EPL_Compiler *compiler);
+
+#endif // COMPILER_H
@@ -25,29 +25,181 @@
 
 /**
  * @file
- * Global error handling module.
+ * Error handling module.
  *
- * Error codes are handled in this module.
+ * Error codes are handled in this module. They are raised into the error context of the
+ * current thread.
  */
 
 #include "error.h"
 
-/// Maximum number of raised error that can exist.
-#define ERROR_BUFFER_SIZE 100
+#if defined(_MSC_VER)
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+/// Table entry of an error. The name is the name of the error code.
+#define ERROR_DESCRIPTION(errorCode, message) [errorCode] = {#errorCode, message, ERR_SEVERITY_ERROR}
+
+/**
+ * The descriptions of the errors indexed by error code.
+ */
+static const struct ERR_ErrorDescription errorDescriptions[ERR_ERROR_CODE_COUNT] =
+{
+    ERROR_DESCRIPTION(E_OK, "No error."),
+    ERROR_DESCRIPTION(E_FILE_NOT_FOUND, "File not found."),
+    ERROR_DESCRIPTION(E_LEX_INVALID_CHARACTER, "Invalid character."),
+    ERROR_DESCRIPTION(E_LEX_IMPOSSIBLE_ERROR, "Impossible lexer error (this error should never happen)."),
+    ERROR_DESCRIPTION(E_LEX_INVALID_BUILT_IN_TYPE_LETTER, "Invalid built in type."),
+    ERROR_DESCRIPTION(E_LEX_INVALID_OPERATOR, "Invalid operator."),
+    ERROR_DESCRIPTION(E_LEX_MISSING_EXPONENTIAL_PART, "Missing exponential part."),
+    ERROR_DESCRIPTION(E_LEX_HEXA_FLOATING_POINT_NOT_ALLOWED, "Hexa floating point is not allowed."),
+    ERROR_DESCRIPTION(E_LEX_QUOTE_EXPECTED, "Unterminated string."),
+    ERROR_DESCRIPTION(E_LEX_INVALID_HEXA_LITERAL, "Invalid hexa literal."),
+    ERROR_DESCRIPTION(E_LEX_INVALID_DECIMAL_NUMBER, "Invalid decimal number."),
+    ERROR_DESCRIPTION(E_LEX_UNTERMINATED_COMMENT, "Unterminated comment."),
+    ERROR_DESCRIPTION(E_LEX_INTEGER_TOO_LARGE, "Integer literal is too large."),
+    ERROR_DESCRIPTION(E_LEX_INVALID_UTF8, "Invalid UTF-8 sequence."),
+
+    ERROR_DESCRIPTION(E_STX_MODULE_EXPECTED, "module expected."),
+    ERROR_DESCRIPTION(E_STX_MODULE_TYPE_EXPECTED, "exe, dll or lib expected."),
+    ERROR_DESCRIPTION(E_STX_SEMICOLON_EXPECTED, "; expected."),
+    ERROR_DESCRIPTION(E_STX_MAIN_EXPECTED, "main expected."),
+    ERROR_DESCRIPTION(E_STX_TYPE_EXPECTED, "data type expected."),
+    ERROR_DESCRIPTION(E_STX_VARDECL_EXPECTED, "variable declaration expected."),
+    ERROR_DESCRIPTION(E_STX_IDENTIFIER_EXPECTED, "identifier expected."),
+    ERROR_DESCRIPTION(E_STX_OF_EXPECTED, "of expected."),
+    ERROR_DESCRIPTION(E_STX_LEFT_BRACKET_EXPECTED, "[ expected."),
+    ERROR_DESCRIPTION(E_STX_INTEGER_NUMBER_EXPECTED, "integer number expected."),
+    ERROR_DESCRIPTION(E_STX_RIGHT_BRACKET_EXPECTED, "] expected."),
+    ERROR_DESCRIPTION(E_STX_TO_EXPECTED, "to expected."),
+    ERROR_DESCRIPTION(E_STX_PARAMETER_DIRECTION_EXPECTED, "parameter direction expected."),
+    ERROR_DESCRIPTION(E_STX_LEFT_PARENTHESIS_EXPECTED, "( expected."),
+    ERROR_DESCRIPTION(E_STX_RIGHT_PARENTHESIS_EXPECTED, ") expected."),
+    ERROR_DESCRIPTION(E_STX_COMMA_EXPECTED, ", expected."),
+    ERROR_DESCRIPTION(E_STX_FUNCTION_EXPECTED, "function expected."),
+    ERROR_DESCRIPTION(E_STX_LEFT_BRACE_EXPECTED, "{ expected."),
+    ERROR_DESCRIPTION(E_STX_RIGHT_BRACE_EXPECTED, "} expected."),
+    ERROR_DESCRIPTION(E_STX_RETURN_EXPECTED, "return expected."),
+    ERROR_DESCRIPTION(E_STX_TERM_EXPECTED, "term expected."),
+    ERROR_DESCRIPTION(E_STX_IF_EXPECTED, "if expected."),
+    ERROR_DESCRIPTION(E_STX_UNKNOWN_STATEMENT, "unknown statement."),
+    ERROR_DESCRIPTION(E_STX_LOOP_EXPECTED, "loop expected."),
+    ERROR_DESCRIPTION(
+        E_STX_ASSIGNMENT_OR_EXPRESSION_STATEMENT_EXPECTED,
+        "Assignment or expression statement expected."),
+    ERROR_DESCRIPTION(E_STX_UNEXPECTED_END_OF_FILE, "Unexpected end of file."),
+    ERROR_DESCRIPTION(E_STX_NAMESPACE_EXPECTED, "namespace expected."),
+    ERROR_DESCRIPTION(E_STX_USING_EXPECTED, "using expected."),
+    ERROR_DESCRIPTION(E_STX_PERIOD_EXPECTED, ". expected."),
+    ERROR_DESCRIPTION(E_STX_STRUCT_EXPECTED, "struct expected."),
+    ERROR_DESCRIPTION(E_STX_FUNCPTR_EXPECTED, "funcptr expected."),
+    ERROR_DESCRIPTION(E_STX_CASE_EXPECTED, "case expected."),
+    ERROR_DESCRIPTION(E_STX_COLON_EXPECTED, ": expected."),
+    ERROR_DESCRIPTION(E_STX_BREAK_OR_CONTINUE_EXPECTED, "break or continue expected."),
+    ERROR_DESCRIPTION(E_STX_SWITCH_EXPECTED, "switch expected."),
+    ERROR_DESCRIPTION(E_STX_CASE_OR_DEFAULT_EXPECTED, "case or default expected."),
+    ERROR_DESCRIPTION(E_STX_DECLARATION_EXPECTED, "declaration expected."),
+    ERROR_DESCRIPTION(E_STX_PRECEDENCE_TYPE_EXPECTED, "Precedence type expected."),
+    ERROR_DESCRIPTION(E_STX_STRING_EXPECTED, "string expected."),
+    ERROR_DESCRIPTION(E_STX_BLOCK_OR_EXTERNAL_EXPECTED, "Block or external expected."),
+    ERROR_DESCRIPTION(E_STX_PLATFORM_EXPECTED, "platform expected."),
+    ERROR_DESCRIPTION(E_STX_BLOCK_OR_IF_STATEMENT_EXPECTED, "Block or if statement expected."),
+    ERROR_DESCRIPTION(E_STX_CORRUPT_TOKEN, "Corrupt token (this error should never happen)."),
+
+    ERROR_DESCRIPTION(E_SMC_CORRUPT_SYNTAX_TREE, "Syntax tree is corrupt!"),
+    ERROR_DESCRIPTION(E_SMC_REDEFINITION_OF_SYMBOL, "Redefinition of symbol!"),
+    ERROR_DESCRIPTION(E_SMC_TOO_FEW_PARAMETERS, "Too few parameters given to this function."),
+    ERROR_DESCRIPTION(E_SMC_TOO_MANY_PARAMETERS, "Too many parameters given to this function."),
+    ERROR_DESCRIPTION(E_SMC_EMPTY_PLATFORM_BLOCK, "Platform block is empty."),
+    ERROR_DESCRIPTION(E_SMC_BREAK_IS_NOT_IN_LOOP_OR_CASE_BLOCK, "Break is not in loop or case block."),
+    ERROR_DESCRIPTION(E_SMC_CONTINUE_IS_NOT_IN_LOOP_OR_CASE_BLOCK, "Continue is not in loop or case block."),
+    ERROR_DESCRIPTION(E_SMC_UNDEFINED_SYMBOL, "Undefined symbol."),
+    ERROR_DESCRIPTION(E_SMC_NOT_AN_OPERATOR, "The symbol is used like an operator, but it's not an operator."),
+    ERROR_DESCRIPTION(E_SMC_NOT_A_NAMESPACE, "The symbol is not a namespace."),
+    ERROR_DESCRIPTION(E_SMC_AMBIGUOS_NAME, "Ambiguous symbol name."),
+};
+
+/**
+ * The description of the error codes missing from the table.
+ */
+static const struct ERR_ErrorDescription unknownErrorDescription =
+{
+    "E_UNKNOWN", "Unknown error.", ERR_SEVERITY_ERROR
+};
+
+/**
+ * The own error context of the thread. Zero initialized, so it's empty.
+ */
+static THREAD_LOCAL struct ERR_Context threadContext;
 
 /**
- * An array that stores the error codes.
+ * The context set by ERR_setContext. Null if the thread uses its own context.
  */
-static enum ERR_ErrorCode errors[ERROR_BUFFER_SIZE] = {0};
+static THREAD_LOCAL struct ERR_Context *currentContext;
+
+/**
+ * @return The error context of the current thread.
+ */
+static struct ERR_Context *getContext()
+{
+    return currentContext ? currentContext : &threadContext;
+}
+
+void ERR_initializeContext(struct ERR_Context *context)
+{
+    int i;
+    for (i = 0; i < ERR_ERROR_BUFFER_SIZE; i++)
+    {
+        context->errors[i].errorCode = E_OK;
+    }
+    context->errorCount = 0;
+}
+
+struct ERR_Context *ERR_setContext(struct ERR_Context *context)
+{
+    struct ERR_Context *previous = getContext();
+    currentContext = context;
+    return previous;
+}
+
+struct ERR_Context *ERR_getContext()
+{
+    return getContext();
+}
+
+const struct ERR_ErrorDescription *ERR_describeError(enum ERR_ErrorCode errorCode)
+{
+    if (((unsigned)errorCode >= ERR_ERROR_CODE_COUNT) || !errorDescriptions[errorCode].name)
+    {
+        return &unknownErrorDescription;
+    }
+    return &errorDescriptions[errorCode];
+}
 
 void ERR_raiseError(enum ERR_ErrorCode errorCode)
 {
+    ERR_raiseErrorAt(errorCode, -1, -1);
+}
+
+void ERR_raiseErrorAt(enum ERR_ErrorCode errorCode, int offset, int nodeId)
+{
+    struct ERR_Context *context = getContext();
     int i;
-    for (i = 0; i < ERROR_BUFFER_SIZE; i++)
+
+    if (!errorCode || (context->errorCount == ERR_ERROR_BUFFER_SIZE))
+    {
+        return;
+    }
+    for (i = 0; i < ERR_ERROR_BUFFER_SIZE; i++)
     {
-        if (!errors[i])
+        if (!context->errors[i].errorCode)
         {
-            errors[i] = errorCode;
+            context->errors[i].errorCode = errorCode;
+            context->errors[i].offset = offset;
+            context->errors[i].nodeId = nodeId;
+            context->errorCount++;
             return;
         }
     }
@@ -55,12 +207,19 @@ void ERR_raiseError(enum ERR_ErrorCode errorCode)
 
 int ERR_catchError(enum ERR_ErrorCode errorCode)
 {
+    struct ERR_Context *context = getContext();
     int i;
-    for (i = 0; i < ERROR_BUFFER_SIZE; i++)
+
+    if (!errorCode || !context->errorCount)
+    {
+        return 0;
+    }
+    for (i = 0; i < ERR_ERROR_BUFFER_SIZE; i++)
     {
-        if (errors[i] == errorCode)
+        if (context->errors[i].errorCode == errorCode)
         {
-            errors[i] = E_OK;
+            context->errors[i].errorCode = E_OK;
+            context->errorCount--;
             return 1;
         }
     }
@@ -69,12 +228,23 @@ int ERR_catchError(enum ERR_ErrorCode errorCode)
 
 int ERR_isError()
 {
+    return getContext()->errorCount != 0;
+}
+
+const struct ERR_Error *ERR_getFirstError()
+{
+    struct ERR_Context *context = getContext();
     int i;
-    for (i = 0; i < ERROR_BUFFER_SIZE; i++)
+
+    if (!context->errorCount)
     {
-        if (errors[i])
+        return 0;
+    }
+    for (i = 0; i < ERR_ERROR_BUFFER_SIZE; i++)
+    {
+        if (context->errors[i].errorCode)
         {
-            return 1;
+            return &context->errors[i];
         }
     }
     return 0;
@@ -82,12 +252,9 @@ int ERR_isError()
 
 void ERR_clearErrors()
 {
-    int i;
-    for (i = 0; i < ERROR_BUFFER_SIZE; i++)
+    struct ERR_Context *context = getContext();
+    if (context->errorCount)
     {
-        errors[i] = E_OK;
+        ERR_initializeContext(context);
     }
 }
-
-
-
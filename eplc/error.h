@@ -41,6 +41,9 @@ enum ERR_ErrorCode
     E_LEX_QUOTE_EXPECTED,
     E_LEX_INVALID_HEXA_LITERAL,
     E_LEX_INVALID_DECIMAL_NUMBER,
+    E_LEX_UNTERMINATED_COMMENT,
+    E_LEX_INTEGER_TOO_LARGE,
+    E_LEX_INVALID_UTF8,
 
     E_STX_MODULE_EXPECTED,
     E_STX_MODULE_TYPE_EXPECTED,
@@ -97,14 +100,88 @@ enum ERR_ErrorCode
     E_SMC_NOT_AN_OPERATOR,
     E_SMC_NOT_A_NAMESPACE,
     E_SMC_AMBIGUOS_NAME,
+
+    ERR_ERROR_CODE_COUNT, ///< Count of error codes.
+};
+
+/**
+ * The severity of a diagnostic.
+ */
+enum ERR_Severity
+{
+    ERR_SEVERITY_ERROR, ///< The compilation fails.
+    ERR_SEVERITY_WARNING, ///< The compilation goes on.
+};
+
+/**
+ * Describes an error code for the diagnostics.
+ */
+struct ERR_ErrorDescription
+{
+    const char *name; ///< Name of the error code, eg. "E_LEX_INVALID_CHARACTER".
+    const char *message; ///< The message shown to the user. A sentence without line break.
+    enum ERR_Severity severity; ///< The severity of the error.
+};
+
+/// Maximum number of raised errors that can exist in an error context.
+#define ERR_ERROR_BUFFER_SIZE 100
+
+/**
+ * A raised error.
+ */
+struct ERR_Error
+{
+    enum ERR_ErrorCode errorCode; ///< The error code. E_OK if the slot is free.
+    int offset; ///< Source offset of the error. -1 if unknown.
+    int nodeId; ///< Id of the syntax tree node of the error. -1 if none.
+};
+
+/**
+ * Stores the errors raised by a compilation.
+ *
+ * Each thread has its own context, so compilations on different threads don't see each
+ * other's errors. A context can be set for the current thread by ERR_setContext.
+ */
+struct ERR_Context
+{
+    struct ERR_Error errors[ERR_ERROR_BUFFER_SIZE]; ///< The raised errors. Freed slots are reused.
+    int errorCount; ///< Count of raised errors, so checking for errors needs no scan.
 };
 
+/**
+ * Initializes an empty error context.
+ *
+ * @param context The context.
+ */
+void ERR_initializeContext(struct ERR_Context *context);
+/**
+ * Sets the error context of the current thread. The errors are raised into it and
+ * checked in it until an other context is set.
+ *
+ * @param context The context. Null sets the own context of the thread.
+ *
+ * @return The previous context.
+ */
+struct ERR_Context *ERR_setContext(struct ERR_Context *context);
+/**
+ * Returns the error context of the current thread.
+ */
+struct ERR_Context *ERR_getContext();
+
 /**
  * Raises an error.
  *
  * @param errorCode the error code to raise.
  */
 void ERR_raiseError(enum ERR_ErrorCode errorCode);
+/**
+ * Raises an error at a place of the source.
+ *
+ * @param errorCode the error code to raise.
+ * @param offset Source offset of the error. -1 if unknown.
+ * @param nodeId Id of the syntax tree node of the error. -1 if none.
+ */
+void ERR_raiseErrorAt(enum ERR_ErrorCode errorCode, int offset, int nodeId);
 /**
  * Catches an error and clears it.
  *
@@ -114,9 +191,23 @@ void ERR_raiseError(enum ERR_ErrorCode errorCode);
  */
 int ERR_catchError(enum ERR_ErrorCode errorCode);
 /**
- * Returns nonzero if there was an error.
+ * Returns nonzero if there was an error. It takes constant time.
  */
 int ERR_isError();
+/**
+ * Returns the description of an error code from a static table.
+ *
+ * @param errorCode The error code.
+ *
+ * @return The description. Never null.
+ */
+const struct ERR_ErrorDescription *ERR_describeError(enum ERR_ErrorCode errorCode);
+/**
+ * Returns the first raised error which is not caught, with its place.
+ *
+ * @return The error. Null if there is no error.
+ */
+const struct ERR_Error *ERR_getFirstError();
 /**
  * Clears all errors previously raised.
  */
@@ -0,0 +1,610 @@
+/**
+ * Copyright (c) 2012, Csirmaz Dávid
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Lexer benchmark. Generates synthetic EPL sources and measures LEX_tokenizeString on
+ * them. With --threads LEX_tokenizeStringParallel is measured too, and its speedup over
+ * the serial lexer is reported. The results are written to the standard output as JSON.
+ * The times are wall clock times.
+ *
+ * The lexer is compiled into this file, so its allocations can be counted:
+ *
+ *     gcc -O2 -pthread lexbench.c error.c -o lexbench
+ */
+
+// The threads of the parallel lexer allocate at the same time.
+static atomic_long allocationCount; ///< Count of allocations made by the lexer.
+static atomic_llong allocatedBytes; ///< Total size of the allocations made by the lexer.
+
+/**
+ * Counting malloc of the lexer.
+ */
+static void *countedMalloc(size_t size)
+{
+    allocationCount++;
+    allocatedBytes += size;
+    return malloc(size);
+}
+
+/**
+ * Counting calloc of the lexer.
+ */
+static void *countedCalloc(size_t count, size_t size)
+{
+    allocationCount++;
+    allocatedBytes += count * size;
+    return calloc(count, size);
+}
+
+/**
+ * Counting realloc of the lexer. The whole new size is counted.
+ */
+static void *countedRealloc(void *block, size_t size)
+{
+    allocationCount++;
+    allocatedBytes += size;
+    return realloc(block, size);
+}
+
+#define malloc countedMalloc
+#define calloc countedCalloc
+#define realloc countedRealloc
+#include "lexer.c"
+#undef malloc
+#undef calloc
+#undef realloc
+
+/**
+ * A generated source.
+ */
+struct Corpus
+{
+    char *text; ///< The source. It's terminated by zero.
+    int length; ///< Length of the source.
+    int allocated; ///< Allocated size of the text.
+    unsigned random; ///< State of the random generator.
+    int depth; ///< The nesting depth of the nested units.
+    int globalCount; ///< Count of the globals of the identifier units.
+};
+
+/**
+ * Appends formatted text to the corpus.
+ *
+ * @param corpus The corpus.
+ * @param format The printf format.
+ */
+static void appendText(struct Corpus *corpus, const char *format, ...)
+{
+    va_list args;
+    int length;
+
+    va_start(args, format);
+    length = vsnprintf(0, 0, format, args);
+    va_end(args);
+    if (corpus->length + length + 1 > corpus->allocated)
+    {
+        while (corpus->length + length + 1 > corpus->allocated)
+        {
+            corpus->allocated *= 2;
+        }
+        corpus->text = realloc(corpus->text, corpus->allocated);
+    }
+    va_start(args, format);
+    vsnprintf(corpus->text + corpus->length, length + 1, format, args);
+    va_end(args);
+    corpus->length += length;
+}
+
+/**
+ * @param corpus The corpus.
+ *
+ * @return The next pseudo random number. (xorshift)
+ */
+static unsigned nextRandom(struct Corpus *corpus)
+{
+    corpus->random ^= corpus->random << 13;
+    corpus->random ^= corpus->random >> 17;
+    corpus->random ^= corpus->random << 5;
+    return corpus->random;
+}
+
+/// The words the generated names are made of.
+static const char *nameWords[] =
+{
+    "count", "index", "buffer", "length", "offset", "total", "value", "node",
+    "parent", "child", "first", "last", "next", "previous", "size", "capacity",
+};
+
+/**
+ * Appends the name of the index-th generated global.
+ *
+ * @param corpus The corpus.
+ * @param index The index of the global.
+ */
+static void appendName(struct Corpus *corpus, int index)
+{
+    const char *second = nameWords[(index / 16) % 16];
+    const char *third = nameWords[(index / 256) % 16];
+    appendText(
+        corpus,
+        "%s%c%s%c%s%d",
+        nameWords[index % 16],
+        second[0] - 'a' + 'A',
+        second + 1,
+        third[0] - 'a' + 'A',
+        third + 1,
+        index);
+}
+
+/**
+ * Appends an identifier heavy unit: a global computed from earlier globals, and a
+ * function with long parameter names after every 8 globals.
+ *
+ * @param corpus The corpus.
+ * @param index The index of the unit.
+ */
+static void generateIdentifierUnit(struct Corpus *corpus, int index)
+{
+    int global = corpus->globalCount++;
+
+    appendText(corpus, "vardecl $i32 ");
+    appendName(corpus, global);
+    if (!global)
+    {
+        appendText(corpus, " := 1;\n");
+        return;
+    }
+    appendText(corpus, " := ");
+    appendName(corpus, nextRandom(corpus) % global);
+    appendText(corpus, " + ");
+    appendName(corpus, nextRandom(corpus) % global);
+    appendText(corpus, " * ");
+    appendName(corpus, nextRandom(corpus) % global);
+    appendText(corpus, ";\n");
+    if (global % 8 == 7)
+    {
+        appendText(corpus, "\nfunction $i32 compute%d(in $i32 leftOperand, in $i32 rightOperand)\n{\n", index);
+        appendText(corpus, "    vardecl $i32 temporaryResult := leftOperand * rightOperand;\n");
+        appendText(corpus, "    return temporaryResult + ");
+        appendName(corpus, global);
+        appendText(corpus, ";\n}\n\n");
+    }
+}
+
+/**
+ * Appends a comment heavy unit: a function with documentation, block and end of line
+ * comments.
+ *
+ * @param corpus The corpus.
+ * @param index The index of the unit.
+ */
+static void generateCommentUnit(struct Corpus *corpus, int index)
+{
+    appendText(
+        corpus,
+        "/**\n"
+        " * Returns the parameter of the function %d. This sentence is here to make the\n"
+        " * comment as long as the documentation of a real function usually is.\n"
+        " *\n"
+        " * @param a The parameter.\n"
+        " */\n"
+        "function $i32 documented%d(in $i32 a) // The name tells what it is.\n"
+        "{\n"
+        "    /* The block comment spans\n"
+        "       two lines. */\n"
+        "    vardecl $i32 b := a; ///< Back comment.\n"
+        "    // An end of line comment.\n"
+        "    return b;\n"
+        "}\n\n",
+        index,
+        index);
+}
+
+/**
+ * Appends a literal heavy unit: integer, float, string and character literals.
+ *
+ * @param corpus The corpus.
+ * @param index The index of the unit.
+ */
+static void generateLiteralUnit(struct Corpus *corpus, int index)
+{
+    appendText(
+        corpus,
+        "vardecl $i32 integerLiteral%d := 0x%X + 0%o - %u;\n",
+        index,
+        nextRandom(corpus) & 0x7FFFFFFF,
+        nextRandom(corpus) & 0xFFFF,
+        nextRandom(corpus) % 1000000);
+    appendText(
+        corpus,
+        "vardecl $f64 realLiteral%d := %u.%u + %u.%ue-%u;\n",
+        index,
+        nextRandom(corpus) % 1000,
+        nextRandom(corpus) % 100000,
+        nextRandom(corpus) % 10,
+        nextRandom(corpus) % 1000,
+        nextRandom(corpus) % 30);
+    appendText(
+        corpus,
+        "vardecl staticptr to $u8 stringLiteral%d := \"String literal number %d.\" #10 "
+        "\"A second line with a character:\" #32 #%u #233 \"!\";\n",
+        index,
+        index,
+        33 + nextRandom(corpus) % 94);
+}
+
+/**
+ * Appends a deeply nested unit: a function with nested if statements and a nested
+ * expression in the innermost block.
+ *
+ * @param corpus The corpus.
+ * @param index The index of the unit.
+ */
+static void generateNestedUnit(struct Corpus *corpus, int index)
+{
+    int level;
+
+    appendText(corpus, "function $i32 nested%d(in $i32 a)\n{\n    vardecl $i32 i := 0;\n", index);
+    for (level = 1; level <= corpus->depth; level++)
+    {
+        appendText(corpus, "%*sif (a > %d)\n%*s{\n", level * 4, "", level, level * 4, "");
+    }
+    appendText(corpus, "%*si := ", level * 4, "");
+    for (level = 0; level < corpus->depth; level++)
+    {
+        appendText(corpus, "(");
+    }
+    for (level = 0; level < corpus->depth; level++)
+    {
+        appendText(corpus, "i + %d) * ", level + 1);
+    }
+    appendText(corpus, "a;\n");
+    for (level = corpus->depth; level >= 1; level--)
+    {
+        appendText(corpus, "%*s}\n", level * 4, "");
+    }
+    appendText(corpus, "    return i;\n}\n\n");
+}
+
+/**
+ * Appends a unit of the corpus.
+ *
+ * @param corpus The corpus.
+ * @param index The index of the unit.
+ */
+typedef void (*GenerateUnitFunction)(struct Corpus *corpus, int index);
+
+/**
+ * A kind of corpus.
+ */
+struct CorpusKind
+{
+    const char *name; ///< The name of the corpus on the command line and in the results.
+    GenerateUnitFunction generateUnit; ///< Generates a unit. Null for the mix of all.
+};
+
+/// The kinds of corpora.
+static const struct CorpusKind corpusKinds[] =
+{
+    {"identifiers", generateIdentifierUnit},
+    {"comments", generateCommentUnit},
+    {"literals", generateLiteralUnit},
+    {"nested", generateNestedUnit},
+    {"mixed", 0},
+};
+
+#define CORPUS_KIND_COUNT (int)(sizeof(corpusKinds) / sizeof(corpusKinds[0]))
+
+/**
+ * Generates a valid EPL module.
+ *
+ * @param corpus Receives the source. Free its text.
+ * @param kind The kind of the corpus.
+ * @param size The approximate size of the source.
+ * @param seed The seed of the random generator. The same seed gives the same source.
+ * @param depth The nesting depth of the nested units.
+ */
+static void generateCorpus(struct Corpus *corpus, const struct CorpusKind *kind, int size, unsigned seed, int depth)
+{
+    int index = 0;
+
+    corpus->allocated = 4096;
+    corpus->text = malloc(corpus->allocated);
+    corpus->length = 0;
+    corpus->random = seed ? seed : 1;
+    corpus->depth = depth;
+    corpus->globalCount = 0;
+    appendText(corpus, "module exe;\n\n");
+    while (corpus->length < size)
+    {
+        if (kind->generateUnit)
+        {
+            kind->generateUnit(corpus, index);
+        }
+        else
+        {
+            // The mix takes the units of the other kinds in turn.
+            corpusKinds[index % (CORPUS_KIND_COUNT - 1)].generateUnit(corpus, index);
+        }
+        index++;
+    }
+    appendText(corpus, "main\n{\n}\n");
+}
+
+/**
+ * @return The wall clock time in seconds.
+ */
+static double getTime(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/**
+ * Lexes a corpus.
+ *
+ * @param corpus The corpus.
+ * @param threadCount The count of threads. The serial lexer is used for 1.
+ *
+ * @return The tokens.
+ */
+static struct LEX_LexerResult tokenizeCorpus(const struct Corpus *corpus, int threadCount)
+{
+    return threadCount > 1 ?
+        LEX_tokenizeStringParallel(corpus->text, threadCount) :
+        LEX_tokenizeString(corpus->text);
+}
+
+/**
+ * Runs the lexer on a corpus repeatedly.
+ *
+ * @param corpus The corpus.
+ * @param threadCount The count of threads. The serial lexer is used for 1.
+ * @param minimumTime The lexer is run until this many seconds elapse.
+ * @param [out] iterations The count of runs.
+ *
+ * @return The seconds per run.
+ */
+static double timeLexer(const struct Corpus *corpus, int threadCount, double minimumTime, int *iterations)
+{
+    struct LEX_LexerResult result;
+    double start = getTime();
+    double now;
+
+    *iterations = 0;
+    do
+    {
+        result = tokenizeCorpus(corpus, threadCount);
+        LEX_cleanUpLexerResult(&result);
+        ++*iterations;
+        now = getTime();
+    }
+    while (now - start < minimumTime);
+    return (now - start) / *iterations;
+}
+
+/**
+ * Measures the lexer on a corpus and writes the result as a JSON object. With several
+ * threads the serial lexer is measured too, for the speedup.
+ *
+ * @param kind The kind of the corpus.
+ * @param corpus The corpus.
+ * @param minimumTime The lexer is run until this many seconds elapse.
+ * @param threadCount The count of threads.
+ */
+static void benchmarkCorpus(
+    const struct CorpusKind *kind,
+    const struct Corpus *corpus,
+    double minimumTime,
+    int threadCount)
+{
+    struct LEX_LexerResult result;
+    long allocations;
+    long long bytes;
+    int tokenCount;
+    int iterations;
+    int serialIterations;
+    double seconds;
+    double serialSeconds;
+
+    // The first run is not timed, it warms up the caches and counts the allocations.
+    allocationCount = 0;
+    allocatedBytes = 0;
+    result = tokenizeCorpus(corpus, threadCount);
+    allocations = allocationCount;
+    bytes = allocatedBytes;
+    tokenCount = result.tokenCount;
+    LEX_cleanUpLexerResult(&result);
+    if (ERR_isError())
+    {
+        fprintf(stderr, "Lexical error in the %s corpus.\n", kind->name);
+        ERR_clearErrors();
+    }
+
+    seconds = timeLexer(corpus, threadCount, minimumTime, &iterations);
+
+    printf(
+        "    {\"corpus\": \"%s\", \"bytes\": %d, \"tokens\": %d, \"iterations\": %d, "
+        "\"secondsPerRun\": %.6f, \"megabytesPerSecond\": %.2f, \"tokensPerSecond\": %.0f, "
+        "\"allocationsPerRun\": %ld, \"allocatedBytesPerRun\": %lld",
+        kind->name,
+        corpus->length,
+        tokenCount,
+        iterations,
+        seconds,
+        corpus->length / seconds / 1e6,
+        tokenCount / seconds,
+        allocations,
+        bytes);
+    if (threadCount > 1)
+    {
+        serialSeconds = timeLexer(corpus, 1, minimumTime, &serialIterations);
+        printf(
+            ", \"serialIterations\": %d, \"serialSecondsPerRun\": %.6f, \"speedup\": %.2f",
+            serialIterations,
+            serialSeconds,
+            serialSeconds / seconds);
+    }
+    printf("}");
+}
+
+/**
+ * Finds a kind of corpus by name.
+ *
+ * @param name The name.
+ *
+ * @return The kind. Null if not found.
+ */
+static const struct CorpusKind *findCorpusKind(const char *name)
+{
+    int i;
+    for (i = 0; i < CORPUS_KIND_COUNT; i++)
+    {
+        if (!strcmp(corpusKinds[i].name, name)) return &corpusKinds[i];
+    }
+    return 0;
+}
+
+/**
+ * Prints the usage.
+ */
+static void printUsage(void)
+{
+    int i;
+
+    printf("Usage: lexbench [options] [corpus...]\n");
+    printf("       lexbench --generate corpus [options]\n");
+    printf("Benchmarks the lexer on generated corpora, or writes a corpus to the standard output.\n");
+    printf("Corpora:");
+    for (i = 0; i < CORPUS_KIND_COUNT; i++)
+    {
+        printf(" %s", corpusKinds[i].name);
+    }
+    printf(" (default: all)\n");
+    printf("Options:\n");
+    printf("    --size bytes      Size of a corpus. (default: 1048576)\n");
+    printf("    --seed number     Seed of the generator. (default: 1)\n");
+    printf("    --depth number    Nesting depth of the nested corpus. (default: 16)\n");
+    printf("    --time seconds    Minimum measured time per corpus. (default: 1)\n");
+    printf("    --threads count   Lexes on this many threads and compares it to the serial lexer.\n");
+    printf("                      The chunks of a thread are at least 1 MB, use a larger size.\n");
+    printf("                      (default: 1)\n");
+}
+
+int main(int argc, char **argv)
+{
+    const struct CorpusKind *kinds[CORPUS_KIND_COUNT];
+    int kindCount = 0;
+    const struct CorpusKind *generatedKind = 0;
+    int size = 1 << 20;
+    unsigned seed = 1;
+    int depth = 16;
+    double minimumTime = 1;
+    int threadCount = 1;
+    struct Corpus corpus;
+    int i;
+
+    for (i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : 0;
+        if (!strcmp(arg, "--size") && value)
+        {
+            size = atoi(value);
+            i++;
+        }
+        else if (!strcmp(arg, "--seed") && value)
+        {
+            seed = strtoul(value, 0, 10);
+            i++;
+        }
+        else if (!strcmp(arg, "--depth") && value)
+        {
+            depth = atoi(value);
+            i++;
+        }
+        else if (!strcmp(arg, "--time") && value)
+        {
+            minimumTime = atof(value);
+            i++;
+        }
+        else if (!strcmp(arg, "--threads") && value && (atoi(value) >= 1))
+        {
+            threadCount = atoi(value);
+            i++;
+        }
+        else if (!strcmp(arg, "--generate") && value && findCorpusKind(value))
+        {
+            generatedKind = findCorpusKind(value);
+            i++;
+        }
+        else if (findCorpusKind(arg) && (kindCount < CORPUS_KIND_COUNT))
+        {
+            kinds[kindCount++] = findCorpusKind(arg);
+        }
+        else
+        {
+            printUsage();
+            return 1;
+        }
+    }
+
+    if (generatedKind)
+    {
+        generateCorpus(&corpus, generatedKind, size, seed, depth);
+        fwrite(corpus.text, 1, corpus.length, stdout);
+        free(corpus.text);
+        return 0;
+    }
+
+    if (!kindCount)
+    {
+        for (i = 0; i < CORPUS_KIND_COUNT; i++)
+        {
+            kinds[kindCount++] = &corpusKinds[i];
+        }
+    }
+    printf(
+        "{\n  \"benchmark\": \"%s\",\n  \"threads\": %d,\n  \"seed\": %u,\n  \"results\": [\n",
+        threadCount > 1 ? "LEX_tokenizeStringParallel" : "LEX_tokenizeString",
+        threadCount,
+        seed);
+    for (i = 0; i < kindCount; i++)
+    {
+        generateCorpus(&corpus, kinds[i], size, seed, depth);
+        benchmarkCorpus(kinds[i], &corpus, minimumTime, threadCount);
+        printf(i + 1 < kindCount ? ",\n" : "\n");
+        free(corpus.text);
+    }
+    printf("  ]\n}\n");
+    return 0;
+}
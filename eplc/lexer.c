@@ -30,9 +30,22 @@
  */
 
 #include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+/// The SSE2 and AVX2 kernels are compiled in, they are chosen at runtime.
+#define LEX_SIMD_KERNELS
+#include <immintrin.h>
+#endif
+
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+/// Eight decimal digits are converted at once in a 64 bit word. It needs little endian.
+#define LEX_SWAR_DIGITS
+#endif
+
 #include "lexer.h"
 #include "error.h"
 
@@ -50,1163 +63,4631 @@ struct KeywordTokenTypePair
 };
 
 /**
- * Array of keyword-token mappings.
- *
- * IMPORTANT: binary search is performed on this array to find the token.
- *      Keep the lexical order of the keywords!
- */
-static struct KeywordTokenTypePair keywordMapping[] =
-{
-    {"additive", 8, LEX_KW_ADDITIVE},
-    {"break", 5, LEX_KW_BREAK},
-    {"buffer", 6, LEX_KW_BUFFER},
-    {"case", 4, LEX_KW_CASE},
-    {"cast", 4, LEX_KW_CAST},
-    {"cleanup", 7, LEX_KW_CLEANUP},
-    {"continue", 8, LEX_KW_CONTINUE},
-    {"default", 7, LEX_KW_DEFAULT},
-    {"deref", 5, LEX_KW_DEREF},
-    {"dll", 3, LEX_KW_DLL},
-    {"else", 4, LEX_KW_ELSE},
-    {"exe", 3, LEX_KW_EXE},
-    {"external", 8, LEX_KW_EXTERNAL},
-    {"for", 3, LEX_KW_FOR},
-    {"funcptr", 7, LEX_KW_FUNCPTR},
-    {"function", 8, LEX_KW_FUNCTION},
-    {"handle", 6, LEX_KW_HANDLE},
-    {"if", 2, LEX_KW_IF},
-    {"in", 2, LEX_KW_IN},
-    {"inc", 3, LEX_KW_INC},
-    {"lib", 3, LEX_KW_LIB},
-    {"localptr", 8, LEX_KW_LOCALPTR},
-    {"loop", 4, LEX_KW_LOOP},
-    {"main", 4, LEX_KW_MAIN},
-    {"module", 6, LEX_KW_MODULE},
-    {"multiplicative", 14, LEX_KW_MULTIPLICATIVE},
-    {"namespace", 9, LEX_KW_NAMESPACE},
-    {"neg", 3, LEX_KW_NEG},
-    {"next", 4, LEX_KW_NEXT},
-    {"not", 3, LEX_KW_NOT},
-    {"of", 2, LEX_KW_OF},
-    {"operator", 8, LEX_KW_OPERATOR},
-    {"out", 3, LEX_KW_OUT},
-    {"pointer", 7, LEX_KW_POINTER},
-    {"ref", 3, LEX_KW_REF},
-    {"relational", 10, LEX_KW_RELATIONAL},
-    {"return", 6, LEX_KW_RETURN},
-    {"staticptr", 9, LEX_KW_STATICPTR},
-    {"struct", 6, LEX_KW_STRUCT},
-    {"switch", 6, LEX_KW_SWITCH},
-    {"to", 2, LEX_KW_TO},
-    {"using", 5, LEX_KW_USING},
-    {"vardecl", 7, LEX_KW_VARDECL},
-};
+ * The list of the keywords. X(text, length, first character, last character, token type)
+ *
+ * The first and last characters are spelled out because the perfect hash of the keyword
+ * must be an integer constant expression.
+ */
+#define KEYWORDS(X) \
+    X("additive", 8, 'a', 'e', LEX_KW_ADDITIVE) \
+    X("break", 5, 'b', 'k', LEX_KW_BREAK) \
+    X("buffer", 6, 'b', 'r', LEX_KW_BUFFER) \
+    X("case", 4, 'c', 'e', LEX_KW_CASE) \
+    X("cast", 4, 'c', 't', LEX_KW_CAST) \
+    X("cleanup", 7, 'c', 'p', LEX_KW_CLEANUP) \
+    X("continue", 8, 'c', 'e', LEX_KW_CONTINUE) \
+    X("default", 7, 'd', 't', LEX_KW_DEFAULT) \
+    X("deref", 5, 'd', 'f', LEX_KW_DEREF) \
+    X("dll", 3, 'd', 'l', LEX_KW_DLL) \
+    X("else", 4, 'e', 'e', LEX_KW_ELSE) \
+    X("exe", 3, 'e', 'e', LEX_KW_EXE) \
+    X("external", 8, 'e', 'l', LEX_KW_EXTERNAL) \
+    X("for", 3, 'f', 'r', LEX_KW_FOR) \
+    X("funcptr", 7, 'f', 'r', LEX_KW_FUNCPTR) \
+    X("function", 8, 'f', 'n', LEX_KW_FUNCTION) \
+    X("handle", 6, 'h', 'e', LEX_KW_HANDLE) \
+    X("if", 2, 'i', 'f', LEX_KW_IF) \
+    X("in", 2, 'i', 'n', LEX_KW_IN) \
+    X("inc", 3, 'i', 'c', LEX_KW_INC) \
+    X("lib", 3, 'l', 'b', LEX_KW_LIB) \
+    X("localptr", 8, 'l', 'r', LEX_KW_LOCALPTR) \
+    X("loop", 4, 'l', 'p', LEX_KW_LOOP) \
+    X("main", 4, 'm', 'n', LEX_KW_MAIN) \
+    X("module", 6, 'm', 'e', LEX_KW_MODULE) \
+    X("multiplicative", 14, 'm', 'e', LEX_KW_MULTIPLICATIVE) \
+    X("namespace", 9, 'n', 'e', LEX_KW_NAMESPACE) \
+    X("neg", 3, 'n', 'g', LEX_KW_NEG) \
+    X("next", 4, 'n', 't', LEX_KW_NEXT) \
+    X("not", 3, 'n', 't', LEX_KW_NOT) \
+    X("of", 2, 'o', 'f', LEX_KW_OF) \
+    X("operator", 8, 'o', 'r', LEX_KW_OPERATOR) \
+    X("out", 3, 'o', 't', LEX_KW_OUT) \
+    X("pointer", 7, 'p', 'r', LEX_KW_POINTER) \
+    X("ref", 3, 'r', 'f', LEX_KW_REF) \
+    X("relational", 10, 'r', 'l', LEX_KW_RELATIONAL) \
+    X("return", 6, 'r', 'n', LEX_KW_RETURN) \
+    X("staticptr", 9, 's', 'r', LEX_KW_STATICPTR) \
+    X("struct", 6, 's', 't', LEX_KW_STRUCT) \
+    X("switch", 6, 's', 'h', LEX_KW_SWITCH) \
+    X("to", 2, 't', 'o', LEX_KW_TO) \
+    X("using", 5, 'u', 'g', LEX_KW_USING) \
+    X("vardecl", 7, 'v', 'l', LEX_KW_VARDECL)
 
 /**
- * This struct stores the context of the lexer.
- *
- * The lfCount and crCount used to count lines. The higher one is the current line.
- * Line endings in most platforms are LF, CR, CR LF or  LF CR etc. So this trick is useful in
- * most of the time.
+ * The perfect hash of the keywords, the hash is collision free for the keywords above.
+ * If a new keyword makes it collide the build fails in checkKeywordTable, then pick new
+ * multipliers.
  *
+ * @param length The length of the identifier.
+ * @param first,last The first and last character of the identifier.
+ */
+#define KEYWORD_HASH(length, first, last) \
+    (((length) * 5 + (unsigned char)(first) * 4 + (unsigned char)(last) * 5) & (KEYWORD_TABLE_SIZE - 1))
+
+/// Size of the keyword hash table. Must be a power of two.
+#define KEYWORD_TABLE_SIZE 128
+
+/// Puts a keyword into its slot of the hash table.
+#define KEYWORD_SLOT(text, length, first, last, type) \
+    [KEYWORD_HASH(length, first, last)] = {text, length, type},
+
+/**
+ * The keyword hash table indexed by KEYWORD_HASH. The empty slots have zero length.
+ */
+static const struct KeywordTokenTypePair keywordTable[KEYWORD_TABLE_SIZE] =
+{
+    KEYWORDS(KEYWORD_SLOT)
+};
+
+#undef KEYWORD_SLOT
+
+/// Counts the keywords.
+#define KEYWORD_COUNT_ONE(text, length, first, last, type) + 1
+/// Makes a case label of the hash of a keyword.
+#define KEYWORD_HASH_CASE(text, length, first, last, type) case KEYWORD_HASH(length, first, last):
+/// Makes a case label of the token type of a keyword.
+#define KEYWORD_TYPE_CASE(text, length, first, last, type) case type:
+
+/// The build fails with a negative array size if the keyword count doesn't match
+/// the count of the keyword token types in LEX_TokenType.
+typedef char keywordCountCheck[
+    (0 KEYWORDS(KEYWORD_COUNT_ONE)) == LEX_SPEC_EOF - LEX_KW_ELSE ? 1 : -1];
+
+/**
+ * Build time check of the keyword table, never called.
+ * Duplicate case labels fail the build if two keywords have the same hash
+ * or the same token type.
+ */
+__attribute__((unused))
+static void checkKeywordTable(int hash, enum LEX_TokenType type)
+{
+    switch (hash)
+    {
+        KEYWORDS(KEYWORD_HASH_CASE)
+            break;
+    }
+    switch (type)
+    {
+        KEYWORDS(KEYWORD_TYPE_CASE)
+            break;
+        default:
+            break;
+    }
+}
+
+#undef KEYWORD_COUNT_ONE
+#undef KEYWORD_HASH_CASE
+#undef KEYWORD_TYPE_CASE
+
+/**
+ * Character classes of the lexer.
  *
+ * Every byte of the source belongs to exactly one class. The classes are chosen so
+ * that every state of the lexer behaves the same way on all characters of a class.
  */
-struct LexerContext
+enum CharacterClass
 {
-    const char *current; ///< pointer to the current char.
-    /// The lexer result which is populated during the scanning.
-    struct LEX_LexerResult *result;
-    int tokensAllocated; ///< Allocated tokens. (needed in a dynamic array.)
-    int tokenCount; ///< Count of tokens.  (needed for a dynamic array.)
-    int currentColumn; ///< The current column of the current charater.
-    int lfCount; ///< Count of LF characters.
-    int crCount; ///< Count of CR characters.
-    struct LEX_LexerToken *currentToken; ///< Current token being scanned.
-    int stringsAllocated; ///< Count of allocated binary string
-    int currentStringLength; ///< Length of the current binary string.
-    int currentStringAllocated; ///< Allocated length of the current string.
-    char *currentString; ///< Pointer to the current string.
+    CC_OTHER, ///< Any character not listed below (also bytes above 0x7F).
+    CC_LF, ///< line feed
+    CC_CR, ///< carriage return
+    CC_END, ///< the terminating zero
+    CC_SPACE, ///< space, tab, vertical tab, form feed
+    CC_ZERO, ///< 0
+    CC_OCTAL, ///< 1-7
+    CC_DECIMAL, ///< 8, 9
+    CC_HEXA_LETTER, ///< a-d, A-D, F
+    CC_E, ///< e, E (hexa digit and exponent mark)
+    CC_F, ///< f (hexa digit and built in type letter)
+    CC_TYPE_LETTER, ///< u, i (built in type letters)
+    CC_X, ///< x (hexa prefix)
+    CC_LETTER, ///< the rest of the latin letters
+    CC_UNDERSCORE, ///< _
+    CC_SEMICOLON, ///< ;
+    CC_LEFT_BRACE, ///< {
+    CC_RIGHT_BRACE, ///< }
+    CC_DOLLAR, ///< $
+    CC_QUOTE, ///< "
+    CC_PLUS, ///< +
+    CC_MINUS, ///< @verbatim - @endverbatim
+    CC_COMMA, ///< ,
+    CC_LEFT_PARENTHESIS, ///< (
+    CC_RIGHT_PARENTHESIS, ///< )
+    CC_LEFT_BRACKET, ///< [
+    CC_RIGHT_BRACKET, ///< ]
+    CC_SLASH, ///< /
+    CC_STAR, ///< *
+    CC_PERIOD, ///< .
+    CC_GREATER, ///< >
+    CC_LESS, ///< <
+    CC_EQUALS, ///< =
+    CC_HASH, ///< #
+    CC_EXCLAMATION, ///< !
+    CC_COLON, ///< :
+
+    CC_COUNT ///< Count of the character classes.
 };
 
 /**
- * Returns the current line the scanner is in.
+ * Maps every byte to its character class.
  *
- * @param lexerContext context.
+ * Bytes above 0x7F are zero initialized, which is CC_OTHER.
+ */
+static const unsigned char characterClasses[256] =
+{
+    CC_END, CC_OTHER, CC_OTHER, CC_OTHER, // 0x00
+    CC_OTHER, CC_OTHER, CC_OTHER, CC_OTHER, // 0x04
+    CC_OTHER, CC_SPACE, CC_LF, CC_SPACE, // 0x08
+    CC_SPACE, CC_CR, CC_OTHER, CC_OTHER, // 0x0C
+    CC_OTHER, CC_OTHER, CC_OTHER, CC_OTHER, // 0x10
+    CC_OTHER, CC_OTHER, CC_OTHER, CC_OTHER, // 0x14
+    CC_OTHER, CC_OTHER, CC_OTHER, CC_OTHER, // 0x18
+    CC_OTHER, CC_OTHER, CC_OTHER, CC_OTHER, // 0x1C
+    CC_SPACE, CC_EXCLAMATION, CC_QUOTE, CC_HASH, // 0x20
+    CC_DOLLAR, CC_OTHER, CC_OTHER, CC_OTHER, // 0x24
+    CC_LEFT_PARENTHESIS, CC_RIGHT_PARENTHESIS, CC_STAR, CC_PLUS, // 0x28
+    CC_COMMA, CC_MINUS, CC_PERIOD, CC_SLASH, // 0x2C
+    CC_ZERO, CC_OCTAL, CC_OCTAL, CC_OCTAL, // 0x30
+    CC_OCTAL, CC_OCTAL, CC_OCTAL, CC_OCTAL, // 0x34
+    CC_DECIMAL, CC_DECIMAL, CC_COLON, CC_SEMICOLON, // 0x38
+    CC_LESS, CC_EQUALS, CC_GREATER, CC_OTHER, // 0x3C
+    CC_OTHER, CC_HEXA_LETTER, CC_HEXA_LETTER, CC_HEXA_LETTER, // 0x40
+    CC_HEXA_LETTER, CC_E, CC_HEXA_LETTER, CC_LETTER, // 0x44
+    CC_LETTER, CC_LETTER, CC_LETTER, CC_LETTER, // 0x48
+    CC_LETTER, CC_LETTER, CC_LETTER, CC_LETTER, // 0x4C
+    CC_LETTER, CC_LETTER, CC_LETTER, CC_LETTER, // 0x50
+    CC_LETTER, CC_LETTER, CC_LETTER, CC_LETTER, // 0x54
+    CC_LETTER, CC_LETTER, CC_LETTER, CC_LEFT_BRACKET, // 0x58
+    CC_OTHER, CC_RIGHT_BRACKET, CC_OTHER, CC_UNDERSCORE, // 0x5C
+    CC_OTHER, CC_HEXA_LETTER, CC_HEXA_LETTER, CC_HEXA_LETTER, // 0x60
+    CC_HEXA_LETTER, CC_E, CC_F, CC_LETTER, // 0x64
+    CC_LETTER, CC_TYPE_LETTER, CC_LETTER, CC_LETTER, // 0x68
+    CC_LETTER, CC_LETTER, CC_LETTER, CC_LETTER, // 0x6C
+    CC_LETTER, CC_LETTER, CC_LETTER, CC_LETTER, // 0x70
+    CC_LETTER, CC_TYPE_LETTER, CC_LETTER, CC_LETTER, // 0x74
+    CC_X, CC_LETTER, CC_LETTER, CC_LEFT_BRACE, // 0x78
+    CC_OTHER, CC_RIGHT_BRACE, CC_OTHER, CC_OTHER, // 0x7C
+};
+
+/**
+ * States of the lexer automaton.
  *
- * @return current line.
+ * LS_NONE means there is no transition: the current token ends before the current character.
+ * The token is accepted if the state it ended in has a token type in acceptedTokenTypes,
+ * otherwise the error in stateErrors is raised.
  */
-static int getCurrentLine(struct LexerContext *lexerContext)
+enum LexerState
 {
-    return
-        (lexerContext->lfCount > lexerContext->crCount ?
-            lexerContext->lfCount :
-            lexerContext->crCount);
-}
+    LS_NONE, ///< No transition.
+    LS_START, ///< At the first character of a token.
+    LS_WHITESPACE, ///< Between tokens.
+    LS_IDENTIFIER, ///< identifier or keyword
+    LS_ZERO, ///< 0
+    LS_OCTAL, ///< 0 followed by octal digits
+    LS_HEXA_PREFIX, ///< 0x
+    LS_HEXA, ///< 0x followed by hexa digits
+    LS_DECIMAL, ///< decimal digits
+    LS_FRACTION_PERIOD, ///< decimal digits followed by a period
+    LS_FRACTION, ///< fraction part of a float number
+    LS_EXPONENT_MARK, ///< e or E after a number
+    LS_EXPONENT_SIGN, ///< sign of the exponent
+    LS_EXPONENT, ///< exponent digits
+    LS_DOLLAR, ///< $
+    LS_BUILT_IN_TYPE, ///< eg. $u32
+    LS_BUILT_IN_TYPE_ATTRIBUTE, ///< eg. $u32_attr
+    LS_STRING_BODY, ///< " followed by anything but "
+    LS_STRING, ///< closed string
+    LS_SEMICOLON, ///< ;
+    LS_LEFT_BRACE, ///< {
+    LS_RIGHT_BRACE, ///< }
+    LS_ADD, ///< +
+    LS_MINUS, ///< @verbatim - @endverbatim (can continue in a negative number)
+    LS_COMMA, ///< ,
+    LS_LEFT_PARENTHESIS, ///< (
+    LS_RIGHT_PARENTHESIS, ///< )
+    LS_LEFT_BRACKET, ///< [
+    LS_RIGHT_BRACKET, ///< ]
+    LS_MULTIPLY, ///< *
+    LS_PERIOD, ///< .
+    LS_SLASH, ///< /
+    LS_BLOCK_COMMENT_OPEN, ///< /*
+    LS_BLOCK_COMMENT_BODY, ///< inside a block comment
+    LS_BLOCK_COMMENT_STAR, ///< * inside a block comment
+    LS_BLOCK_COMMENT, ///< closed block comment
+    LS_DOCUMENTATION_BLOCK_COMMENT_BODY, ///< inside a documentation block comment
+    LS_DOCUMENTATION_BLOCK_COMMENT_STAR, ///< * inside a documentation block comment
+    LS_DOCUMENTATION_BLOCK_COMMENT, ///< closed documentation block comment
+    LS_EOL_COMMENT_OPEN, ///< //
+    LS_EOL_COMMENT, ///< inside an EOL comment
+    LS_DOCUMENTATION_EOL_COMMENT_OPEN, ///< ///
+    LS_DOCUMENTATION_EOL_COMMENT, ///< inside a documentation EOL comment
+    LS_DOCUMENTATION_EOL_BACK_COMMENT, ///< inside a documentation EOL back comment
+    LS_GREATER, ///< >
+    LS_GREATER_EQUAL, ///< >=
+    LS_SHIFT_RIGHT, ///< >>
+    LS_LESS, ///< <
+    LS_LESS_EQUAL, ///< <=
+    LS_SHIFT_LEFT, ///< <<
+    LS_EQUALS, ///< =
+    LS_EQUAL, ///< ==
+    LS_EXCLAMATION, ///< !
+    LS_NOT_EQUAL, ///< !=
+    LS_COLON, ///< :
+    LS_ASSIGN, ///< :=
+    LS_SCOPE_SEPARATOR, ///< ::
+    LS_CHARACTER, ///< eg. #32
+
+    LS_COUNT ///< Count of the states.
+};
+
+/// Transitions on the decimal digits.
+#define DECIMAL_TRANSITIONS(state) \
+    [CC_ZERO] = state, [CC_OCTAL] = state, [CC_DECIMAL] = state
+
+/// Transitions on the hexadecimal digits.
+#define HEXA_TRANSITIONS(state) \
+    DECIMAL_TRANSITIONS(state), \
+    [CC_HEXA_LETTER] = state, [CC_E] = state, [CC_F] = state
+
+/// Transitions on the letters and the underscore. (Notation: LETTER)
+#define LETTER_TRANSITIONS(state) \
+    [CC_HEXA_LETTER] = state, [CC_E] = state, [CC_F] = state, [CC_TYPE_LETTER] = state, \
+    [CC_X] = state, [CC_LETTER] = state, [CC_UNDERSCORE] = state
+
+/// Transitions on every character class except the terminating zero.
+#define NON_END_TRANSITIONS(state) \
+    [CC_OTHER] = state, [CC_LF] = state, [CC_CR] = state, [CC_SPACE] = state, \
+    LETTER_TRANSITIONS(state), DECIMAL_TRANSITIONS(state), \
+    [CC_SEMICOLON] = state, [CC_LEFT_BRACE] = state, [CC_RIGHT_BRACE] = state, \
+    [CC_DOLLAR] = state, [CC_QUOTE] = state, [CC_PLUS] = state, [CC_MINUS] = state, \
+    [CC_COMMA] = state, [CC_LEFT_PARENTHESIS] = state, [CC_RIGHT_PARENTHESIS] = state, \
+    [CC_LEFT_BRACKET] = state, [CC_RIGHT_BRACKET] = state, [CC_SLASH] = state, \
+    [CC_STAR] = state, [CC_PERIOD] = state, [CC_GREATER] = state, [CC_LESS] = state, \
+    [CC_EQUALS] = state, [CC_HASH] = state, [CC_EXCLAMATION] = state, [CC_COLON] = state
+
+/// Transitions of the number states after the leading zero and the octal digits.
+#define OCTAL_TRANSITIONS \
+    [CC_ZERO] = LS_OCTAL, [CC_OCTAL] = LS_OCTAL, [CC_DECIMAL] = LS_DECIMAL, \
+    [CC_PERIOD] = LS_FRACTION_PERIOD, [CC_E] = LS_EXPONENT_MARK
 
 /**
- * Starts a new token.
+ * The state transition table, indexed by the current state and the class of the current character.
  *
- * @param lexerContext context.
- * @param type The type of the new token.
+ * Later initializers override the earlier ones, that's how the "anything else" transitions
+ * of the comment and string states are written.
  */
-static void startNewToken(struct LexerContext *lexerContext, enum LEX_TokenType type)
+static const unsigned char transitions[LS_COUNT][CC_COUNT] =
 {
-    assert(!lexerContext->currentToken);
-    if (lexerContext->tokenCount == lexerContext->tokensAllocated)
+    [LS_WHITESPACE] = { [CC_SPACE] = LS_WHITESPACE, [CC_LF] = LS_WHITESPACE, [CC_CR] = LS_WHITESPACE },
+    [LS_START] =
     {
-        if (lexerContext->tokensAllocated)
-        {
-            lexerContext->tokensAllocated *= 2;
-        }
-        else
-        {
-            lexerContext->tokensAllocated = 10;
-        }
-        lexerContext->result->tokens =
-            realloc(
-                lexerContext->result->tokens,
-                lexerContext->tokensAllocated * sizeof(struct LEX_LexerToken));
-    }
+        LETTER_TRANSITIONS(LS_IDENTIFIER),
+        [CC_ZERO] = LS_ZERO, [CC_OCTAL] = LS_DECIMAL, [CC_DECIMAL] = LS_DECIMAL,
+        [CC_SEMICOLON] = LS_SEMICOLON,
+        [CC_LEFT_BRACE] = LS_LEFT_BRACE,
+        [CC_RIGHT_BRACE] = LS_RIGHT_BRACE,
+        [CC_DOLLAR] = LS_DOLLAR,
+        [CC_QUOTE] = LS_STRING_BODY,
+        [CC_PLUS] = LS_ADD,
+        [CC_MINUS] = LS_MINUS,
+        [CC_COMMA] = LS_COMMA,
+        [CC_LEFT_PARENTHESIS] = LS_LEFT_PARENTHESIS,
+        [CC_RIGHT_PARENTHESIS] = LS_RIGHT_PARENTHESIS,
+        [CC_LEFT_BRACKET] = LS_LEFT_BRACKET,
+        [CC_RIGHT_BRACKET] = LS_RIGHT_BRACKET,
+        [CC_SLASH] = LS_SLASH,
+        [CC_STAR] = LS_MULTIPLY,
+        [CC_PERIOD] = LS_PERIOD,
+        [CC_GREATER] = LS_GREATER,
+        [CC_LESS] = LS_LESS,
+        [CC_EQUALS] = LS_EQUALS,
+        [CC_HASH] = LS_CHARACTER,
+        [CC_EXCLAMATION] = LS_EXCLAMATION,
+        [CC_COLON] = LS_COLON,
+    },
+    // identifier ::= LETTER ALNUM*
+    [LS_IDENTIFIER] = { LETTER_TRANSITIONS(LS_IDENTIFIER), DECIMAL_TRANSITIONS(LS_IDENTIFIER) },
+    // octal_integer ::= '0' OCTAL*
+    // hexa_integer ::= '0' 'x' HEXA+
+    // decimal_integer ::= DECIMAL+
+    // float_number ::= DECIMAL+ ('.' DECIMAL+)? ( ('e' | 'E') ('+' | '-')? DECIMAL+)?
+    // An octal number continues as a decimal one if a 8, 9, period or exponent follows.
+    [LS_ZERO] = { OCTAL_TRANSITIONS, [CC_X] = LS_HEXA_PREFIX },
+    [LS_OCTAL] = { OCTAL_TRANSITIONS },
+    [LS_HEXA_PREFIX] = { HEXA_TRANSITIONS(LS_HEXA) },
+    [LS_HEXA] = { HEXA_TRANSITIONS(LS_HEXA) },
+    [LS_DECIMAL] =
+    {
+        DECIMAL_TRANSITIONS(LS_DECIMAL),
+        [CC_PERIOD] = LS_FRACTION_PERIOD, [CC_E] = LS_EXPONENT_MARK
+    },
+    [LS_FRACTION_PERIOD] = { DECIMAL_TRANSITIONS(LS_FRACTION) },
+    [LS_FRACTION] = { DECIMAL_TRANSITIONS(LS_FRACTION), [CC_E] = LS_EXPONENT_MARK },
+    [LS_EXPONENT_MARK] =
+    {
+        DECIMAL_TRANSITIONS(LS_EXPONENT),
+        [CC_PLUS] = LS_EXPONENT_SIGN, [CC_MINUS] = LS_EXPONENT_SIGN
+    },
+    [LS_EXPONENT_SIGN] = { DECIMAL_TRANSITIONS(LS_EXPONENT) },
+    [LS_EXPONENT] = { DECIMAL_TRANSITIONS(LS_EXPONENT) },
+    // built_in_type ::= '$' ('u' | 'i' | 'f') DECIMAL* ( '_' LETTER* )?
+    [LS_DOLLAR] = { [CC_TYPE_LETTER] = LS_BUILT_IN_TYPE, [CC_F] = LS_BUILT_IN_TYPE },
+    [LS_BUILT_IN_TYPE] =
+    {
+        DECIMAL_TRANSITIONS(LS_BUILT_IN_TYPE),
+        [CC_UNDERSCORE] = LS_BUILT_IN_TYPE_ATTRIBUTE
+    },
+    [LS_BUILT_IN_TYPE_ATTRIBUTE] = { LETTER_TRANSITIONS(LS_BUILT_IN_TYPE_ATTRIBUTE) },
+    // string ::= '"' non-"* '"'
+    [LS_STRING_BODY] = { NON_END_TRANSITIONS(LS_STRING_BODY), [CC_QUOTE] = LS_STRING },
+    // If a decimal digit follows directly the -, it's a negative number.
+    [LS_MINUS] = { [CC_ZERO] = LS_ZERO, [CC_OCTAL] = LS_DECIMAL, [CC_DECIMAL] = LS_DECIMAL },
+    // '/*' starts a block comment, '/**' starts a documentation block comment.
+    // '//' starts an EOL comment, '///' a documentation EOL comment,
+    // '//<' or '///<' a documentation EOL back comment.
+    [LS_SLASH] = { [CC_STAR] = LS_BLOCK_COMMENT_OPEN, [CC_SLASH] = LS_EOL_COMMENT_OPEN },
+    [LS_BLOCK_COMMENT_OPEN] =
+    {
+        NON_END_TRANSITIONS(LS_BLOCK_COMMENT_BODY),
+        [CC_STAR] = LS_DOCUMENTATION_BLOCK_COMMENT_BODY
+    },
+    [LS_BLOCK_COMMENT_BODY] =
+    {
+        NON_END_TRANSITIONS(LS_BLOCK_COMMENT_BODY),
+        [CC_STAR] = LS_BLOCK_COMMENT_STAR
+    },
+    [LS_BLOCK_COMMENT_STAR] =
+    {
+        NON_END_TRANSITIONS(LS_BLOCK_COMMENT_BODY),
+        [CC_STAR] = LS_BLOCK_COMMENT_STAR, [CC_SLASH] = LS_BLOCK_COMMENT
+    },
+    [LS_DOCUMENTATION_BLOCK_COMMENT_BODY] =
+    {
+        NON_END_TRANSITIONS(LS_DOCUMENTATION_BLOCK_COMMENT_BODY),
+        [CC_STAR] = LS_DOCUMENTATION_BLOCK_COMMENT_STAR
+    },
+    [LS_DOCUMENTATION_BLOCK_COMMENT_STAR] =
+    {
+        NON_END_TRANSITIONS(LS_DOCUMENTATION_BLOCK_COMMENT_BODY),
+        [CC_STAR] = LS_DOCUMENTATION_BLOCK_COMMENT_STAR,
+        [CC_SLASH] = LS_DOCUMENTATION_BLOCK_COMMENT
+    },
+    [LS_EOL_COMMENT_OPEN] =
+    {
+        NON_END_TRANSITIONS(LS_EOL_COMMENT),
+        [CC_LF] = LS_NONE, [CC_CR] = LS_NONE,
+        [CC_SLASH] = LS_DOCUMENTATION_EOL_COMMENT_OPEN,
+        [CC_LESS] = LS_DOCUMENTATION_EOL_BACK_COMMENT
+    },
+    [LS_EOL_COMMENT] =
+    {
+        NON_END_TRANSITIONS(LS_EOL_COMMENT),
+        [CC_LF] = LS_NONE, [CC_CR] = LS_NONE
+    },
+    [LS_DOCUMENTATION_EOL_COMMENT_OPEN] =
+    {
+        NON_END_TRANSITIONS(LS_DOCUMENTATION_EOL_COMMENT),
+        [CC_LF] = LS_NONE, [CC_CR] = LS_NONE,
+        [CC_LESS] = LS_DOCUMENTATION_EOL_BACK_COMMENT
+    },
+    [LS_DOCUMENTATION_EOL_COMMENT] =
+    {
+        NON_END_TRANSITIONS(LS_DOCUMENTATION_EOL_COMMENT),
+        [CC_LF] = LS_NONE, [CC_CR] = LS_NONE
+    },
+    [LS_DOCUMENTATION_EOL_BACK_COMMENT] =
+    {
+        NON_END_TRANSITIONS(LS_DOCUMENTATION_EOL_BACK_COMMENT),
+        [CC_LF] = LS_NONE, [CC_CR] = LS_NONE
+    },
+    [LS_GREATER] = { [CC_EQUALS] = LS_GREATER_EQUAL, [CC_GREATER] = LS_SHIFT_RIGHT },
+    [LS_LESS] = { [CC_EQUALS] = LS_LESS_EQUAL, [CC_LESS] = LS_SHIFT_LEFT },
+    [LS_EQUALS] = { [CC_EQUALS] = LS_EQUAL },
+    [LS_EXCLAMATION] = { [CC_EQUALS] = LS_NOT_EQUAL },
+    [LS_COLON] = { [CC_EQUALS] = LS_ASSIGN, [CC_COLON] = LS_SCOPE_SEPARATOR },
+    // #32 is for space for example
+    [LS_CHARACTER] = { DECIMAL_TRANSITIONS(LS_CHARACTER) },
+};
 
-    lexerContext->currentToken =
-        &lexerContext->result->tokens[lexerContext->tokenCount++];
-    lexerContext->currentToken->beginLine = getCurrentLine(lexerContext);
-    lexerContext->currentToken->beginColumn = lexerContext->currentColumn;
-    lexerContext->currentToken->tokenType = type;
-    lexerContext->currentToken->start = lexerContext->current;
-    lexerContext->currentToken->length = 0;
-}
+#undef OCTAL_TRANSITIONS
+#undef NON_END_TRANSITIONS
+#undef LETTER_TRANSITIONS
+#undef HEXA_TRANSITIONS
+#undef DECIMAL_TRANSITIONS
 
 /**
- * Finishes the current token.
- *
- * @param lexerContext context
+ * The token types of the accepting states. LEX_UNKNOWN for the non-accepting states.
  */
-static void finishCurrentToken(struct LexerContext *lexerContext)
+static const unsigned char acceptedTokenTypes[LS_COUNT] =
 {
-    assert(lexerContext->currentToken);
+    [LS_IDENTIFIER] = LEX_IDENTIFIER,
+    [LS_ZERO] = LEX_OCTAL_INTEGER,
+    [LS_OCTAL] = LEX_OCTAL_INTEGER,
+    [LS_HEXA] = LEX_HEXA_INTEGER,
+    [LS_DECIMAL] = LEX_DECIMAL_INTEGER,
+    [LS_FRACTION] = LEX_FLOAT_NUMBER,
+    [LS_EXPONENT] = LEX_FLOAT_NUMBER,
+    [LS_BUILT_IN_TYPE] = LEX_BUILT_IN_TYPE,
+    [LS_BUILT_IN_TYPE_ATTRIBUTE] = LEX_BUILT_IN_TYPE,
+    [LS_STRING] = LEX_STRING,
+    [LS_SEMICOLON] = LEX_SEMICOLON,
+    [LS_LEFT_BRACE] = LEX_LEFT_BRACE,
+    [LS_RIGHT_BRACE] = LEX_RIGHT_BRACE,
+    [LS_ADD] = LEX_ADD_OPERATOR,
+    [LS_MINUS] = LEX_SUBTRACT_OPERATOR,
+    [LS_COMMA] = LEX_COMMA,
+    [LS_LEFT_PARENTHESIS] = LEX_LEFT_PARENTHESIS,
+    [LS_RIGHT_PARENTHESIS] = LEX_RIGHT_PARENTHESIS,
+    [LS_LEFT_BRACKET] = LEX_LEFT_BRACKET,
+    [LS_RIGHT_BRACKET] = LEX_RIGHT_BRACKET,
+    [LS_MULTIPLY] = LEX_MULTIPLY_OPERATOR,
+    [LS_PERIOD] = LEX_PERIOD,
+    [LS_SLASH] = LEX_DIVISION_OPERATOR,
+    [LS_BLOCK_COMMENT] = LEX_BLOCK_COMMENT,
+    [LS_DOCUMENTATION_BLOCK_COMMENT] = LEX_DOCUMENTATION_BLOCK_COMMENT,
+    [LS_EOL_COMMENT_OPEN] = LEX_EOL_COMMENT,
+    [LS_EOL_COMMENT] = LEX_EOL_COMMENT,
+    [LS_DOCUMENTATION_EOL_COMMENT_OPEN] = LEX_DOCUMENTATION_EOL_COMMENT,
+    [LS_DOCUMENTATION_EOL_COMMENT] = LEX_DOCUMENTATION_EOL_COMMENT,
+    [LS_DOCUMENTATION_EOL_BACK_COMMENT] = LEX_DOCUMENTATION_EOL_BACK_COMMENT,
+    [LS_GREATER] = LEX_GREATER_THAN,
+    [LS_GREATER_EQUAL] = LEX_GREATER_EQUAL_THAN,
+    [LS_SHIFT_RIGHT] = LEX_SHIFT_RIGHT,
+    [LS_LESS] = LEX_LESS_THAN,
+    [LS_LESS_EQUAL] = LEX_LESS_EQUAL_THAN,
+    [LS_SHIFT_LEFT] = LEX_SHIFT_LEFT,
+    [LS_EQUAL] = LEX_EQUAL,
+    [LS_NOT_EQUAL] = LEX_NOT_EQUAL,
+    [LS_COLON] = LEX_COLON,
+    [LS_ASSIGN] = LEX_ASSIGN_OPERATOR,
+    [LS_SCOPE_SEPARATOR] = LEX_SCOPE_SEPARATOR,
+    [LS_CHARACTER] = LEX_CHARACTER,
+};
 
-    lexerContext->currentToken->endLine = getCurrentLine(lexerContext);
-    lexerContext->currentToken->endColumn = lexerContext->currentColumn;
-    lexerContext->currentToken = 0;
-}
+/**
+ * The errors raised when a token ends in a non-accepting state.
+ */
+static const unsigned char stateErrors[LS_COUNT] =
+{
+    [LS_HEXA_PREFIX] = E_LEX_INVALID_HEXA_LITERAL,
+    [LS_FRACTION_PERIOD] = E_LEX_INVALID_DECIMAL_NUMBER,
+    [LS_EXPONENT_MARK] = E_LEX_INVALID_DECIMAL_NUMBER,
+    [LS_EXPONENT_SIGN] = E_LEX_INVALID_DECIMAL_NUMBER,
+    [LS_DOLLAR] = E_LEX_INVALID_BUILT_IN_TYPE_LETTER,
+    [LS_STRING_BODY] = E_LEX_QUOTE_EXPECTED,
+    [LS_BLOCK_COMMENT_OPEN] = E_LEX_UNTERMINATED_COMMENT,
+    [LS_BLOCK_COMMENT_BODY] = E_LEX_UNTERMINATED_COMMENT,
+    [LS_BLOCK_COMMENT_STAR] = E_LEX_UNTERMINATED_COMMENT,
+    [LS_DOCUMENTATION_BLOCK_COMMENT_BODY] = E_LEX_UNTERMINATED_COMMENT,
+    [LS_DOCUMENTATION_BLOCK_COMMENT_STAR] = E_LEX_UNTERMINATED_COMMENT,
+    [LS_EQUALS] = E_LEX_INVALID_OPERATOR,
+    [LS_EXCLAMATION] = E_LEX_INVALID_OPERATOR,
+};
 
 /**
- * Sets the type of the current token.
- *
- * @param lexerContext context.
- * @param newType The new type of the token.
+ * Kinds of character runs that keep the automaton in the same state for a long time.
+ * These are skipped in bulk by the skip run kernels.
  */
-static void setCurrentTokenType(
-    struct LexerContext *lexerContext,
-    enum LEX_TokenType newType)
+enum RunKind
 {
-    assert(lexerContext->currentToken);
-    lexerContext->currentToken->tokenType = newType;
-}
+    RUN_NONE, ///< The state has no long runs, the automaton steps character by character.
+    RUN_WHITESPACE, ///< space, tab, vertical tab, form feed, LF, CR
+    RUN_IDENTIFIER, ///< letters, digits and the underscore
+    RUN_BLOCK_COMMENT, ///< anything but * and the terminating zero
+    RUN_EOL_COMMENT, ///< anything but LF, CR and the terminating zero
+    RUN_STRING, ///< anything but " and the terminating zero
+};
 
 /**
- * Notation: LETTER
- *
- * @param c character to check.
- *
- * @return Nonzero if the character is a latin letter or underscore, zero otherwise.
+ * The run kind of the self transitions of the states.
  */
-static int isLetter(char c)
+static const unsigned char runKinds[LS_COUNT] =
 {
-    return
-        (('a' <= c) && (c <= 'z')) ||
-        (('A' <= c) && (c <= 'Z')) ||
-        (c == '_');
-}
+    [LS_WHITESPACE] = RUN_WHITESPACE,
+    [LS_IDENTIFIER] = RUN_IDENTIFIER,
+    [LS_STRING_BODY] = RUN_STRING,
+    [LS_BLOCK_COMMENT_BODY] = RUN_BLOCK_COMMENT,
+    [LS_DOCUMENTATION_BLOCK_COMMENT_BODY] = RUN_BLOCK_COMMENT,
+    [LS_EOL_COMMENT] = RUN_EOL_COMMENT,
+    [LS_DOCUMENTATION_EOL_COMMENT] = RUN_EOL_COMMENT,
+    [LS_DOCUMENTATION_EOL_BACK_COMMENT] = RUN_EOL_COMMENT,
+};
 
 /**
- * Notation: OCTAL
+ * Skips the run of characters of the given kind.
  *
- * @param c character to check
+ * @param current The first character of the run.
+ * @param kind The kind of the run.
  *
- * @return Nonzero if the character is an octal digit, zero otherwise.
+ * @return Pointer to the first character that is not part of the run.
  */
-static int isOctal(char c)
-{
-    return
-        (('0' <= c) && (c <= '7'));
-}
+typedef const char *(*SkipRunFunction)(const char *current, enum RunKind kind);
 
 /**
- * Notation: DECIMAL
+ * Finds the first byte which is not part of a well-formed UTF-8 sequence. Overlong
+ * forms, surrogates and codes above 0x10FFFF are ill-formed.
  *
- * @param c character to check
+ * @param current The first byte to check.
+ * @param end The end of the bytes to check. A sequence cut by it is ill-formed.
  *
- * @return Nonzero if the character is an decimal digit, zero otherwise.
+ * @return The first byte of the first ill-formed sequence, or end if there is none.
  */
-static int isDecimal(char c)
-{
-    return
-        (('0' <= c) && (c <= '9'));
-}
+typedef const char *(*FindInvalidUtf8Function)(const char *current, const char *end);
 
 /**
- * Notation: HEXA
- *
- * @param c character to check
+ * This struct stores the context of the lexer.
  *
- * @return Nonzero if the character is a hexadecimal digit, zero otherwise.
- *      lower and uppercase letters 10+ values allowed.
+ * Lines are not counted during the scanning. The line starts are collected by
+ * addLineStarts in a separate pass over each part of the source as it arrives.
  */
-static int isHexa(char c)
+struct LexerContext
 {
-    return
-        (('0' <= c) && (c <= '9')) ||
-        (('A' <= c) && (c <= 'F')) ||
-        (('a' <= c) && (c <= 'f'));
-}
+    const char *current; ///< pointer to the current char.
+    const char *windowStart; ///< The first character of the source in memory.
+    /// The end of the source received so far. A zero before it is an invalid character.
+    /// Null if the source ends with the first zero.
+    const char *windowEnd;
+    unsigned windowOffset; ///< Offset of windowStart in the source.
+    int isInputFinished; ///< Nonzero if the whole source is in memory.
+    /// The lexer result which is populated during the scanning. (Binary strings, lines.)
+    struct LEX_LexerResult *result;
+    /// The token scanned after a series of strings. It's the next token to return.
+    struct LEX_LexerToken pendingToken;
+    int hasPendingToken; ///< Nonzero if pendingToken is valid.
+    /// The series of strings being merged when the input ran out.
+    struct LEX_LexerToken seriesToken;
+    int isInSeries; ///< Nonzero if seriesToken is valid.
+    /// The state of the automaton when the input ran out in the middle of a token.
+    /// LS_NONE if there is no such token.
+    enum LexerState partialState;
+    unsigned partialOffset; ///< The offset of the token interrupted by the end of the input.
+    int isFinished; ///< Nonzero after reaching the end of the source or an error.
+    enum ERR_ErrorCode error; ///< The error which stopped the scanning.
+    /// Nonzero if the errors are only recorded, not raised. (Workers of the parallel lexer.)
+    int isQuiet;
+    int stringsAllocated; ///< Count of allocated binary string
+    /// The series of strings being merged is decoded here. It's reused by every series,
+    /// the finished string is copied into the text arena.
+    char *currentString;
+    int currentStringLength; ///< Length of the current binary string.
+    int currentStringAllocated; ///< Allocated length of the current string.
+    /// Open addressing hash table of the distinct binary strings. The slots store the
+    /// index of the first string with the given bytes plus one. Zero marks an empty slot.
+    unsigned *stringSlots;
+    int stringSlotCount; ///< Size of the string hash table. Power of two.
+    int distinctStringCount; ///< Count of the used slots of the string hash table.
+    SkipRunFunction skipRun; ///< The skip run kernel chosen for this CPU.
+    FindInvalidUtf8Function findInvalidUtf8; ///< The UTF-8 validation kernel chosen for this CPU.
+    /// The UTF-8 sequence cut by the end of the input received so far. It's checked when
+    /// the rest arrives.
+    char utf8Carry[4];
+    int utf8CarryLength; ///< Length of the cut sequence. Zero if there is none.
+    int linesAllocated; ///< Allocated size of the line table.
+    /// The line break at the end of the input received so far, it can be the first
+    /// half of a CR LF or LF CR pair. Zero if there is no such line break.
+    char lastLineBreak;
+    int textsAllocated; ///< Allocated size of the saved text array.
+    /// Open addressing hash table of the symbol ids. Zero marks an empty slot.
+    unsigned *symbolSlots;
+    int symbolSlotCount; ///< Size of the symbol hash table. Power of two.
+    int symbolsAllocated; ///< Allocated size of the symbol array.
+    int numbersAllocated; ///< Allocated size of the number array.
+    int docCommentsAllocated; ///< Allocated size of the documentation comment array.
+    unsigned tokenIndex; ///< The index of the next token to return.
+    /// Nonzero if the source is edited by LEX_relex. Then the names and the number texts
+    /// are copied into the text arena instead of pointing into the source.
+    int isSourceEdited;
+};
 
 /**
- * Notation: SPACE
- *
- * @param c character to check
- *
- * @return Nonzero if the character is a white space character:
- *      - space
- *      - tab
- *      - line feed
- *      - vertical tab
- *      - form feed
- *      - carriage return.
+ * Status of scanning a raw token.
  */
-static int isWhitespace(char c)
+enum ScanStatus
 {
-    return
-        (c == ' ') ||
-        (c == '\n') ||
-        (c == '\r') ||
-        (c == '\t') ||
-        (c == '\v') ||
-        (c == '\f');
-}
+    SCAN_END, ///< The end of the source is reached or an error occured.
+    SCAN_TOKEN, ///< A token is scanned.
+    SCAN_NEED_INPUT, ///< The token may continue in the input not received yet.
+};
+
+/// Size of the token ring of the lexer. Must be a power of two.
+#define TOKEN_RING_SIZE 16
 
 /**
- * Notation: ALNUM = LETTER | DECIMAL
+ * The streaming lexer.
  *
- * @param c character to check.
- *
- * @return Nonzero if the character is a letter or a decimal digit, zero otherwise.
+ * The tokens are scanned on demand into a ring buffer. The slots between ringStart and
+ * ringStart + ringCount hold the tokens scanned ahead by LEX_peekToken.
  */
-static int isAlphaNumeric(char c)
+struct LEX_Lexer
 {
-    return isLetter(c) || isDecimal(c);
-}
+    struct LexerContext context; ///< The scanning context.
+    /// The binary strings and the line table. It has no token array.
+    struct LEX_LexerResult result;
+    struct LEX_LexerToken ring[TOKEN_RING_SIZE]; ///< The token ring.
+    int ringStart; ///< The slot of the next token to return.
+    int ringCount; ///< The count of tokens scanned ahead.
+    /// The unscanned input of a lexer fed in chunks followed by a terminating zero.
+    char *window;
+    int windowAllocated; ///< Allocated size of the window.
+    LEX_InputCallback inputCallback; ///< Called when more input is needed.
+    void *inputUserData; ///< Passed to the input callback.
+    /// Nonzero if the tokens are taken from a borrowed result instead of being scanned.
+    int isReplaying;
+    int replayIndex; ///< The index of the next token of the replayed result.
+    /// Nonzero if the error found when the lexer was created is not raised yet. It's
+    /// raised when the first token is asked for, the caller sets the error context of
+    /// the scanning only after it created the lexer.
+    int hasDeferredError;
+    unsigned deferredErrorOffset; ///< The offset of the deferred error.
+};
 
 /**
- * Moves the cursor forward with one character. Sets crCount, lfCount and currentColumn.
- *
- * @param context context.
+ * The gap of an array of an edited lexer result. An edit replaces the items at the gap,
+ * so the edits near each other move only the items between them. The offsets of the
+ * items after the gap don't have the length changes of the edits before them, those are
+ * added when the items move before the gap.
  */
-static void advance(struct LexerContext *context)
+struct RelexGap
 {
-    char c = *context->current;
-    context->currentColumn++;
+    int start; ///< The count of the items before the gap.
+    int length; ///< The count of the unused items in the gap.
+    int delta; ///< The length change not added to the offsets after the gap yet.
+    /// The token count change not added to the token indexes after the gap yet. Only the
+    /// documentation comments have token indexes.
+    int indexDelta;
+};
 
-    if (c == '\r')
-    {
-        context->crCount++;
-        context->currentColumn = 1;
-    }
-    if (c == '\n')
-    {
-        context->lfCount++;
-        context->currentColumn = 1;
-    }
-    context->current++;
-}
+/**
+ * The state kept by LEX_relex between the edits of a lexer result. The result owns a
+ * copy of the source from the first edit on, and the edits are applied to that copy.
+ */
+struct LEX_RelexState
+{
+    /// The context of the edits. It keeps the hash tables and the allocated sizes of the
+    /// side tables. Its result is set on each edit.
+    struct LexerContext context;
+    /// The edited source. It has a gap after the last edit, the text after the gap is
+    /// moved before it as far as the lexing of the edit goes. The gap starts with a zero.
+    char *source;
+    unsigned sourceLength; ///< Length of the source without the gap.
+    unsigned gapStart; ///< The offset of the gap of the source.
+    unsigned gapLength; ///< Length of the gap of the source. It's at least 1.
+    struct RelexGap tokenGap; ///< The gap of the token array.
+    struct RelexGap lineGap; ///< The gap of the line starts.
+    struct RelexGap docCommentGap; ///< The gap of the documentation comments.
+    int *addedLines; ///< The line starts found by the last edit.
+    int addedLinesAllocated; ///< Allocated size of addedLines.
+    struct LEX_DocComment *addedDocComments; ///< The documentation comments found by the last edit.
+    int addedDocCommentsAllocated; ///< Allocated size of addedDocComments.
+    /// The count of the strings and numbers above which the unused ones are dropped.
+    int compactionLimit;
+    enum ERR_ErrorCode error; ///< The error which stopped the lexing of the source.
+};
 
 /**
- * Accepts current character and advances to the next character.
- *
- * @param context context
+ * The length of the source moved before the gap of an edited source first when the
+ * lexing reaches the gap. It's doubled on each move of the same edit.
+ */
+#define RELEX_CHUNK_SIZE 4096
+
+/**
+ * The count of strings and numbers added by the edits of a lexer result before the
+ * unused ones are dropped.
+ */
+#define RELEX_COMPACTION_MINIMUM 4096
+
+/**
+ * Size of the text arena blocks.
  */
-static void acceptCurrent(struct LexerContext *context)
+#define TEXT_BLOCK_SIZE 65536
+
+/**
+ * A block of the text arena. The saved texts never move, so pointers to them are
+ * valid until the lexer result is cleaned up.
+ */
+struct LEX_TextBlock
 {
-    assert(context->currentToken);
-    context->currentToken->length++;
-    advance(context);
-}
+    struct LEX_TextBlock *next; ///< The previously allocated block.
+    int used; ///< The count of the used bytes.
+    int size; ///< The size of the block.
+    char text[]; ///< The texts.
+};
+
 /**
- * Ignores current character and moves the cursor to the next.
+ * The scalar fallback: leaves the run to the caller.
  *
- * @param context context
+ * @param current The first character of the run.
+ * @param kind The kind of the run.
+ *
+ * @return current.
  */
-static void ignoreCurrent(struct LexerContext *context)
+static const char *skipRunScalar(const char *current, enum RunKind kind)
 {
-    advance(context);
+    (void)kind;
+    return current;
 }
 
+#ifdef LEX_SIMD_KERNELS
+
 /**
- * @param context context.
+ * Classifies the bytes of a 16 byte block.
+ *
+ * @param bytes The block.
+ * @param kind The kind of the run.
  *
- * @return The current character.
+ * @return Mask of the bytes which are part of the run.
  */
-static char getCurrentCharacter(struct LexerContext *context)
+__attribute__((target("sse2"), always_inline))
+static inline unsigned classifySse2(__m128i bytes, enum RunKind kind)
 {
-    return *context->current;
+    __m128i zero = _mm_setzero_si128();
+    __m128i stop;
+    switch (kind)
+    {
+        case RUN_WHITESPACE:
+        {
+            // Tab, LF, vertical tab, form feed, CR are 9..13.
+            __m128i control =
+                _mm_cmpeq_epi8(
+                    _mm_subs_epu8(
+                        _mm_sub_epi8(bytes, _mm_set1_epi8('\t')),
+                        _mm_set1_epi8('\r' - '\t')),
+                    zero);
+            __m128i space = _mm_cmpeq_epi8(bytes, _mm_set1_epi8(' '));
+            return _mm_movemask_epi8(_mm_or_si128(control, space));
+        }
+        case RUN_IDENTIFIER:
+        {
+            __m128i lower = _mm_or_si128(bytes, _mm_set1_epi8(0x20));
+            __m128i letter =
+                _mm_cmpeq_epi8(
+                    _mm_subs_epu8(
+                        _mm_sub_epi8(lower, _mm_set1_epi8('a')),
+                        _mm_set1_epi8('z' - 'a')),
+                    zero);
+            __m128i digit =
+                _mm_cmpeq_epi8(
+                    _mm_subs_epu8(
+                        _mm_sub_epi8(bytes, _mm_set1_epi8('0')),
+                        _mm_set1_epi8('9' - '0')),
+                    zero);
+            __m128i underscore = _mm_cmpeq_epi8(bytes, _mm_set1_epi8('_'));
+            return _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(letter, digit), underscore));
+        }
+        case RUN_BLOCK_COMMENT:
+            stop = _mm_cmpeq_epi8(bytes, _mm_set1_epi8('*'));
+            break;
+        case RUN_EOL_COMMENT:
+            stop =
+                _mm_or_si128(
+                    _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\n')),
+                    _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\r')));
+            break;
+        case RUN_STRING:
+            stop = _mm_cmpeq_epi8(bytes, _mm_set1_epi8('"'));
+            break;
+        default:
+            return 0;
+    }
+    stop = _mm_or_si128(stop, _mm_cmpeq_epi8(bytes, zero));
+    return ~_mm_movemask_epi8(stop) & 0xFFFF;
 }
 
 /**
- * Compares two non-zero terminated strings.
+ * Skips a run 16 bytes at a time.
+ *
+ * Only aligned blocks are loaded so the loads never cross a page boundary and can't fault
+ * after the terminating zero which always ends the run.
  *
- * @param str1,len1 The pointer to the first string and its length.
- * @param str2,len2 The pointer to the second string and its length.
+ * @param current The first character of the run.
+ * @param kind The kind of the run.
  *
- * @return
- *      - Zero if the two strings are equal.
- *      - Negative if the first is less.
- *      - Positive if the first is bigger.
+ * @return Pointer to the first character that is not part of the run.
  */
-static int compareBinaryString(
-    const char *str1,
-    int len1,
-    const char *str2,
-    int len2
-)
+__attribute__((target("sse2"), always_inline))
+static inline const char *skipBlocksSse2(const char *current, enum RunKind kind)
 {
-    int len = len1 < len2 ? len1 : len2;
-    int d = memcmp(str1, str2, len);
-    if (!d)
+    const char *block = (const char *)((uintptr_t)current & ~(uintptr_t)15);
+    unsigned stop = ~classifySse2(_mm_load_si128((const __m128i *)block), kind) & 0xFFFFu;
+    stop &= 0xFFFFu << (current - block);
+    while (!stop)
     {
-        d = len1 - len2;
+        block += 16;
+        stop = ~classifySse2(_mm_load_si128((const __m128i *)block), kind) & 0xFFFFu;
     }
-    return d;
+    return block + __builtin_ctz(stop);
 }
 
 /**
- * Scans indetifier. It may change the current token type, if keyword is found.
- * identifier ::= LETTER ALNUM*
+ * Dispatches on the run kind once, so the block loops are specialized for each kind.
  *
- * @param context context.
+ * @param current The first character of the run.
+ * @param kind The kind of the run.
  *
- * @return Nonzero on success.
+ * @return Pointer to the first character that is not part of the run.
  */
-static int scanIdentifier(struct LexerContext *context)
+__attribute__((target("sse2")))
+static const char *skipRunSse2(const char *current, enum RunKind kind)
 {
-    if (isLetter(getCurrentCharacter(context)))
-    {
-        acceptCurrent(context);
-    }
-    while (isAlphaNumeric(getCurrentCharacter(context)))
-    {
-        acceptCurrent(context);
-    }
-    // set token type if the current token is a keyword, do binary search in keyword.
+    switch (kind)
     {
-        const int N = sizeof(keywordMapping) / sizeof(keywordMapping[0]);
-        int left = 0;
-        int right = N - 1;
-        while (right >= left)
-        {
-            int middle = (left + right) >> 1;
-            assert(middle >= 0);
-            assert(middle < N);
-            struct KeywordTokenTypePair *kttp = &keywordMapping[middle];
-            int d = compareBinaryString(
-                context->currentToken->start,
-                context->currentToken->length,
-                kttp->keywordText,
-                kttp->keywordLength
-            );
-            if (d < 0)
-            {
-                right = middle - 1;
-            }
-            else if (d > 0)
-            {
-                left = middle + 1;
-            }
-            else
-            {
-                setCurrentTokenType(context, kttp->tokenType);
-                break;
-            }
-        }
+        case RUN_WHITESPACE: return skipBlocksSse2(current, RUN_WHITESPACE);
+        case RUN_IDENTIFIER: return skipBlocksSse2(current, RUN_IDENTIFIER);
+        case RUN_BLOCK_COMMENT: return skipBlocksSse2(current, RUN_BLOCK_COMMENT);
+        case RUN_EOL_COMMENT: return skipBlocksSse2(current, RUN_EOL_COMMENT);
+        case RUN_STRING: return skipBlocksSse2(current, RUN_STRING);
+        default: return current;
     }
-    return 1;
 }
 
 /**
- * Scans primitive type. (eg. $i32)
- * built_in_type ::= '$' ('u' | 'i' | 'f') DECIMAL* ( '_' LETTER* )?
+ * Classifies the bytes of a 32 byte block.
  *
- * @param context context.
+ * @param bytes The block.
+ * @param kind The kind of the run.
  *
- * @return Nonzero on success.
+ * @return Mask of the bytes which are part of the run.
  */
-static int scanBuiltInType(struct LexerContext *context)
+__attribute__((target("avx2"), always_inline))
+static inline unsigned classifyAvx2(__m256i bytes, enum RunKind kind)
 {
-    if (getCurrentCharacter(context) == '$')
-    {
-        acceptCurrent(context);
-    }
-    else
-    {
-        ERR_raiseError(E_LEX_IMPOSSIBLE_ERROR);
-        return 0;
-    }
-    switch (getCurrentCharacter(context))
+    __m256i zero = _mm256_setzero_si256();
+    __m256i stop;
+    switch (kind)
     {
-        case 'u':
-        case 'i':
-        case 'f':
-            acceptCurrent(context);
-        break;
+        case RUN_WHITESPACE:
+        {
+            __m256i control =
+                _mm256_cmpeq_epi8(
+                    _mm256_subs_epu8(
+                        _mm256_sub_epi8(bytes, _mm256_set1_epi8('\t')),
+                        _mm256_set1_epi8('\r' - '\t')),
+                    zero);
+            __m256i space = _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(' '));
+            return _mm256_movemask_epi8(_mm256_or_si256(control, space));
+        }
+        case RUN_IDENTIFIER:
+        {
+            __m256i lower = _mm256_or_si256(bytes, _mm256_set1_epi8(0x20));
+            __m256i letter =
+                _mm256_cmpeq_epi8(
+                    _mm256_subs_epu8(
+                        _mm256_sub_epi8(lower, _mm256_set1_epi8('a')),
+                        _mm256_set1_epi8('z' - 'a')),
+                    zero);
+            __m256i digit =
+                _mm256_cmpeq_epi8(
+                    _mm256_subs_epu8(
+                        _mm256_sub_epi8(bytes, _mm256_set1_epi8('0')),
+                        _mm256_set1_epi8('9' - '0')),
+                    zero);
+            __m256i underscore = _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('_'));
+            return _mm256_movemask_epi8(
+                _mm256_or_si256(_mm256_or_si256(letter, digit), underscore));
+        }
+        case RUN_BLOCK_COMMENT:
+            stop = _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('*'));
+            break;
+        case RUN_EOL_COMMENT:
+            stop =
+                _mm256_or_si256(
+                    _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\n')),
+                    _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\r')));
+            break;
+        case RUN_STRING:
+            stop = _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('"'));
+            break;
         default:
-            ERR_raiseError(E_LEX_INVALID_BUILT_IN_TYPE_LETTER);
             return 0;
     }
-    while (isDecimal(getCurrentCharacter(context)))
+    stop = _mm256_or_si256(stop, _mm256_cmpeq_epi8(bytes, zero));
+    return ~(unsigned)_mm256_movemask_epi8(stop);
+}
+
+/**
+ * Skips a run 32 bytes at a time. Same as skipBlocksSse2 with wider blocks.
+ *
+ * @param current The first character of the run.
+ * @param kind The kind of the run.
+ *
+ * @return Pointer to the first character that is not part of the run.
+ */
+__attribute__((target("avx2"), always_inline))
+static inline const char *skipBlocksAvx2(const char *current, enum RunKind kind)
+{
+    const char *block = (const char *)((uintptr_t)current & ~(uintptr_t)31);
+    unsigned stop = ~classifyAvx2(_mm256_load_si256((const __m256i *)block), kind);
+    stop &= 0xFFFFFFFFu << (current - block);
+    while (!stop)
     {
-        acceptCurrent(context);
+        block += 32;
+        stop = ~classifyAvx2(_mm256_load_si256((const __m256i *)block), kind);
     }
-    if (getCurrentCharacter(context) == '_' )
+    return block + __builtin_ctz(stop);
+}
+
+/**
+ * Dispatches on the run kind once, so the block loops are specialized for each kind.
+ *
+ * @param current The first character of the run.
+ * @param kind The kind of the run.
+ *
+ * @return Pointer to the first character that is not part of the run.
+ */
+__attribute__((target("avx2")))
+static const char *skipRunAvx2(const char *current, enum RunKind kind)
+{
+    switch (kind)
     {
-        acceptCurrent(context);
-        while (isLetter(getCurrentCharacter(context)))
-        {
-            acceptCurrent(context);
-        }
+        case RUN_WHITESPACE: return skipBlocksAvx2(current, RUN_WHITESPACE);
+        case RUN_IDENTIFIER: return skipBlocksAvx2(current, RUN_IDENTIFIER);
+        case RUN_BLOCK_COMMENT: return skipBlocksAvx2(current, RUN_BLOCK_COMMENT);
+        case RUN_EOL_COMMENT: return skipBlocksAvx2(current, RUN_EOL_COMMENT);
+        case RUN_STRING: return skipBlocksAvx2(current, RUN_STRING);
+        default: return current;
     }
-    return 1;
 }
 
+#endif // LEX_SIMD_KERNELS
+
 /**
- * Scans a number.
- *      octal_integer ::= '0' OCTAL*
- *      hexa_integer ::= '0' 'x' HEXA*
- *      decimal_integer ::= DECIMAL+
- *      float_number ::= DECIMAL+ ('.' DECIMAL+)? ( ('e' | 'E') ('+' | '-') DECIMAL+)?
- *
- * @param context context.
+ * Chooses the widest skip run kernel the CPU supports.
  *
- * @return Nonzero on success.
+ * @return The kernel.
  */
+static SkipRunFunction selectSkipRunFunction(void)
+{
+#ifdef LEX_SIMD_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return skipRunAvx2;
+    if (__builtin_cpu_supports("sse2")) return skipRunSse2;
+#endif
+    return skipRunScalar;
+}
 
-static int scanNumber(struct LexerContext *context)
+/**
+ * Checks the UTF-8 sequence starting at the given byte.
+ *
+ * @param current The first byte of the sequence.
+ * @param end The end of the input.
+ *
+ * @return The length of the sequence. Zero if it's ill-formed or cut by the end.
+ */
+static int getUtf8SequenceLength(const char *current, const char *end)
 {
-    char c = getCurrentCharacter(context);
-    int octalTried = 0;
+    const unsigned char *bytes = (const unsigned char *)current;
+    // The range of the second byte depends on the first one.
+    unsigned char low = 0x80;
+    unsigned char high = 0xBF;
+    int length;
+    int i;
 
-    if (c == '0')
+    if (bytes[0] < 0x80) return 1;
+    if (bytes[0] < 0xC2) return 0;
+    if (bytes[0] < 0xE0)
     {
-        // This can be an octal or a hexadecimal number at this point.
-        acceptCurrent(context);
-        octalTried = 1;
-        if (getCurrentCharacter(context) == 'x')
-        {
-            // Now we are sure this is a hexadecimal character.
-            acceptCurrent(context);
-            setCurrentTokenType(context, LEX_HEXA_INTEGER);
-            // Scan one or more hexadecimal characters.
-            if (!isHexa(getCurrentCharacter(context)))
-            {
-                ERR_raiseError(E_LEX_INVALID_HEXA_LITERAL);
-                return 0;
-            }
-            while (isHexa(getCurrentCharacter(context)))
-            {
-                acceptCurrent(context);
-            }
-            return 1;
-        }
-        // Its not hexadecimal its an octal.
-        // So read zero or more octal numbers.
-        setCurrentTokenType(context, LEX_OCTAL_INTEGER);
-        while (isOctal(getCurrentCharacter(context)))
-        {
-            acceptCurrent(context);
-        }
-        // If the next character cannot be a part of a decimal integer
-        // or floating point number. The current token is accepted as an octal number.
-        c = getCurrentCharacter(context);
-        if
-        (
-            !isDecimal(c) &&
-            (c != '.') &&
-            ((c | 0x20) != 'e')
-        )
-        {
-            return 1;
-        }
+        length = 2;
     }
-    // At this point the number is decimal at least.
-    setCurrentTokenType(context, LEX_DECIMAL_INTEGER);
-    // read one or more decimal digits. If we tried octal mode we already read
-    // at least one 0.
-    if (!octalTried && !isDecimal(getCurrentCharacter(context)))
+    else if (bytes[0] < 0xF0)
     {
-        ERR_raiseError(E_LEX_INVALID_DECIMAL_NUMBER);
-        return 0;
+        length = 3;
+        if (bytes[0] == 0xE0) low = 0xA0; // Overlong.
+        if (bytes[0] == 0xED) high = 0x9F; // Surrogate.
     }
-    while (isDecimal(getCurrentCharacter(context)))
+    else if (bytes[0] < 0xF5)
     {
-        acceptCurrent(context);
+        length = 4;
+        if (bytes[0] == 0xF0) low = 0x90; // Overlong.
+        if (bytes[0] == 0xF4) high = 0x8F; // Above 0x10FFFF.
     }
-    if (getCurrentCharacter(context) == '.')
+    else
     {
-        // Period read, fraction part coming with at least one decimal number
-        setCurrentTokenType(context, LEX_FLOAT_NUMBER);
-        acceptCurrent(context);
-        if (!isDecimal(getCurrentCharacter(context)))
-        {
-            ERR_raiseError(E_LEX_INVALID_DECIMAL_NUMBER);
-            return 0;
-        }
-        while (isDecimal(getCurrentCharacter(context)))
-        {
-            acceptCurrent(context);
-        }
+        return 0;
     }
-    if ((getCurrentCharacter(context) | 0x20) == 'e')
+    if (end - current < length) return 0;
+    if ((bytes[1] < low) || (bytes[1] > high)) return 0;
+    for (i = 2; i < length; i++)
     {
-        // E read. Exponential part coming.
-        setCurrentTokenType(context, LEX_FLOAT_NUMBER);
-        acceptCurrent(context);
-        // accept an optional sign.
-        switch (getCurrentCharacter(context))
-        {
-            case '-':
-            case '+':
-                acceptCurrent(context);
-            break;
-            default:
-            break;
-        }
-        // accept at least one decimal numbers.
-        if (!isDecimal(getCurrentCharacter(context)))
-        {
-            ERR_raiseError(E_LEX_INVALID_DECIMAL_NUMBER);
-            return 0;
-        }
-        while (isDecimal(getCurrentCharacter(context)))
-        {
-            acceptCurrent(context);
-        }
+        if ((bytes[i] & 0xC0) != 0x80) return 0;
     }
-    return 1;
+    return length;
 }
 
 /**
- * Scans a string.
- * string ::= '"' non-"* '"'
- *
- * @param context context.
- *
- * @return Nonzero on success.
+ * The scalar UTF-8 validation. See FindInvalidUtf8Function.
  */
-static int scanString(struct LexerContext *context)
+static const char *findInvalidUtf8Scalar(const char *current, const char *end)
 {
-    char c = getCurrentCharacter(context);
-    if (c != '"')
-    {
-        ERR_raiseError(E_LEX_QUOTE_EXPECTED);
-        return 0;
-    }
-    acceptCurrent(context);
-    while(getCurrentCharacter(context) != '"')
+    while (current < end)
     {
-        acceptCurrent(context);
+        int length;
+        if (!(*current & 0x80))
+        {
+            current++;
+            continue;
+        }
+        length = getUtf8SequenceLength(current, end);
+        if (!length) return current;
+        current += length;
     }
-    acceptCurrent(context); // accept the last quote.
-    return 1;
+    return end;
 }
 
+#ifdef LEX_SIMD_KERNELS
+
 /**
- * The main function that does the tokenization.
- *
- * @param context context.
- *
- * @return Nonzero on success.
+ * Skips the ASCII 16 bytes at a time, the other sequences are checked one by one. See
+ * FindInvalidUtf8Function.
  */
-static int doTokenization(struct LexerContext *context)
+__attribute__((target("sse2")))
+static const char *findInvalidUtf8Sse2(const char *current, const char *end)
 {
-    while (getCurrentCharacter(context))
+    while (current < end)
     {
-        char c = getCurrentCharacter(context);
+        int length;
+        if (end - current >= 16)
+        {
+            unsigned nonAscii = _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)current));
+            if (!nonAscii)
+            {
+                current += 16;
+                continue;
+            }
+            current += __builtin_ctz(nonAscii);
+        }
+        else if (!(*current & 0x80))
+        {
+            current++;
+            continue;
+        }
+        length = getUtf8SequenceLength(current, end);
+        if (!length) return current;
+        current += length;
+    }
+    return end;
+}
+
+// The error classes of the byte pairs, after Keiser and Lemire: Validating UTF-8 in less
+// than one instruction per byte. A pair is ill-formed if the three lookups share a bit.
+#define UTF8_TOO_SHORT 0x01 ///< A lead byte not followed by a continuation byte.
+#define UTF8_TOO_LONG 0x02 ///< An ASCII byte followed by a continuation byte.
+#define UTF8_OVERLONG_3 0x04 ///< E0 followed by 80..9F.
+#define UTF8_TOO_LARGE 0x08 ///< F4 followed by 90..BF, or F5..FF followed by 90..BF.
+#define UTF8_SURROGATE 0x10 ///< ED followed by A0..BF.
+#define UTF8_OVERLONG_2 0x20 ///< C0 or C1 followed by a continuation byte.
+#define UTF8_TOO_LARGE_1000 0x40 ///< F5..FF followed by 80..8F.
+#define UTF8_OVERLONG_4 0x40 ///< F0 followed by 80..8F.
+#define UTF8_TWO_CONTINUATIONS 0x80 ///< A continuation byte followed by a continuation byte.
+#define UTF8_CARRY (UTF8_TOO_SHORT | UTF8_TOO_LONG | UTF8_TWO_CONTINUATIONS)
+
+#define UTF8_FIRST_HIGH_NIBBLE \
+    UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, \
+    UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, \
+    UTF8_TWO_CONTINUATIONS, UTF8_TWO_CONTINUATIONS, UTF8_TWO_CONTINUATIONS, UTF8_TWO_CONTINUATIONS, \
+    UTF8_TOO_SHORT | UTF8_OVERLONG_2, \
+    UTF8_TOO_SHORT, \
+    UTF8_TOO_SHORT | UTF8_OVERLONG_3 | UTF8_SURROGATE, \
+    UTF8_TOO_SHORT | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4
+
+#define UTF8_FIRST_LOW_NIBBLE \
+    UTF8_CARRY | UTF8_OVERLONG_3 | UTF8_OVERLONG_2 | UTF8_OVERLONG_4, \
+    UTF8_CARRY | UTF8_OVERLONG_2, \
+    UTF8_CARRY, \
+    UTF8_CARRY, \
+    UTF8_CARRY | UTF8_TOO_LARGE, \
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000, \
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000, \
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000, \
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000, \
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000, \
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000, \
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000, \
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000, \
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_SURROGATE, \
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000, \
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000
+
+#define UTF8_SECOND_HIGH_NIBBLE \
+    UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, \
+    UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, \
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTINUATIONS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4, \
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTINUATIONS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE, \
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTINUATIONS | UTF8_SURROGATE | UTF8_TOO_LARGE, \
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTINUATIONS | UTF8_SURROGATE | UTF8_TOO_LARGE, \
+    UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT
+
+/// The lookup tables of the byte pairs, the same 16 entries in both lanes.
+static const unsigned char utf8FirstHighNibble[32] = {UTF8_FIRST_HIGH_NIBBLE, UTF8_FIRST_HIGH_NIBBLE};
+static const unsigned char utf8FirstLowNibble[32] = {UTF8_FIRST_LOW_NIBBLE, UTF8_FIRST_LOW_NIBBLE};
+static const unsigned char utf8SecondHighNibble[32] = {UTF8_SECOND_HIGH_NIBBLE, UTF8_SECOND_HIGH_NIBBLE};
+
+/// A block is incomplete if one of its last three bytes starts a sequence longer than
+/// the rest of the block.
+static const unsigned char utf8IncompleteLimits[32] =
+{
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 0xF0 - 1, 0xE0 - 1, 0xC0 - 1,
+};
+
+/**
+ * Shifts the bytes of the previous block into a block.
+ *
+ * @param bytes The block.
+ * @param previous The previous block.
+ * @param count The count of bytes shifted in. 1, 2 or 3.
+ *
+ * @return The last count bytes of previous followed by the bytes of the block.
+ */
+#define PREVIOUS_BYTES_AVX2(bytes, previous, count) \
+    _mm256_alignr_epi8((bytes), _mm256_permute2x128_si256((previous), (bytes), 0x21), 16 - (count))
+
+/**
+ * Checks a 32 byte block containing non-ASCII bytes.
+ *
+ * @param bytes The block.
+ * @param previous The previous block.
+ *
+ * @return Nonzero bytes where the sequences are ill-formed. The sequences cut by the end
+ *     of the block are checked with the next block.
+ */
+__attribute__((target("avx2"), always_inline))
+static inline __m256i checkUtf8BlockAvx2(__m256i bytes, __m256i previous)
+{
+    __m256i lowNibbleMask = _mm256_set1_epi8(0x0F);
+    __m256i previous1 = PREVIOUS_BYTES_AVX2(bytes, previous, 1);
+    __m256i previous2 = PREVIOUS_BYTES_AVX2(bytes, previous, 2);
+    __m256i previous3 = PREVIOUS_BYTES_AVX2(bytes, previous, 3);
+    __m256i firstHigh = _mm256_shuffle_epi8(
+        _mm256_loadu_si256((const __m256i *)utf8FirstHighNibble),
+        _mm256_and_si256(_mm256_srli_epi16(previous1, 4), lowNibbleMask));
+    __m256i firstLow = _mm256_shuffle_epi8(
+        _mm256_loadu_si256((const __m256i *)utf8FirstLowNibble),
+        _mm256_and_si256(previous1, lowNibbleMask));
+    __m256i secondHigh = _mm256_shuffle_epi8(
+        _mm256_loadu_si256((const __m256i *)utf8SecondHighNibble),
+        _mm256_and_si256(_mm256_srli_epi16(bytes, 4), lowNibbleMask));
+    __m256i pairErrors = _mm256_and_si256(_mm256_and_si256(firstHigh, firstLow), secondHigh);
+    // The third and fourth bytes of the 3 and 4 byte sequences must be continuations.
+    // They have the bit 7 of the pair error, which flags two continuations otherwise.
+    __m256i isThirdByte = _mm256_subs_epu8(previous2, _mm256_set1_epi8(0xE0 - 0x80));
+    __m256i isFourthByte = _mm256_subs_epu8(previous3, _mm256_set1_epi8((char)(0xF0 - 0x80)));
+    __m256i mustBeContinuation = _mm256_and_si256(
+        _mm256_or_si256(isThirdByte, isFourthByte),
+        _mm256_set1_epi8((char)0x80));
+    return _mm256_xor_si256(mustBeContinuation, pairErrors);
+}
+
+/**
+ * Checks 32 bytes at a time with the Keiser-Lemire algorithm. The blocks of ASCII are
+ * skipped. The ill-formed sequence is located by the scalar validation from the end of
+ * the last ASCII block. See FindInvalidUtf8Function.
+ */
+__attribute__((target("avx2")))
+static const char *findInvalidUtf8Avx2(const char *current, const char *end)
+{
+    const char *block = current;
+    // Everything before it is well-formed and it's a sequence boundary.
+    const char *boundary = current;
+    __m256i previous = _mm256_setzero_si256();
+    __m256i previousIncomplete = _mm256_setzero_si256();
+    char last[32];
 
-        if (isWhitespace(c))
+    for (;;)
+    {
+        // The last block is padded with zeros, so it ends every sequence.
+        int isLast = end - block < 32;
+        __m256i bytes;
+        __m256i errors;
+        if (isLast)
         {
-            // Ignore any whitespace.
-            ignoreCurrent(context);
+            memset(last, 0, sizeof(last));
+            memcpy(last, block, end - block);
+            bytes = _mm256_loadu_si256((const __m256i *)last);
         }
-        else if (isLetter(c))
+        else
         {
-            // If read letter try to scan an identifier.
-            startNewToken(context, LEX_IDENTIFIER);
-            if (!scanIdentifier(context)) return 0;
-            finishCurrentToken(context);
+            bytes = _mm256_loadu_si256((const __m256i *)block);
         }
-        else if (isDecimal(c))
+        int isAscii = !_mm256_movemask_epi8(bytes);
+        if (isAscii)
         {
-            // If read an integer, try to scan a decimal number.
-            startNewToken(context, LEX_DECIMAL_INTEGER);
-            if (!scanNumber(context)) return 0;
-            finishCurrentToken(context);
+            errors = previousIncomplete;
+            previousIncomplete = _mm256_setzero_si256();
         }
         else
         {
-            // Special character handling goes here.
-            switch (c)
-            {
-                case ';':
-                    startNewToken(context, LEX_SEMICOLON);
-                    acceptCurrent(context);
-                    finishCurrentToken(context);
-                break;
-                case '{':
-                    startNewToken(context, LEX_LEFT_BRACE);
-                    acceptCurrent(context);
-                    finishCurrentToken(context);
-                break;
-                case '}':
-                    startNewToken(context, LEX_RIGHT_BRACE);
-                    acceptCurrent(context);
-                    finishCurrentToken(context);
-                break;
-                case '$':
-                    startNewToken(context, LEX_BUILT_IN_TYPE);
-                    if (!scanBuiltInType(context)) return 0;
-                    finishCurrentToken(context);
-                break;
-                case '"':
-                    startNewToken(context, LEX_STRING);
-                    if (!scanString(context)) return 0;
-                    finishCurrentToken(context);
-                break;
-                case '+':
-                    startNewToken(context, LEX_ADD_OPERATOR);
-                    acceptCurrent(context);
-                    finishCurrentToken(context);
-                break;
-                case '-':
-                    startNewToken(context, LEX_SUBTRACT_OPERATOR);
-                    acceptCurrent(context);
-                    if (isDecimal(getCurrentCharacter(context)))
-                    {
-                        // If a decimal digit follows directly the -. We read a negative number.
-                        if (!scanNumber(context)) return 0;
-                    }
-                    finishCurrentToken(context);
-                break;
-                case ',':
-                    startNewToken(context, LEX_COMMA);
-                    acceptCurrent(context);
-                    finishCurrentToken(context);
-                break;
-                case '(':
-                    startNewToken(context, LEX_LEFT_PARENTHESIS);
-                    acceptCurrent(context);
-                    finishCurrentToken(context);
-                break;
-                case ')':
-                    startNewToken(context, LEX_RIGHT_PARENTHESIS);
-                    acceptCurrent(context);
-                    finishCurrentToken(context);
-                break;
-                case '[':
-                    startNewToken(context, LEX_LEFT_BRACKET);
-                    acceptCurrent(context);
-                    finishCurrentToken(context);
-                break;
-                case '/':
-                    // '/' means division operator
-                    startNewToken(context, LEX_DIVISION_OPERATOR);
-                    acceptCurrent(context);
-                    if (getCurrentCharacter(context) == '*')
-                    {
-                        // '/*' means the beginning of the block comment.
-                        setCurrentTokenType(context, LEX_BLOCK_COMMENT);
-                        acceptCurrent(context);
-                        if (getCurrentCharacter(context) == '*')
-                        {
-                            // '/**' is a documentation block comment.
-                            setCurrentTokenType(context, LEX_DOCUMENTATION_BLOCK_COMMENT);
-                            acceptCurrent(context);
-                        }
-                        for (;;)
-                        {
-                            if (getCurrentCharacter(context) == '*')
-                            {
-                                acceptCurrent(context);
-                                if (getCurrentCharacter(context) == '/')
-                                {
-                                    // '*/' character sequence closes the comment.
-                                    acceptCurrent(context);
-                                    break;
-                                }
-                            }
-                            else
-                            {
-                                acceptCurrent(context);
-                            }
-                        }
-                    }
-                    else if (getCurrentCharacter(context) == '/')
-                    {
-                        // '//' starts an EOL comment.
-                        setCurrentTokenType(context, LEX_EOL_COMMENT);
-                        acceptCurrent(context);
-                        if (getCurrentCharacter(context) == '/')
-                        {
-                            // '///' starts an EOL documentation comment
-                            setCurrentTokenType(context, LEX_DOCUMENTATION_EOL_COMMENT);
-                            acceptCurrent(context);
-                        }
-                        if (getCurrentCharacter(context) == '<')
-                        {
-                            // '//<' starts an EOL documentation back comment.
-                            setCurrentTokenType(context, LEX_DOCUMENTATION_EOL_BACK_COMMENT);
-                            acceptCurrent(context);
-                        }
-                        while ((getCurrentCharacter(context) != '\n') && (getCurrentCharacter(context) != '\r'))
-                        {
-                            // read characters until we reached end of the line.
-                            acceptCurrent(context);
-                        }
-                    }
-                    finishCurrentToken(context);
-                break;
-                case ']':
-                    startNewToken(context, LEX_RIGHT_BRACKET);
-                    acceptCurrent(context);
-                    finishCurrentToken(context);
-                break;
-                case '*':
-                    startNewToken(context, LEX_MULTIPLY_OPERATOR);
-                    acceptCurrent(context);
-                    finishCurrentToken(context);
-                break;
-                case '.':
-                    startNewToken(context, LEX_PERIOD);
-                    acceptCurrent(context);
-                    finishCurrentToken(context);
-                break;
-                case  '>':
-                    startNewToken(context, LEX_GREATER_THAN);
-                    acceptCurrent(context);
-                    switch (getCurrentCharacter(context))
-                    {
-                        case '=':
-                        {
-                            // >=
-                            setCurrentTokenType(context, LEX_GREATER_EQUAL_THAN);
-                            acceptCurrent(context);
-                        }
-                        break;
-                        case '>':
-                        {
-                            // >>
-                            setCurrentTokenType(context, LEX_SHIFT_RIGHT);
-                            acceptCurrent(context);
-                        }
-                        break;
-                    }
-                    finishCurrentToken(context);
-                break;
-                case  '<':
-                    startNewToken(context, LEX_LESS_THAN);
-                    acceptCurrent(context);
-                    switch (getCurrentCharacter(context))
-                    {
-                        case '=':
-                        {
-                            // <=
-                            setCurrentTokenType(context, LEX_LESS_EQUAL_THAN);
-                            acceptCurrent(context);
-                        }
-                        break;
-                        case '<':
-                        {
-                            // <<
-                            setCurrentTokenType(context, LEX_SHIFT_LEFT);
-                            acceptCurrent(context);
-                        }
-                        break;
-                    }
-                    finishCurrentToken(context);
-                break;
-                case '=':
-                    startNewToken(context, LEX_EQUAL);
-                    acceptCurrent(context);
-                    if (getCurrentCharacter(context) == '=')
-                    {
-                        // == equality
-                        acceptCurrent(context);
-                    }
-                    else
-                    {
-                        ERR_raiseError(E_LEX_INVALID_OPERATOR);
-                        return 0;
-                    }
-                    finishCurrentToken(context);
-                break;
-                case '#':
-                    startNewToken(context, LEX_CHARACTER);
-                    acceptCurrent(context);
-                    while (isDecimal(getCurrentCharacter(context)))
-                    {
-                        // #32 is for space for example
-                        acceptCurrent(context);
-                    }
-                    finishCurrentToken(context);
-                break;
-                case '!':
-                    startNewToken(context, LEX_NOT_EQUAL);
-                    acceptCurrent(context);
-                    if (getCurrentCharacter(context) == '=')
-                    {
-                        // !=
-                        acceptCurrent(context);
-                    }
-                    else
-                    {
-                        ERR_raiseError(E_LEX_INVALID_OPERATOR);
-                        return 0;
-                    }
-                    finishCurrentToken(context);
-                break;
-                case ':':
-                    startNewToken(context, LEX_COLON);
-                    acceptCurrent(context);
-                    if (getCurrentCharacter(context) == '=')
-                    {
-                        // :=
-                        setCurrentTokenType(context, LEX_ASSIGN_OPERATOR);
-                        acceptCurrent(context);
-                    }
-                    else if (getCurrentCharacter(context) == ':')
-                    {
-                        // ::
-                        setCurrentTokenType(context, LEX_SCOPE_SEPARATOR);
-                        acceptCurrent(context);
-                    }
-                    finishCurrentToken(context);
-                break;
-                default:
-                    ERR_raiseError(E_LEX_INVALID_CHARACTER);
-                    return 0;
-            }
+            errors = checkUtf8BlockAvx2(bytes, previous);
+            previousIncomplete = _mm256_subs_epu8(bytes, _mm256_loadu_si256((const __m256i *)utf8IncompleteLimits));
+        }
+        if (!_mm256_testz_si256(errors, errors))
+        {
+            return findInvalidUtf8Scalar(boundary, end);
         }
+        if (isLast) return end;
+        if (isAscii)
+        {
+            boundary = block + 32;
+        }
+        previous = bytes;
+        block += 32;
     }
-    return 1;
 }
 
-void LEX_cleanUpLexerResult(struct LEX_LexerResult *lexerResult)
+#endif // LEX_SIMD_KERNELS
+
+/**
+ * Chooses the widest UTF-8 validation kernel the CPU supports.
+ *
+ * @return The kernel.
+ */
+static FindInvalidUtf8Function selectFindInvalidUtf8Function(void)
 {
-    int i;
-    for (i = 0; i < lexerResult->stringCount; i++)
+#ifdef LEX_SIMD_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return findInvalidUtf8Avx2;
+    if (__builtin_cpu_supports("sse2")) return findInvalidUtf8Sse2;
+#endif
+    return findInvalidUtf8Scalar;
+}
+
+/**
+ * Looks up the identifier among the keywords.
+ *
+ * One probe in the keyword hash table and one compare.
+ *
+ * @param start,length The identifier.
+ *
+ * @return The type of the keyword token, LEX_IDENTIFIER if the identifier is not a keyword.
+ */
+static enum LEX_TokenType lookUpKeyword(const char *start, int length)
+{
+    const struct KeywordTokenTypePair *kttp =
+        &keywordTable[KEYWORD_HASH(length, start[0], start[length - 1])];
+    if (kttp->keywordLength == length && !memcmp(start, kttp->keywordText, length))
     {
-        free(lexerResult->strings[i]);
+        return kttp->tokenType;
     }
-    free(lexerResult->strings);
-    free(lexerResult->tokens);
+    return LEX_IDENTIFIER;
 }
 
 /**
- * Merges adjacent strings and character literals into a single token.
+ * Runs the automaton from the given state until there is no transition on the current
+ * character.
  *
- * @param context context.
+ * @param context context. The current character is moved after the last accepted character.
+ * @param state The state to start from.
  *
- * @return Nonzero on success.
+ * @return The state the automaton stopped in.
  */
-static void mergeAdjacentStrings(struct LexerContext *context)
+static enum LexerState runAutomaton(struct LexerContext *context, enum LexerState state)
 {
-    int i, j = 0;
-    int inSeriesOfStrings = 0;
-    struct LEX_LexerToken *stringToken;
-    struct LEX_LexerResult *result = context->result;
-    // For each token.
-    for (i = 0; i < context->tokenCount; i++)
+    const char *current = context->current;
+    // The long runs of self transitions (comments, strings, whitespace, identifiers)
+    // are skipped by the skip run kernel, the rest goes character by character.
+    const unsigned char *row = transitions[state];
+    if (runKinds[state] && row[characterClasses[(unsigned char)*current]] == state)
     {
-        struct LEX_LexerToken *token = &result->tokens[i];
-        struct LEX_LexerToken *previousToken;
-        switch (token->tokenType)
+        current = context->skipRun(current, runKinds[state]);
+    }
+    for (;;)
+    {
+        unsigned char characterClass = characterClasses[(unsigned char)*current];
+        unsigned char nextState = row[characterClass];
+        if (nextState == LS_NONE) break;
+        current++;
+        if (nextState != state)
         {
-            case LEX_STRING:
-            case LEX_CHARACTER:
+            state = nextState;
+            row = transitions[state];
+            // Entering a state with long runs: skip the run in bulk unless it ends right away.
+            if (runKinds[state] &&
+                row[characterClasses[(unsigned char)*current]] == state)
             {
-                // On string or character.
-                if (!inSeriesOfStrings)
-                {
-                    // If we are not in series of strings
-                    // start one
-                    inSeriesOfStrings = 1;
-                    // Remember the first token in the series.
-                    stringToken = token;
-                }
-                else
-                {
-                    // If we are in a series of strings, mark the current token
-                    // deleted.
-                    token->tokenType = LEX_SPEC_DELETED;
-                }
+                current = context->skipRun(current, runKinds[state]);
             }
-            break;
-            default:
-                if (inSeriesOfStrings)
-                {
-                    // If we are in a series of strings but read a non-string.
-                    // Update the end position of the first token.
-                    inSeriesOfStrings = 0;
-                    stringToken->endColumn = previousToken->endColumn;
-                    stringToken->endLine = previousToken->endLine;
-                    // update the length of the first token.
-                    stringToken->length =
-                        (size_t)(previousToken->start + previousToken->length) -
-                        (size_t)(stringToken->start);
-                    // Now the first token's string contains all adjacent strings.
-                }
-        }
-        previousToken = token;
-    }
-    // Now delete all previously marked tokens.
-    i = 0;
-    j = 0;
-    for (i = 0; i < context->tokenCount; i++)
-    {
-        struct LEX_LexerToken *token = &result->tokens[i];
-        if (token->tokenType != LEX_SPEC_DELETED)
-        {
-            result->tokens[j++] = *token;
         }
     }
-    context->tokenCount = j;
+    context->current = current;
+    return state;
 }
 
 /**
- * Creates a new binary string.
+ * Returns the pointer to the given offset of the source. The offset must be in the
+ * part of the source which is in memory.
  *
- * Binary strings store the binary representations of the string literals.
+ * @param context context.
+ * @param offset The offset in the source.
  *
- * @param [in,out] context context.
+ * @return The pointer to the character.
  */
-static void createBinaryString(struct LexerContext *context)
+static const char *getSourcePointer(const struct LexerContext *context, unsigned offset)
 {
-    assert(!context->currentStringAllocated);
-    context->currentStringAllocated = 20;
-    context->currentString = malloc(context->currentStringAllocated * sizeof(char));
-    context->currentStringLength = 0;
+    return context->windowStart + (offset - context->windowOffset);
 }
+
 /**
- * Finalizes and saves the current binary string.
+ * Records the error which stopped the scanning and raises it unless the context is quiet.
  *
  * @param context context.
- * @param [out] string The string's address is saved here.
- * @param [out] length The string's length is saved here.
+ * @param error The error.
  */
-static void finalizeBinaryString(struct LexerContext *context, const char **string, int *length)
+static void raiseLexerError(struct LexerContext *context, enum ERR_ErrorCode error)
 {
-    struct LEX_LexerResult *result = context->result;
+    context->error = error;
+    if (!context->isQuiet)
+    {
+        ERR_raiseErrorAt(error, context->windowOffset + (context->current - context->windowStart), -1);
+    }
+}
 
-    assert(context->currentStringAllocated);
-    assert(string);
-    assert(length);
-    if (result->stringCount == context->stringsAllocated)
+/**
+ * Copies a text into the text arena.
+ *
+ * @param result The lexer result owning the arena.
+ * @param text The text.
+ * @param length The length of the text.
+ *
+ * @return The copy. It never moves.
+ */
+static const char *copyToTextArena(struct LEX_LexerResult *result, const char *text, int length)
+{
+    struct LEX_TextBlock *block = result->textBlocks;
+    char *copy;
+
+    if (!block || (block->size - block->used < length))
     {
-        if (context->stringsAllocated)
-        {
-            context->stringsAllocated <<= 1;
-        }
-        else
+        int size = length > TEXT_BLOCK_SIZE ? length : TEXT_BLOCK_SIZE;
+        block = malloc(sizeof(struct LEX_TextBlock) + size);
+        block->next = result->textBlocks;
+        block->used = 0;
+        block->size = size;
+        result->textBlocks = block;
+    }
+    copy = block->text + block->used;
+    block->used += length;
+    memcpy(copy, text, length);
+    return copy;
+}
+
+/**
+ * Hashes a name. (FNV-1a)
+ *
+ * @param name The name.
+ * @param length The length of the name.
+ *
+ * @return The hash.
+ */
+static unsigned hashName(const char *name, int length)
+{
+    unsigned hash = 2166136261u;
+    int i;
+    for (i = 0; i < length; i++)
+    {
+        hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * Doubles the symbol hash table.
+ *
+ * @param context context.
+ */
+static void growSymbolSlots(struct LexerContext *context)
+{
+    const struct LEX_Symbol *symbols = context->result->symbols;
+    int mask;
+    int i;
+
+    context->symbolSlotCount <<= 1;
+    mask = context->symbolSlotCount - 1;
+    free(context->symbolSlots);
+    context->symbolSlots = calloc(context->symbolSlotCount, sizeof(*context->symbolSlots));
+    for (i = 1; i < context->result->symbolCount; i++)
+    {
+        unsigned slot = hashName(symbols[i].name, symbols[i].length) & mask;
+        while (context->symbolSlots[slot])
         {
-            context->stringsAllocated = 20;
+            slot = (slot + 1) & mask;
         }
-        result->strings = realloc(result->strings, context->stringsAllocated * sizeof(*result->strings));
+        context->symbolSlots[slot] = i;
     }
-    result->strings[result->stringCount++] = context->currentString;
-    context->currentStringAllocated = 0;
-    *string = context->currentString;
-    *length = context->currentStringLength;
-
 }
 
 /**
- * Adds a single character to the current binary string.
+ * Returns the symbol id of a name. A new id is given to names which are not seen yet.
+ * The ids are dense and given in the order of the first occurrence.
  *
  * @param context context.
- * @param c The character to add.
+ * @param name The name. Lexers fed in chunks copy the name when it's first seen.
+ * @param length The length of the name.
  *
+ * @return The symbol id.
  */
-static void addToBinaryString(struct LexerContext *context, char c)
+static unsigned internSymbol(struct LexerContext *context, const char *name, int length)
 {
-    assert(context->currentStringAllocated);
+    struct LEX_LexerResult *result = context->result;
+    int mask = context->symbolSlotCount - 1;
+    unsigned slot = hashName(name, length) & mask;
+    unsigned id;
 
-    if (context->currentStringLength == context->currentStringAllocated)
+    while ((id = context->symbolSlots[slot]))
     {
-        context->currentStringAllocated <<= 1;
-        context->currentString = realloc(context->currentString, context->currentStringAllocated * sizeof(*context->currentString));
+        if ((result->symbols[id].length == length) && !memcmp(result->symbols[id].name, name, length))
+        {
+            return id;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    if (result->symbolCount == context->symbolsAllocated)
+    {
+        context->symbolsAllocated <<= 1;
+        result->symbols = realloc(result->symbols, context->symbolsAllocated * sizeof(*result->symbols));
     }
-    context->currentString[context->currentStringLength++] = c;
+    id = result->symbolCount++;
+    result->symbols[id].name =
+        (result->source && !context->isSourceEdited) ? name : copyToTextArena(result, name, length);
+    result->symbols[id].length = length;
+    context->symbolSlots[slot] = id;
+    if (result->symbolCount * 2 > context->symbolSlotCount)
+    {
+        growSymbolSlots(context);
+    }
+    return id;
 }
 
 /**
- * Adds an UTF-8 character to the current binary string.
+ * @param type A token type.
  *
- * @param context context.
- * @param ch The unicode code of the character to add
+ * @return Nonzero if it's the type of a number literal.
+ */
+static int isNumberToken(enum LEX_TokenType type)
+{
+    return
+        (type == LEX_DECIMAL_INTEGER) ||
+        (type == LEX_OCTAL_INTEGER) ||
+        (type == LEX_HEXA_INTEGER) ||
+        (type == LEX_FLOAT_NUMBER);
+}
+
+/**
+ * @param type A token type.
  *
+ * @return Nonzero if it's the type of a comment, documentation or not.
  */
+static int isCommentToken(enum LEX_TokenType type)
+{
+    return
+        (type == LEX_BLOCK_COMMENT) ||
+        (type == LEX_EOL_COMMENT) ||
+        (type == LEX_DOCUMENTATION_BLOCK_COMMENT) ||
+        (type == LEX_DOCUMENTATION_EOL_COMMENT) ||
+        (type == LEX_DOCUMENTATION_EOL_BACK_COMMENT);
+}
 
-static void addUtf8CharacterToBinaryString(struct LexerContext *context, int ch)
+/**
+ * Converts eight decimal digits to their value.
+ *
+ * @param digits The digits. Must be decimal digits.
+ *
+ * @return The value.
+ */
+static uint64_t convertEightDigits(const char *digits)
 {
-    if (ch < (1 << 7) )
+#ifdef LEX_SWAR_DIGITS
+    // The first digit is in the lowest byte. Adjacent digits are combined to 2, then
+    // 4, then 8 digit numbers in each step.
+    uint64_t word;
+    memcpy(&word, digits, sizeof(word));
+    word -= 0x3030303030303030u;
+    word = (word * 10 + (word >> 8)) & 0x00FF00FF00FF00FFu;
+    word = (word * 100 + (word >> 16)) & 0x0000FFFF0000FFFFu;
+    word = (word * 10000 + (word >> 32)) & 0x00000000FFFFFFFFu;
+    return word;
+#else
+    uint64_t value = 0;
+    int i;
+    for (i = 0; i < 8; i++)
     {
-        addToBinaryString(context, (char)ch);
+        value = value * 10 + (digits[i] - '0');
     }
-    else if (ch < (1 << 11))
+    return value;
+#endif
+}
+
+/**
+ * Computes the magnitude of an integer literal.
+ *
+ * @param digits The digits after the sign and the 0x prefix.
+ * @param length The count of digits.
+ * @param type The type of the literal.
+ * @param [out] magnitude The value is stored here.
+ *
+ * @return Nonzero on success, zero if the value does not fit in 64 bits.
+ */
+static int decodeMagnitude(const char *digits, int length, enum LEX_TokenType type, uint64_t *magnitude)
+{
+    const char *end = digits + length;
+    uint64_t value = 0;
+
+    // Leading zeros don't count in the length limits.
+    while ((digits != end) && (*digits == '0'))
     {
-        addToBinaryString(context, 0xC0 | ((ch & 0x000007C0) >> 6) );
-        addToBinaryString(context, 0x80 | (ch & 0x0000003F) );
+        digits++;
     }
-    else if (ch < (1 << 16))
+    length = end - digits;
+    switch (type)
     {
-        addToBinaryString(context, 0xE0 | ((ch & 0x0000F000) >> 12) );
-        addToBinaryString(context, 0x80 | ((ch & 0x00000FC0) >> 6) );
-        addToBinaryString(context, 0x80 | (ch & 0x0000003F) );
+        case LEX_HEXA_INTEGER:
+            if (length > 16) return 0;
+            for (; digits != end; digits++)
+            {
+                int digit = *digits <= '9' ? *digits - '0' : (*digits | 0x20) - 'a' + 10;
+                value = (value << 4) | digit;
+            }
+        break;
+        case LEX_OCTAL_INTEGER:
+            // 22 octal digits are 66 bits, the first digit may use only one of the top 3 bits.
+            if ((length > 22) || ((length == 22) && (*digits > '1'))) return 0;
+            for (; digits != end; digits++)
+            {
+                value = (value << 3) | (*digits - '0');
+            }
+        break;
+        default:
+            // 19 decimal digits always fit, the 20th needs checking.
+            if (length > 20) return 0;
+            while (end - digits >= 8 + (length == 20))
+            {
+                value = value * 100000000 + convertEightDigits(digits);
+                digits += 8;
+            }
+            while (end - digits > (length == 20))
+            {
+                value = value * 10 + (*digits++ - '0');
+            }
+            if (digits != end)
+            {
+                int digit = *digits - '0';
+                if (value > (UINT64_MAX - digit) / 10) return 0;
+                value = value * 10 + digit;
+            }
+        break;
     }
-    else if (ch < (1 << 21))
+    *magnitude = value;
+    return 1;
+}
+
+/**
+ * Appends a slot to the numbers of the result.
+ *
+ * @param context context.
+ * @param [out] index The index of the new slot.
+ *
+ * @return The new slot.
+ */
+static struct LEX_Number *appendNumber(struct LexerContext *context, unsigned *index)
+{
+    struct LEX_LexerResult *result = context->result;
+
+    if (result->numberCount == context->numbersAllocated)
     {
-        addToBinaryString(context, 0xF0 | ((ch & 0x00070000) >> 18) );
-        addToBinaryString(context, 0x80 | ((ch & 0x0003F000) >> 12) );
-        addToBinaryString(context, 0x80 | ((ch & 0x00000FC0) >> 6) );
-        addToBinaryString(context, 0x80 | (ch & 0x0000003F) );
+        context->numbersAllocated = context->numbersAllocated ? context->numbersAllocated << 1 : 64;
+        result->numbers = realloc(result->numbers, context->numbersAllocated * sizeof(*result->numbers));
     }
-    else if (ch < (1 << 26))
+    *index = result->numberCount;
+    return &result->numbers[result->numberCount++];
+}
+
+/**
+ * Decodes the value of a number literal and appends it to the numbers of the result.
+ * The token's value is set to its index.
+ *
+ * @param context context.
+ * @param token The number token.
+ * @param text The text of the token.
+ *
+ * @return Nonzero on success, zero if an integer literal is too large. Positive literals
+ *      must fit in 64 bits unsigned, negative ones in 64 bits signed.
+ */
+static int addNumber(struct LexerContext *context, struct LEX_LexerToken *token, const char *text)
+{
+    struct LEX_LexerResult *result = context->result;
+    struct LEX_Number number;
+
+    if (token->tokenType == LEX_FLOAT_NUMBER)
     {
-        addToBinaryString(context, 0xF8 | ((ch & 0x03000000) >> 24) );
-        addToBinaryString(context, 0x80 | ((ch & 0x00FC0000) >> 18) );
-        addToBinaryString(context, 0x80 | ((ch & 0x0003F000) >> 12) );
-        addToBinaryString(context, 0x80 | ((ch & 0x00000FC0) >> 6) );
-        addToBinaryString(context, 0x80 | (ch & 0x0000003F) );
+        // strtod needs a terminated string.
+        char buffer[64];
+        char *copy = token->length < sizeof(buffer) ? buffer : malloc(token->length + 1);
+        memcpy(copy, text, token->length);
+        copy[token->length] = 0;
+        number.real = strtod(copy, 0);
+        if (copy != buffer) free(copy);
     }
-    else if (ch < (1 << 31))
+    else
     {
-        addToBinaryString(context, 0xFC | ((ch & 0xC0000000) >> 30) );
-        addToBinaryString(context, 0x80 | ((ch & 0x3F000000) >> 24) );
-        addToBinaryString(context, 0x80 | ((ch & 0x00FC0000) >> 18) );
-        addToBinaryString(context, 0x80 | ((ch & 0x0003F000) >> 12) );
-        addToBinaryString(context, 0x80 | ((ch & 0x00000FC0) >> 6) );
-        addToBinaryString(context, 0x80 | (ch & 0x0000003F) );
+        int isNegative = *text == '-';
+        int prefixLength = isNegative + (token->tokenType == LEX_HEXA_INTEGER ? 2 : 0);
+        uint64_t magnitude;
+        if (!decodeMagnitude(text + prefixLength, token->length - prefixLength, token->tokenType, &magnitude))
+        {
+            return 0;
+        }
+        if (isNegative && (magnitude > (uint64_t)1 << 63)) return 0;
+        number.integer = isNegative ? 0 - magnitude : magnitude;
     }
+    number.text =
+        (result->source && !context->isSourceEdited) ? text : copyToTextArena(result, text, token->length);
+    *appendNumber(context, &token->value) = number;
+    return 1;
 }
 
 /**
- * Turns string literals to the binary form.
+ * Scans the next token from the source.
+ *
+ * Every character costs one class lookup and one transition in the automaton
+ * described by the transitions table. A token ends when there is no transition
+ * on the current character.
+ *
+ * If the input is not finished yet and the scanning reaches the end of the received
+ * input, the token may continue in the next chunk. Then the state of the automaton is
+ * saved and the scanning is resumed from there when more input arrives.
  *
  * @param context context.
+ * @param [out] token The scanned token.
+ *
+ * @return The scan status.
  */
-static void createBinaryStrings(struct LexerContext *context)
+static enum ScanStatus scanRawToken(struct LexerContext *context, struct LEX_LexerToken *token)
 {
-    int i;
-    // For each token.
-    for (i = 0; i < context->tokenCount; i++)
+    enum LexerState state;
+    enum LEX_TokenType type;
+    const char *start;
+
+    if (context->isFinished) return SCAN_END;
+
+    if (context->partialState != LS_NONE)
     {
-        struct LEX_LexerToken *token;
-        const char *c;
-        int inString = 0;
-        int inCharacter = 0;
-        int characterCode = 0;
+        // Continue the token interrupted by the end of the previous input.
+        start = getSourcePointer(context, context->partialOffset);
+        state = context->partialState;
+        context->partialState = LS_NONE;
+    }
+    else
+    {
+        // Ignore any whitespace.
+        runAutomaton(context, LS_WHITESPACE);
+        if (!context->isInputFinished && (context->current == context->windowEnd))
+        {
+            return SCAN_NEED_INPUT;
+        }
 
-        token = &context->result->tokens[i];
-        if (token->tokenType != LEX_STRING) continue;
-        // At this point the current token is string.
-        createBinaryString(context);
-        for (c = token->start; c != token->start + token->length; c++)
+        start = context->current;
+        state = transitions[LS_START][characterClasses[(unsigned char)*start]];
+        if (state == LS_NONE)
         {
-            if (*c == '\"')
-            {
-                // " is the delimiter of strings. Switches inString mode.
-                inString = !inString;
-                continue;
-            }
-            if (inString)
-            {
-                // We are in string, add the the character to the binary form.
-                addToBinaryString(context, *c);
-            }
-            else
+            context->isFinished = 1;
+            if (*start || (context->windowEnd && (start != context->windowEnd)))
             {
-                // We are not in string.
-                if (inCharacter)
-                {
-                    // if we are in a character literal.
-                    if (('0' <= *c) && (*c <= '9'))
-                    {
-                        // Read a digit. Add it to the character code.
-                        characterCode *= 10;
-                        characterCode += *c - '0';
-                    }
-                    else
-                    {
-                        // Read a non-digit. Finish character reading. Save the character.
-                        inCharacter = 0;
-                        addUtf8CharacterToBinaryString(context, characterCode);
-                    }
-                }
-                if (!inCharacter)
-                {
-                    // Not in character reading mode
-                    if (*c == '#')
-                    {
-                        // If read # enter character reading mode.
-                        inCharacter = 1;
-                        characterCode = 0;
-                    }
-                }
+                raiseLexerError(context, E_LEX_INVALID_CHARACTER);
             }
+            return SCAN_END;
         }
-        if (inCharacter)
+        context->current++;
+    }
+    state = runAutomaton(context, state);
+    if (!context->isInputFinished && (context->current == context->windowEnd))
+    {
+        context->partialState = state;
+        context->partialOffset = context->windowOffset + (start - context->windowStart);
+        return SCAN_NEED_INPUT;
+    }
+    type = acceptedTokenTypes[state];
+    if (type == LEX_UNKNOWN)
+    {
+        context->isFinished = 1;
+        raiseLexerError(context, stateErrors[state]);
+        return SCAN_END;
+    }
+    token->offset = context->windowOffset + (start - context->windowStart);
+    token->length = context->current - start;
+    token->value = 0;
+    if (type == LEX_IDENTIFIER)
+    {
+        // Set token type if the current token is a keyword.
+        type = lookUpKeyword(start, token->length);
+        if (type == LEX_IDENTIFIER)
         {
-            // If we are in character reading mode after finished reading
-            // the string, save the character.
-            addUtf8CharacterToBinaryString(context, characterCode);
+            token->value = internSymbol(context, start, token->length);
         }
-        // Finished the binary string, save it the token.
-        finalizeBinaryString(context, &token->start, &token->length);
     }
+    token->tokenType = type;
+    if (isNumberToken(type) && !addNumber(context, token, start))
+    {
+        // The error and the end of the tokens are at the start of the literal.
+        context->current = start;
+        context->isFinished = 1;
+        raiseLexerError(context, E_LEX_INTEGER_TOO_LARGE);
+        return SCAN_END;
+    }
+    return SCAN_TOKEN;
 }
 
-struct LEX_LexerResult LEX_tokenizeString(const char *code)
+void LEX_cleanUpLexerResult(struct LEX_LexerResult *lexerResult)
 {
-    struct LEX_LexerResult lexerResult;
-    struct LexerContext lexerContext;
-
-    lexerResult.tokenCount = 0;
-    lexerResult.stringCount = 0;
-    lexerResult.tokens = 0;
-    lexerResult.strings = 0;
+    struct LEX_TextBlock *block = lexerResult->textBlocks;
 
-    lexerContext.current = code;
-    lexerContext.result = &lexerResult;
-    lexerContext.tokensAllocated = 0;
-    lexerContext.tokenCount = 0;
-    lexerContext.currentColumn = 1;
-    lexerContext.lfCount = 1;
-    lexerContext.crCount = 1;
-    lexerContext.currentToken = 0;
-    lexerContext.stringsAllocated = 0;
-    lexerContext.currentStringAllocated = 0;
-    lexerContext.currentStringLength = 0;
-
-    doTokenization(&lexerContext);
+    free(lexerResult->strings);
+    if (!lexerResult->isMapped)
+    {
+        free(lexerResult->tokens);
+        free(lexerResult->lineStarts);
+        free(lexerResult->docComments);
+    }
+    free(lexerResult->texts);
+    free(lexerResult->symbols);
+    free(lexerResult->numbers);
+    if (lexerResult->relexState)
+    {
+        free(lexerResult->relexState->context.symbolSlots);
+        free(lexerResult->relexState->context.stringSlots);
+        free(lexerResult->relexState->context.currentString);
+        free(lexerResult->relexState->source);
+        free(lexerResult->relexState->addedLines);
+        free(lexerResult->relexState->addedDocComments);
+        free(lexerResult->relexState);
+    }
+    while (block)
+    {
+        struct LEX_TextBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+}
 
-    mergeAdjacentStrings(&lexerContext);
+/**
+ * Returns nonzero if the text of the tokens of the given type is saved by the lexers
+ * fed in chunks. Strings have binary strings, identifiers have symbol names, numbers
+ * save their text with their values, the end of file has no text.
+ *
+ * @param tokenType The type of the token.
+ *
+ * @return Nonzero if the text is saved.
+ */
+static int isTextSaved(enum LEX_TokenType tokenType)
+{
+    return
+        (tokenType != LEX_STRING) &&
+        (tokenType != LEX_IDENTIFIER) &&
+        !isNumberToken(tokenType) &&
+        (tokenType != LEX_SPEC_EOF);
+}
 
-    createBinaryStrings(&lexerContext);
+/**
+ * Copies the text of the token into the text arena. The token's value is set to the
+ * index of the saved text.
+ *
+ * @param context context.
+ * @param token The token.
+ */
+static void saveTokenText(struct LexerContext *context, struct LEX_LexerToken *token)
+{
+    struct LEX_LexerResult *result = context->result;
+    const char *text = copyToTextArena(
+        result,
+        getSourcePointer(context, token->offset),
+        token->length);
 
-    startNewToken(&lexerContext, LEX_SPEC_EOF);
-    finishCurrentToken(&lexerContext);
+    if (result->textCount == context->textsAllocated)
+    {
+        context->textsAllocated = context->textsAllocated ? context->textsAllocated << 1 : 64;
+        result->texts = realloc(result->texts, context->textsAllocated * sizeof(*result->texts));
+    }
+    result->texts[result->textCount] = text;
+    token->value = result->textCount++;
+}
+
+/**
+ * Doubles the string hash table.
+ *
+ * @param context context.
+ */
+static void growStringSlots(struct LexerContext *context)
+{
+    const struct LEX_BinaryString *strings = context->result->strings;
+    unsigned *oldSlots = context->stringSlots;
+    int oldSlotCount = context->stringSlotCount;
+    int mask;
+    int i;
+
+    context->stringSlotCount <<= 1;
+    mask = context->stringSlotCount - 1;
+    context->stringSlots = calloc(context->stringSlotCount, sizeof(*context->stringSlots));
+    for (i = 0; i < oldSlotCount; i++)
+    {
+        if (oldSlots[i])
+        {
+            const struct LEX_BinaryString *string = &strings[oldSlots[i] - 1];
+            unsigned slot = hashName(string->bytes, string->length) & mask;
+            while (context->stringSlots[slot])
+            {
+                slot = (slot + 1) & mask;
+            }
+            context->stringSlots[slot] = oldSlots[i];
+        }
+    }
+    free(oldSlots);
+}
+
+/**
+ * Appends a binary string to the strings of the result.
+ *
+ * The bytes are copied into the text arena, unless an identical string is already
+ * there. Then the bytes of that string are shared.
+ *
+ * @param context context.
+ * @param bytes The bytes of the string.
+ * @param length The length of the string.
+ *
+ * @return The index of the new string.
+ */
+static unsigned addBinaryString(struct LexerContext *context, const char *bytes, int length)
+{
+    struct LEX_LexerResult *result = context->result;
+    int mask = context->stringSlotCount - 1;
+    unsigned slot = hashName(bytes, length) & mask;
+    const char *pooledBytes = 0;
+    unsigned index;
+
+    while (context->stringSlots[slot])
+    {
+        const struct LEX_BinaryString *string = &result->strings[context->stringSlots[slot] - 1];
+        if ((string->length == length) && !memcmp(string->bytes, bytes, length))
+        {
+            pooledBytes = string->bytes;
+            break;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    if (result->stringCount == context->stringsAllocated)
+    {
+        context->stringsAllocated = context->stringsAllocated ? context->stringsAllocated << 1 : 64;
+        result->strings = realloc(result->strings, context->stringsAllocated * sizeof(*result->strings));
+    }
+    index = result->stringCount++;
+    result->strings[index].length = length;
+    if (pooledBytes)
+    {
+        result->strings[index].bytes = pooledBytes;
+        return index;
+    }
+    result->strings[index].bytes = copyToTextArena(result, bytes, length);
+    context->stringSlots[slot] = index + 1;
+    context->distinctStringCount++;
+    if (context->distinctStringCount * 2 > context->stringSlotCount)
+    {
+        growStringSlots(context);
+    }
+    return index;
+}
+
+/**
+ * Makes room at the end of the current binary string.
+ *
+ * @param context context.
+ * @param length The count of bytes to make room for.
+ *
+ * @return Pointer to the room. The length of the string is not changed.
+ */
+static char *reserveBinaryString(struct LexerContext *context, int length)
+{
+    if (context->currentStringLength + length > context->currentStringAllocated)
+    {
+        do
+        {
+            context->currentStringAllocated = context->currentStringAllocated ? context->currentStringAllocated << 1 : 256;
+        }
+        while (context->currentStringLength + length > context->currentStringAllocated);
+        context->currentString = realloc(context->currentString, context->currentStringAllocated * sizeof(*context->currentString));
+    }
+    return context->currentString + context->currentStringLength;
+}
+
+/**
+ * Adds bytes to the current binary string.
+ *
+ * @param context context.
+ * @param bytes The bytes to add.
+ * @param length The count of bytes.
+ */
+static void addBytesToBinaryString(struct LexerContext *context, const char *bytes, int length)
+{
+    memcpy(reserveBinaryString(context, length), bytes, length);
+    context->currentStringLength += length;
+}
+
+/**
+ * Encodes a character in UTF-8. The codes above 0x10FFFF are encoded in the original 5
+ * and 6 byte forms of UTF-8.
+ *
+ * @param code The unicode code of the character.
+ * @param [out] bytes The encoding. Room for 6 bytes.
+ *
+ * @return The length of the encoding. Zero if the code has more than 31 bits.
+ */
+static int encodeUtf8Character(unsigned code, char *bytes)
+{
+    static const unsigned char leadBits[7] = {0, 0, 0xC0, 0xE0, 0xF0, 0xF8, 0xFC};
+    int length;
+    int i;
+
+    if (code < (1u << 7))
+    {
+        bytes[0] = code;
+        return 1;
+    }
+    length =
+        code < (1u << 11) ? 2 :
+        code < (1u << 16) ? 3 :
+        code < (1u << 21) ? 4 :
+        code < (1u << 26) ? 5 :
+        code < (1u << 31) ? 6 : 0;
+    if (!length) return 0;
+    for (i = length - 1; i > 0; i--)
+    {
+        bytes[i] = 0x80 | (code & 0x3F);
+        code >>= 6;
+    }
+    bytes[0] = leadBits[length] | code;
+    return length;
+}
+
+/**
+ * Adds an UTF-8 character to the current binary string. The length of the encoding is
+ * computed first, then the bytes are written in place.
+ *
+ * @param context context.
+ * @param ch The unicode code of the character to add
+ *
+ */
+static void addUtf8CharacterToBinaryString(struct LexerContext *context, int ch)
+{
+    context->currentStringLength += encodeUtf8Character(ch, reserveBinaryString(context, 6));
+}
+
+/**
+ * Adds the binary form of a string or character literal to the current binary string.
+ * The bytes between the quotes of the strings are added as is, the character
+ * literals are UTF-8 encoded.
+ *
+ * @param context context.
+ * @param token A raw LEX_STRING or LEX_CHARACTER token.
+ */
+static void addLiteralToBinaryString(struct LexerContext *context, const struct LEX_LexerToken *token)
+{
+    const char *text = getSourcePointer(context, token->offset);
+
+    if (token->tokenType == LEX_STRING)
+    {
+        addBytesToBinaryString(context, text + 1, token->length - 2);
+    }
+    else
+    {
+        // Skip the # and read the decimal character code.
+        int characterCode = 0;
+        unsigned i;
+        for (i = 1; i < token->length; i++)
+        {
+            characterCode *= 10;
+            characterCode += text[i] - '0';
+        }
+        addUtf8CharacterToBinaryString(context, characterCode);
+    }
+}
+
+/**
+ * Appends a line start to the line table.
+ *
+ * @param context context.
+ * @param offset The offset of the line start.
+ */
+static void addLineStart(struct LexerContext *context, int offset)
+{
+    struct LEX_LexerResult *result = context->result;
+    if (result->lineCount == context->linesAllocated)
+    {
+        context->linesAllocated *= 2;
+        result->lineStarts = realloc(result->lineStarts, context->linesAllocated * sizeof(*result->lineStarts));
+    }
+    result->lineStarts[result->lineCount++] = offset;
+}
+
+/**
+ * Adds the line starts of a part of the source to the line table. The parts must be
+ * added in order, the line table is built as the source arrives.
+ *
+ * LF, CR, CR LF and LF CR are all single line breaks, so the usual line ending
+ * conventions are counted right, even if a pair is split between two parts.
+ *
+ * @param context context.
+ * @param begin The first character of the part.
+ * @param end The end of the part. If null, the part ends with the terminating zero.
+ */
+static void addLineStarts(struct LexerContext *context, const char *begin, const char *end)
+{
+    const char *current = begin;
+
+    if (!*current) return;
+    if (context->lastLineBreak && (*current == (context->lastLineBreak ^ ('\n' ^ '\r'))))
+    {
+        // The second half of a pair: the line starts after it.
+        context->result->lineStarts[context->result->lineCount - 1]++;
+        current++;
+    }
+    context->lastLineBreak = 0;
+    for (;;)
+    {
+        // A line has the same characters as the body of an EOL comment.
+        current = context->skipRun(current, RUN_EOL_COMMENT);
+        while (*current && (*current != '\n') && (*current != '\r'))
+        {
+            current++;
+        }
+        if (!*current || (end && (current >= end))) break;
+        if (((current[1] == '\n') || (current[1] == '\r')) && (current[1] != current[0]))
+        {
+            current++;
+        }
+        else if (!current[1])
+        {
+            context->lastLineBreak = *current;
+        }
+        current++;
+        addLineStart(context, context->windowOffset + (current - context->windowStart));
+    }
+}
+
+const char *LEX_getTokenText(
+    const struct LEX_LexerResult *lexerResult,
+    const struct LEX_LexerToken *token,
+    int *length)
+{
+    if (token->tokenType == LEX_STRING)
+    {
+        const struct LEX_BinaryString *string = &lexerResult->strings[token->value];
+        *length = string->length;
+        return string->bytes;
+    }
+    if (token->tokenType == LEX_IDENTIFIER)
+    {
+        const struct LEX_Symbol *symbol = &lexerResult->symbols[token->value];
+        *length = symbol->length;
+        return symbol->name;
+    }
+    if (isNumberToken(token->tokenType))
+    {
+        *length = token->length;
+        return lexerResult->numbers[token->value].text;
+    }
+    if (lexerResult->source)
+    {
+        *length = token->length;
+        return lexerResult->source + token->offset;
+    }
+    if (!isTextSaved(token->tokenType))
+    {
+        *length = 0;
+        return "";
+    }
+    *length = token->length;
+    return lexerResult->texts[token->value];
+}
+
+void LEX_getPosition(const struct LEX_LexerResult *lexerResult, int offset, int *line, int *column)
+{
+    // Find the last line starting before or at the offset.
+    int left = 0;
+    int right = lexerResult->lineCount - 1;
+    while (left < right)
+    {
+        int middle = (left + right + 1) >> 1;
+        if (lexerResult->lineStarts[middle] <= offset)
+        {
+            left = middle;
+        }
+        else
+        {
+            right = middle - 1;
+        }
+    }
+    *line = left + 1;
+    *column = offset - lexerResult->lineStarts[left] + 1;
+}
+
+/**
+ * Appends a documentation comment to the side table of the result. It will belong to
+ * the next token returned.
+ *
+ * @param context context.
+ * @param token The comment token.
+ */
+static void addDocComment(struct LexerContext *context, struct LEX_LexerToken *token)
+{
+    struct LEX_LexerResult *result = context->result;
+
+    if (!result->source)
+    {
+        saveTokenText(context, token);
+    }
+    if (result->docCommentCount == context->docCommentsAllocated)
+    {
+        context->docCommentsAllocated = context->docCommentsAllocated ? context->docCommentsAllocated << 1 : 64;
+        result->docComments = realloc(
+            result->docComments,
+            context->docCommentsAllocated * sizeof(*result->docComments));
+    }
+    result->docComments[result->docCommentCount].token = *token;
+    result->docComments[result->docCommentCount].tokenIndex = context->tokenIndex;
+    result->docCommentCount++;
+}
+
+/**
+ * Scans the next token into the given slot. Comments are skipped, the documentation
+ * comments are put into the side table. Adjacent strings and character literals
+ * are merged into a single string token, and the string tokens are turned into the
+ * binary form. After the last token LEX_SPEC_EOF tokens are returned.
+ *
+ * @param context context.
+ * @param [out] token The next token.
+ *
+ * @return Nonzero if the token is scanned, zero if more input is needed.
+ */
+static int scanToken(struct LexerContext *context, struct LEX_LexerToken *token)
+{
+    int isSeriesResumed = context->isInSeries;
+
+    for (;;)
+    {
+        if (context->isInSeries)
+        {
+            // Continue merging the series interrupted by the end of the input.
+            *token = context->seriesToken;
+            context->isInSeries = 0;
+        }
+        else if (context->hasPendingToken)
+        {
+            *token = context->pendingToken;
+            context->hasPendingToken = 0;
+        }
+        else
+        {
+            enum ScanStatus status = scanRawToken(context, token);
+            if (status == SCAN_NEED_INPUT) return 0;
+            if (status == SCAN_END)
+            {
+                token->offset = context->windowOffset + (context->current - context->windowStart);
+                token->length = 0;
+                token->value = 0;
+                token->tokenType = LEX_SPEC_EOF;
+                LEX_getPosition(
+                    context->result,
+                    token->offset,
+                    &context->result->linePos,
+                    &context->result->columnPos);
+                context->tokenIndex++;
+                return 1;
+            }
+        }
+        if (!isCommentToken(token->tokenType)) break;
+        if ((token->tokenType != LEX_BLOCK_COMMENT) && (token->tokenType != LEX_EOL_COMMENT))
+        {
+            addDocComment(context, token);
+        }
+    }
+    if ((token->tokenType == LEX_STRING) || (token->tokenType == LEX_CHARACTER))
+    {
+        // Merge the following strings and characters. The first token
+        // which is not a string is kept for the next call.
+        // The literals are decoded while they are scanned.
+        struct LEX_LexerToken *next = &context->pendingToken;
+        enum ScanStatus status;
+        if (!isSeriesResumed)
+        {
+            context->currentStringLength = 0;
+            addLiteralToBinaryString(context, token);
+        }
+        while ((status = scanRawToken(context, next)) == SCAN_TOKEN)
+        {
+            if ((next->tokenType != LEX_STRING) && (next->tokenType != LEX_CHARACTER))
+            {
+                context->hasPendingToken = 1;
+                break;
+            }
+            token->length = next->offset + next->length - token->offset;
+            addLiteralToBinaryString(context, next);
+        }
+        if (status == SCAN_NEED_INPUT)
+        {
+            context->seriesToken = *token;
+            context->isInSeries = 1;
+            return 0;
+        }
+        if (token->tokenType == LEX_STRING)
+        {
+            token->value = addBinaryString(context, context->currentString, context->currentStringLength);
+        }
+    }
+    if (!context->result->source && isTextSaved(token->tokenType))
+    {
+        saveTokenText(context, token);
+    }
+    context->tokenIndex++;
+    return 1;
+}
+
+/**
+ * Creates a lexer with empty result.
+ *
+ * @return The lexer.
+ */
+static struct LEX_Lexer *createLexer(void)
+{
+    struct LEX_Lexer *lexer = malloc(sizeof(struct LEX_Lexer));
+    struct LexerContext *context = &lexer->context;
+
+    lexer->result.tokenCount = 0;
+    lexer->result.tokens = 0;
+    lexer->result.linePos = 1;
+    lexer->result.columnPos = 1;
+    lexer->result.strings = 0;
+    lexer->result.stringCount = 0;
+    lexer->result.source = 0;
+    lexer->result.texts = 0;
+    lexer->result.textCount = 0;
+    lexer->result.textBlocks = 0;
+    lexer->ringStart = 0;
+    lexer->ringCount = 0;
+    lexer->window = 0;
+    lexer->windowAllocated = 0;
+    lexer->inputCallback = 0;
+    lexer->inputUserData = 0;
+    lexer->hasDeferredError = 0;
+
+    context->result = &lexer->result;
+    context->hasPendingToken = 0;
+    context->isInSeries = 0;
+    context->partialState = LS_NONE;
+    context->isFinished = 0;
+    context->error = E_OK;
+    context->isQuiet = 0;
+    context->stringsAllocated = 0;
+    context->currentString = 0;
+    context->currentStringAllocated = 0;
+    context->currentStringLength = 0;
+    context->stringSlotCount = 256;
+    context->stringSlots = calloc(context->stringSlotCount, sizeof(*context->stringSlots));
+    context->distinctStringCount = 0;
+    context->skipRun = selectSkipRunFunction();
+    context->findInvalidUtf8 = selectFindInvalidUtf8Function();
+    context->utf8CarryLength = 0;
+    context->textsAllocated = 0;
+    context->symbolSlotCount = 1024;
+    context->symbolSlots = calloc(context->symbolSlotCount, sizeof(*context->symbolSlots));
+    // Symbol id 0 is reserved, it means no symbol.
+    context->symbolsAllocated = 256;
+    lexer->result.symbols = malloc(context->symbolsAllocated * sizeof(*lexer->result.symbols));
+    lexer->result.symbols[0].name = "";
+    lexer->result.symbols[0].length = 0;
+    lexer->result.symbolCount = 1;
+    lexer->result.numbers = 0;
+    lexer->result.numberCount = 0;
+    context->numbersAllocated = 0;
+    lexer->result.docComments = 0;
+    lexer->result.docCommentCount = 0;
+    context->docCommentsAllocated = 0;
+    context->tokenIndex = 0;
+    context->windowOffset = 0;
+    context->windowEnd = 0;
+    context->lastLineBreak = 0;
+    context->isSourceEdited = 0;
+    lexer->result.relexState = 0;
+    lexer->result.isMapped = 0;
+    lexer->isReplaying = 0;
+    lexer->replayIndex = 0;
+
+    context->linesAllocated = 64;
+    lexer->result.lineStarts = malloc(context->linesAllocated * sizeof(*lexer->result.lineStarts));
+    lexer->result.lineCount = 0;
+    addLineStart(context, 0);
+
+    return lexer;
+}
+
+/**
+ * Stops the lexer on an ill-formed UTF-8 sequence. The tokens before it which are not
+ * returned yet are dropped.
+ *
+ * @param context context.
+ * @param invalid The ill-formed sequence.
+ */
+static void stopOnInvalidUtf8(struct LexerContext *context, const char *invalid)
+{
+    if (context->isFinished) return;
+    context->current = invalid;
+    context->partialState = LS_NONE;
+    context->isFinished = 1;
+    raiseLexerError(context, E_LEX_INVALID_UTF8);
+}
+
+/**
+ * Checks that the source is UTF-8. If it's not, the lexer stops with an error.
+ *
+ * @param context context.
+ * @param begin The first byte to check.
+ * @param end The end of the bytes to check.
+ */
+static void checkUtf8(struct LexerContext *context, const char *begin, const char *end)
+{
+    const char *invalid = context->findInvalidUtf8(begin, end);
+
+    if (invalid != end)
+    {
+        stopOnInvalidUtf8(context, invalid);
+    }
+}
+
+/**
+ * Checks that a part of a source fed in chunks is UTF-8. The sequence cut by the end of
+ * the part is checked when the rest arrives.
+ *
+ * @param context context.
+ * @param begin The first byte of the part.
+ * @param end The end of the part.
+ */
+static void checkUtf8Part(struct LexerContext *context, const char *begin, const char *end)
+{
+    const char *rest = begin;
+    const char *cut;
+
+    if (context->utf8CarryLength)
+    {
+        // Complete the sequence cut by the end of the previous part.
+        unsigned char lead = context->utf8Carry[0];
+        int length = lead < 0xE0 ? 2 : lead < 0xF0 ? 3 : 4;
+        while ((context->utf8CarryLength < length) && (rest < end))
+        {
+            context->utf8Carry[context->utf8CarryLength++] = *rest++;
+        }
+        if (context->utf8CarryLength < length) return;
+        context->utf8CarryLength = 0;
+        if (getUtf8SequenceLength(context->utf8Carry, context->utf8Carry + length) != length)
+        {
+            stopOnInvalidUtf8(context, begin);
+            return;
+        }
+    }
+
+    // Find the start of the last sequence. If it's longer than the rest of the part,
+    // it's carried.
+    cut = end;
+    while ((cut > rest) && (end - cut < 3) && ((cut[-1] & 0xC0) == 0x80))
+    {
+        cut--;
+    }
+    if (cut > rest)
+    {
+        unsigned char lead = cut[-1];
+        int length = lead < 0xC2 ? 1 : lead < 0xE0 ? 2 : lead < 0xF0 ? 3 : lead < 0xF5 ? 4 : 1;
+        cut = cut - 1 + length > end ? cut - 1 : end;
+    }
+    else
+    {
+        cut = end;
+    }
+    memcpy(context->utf8Carry, cut, end - cut);
+    context->utf8CarryLength = end - cut;
+    checkUtf8(context, rest, cut);
+}
+
+struct LEX_Lexer *LEX_createLexer(const char *code)
+{
+    return LEX_createBufferLexer(code, code + strlen(code));
+}
+
+struct LEX_Lexer *LEX_createBufferLexer(const char *begin, const char *end)
+{
+    struct LEX_Lexer *lexer = createLexer();
+    struct LexerContext *context = &lexer->context;
+
+    lexer->result.source = begin;
+    context->current = begin;
+    context->windowStart = begin;
+    context->windowEnd = end;
+    context->isInputFinished = 1;
+    addLineStarts(context, begin, end);
+    context->isQuiet = 1;
+    checkUtf8(context, begin, end);
+    context->isQuiet = 0;
+    if (context->isFinished)
+    {
+        lexer->hasDeferredError = 1;
+        lexer->deferredErrorOffset = context->current - begin;
+    }
+
+    return lexer;
+}
+
+struct LEX_Lexer *LEX_createChunkedLexer(LEX_InputCallback inputCallback, void *userData)
+{
+    struct LEX_Lexer *lexer = createLexer();
+    struct LexerContext *context = &lexer->context;
+
+    lexer->inputCallback = inputCallback;
+    lexer->inputUserData = userData;
+    lexer->windowAllocated = 1;
+    lexer->window = malloc(lexer->windowAllocated);
+    lexer->window[0] = 0;
+    context->current = lexer->window;
+    context->windowStart = lexer->window;
+    context->windowEnd = lexer->window;
+    context->isInputFinished = 0;
+
+    return lexer;
+}
+
+void LEX_feed(struct LEX_Lexer *lexer, const char *buffer, int length)
+{
+    struct LexerContext *context = &lexer->context;
+    // Only the unscanned input is kept: the token or series of strings being
+    // scanned and the token after a series of strings if it's not returned yet.
+    const char *keep = context->current;
+    int kept;
+    int currentIndex;
+
+    assert(!context->isInputFinished);
+    if (context->isInSeries)
+    {
+        keep = getSourcePointer(context, context->seriesToken.offset);
+    }
+    else if (context->hasPendingToken)
+    {
+        keep = getSourcePointer(context, context->pendingToken.offset);
+    }
+    else if (context->partialState != LS_NONE)
+    {
+        keep = getSourcePointer(context, context->partialOffset);
+    }
+    kept = context->windowEnd - keep;
+    currentIndex = context->current - keep;
+    context->windowOffset += keep - lexer->window;
+    memmove(lexer->window, keep, kept);
+    if (kept + length + 1 > lexer->windowAllocated)
+    {
+        lexer->windowAllocated = lexer->windowAllocated * 2 > kept + length + 1 ?
+            lexer->windowAllocated * 2 :
+            kept + length + 1;
+        lexer->window = realloc(lexer->window, lexer->windowAllocated);
+    }
+    memcpy(lexer->window + kept, buffer, length);
+    lexer->window[kept + length] = 0;
+
+    context->windowStart = lexer->window;
+    context->windowEnd = lexer->window + kept + length;
+    context->current = lexer->window + currentIndex;
+    addLineStarts(context, lexer->window + kept, 0);
+    checkUtf8Part(context, lexer->window + kept, context->windowEnd);
+}
+
+void LEX_finish(struct LEX_Lexer *lexer)
+{
+    struct LexerContext *context = &lexer->context;
+
+    context->isInputFinished = 1;
+    if (context->utf8CarryLength)
+    {
+        // The source ends in the middle of a sequence.
+        stopOnInvalidUtf8(context, context->windowEnd);
+    }
+}
+
+const char *LEX_saveText(struct LEX_Lexer *lexer, const char *text, int length)
+{
+    return copyToTextArena(&lexer->result, text, length);
+}
+
+struct LEX_Lexer *LEX_createResultLexer(const struct LEX_LexerResult *lexerResult)
+{
+    struct LEX_Lexer *lexer = createLexer();
+
+    LEX_cleanUpLexerResult(&lexer->result);
+    lexer->result = *lexerResult;
+    lexer->isReplaying = 1;
+
+    return lexer;
+}
+
+/**
+ * Gets the next token of the source. It's scanned, or taken from the replayed result.
+ *
+ * @param lexer The lexer.
+ * @param token Receives the token.
+ *
+ * @return Nonzero on success. Zero if more input is needed and there is no input callback.
+ */
+static int produceToken(struct LEX_Lexer *lexer, struct LEX_LexerToken *token)
+{
+    if (lexer->isReplaying)
+    {
+        // The end of file is returned again after the last token.
+        *token = lexer->result.tokens[lexer->replayIndex];
+        if (lexer->replayIndex < lexer->result.tokenCount - 1) lexer->replayIndex++;
+        return 1;
+    }
+    if (lexer->hasDeferredError)
+    {
+        lexer->hasDeferredError = 0;
+        ERR_raiseErrorAt(lexer->context.error, lexer->deferredErrorOffset, -1);
+    }
+    while (!scanToken(&lexer->context, token))
+    {
+        if (!lexer->inputCallback) return 0;
+        lexer->inputCallback(lexer, lexer->inputUserData);
+    }
+    return 1;
+}
+
+const struct LEX_LexerToken *LEX_nextToken(struct LEX_Lexer *lexer)
+{
+    struct LEX_LexerToken *token = &lexer->ring[lexer->ringStart];
+    if (lexer->ringCount)
+    {
+        lexer->ringCount--;
+    }
+    else if (!produceToken(lexer, token))
+    {
+        return 0;
+    }
+    lexer->ringStart = (lexer->ringStart + 1) & (TOKEN_RING_SIZE - 1);
+    return token;
+}
+
+const struct LEX_LexerToken *LEX_peekToken(struct LEX_Lexer *lexer, int ahead)
+{
+    assert(ahead >= 0);
+    assert(ahead < TOKEN_RING_SIZE / 2);
+    while (lexer->ringCount <= ahead)
+    {
+        if (!produceToken(lexer, &lexer->ring[(lexer->ringStart + lexer->ringCount) & (TOKEN_RING_SIZE - 1)]))
+        {
+            return 0;
+        }
+        lexer->ringCount++;
+    }
+    return &lexer->ring[(lexer->ringStart + ahead) & (TOKEN_RING_SIZE - 1)];
+}
+
+const struct LEX_LexerResult *LEX_getLexerResult(const struct LEX_Lexer *lexer)
+{
+    return &lexer->result;
+}
+
+/**
+ * Frees the lexer but not its result.
+ *
+ * @param lexer The lexer.
+ */
+static void freeLexer(struct LEX_Lexer *lexer)
+{
+    free(lexer->context.symbolSlots);
+    free(lexer->context.stringSlots);
+    free(lexer->context.currentString);
+    free(lexer->window);
+    free(lexer);
+}
+
+void LEX_destroyLexer(struct LEX_Lexer *lexer)
+{
+    if (!lexer->isReplaying) LEX_cleanUpLexerResult(&lexer->result);
+    freeLexer(lexer);
+}
+struct LEX_LexerResult LEX_tokenizeString(const char *code)
+{
+    return LEX_tokenizeBuffer(code, code + strlen(code));
+}
+
+struct LEX_LexerResult LEX_tokenizeBuffer(const char *begin, const char *end)
+{
+    struct LEX_Lexer *lexer = LEX_createBufferLexer(begin, end);
+    struct LEX_LexerResult lexerResult;
+    int tokensAllocated = 10;
+    const struct LEX_LexerToken *token;
+
+    lexerResult = lexer->result;
+    lexerResult.tokens = malloc(tokensAllocated * sizeof(struct LEX_LexerToken));
+    do
+    {
+        token = LEX_nextToken(lexer);
+        if (lexerResult.tokenCount == tokensAllocated)
+        {
+            tokensAllocated *= 2;
+            lexerResult.tokens =
+                realloc(lexerResult.tokens, tokensAllocated * sizeof(struct LEX_LexerToken));
+        }
+        lexerResult.tokens[lexerResult.tokenCount++] = *token;
+    }
+    while (token->tokenType != LEX_SPEC_EOF);
+
+    // The strings, the arena and the line table are moved to the result.
+    lexerResult.strings = lexer->result.strings;
+    lexerResult.stringCount = lexer->result.stringCount;
+    lexerResult.textBlocks = lexer->result.textBlocks;
+    lexerResult.lineStarts = lexer->result.lineStarts;
+    lexerResult.lineCount = lexer->result.lineCount;
+    lexerResult.symbols = lexer->result.symbols;
+    lexerResult.symbolCount = lexer->result.symbolCount;
+    lexerResult.numbers = lexer->result.numbers;
+    lexerResult.numberCount = lexer->result.numberCount;
+    lexerResult.docComments = lexer->result.docComments;
+    lexerResult.docCommentCount = lexer->result.docCommentCount;
+    lexerResult.linePos = lexer->result.linePos;
+    lexerResult.columnPos = lexer->result.columnPos;
+    freeLexer(lexer);
+
+    return lexerResult;
+}
+
+/**
+ * The minimum size of the chunks of the parallel lexer. Shorter sources are lexed on
+ * fewer threads.
+ */
+#define MIN_PARALLEL_CHUNK_SIZE (1 << 20)
+
+/**
+ * A chunk of the source lexed by the parallel lexer, or a part of a chunk lexed again
+ * after the chunk started at a wrong place.
+ */
+struct ParallelChunk
+{
+    /// The lexer of the chunk. Its result holds the binary strings and the line starts.
+    struct LEX_Lexer *lexer;
+    unsigned begin; ///< Offset of the first character of the chunk.
+    unsigned end; ///< Offset after the last character of the chunk.
+    struct LEX_LexerToken *tokens; ///< The tokens starting in the chunk.
+    int tokenCount; ///< Count of the tokens.
+    int tokensAllocated; ///< Allocated size of the token array.
+    /// The first token which is also a token of the serial lexer. The tokens before it
+    /// are dropped.
+    int firstToken;
+    /// The documentation comments before this token are dropped. They are before the
+    /// first token, where the previous segment may have found them.
+    int firstDocCommentToken;
+    /// Nonzero if the source ends in the chunk. (At the end or on an error.)
+    /// Then the last token is LEX_SPEC_EOF.
+    int isFinished;
+    unsigned nextOffset; ///< Offset of the first token after the chunk if not finished.
+    pthread_t thread; ///< The thread lexing the chunk, then copying its tokens.
+    int isThreadStarted; ///< Nonzero if the chunk is lexed by its own thread.
+    /// The index of the first token of each symbol of the chunk, indexed by symbol id.
+    /// The ids are given in the order of the first tokens.
+    int *symbolFirstTokens;
+    int symbolFirstTokensAllocated; ///< Allocated size of symbolFirstTokens.
+    unsigned knownSymbolCount; ///< Count of the symbols used by the tokens, including id 0.
+    /// Count of the string tokens. The strings of the chunk belong to them in order.
+    int stringTokenCount;
+    /// Count of the number tokens. The numbers of the chunk belong to them in order.
+    int numberTokenCount;
+    int droppedStringCount; ///< Count of the string tokens before the first token.
+    int droppedNumberCount; ///< Count of the number tokens before the first token.
+    unsigned *symbolOrder; ///< The ids of the kept symbols in the order of their first kept token.
+    unsigned symbolOrderCount; ///< Count of the kept symbols.
+    unsigned *symbolMap; ///< The symbol ids of the joined result indexed by the ids of the chunk.
+    int stringShift; ///< Added to the string indexes of the chunk in the joined result.
+    int numberShift; ///< Added to the number indexes of the chunk in the joined result.
+    unsigned tokenBase; ///< The index of the first kept token in the joined result.
+    struct LEX_LexerToken *joinedTokens; ///< The kept tokens in the joined result.
+};
+
+/**
+ * Creates a chunk. Its lexer is quiet, the error is raised when the chunks are joined.
+ *
+ * @param code The source code.
+ * @param begin Offset of the first character of the chunk. Must be a line start.
+ * @param end Offset after the last character of the chunk.
+ *
+ * @return The chunk.
+ */
+static struct ParallelChunk *createChunk(const char *code, unsigned begin, unsigned end)
+{
+    struct ParallelChunk *chunk = malloc(sizeof(struct ParallelChunk));
+    struct LexerContext *context;
+
+    chunk->lexer = createLexer();
+    chunk->lexer->result.source = code;
+    chunk->lexer->result.lineStarts[0] = begin;
+    context = &chunk->lexer->context;
+    context->current = code + begin;
+    context->windowStart = code;
+    context->isInputFinished = 1;
+    context->isQuiet = 1;
+    chunk->begin = begin;
+    chunk->end = end;
+    chunk->tokens = 0;
+    chunk->tokenCount = 0;
+    chunk->tokensAllocated = 0;
+    chunk->firstToken = 0;
+    chunk->firstDocCommentToken = 0;
+    chunk->isFinished = 0;
+    chunk->nextOffset = 0;
+    chunk->isThreadStarted = 0;
+    chunk->symbolFirstTokens = 0;
+    chunk->symbolFirstTokensAllocated = 0;
+    chunk->knownSymbolCount = 1;
+    chunk->stringTokenCount = 0;
+    chunk->numberTokenCount = 0;
+    chunk->symbolOrder = 0;
+    chunk->symbolMap = 0;
+    return chunk;
+}
+
+/**
+ * Destroys the chunk.
+ *
+ * @param chunk The chunk.
+ */
+static void destroyChunk(struct ParallelChunk *chunk)
+{
+    LEX_destroyLexer(chunk->lexer);
+    free(chunk->tokens);
+    free(chunk->symbolFirstTokens);
+    free(chunk->symbolOrder);
+    free(chunk->symbolMap);
+    free(chunk);
+}
+
+/**
+ * Appends a token to the chunk. The first token of a new symbol and the count of the
+ * literals are noted for the joining.
+ *
+ * @param chunk The chunk.
+ * @param token The token.
+ */
+static void addChunkToken(struct ParallelChunk *chunk, const struct LEX_LexerToken *token)
+{
+    if (chunk->tokenCount == chunk->tokensAllocated)
+    {
+        chunk->tokensAllocated = chunk->tokensAllocated ? chunk->tokensAllocated << 1 : 1024;
+        chunk->tokens = realloc(chunk->tokens, chunk->tokensAllocated * sizeof(*chunk->tokens));
+    }
+    if ((token->tokenType == LEX_IDENTIFIER) && (token->value >= chunk->knownSymbolCount))
+    {
+        if ((int)token->value >= chunk->symbolFirstTokensAllocated)
+        {
+            chunk->symbolFirstTokensAllocated = (token->value + 1) * 2;
+            chunk->symbolFirstTokens = realloc(
+                chunk->symbolFirstTokens,
+                chunk->symbolFirstTokensAllocated * sizeof(*chunk->symbolFirstTokens));
+        }
+        chunk->symbolFirstTokens[token->value] = chunk->tokenCount;
+        chunk->knownSymbolCount = token->value + 1;
+    }
+    else if (token->tokenType == LEX_STRING)
+    {
+        chunk->stringTokenCount++;
+    }
+    else if (isNumberToken(token->tokenType))
+    {
+        chunk->numberTokenCount++;
+    }
+    chunk->tokens[chunk->tokenCount++] = *token;
+}
+
+/**
+ * Lexes a chunk as if a token started at its beginning. The tokens starting in the
+ * chunk are saved, the offset of the next token is saved too. Thread function.
+ *
+ * @param userData The chunk.
+ *
+ * @return Null.
+ */
+static void *lexChunk(void *userData)
+{
+    struct ParallelChunk *chunk = userData;
+    struct LexerContext *context = &chunk->lexer->context;
+    const char *code = chunk->lexer->result.source;
+    struct LEX_LexerToken token;
+
+    addLineStarts(context, code + chunk->begin, code + chunk->end);
+    for (;;)
+    {
+        scanToken(context, &token);
+        if (token.tokenType == LEX_SPEC_EOF)
+        {
+            addChunkToken(chunk, &token);
+            chunk->isFinished = 1;
+            break;
+        }
+        if (token.offset >= chunk->end)
+        {
+            chunk->nextOffset = token.offset;
+            break;
+        }
+        addChunkToken(chunk, &token);
+    }
+    return 0;
+}
+
+/**
+ * Lexes a chunk from the first token of the serial lexer until a token of the chunk is
+ * met. From a common token on the chunk has the same tokens as the serial lexer, so
+ * usually only a single token is lexed again. If the chunk started inside a comment or
+ * a string, the whole chunk may be lexed again.
+ *
+ * @param code The source code.
+ * @param chunk The chunk. Its firstToken is set.
+ * @param offset The offset of the first token of the serial lexer in the chunk.
+ *
+ * @return The tokens lexed again. They are followed by the tokens of the chunk if
+ *      a token is met, otherwise they replace the whole chunk.
+ */
+static struct ParallelChunk *relexChunk(const char *code, struct ParallelChunk *chunk, unsigned offset)
+{
+    struct ParallelChunk *relexed = createChunk(code, offset, chunk->end);
+    struct LexerContext *context = &relexed->lexer->context;
+    struct LEX_LexerToken token;
+    int i = 0;
+
+    chunk->firstToken = chunk->tokenCount;
+    for (;;)
+    {
+        scanToken(context, &token);
+        if (token.tokenType == LEX_SPEC_EOF)
+        {
+            addChunkToken(relexed, &token);
+            relexed->isFinished = 1;
+            break;
+        }
+        while ((i < chunk->tokenCount) && (chunk->tokens[i].offset < token.offset))
+        {
+            i++;
+        }
+        if ((i < chunk->tokenCount) &&
+            (chunk->tokens[i].offset == token.offset) &&
+            (chunk->tokens[i].tokenType != LEX_SPEC_EOF))
+        {
+            chunk->firstToken = i;
+            break;
+        }
+        if (token.offset >= chunk->end)
+        {
+            relexed->nextOffset = token.offset;
+            break;
+        }
+        addChunkToken(relexed, &token);
+    }
+    return relexed;
+}
+
+/**
+ * Orders the symbols of a segment for the joining, in the order of their first kept
+ * token. It's the order of the ids except for the symbols first used by the dropped
+ * tokens. Those are looked up among the kept tokens, usually there is none of them.
+ * The literals of the dropped tokens are counted too. Thread function.
+ *
+ * @param userData The segment. Its firstToken is set.
+ *
+ * @return Null.
+ */
+static void *orderChunkSymbols(void *userData)
+{
+    struct ParallelChunk *chunk = userData;
+    int *firstTokens = chunk->symbolFirstTokens;
+    unsigned count = chunk->knownSymbolCount;
+    unsigned dropped = 1;
+    unsigned *keptDropped;
+    unsigned keptDroppedCount = 0;
+    unsigned id;
+    unsigned j = 0;
+    int i;
+
+    chunk->droppedStringCount = 0;
+    chunk->droppedNumberCount = 0;
+    for (i = 0; i < chunk->firstToken; i++)
+    {
+        chunk->droppedStringCount += chunk->tokens[i].tokenType == LEX_STRING;
+        chunk->droppedNumberCount += isNumberToken(chunk->tokens[i].tokenType);
+    }
+    while ((dropped < count) && (firstTokens[dropped] < chunk->firstToken))
+    {
+        dropped++;
+    }
+
+    // The first kept tokens of the symbols of the dropped tokens replace their first tokens.
+    keptDropped = malloc(dropped * sizeof(*keptDropped));
+    for (id = 1; id < dropped; id++)
+    {
+        firstTokens[id] = -1;
+    }
+    for (i = chunk->firstToken; (keptDroppedCount < dropped - 1) && (i < chunk->tokenCount); i++)
+    {
+        const struct LEX_LexerToken *token = &chunk->tokens[i];
+        if ((token->tokenType == LEX_IDENTIFIER) && (token->value < dropped) && (firstTokens[token->value] < 0))
+        {
+            firstTokens[token->value] = i;
+            keptDropped[keptDroppedCount++] = token->value;
+        }
+    }
+
+    chunk->symbolOrder = malloc(count * sizeof(*chunk->symbolOrder));
+    chunk->symbolOrderCount = 0;
+    id = dropped;
+    while ((j < keptDroppedCount) || (id < count))
+    {
+        if ((id == count) || ((j < keptDroppedCount) && (firstTokens[keptDropped[j]] < firstTokens[id])))
+        {
+            chunk->symbolOrder[chunk->symbolOrderCount++] = keptDropped[j++];
+        }
+        else
+        {
+            chunk->symbolOrder[chunk->symbolOrderCount++] = id++;
+        }
+    }
+    free(keptDropped);
+    return 0;
+}
+
+/**
+ * Copies the kept tokens of a segment into the joined result, and maps their values to
+ * the side tables of the joined result. Thread function.
+ *
+ * @param userData The segment.
+ *
+ * @return Null.
+ */
+static void *copyChunkTokens(void *userData)
+{
+    struct ParallelChunk *chunk = userData;
+    struct LEX_LexerToken *token = chunk->joinedTokens;
+    int i;
+
+    for (i = chunk->firstToken; i < chunk->tokenCount; i++, token++)
+    {
+        *token = chunk->tokens[i];
+        if (token->tokenType == LEX_IDENTIFIER)
+        {
+            token->value = chunk->symbolMap[token->value];
+        }
+        else if (token->tokenType == LEX_STRING)
+        {
+            token->value += chunk->stringShift;
+        }
+        else if (isNumberToken(token->tokenType))
+        {
+            token->value += chunk->numberShift;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Runs a function on each chunk, the first one on the calling thread, the others on
+ * their own threads. A chunk is processed on the calling thread if its thread can't
+ * be started.
+ *
+ * @param chunks The chunks.
+ * @param chunkCount Count of chunks.
+ * @param function The function. It gets the chunk.
+ */
+static void runChunkThreads(struct ParallelChunk **chunks, int chunkCount, void *(*function)(void *))
+{
+    int i;
+
+    for (i = 1; i < chunkCount; i++)
+    {
+        chunks[i]->isThreadStarted = !pthread_create(&chunks[i]->thread, 0, function, chunks[i]);
+        if (!chunks[i]->isThreadStarted)
+        {
+            function(chunks[i]);
+        }
+    }
+    function(chunks[0]);
+    for (i = 1; i < chunkCount; i++)
+    {
+        if (chunks[i]->isThreadStarted)
+        {
+            pthread_join(chunks[i]->thread, 0);
+        }
+    }
+}
+
+/**
+ * Returns nonzero if a chunk can start at the given offset: it's a line start and it's
+ * not in the middle of a CR LF or LF CR pair.
+ *
+ * @param code The source code.
+ * @param offset The offset. Must be in the source.
+ *
+ * @return Nonzero if a chunk can start at the offset.
+ */
+static int isChunkBoundary(const char *code, unsigned offset)
+{
+    return
+        offset &&
+        ((code[offset - 1] == '\n') || (code[offset - 1] == '\r')) &&
+        (code[offset] != '\n') &&
+        (code[offset] != '\r');
+}
+
+struct LEX_LexerResult LEX_tokenizeStringParallel(const char *code, int threadCount)
+{
+    return LEX_tokenizeBufferParallel(code, code + strlen(code), threadCount);
+}
+
+struct LEX_LexerResult LEX_tokenizeBufferParallel(const char *code, const char *end, int threadCount)
+{
+    unsigned length = end - code;
+    struct ParallelChunk **chunks;
+    struct ParallelChunk **segments;
+    struct ParallelChunk *last;
+    struct LEX_LexerResult lexerResult;
+    struct LEX_Lexer *joined;
+    int chunkCount = 0;
+    int segmentCount = 0;
+    unsigned begin = 0;
+    int i;
+    int j;
+
+    if (threadCount > (int)(length / MIN_PARALLEL_CHUNK_SIZE))
+    {
+        threadCount = length / MIN_PARALLEL_CHUNK_SIZE;
+    }
+    // The source which is not UTF-8 is rejected by the serial lexer before the first token,
+    // and the chunks would stop on a zero before the end instead of rejecting it.
+    if ((threadCount <= 1) ||
+        (selectFindInvalidUtf8Function()(code, end) != end) ||
+        memchr(code, 0, length))
+    {
+        return LEX_tokenizeBuffer(code, end);
+    }
+
+    // Split the source at line starts. The lines starts of the chunks are collected
+    // by the threads too.
+    chunks = calloc(threadCount, sizeof(*chunks));
+    for (i = 1; (i <= threadCount) && (begin < length); i++)
+    {
+        unsigned end = (unsigned)((uint64_t)length * i / threadCount);
+        if (end <= begin) continue;
+        while ((end < length) && !isChunkBoundary(code, end))
+        {
+            end++;
+        }
+        chunks[chunkCount++] = createChunk(code, begin, end);
+        begin = end;
+    }
+    runChunkThreads(chunks, chunkCount, lexChunk);
+
+    // Join the chunks. The first chunk started at the beginning, so its tokens are
+    // right. Every other chunk is checked against the end of the previous one.
+    segments = malloc(2 * chunkCount * sizeof(*segments));
+    segments[segmentCount++] = chunks[0];
+    last = chunks[0];
+    for (i = 1; i < chunkCount; i++)
+    {
+        if (last->isFinished)
+        {
+            chunks[i]->firstToken = chunks[i]->tokenCount;
+        }
+        else
+        {
+            struct ParallelChunk *relexed = relexChunk(code, chunks[i], last->nextOffset);
+            segments[segmentCount++] = relexed;
+            last = chunks[i]->firstToken < chunks[i]->tokenCount ? chunks[i] : relexed;
+        }
+        chunks[i]->firstDocCommentToken = chunks[i]->firstToken + 1;
+        segments[segmentCount++] = chunks[i];
+    }
+
+    // The symbols of each segment are added in the order of their first kept token, so
+    // they get the same ids as in the serial lexer. The strings and the numbers of the
+    // kept tokens are in token order at the end of the side tables of the segment, they
+    // are appended at once. The tokens are copied and mapped by the threads.
+    runChunkThreads(segments, segmentCount, orderChunkSymbols);
+    joined = createLexer();
+    joined->result.source = code;
+    lexerResult.tokenCount = 0;
+    lexerResult.stringCount = 0;
+    lexerResult.numberCount = 0;
+    for (i = 0; i < segmentCount; i++)
+    {
+        const struct LEX_Symbol *symbols = segments[i]->lexer->result.symbols;
+        segments[i]->symbolMap = calloc(segments[i]->knownSymbolCount, sizeof(*segments[i]->symbolMap));
+        for (j = 0; j < (int)segments[i]->symbolOrderCount; j++)
+        {
+            unsigned id = segments[i]->symbolOrder[j];
+            segments[i]->symbolMap[id] = internSymbol(&joined->context, symbols[id].name, symbols[id].length);
+        }
+        segments[i]->tokenBase = lexerResult.tokenCount;
+        segments[i]->stringShift = lexerResult.stringCount - segments[i]->droppedStringCount;
+        segments[i]->numberShift = lexerResult.numberCount - segments[i]->droppedNumberCount;
+        lexerResult.tokenCount += segments[i]->tokenCount - segments[i]->firstToken;
+        lexerResult.stringCount += segments[i]->stringTokenCount - segments[i]->droppedStringCount;
+        lexerResult.numberCount += segments[i]->numberTokenCount - segments[i]->droppedNumberCount;
+    }
+    lexerResult.tokens = malloc(lexerResult.tokenCount * sizeof(struct LEX_LexerToken));
+    lexerResult.strings = malloc((lexerResult.stringCount + 1) * sizeof(struct LEX_BinaryString));
+    lexerResult.numbers = malloc((lexerResult.numberCount + 1) * sizeof(struct LEX_Number));
+    lexerResult.textBlocks = 0;
+    for (i = 0; i < segmentCount; i++)
+    {
+        struct ParallelChunk *segment = segments[i];
+        struct LEX_LexerResult *segmentResult = &segment->lexer->result;
+        struct LEX_TextBlock *block = segmentResult->textBlocks;
+
+        segment->joinedTokens = lexerResult.tokens + segment->tokenBase;
+        memcpy(
+            lexerResult.strings + segment->droppedStringCount + segment->stringShift,
+            segmentResult->strings + segment->droppedStringCount,
+            (segment->stringTokenCount - segment->droppedStringCount) * sizeof(struct LEX_BinaryString));
+        memcpy(
+            lexerResult.numbers + segment->droppedNumberCount + segment->numberShift,
+            segmentResult->numbers + segment->droppedNumberCount,
+            (segment->numberTokenCount - segment->droppedNumberCount) * sizeof(struct LEX_Number));
+        // The bytes of the strings stay in the arena of the segment.
+        if (block)
+        {
+            while (block->next)
+            {
+                block = block->next;
+            }
+            block->next = lexerResult.textBlocks;
+            lexerResult.textBlocks = segmentResult->textBlocks;
+            segmentResult->textBlocks = 0;
+        }
+        for (j = 0; j < segmentResult->docCommentCount; j++)
+        {
+            struct LEX_DocComment *docComment = &segmentResult->docComments[j];
+            if ((int)docComment->tokenIndex >= segment->firstDocCommentToken)
+            {
+                joined->context.tokenIndex = segment->tokenBase + docComment->tokenIndex - segment->firstToken;
+                addDocComment(&joined->context, &docComment->token);
+            }
+        }
+    }
+    runChunkThreads(segments, segmentCount, copyChunkTokens);
+    lexerResult.symbols = joined->result.symbols;
+    lexerResult.symbolCount = joined->result.symbolCount;
+    lexerResult.docComments = joined->result.docComments;
+    lexerResult.docCommentCount = joined->result.docCommentCount;
+    joined->result.symbols = 0;
+    joined->result.docComments = 0;
+    LEX_destroyLexer(joined);
+
+    // The first line start of the chunks is the last line start of the previous one.
+    lexerResult.lineCount = 1;
+    for (i = 0; i < chunkCount; i++)
+    {
+        lexerResult.lineCount += chunks[i]->lexer->result.lineCount - 1;
+    }
+    lexerResult.lineStarts = malloc(lexerResult.lineCount * sizeof(*lexerResult.lineStarts));
+    lexerResult.lineStarts[0] = 0;
+    lexerResult.lineCount = 1;
+    for (i = 0; i < chunkCount; i++)
+    {
+        const struct LEX_LexerResult *chunkResult = &chunks[i]->lexer->result;
+        memcpy(
+            lexerResult.lineStarts + lexerResult.lineCount,
+            chunkResult->lineStarts + 1,
+            (chunkResult->lineCount - 1) * sizeof(*lexerResult.lineStarts));
+        lexerResult.lineCount += chunkResult->lineCount - 1;
+    }
+
+    lexerResult.source = code;
+    lexerResult.texts = 0;
+    lexerResult.textCount = 0;
+    lexerResult.relexState = 0;
+    lexerResult.isMapped = 0;
+    LEX_getPosition(
+        &lexerResult,
+        lexerResult.tokens[lexerResult.tokenCount - 1].offset,
+        &lexerResult.linePos,
+        &lexerResult.columnPos);
+    if (last->lexer->context.error)
+    {
+        ERR_raiseErrorAt(
+            last->lexer->context.error,
+            lexerResult.tokens[lexerResult.tokenCount - 1].offset,
+            -1);
+    }
+
+    for (i = 0; i < segmentCount; i++)
+    {
+        destroyChunk(segments[i]);
+    }
+    free(segments);
+    free(chunks);
+
+    return lexerResult;
+}
+
+/**
+ * Copies an array to the heap.
+ *
+ * @param array The array.
+ * @param count Count of elements.
+ * @param size Size of an element.
+ *
+ * @return The copy. Never null.
+ */
+static void *copyArray(const void *array, int count, size_t size)
+{
+    void *copy = malloc(count * size + 1);
+    memcpy(copy, array, count * size);
+    return copy;
+}
+
+/**
+ * Creates the state of the edits of a lexer result. The source is copied, and the names
+ * and the number texts pointing into it are moved to the text arena. The hash tables
+ * are built from the symbols and the strings of the result.
+ *
+ * @param lexerResult The lexer result. Must have a source.
+ *
+ * @return The state.
+ */
+static struct LEX_RelexState *createRelexState(struct LEX_LexerResult *lexerResult)
+{
+    struct LEX_RelexState *state = malloc(sizeof(struct LEX_RelexState));
+    struct LexerContext *context = &state->context;
+    int docCommentCount = lexerResult->docCommentCount;
+    int mask;
+    int i;
+
+    state->sourceLength = strlen(lexerResult->source);
+    state->gapStart = state->sourceLength;
+    state->gapLength = RELEX_CHUNK_SIZE;
+    state->source = malloc(state->sourceLength + state->gapLength + 1);
+    memcpy(state->source, lexerResult->source, state->sourceLength);
+    state->source[state->sourceLength] = 0;
+    state->source[state->sourceLength + state->gapLength] = 0;
+    state->tokenGap.start = lexerResult->tokenCount;
+    state->tokenGap.length = 0;
+    state->tokenGap.delta = 0;
+    state->tokenGap.indexDelta = 0;
+    state->lineGap.start = lexerResult->lineCount;
+    state->lineGap.length = 0;
+    state->lineGap.delta = 0;
+    state->lineGap.indexDelta = 0;
+    state->docCommentGap.start = lexerResult->docCommentCount;
+    state->docCommentGap.length = 0;
+    state->docCommentGap.delta = 0;
+    state->docCommentGap.indexDelta = 0;
+    state->addedLines = malloc(64 * sizeof(int));
+    state->addedLinesAllocated = 64;
+    state->addedDocComments = malloc(16 * sizeof(struct LEX_DocComment));
+    state->addedDocCommentsAllocated = 16;
+    state->compactionLimit = 2 * (lexerResult->stringCount + lexerResult->numberCount) + RELEX_COMPACTION_MINIMUM;
+    if (lexerResult->isMapped)
+    {
+        // The arrays in the token cache are read only.
+        lexerResult->tokens = copyArray(lexerResult->tokens, lexerResult->tokenCount, sizeof(struct LEX_LexerToken));
+        lexerResult->lineStarts = copyArray(lexerResult->lineStarts, lexerResult->lineCount, sizeof(int));
+        lexerResult->docComments =
+            copyArray(lexerResult->docComments, lexerResult->docCommentCount, sizeof(struct LEX_DocComment));
+        lexerResult->isMapped = 0;
+    }
+
+    context->result = lexerResult;
+    context->windowStart = state->source;
+    context->windowEnd = 0;
+    context->windowOffset = 0;
+    context->isInputFinished = 1;
+    context->hasPendingToken = 0;
+    context->isInSeries = 0;
+    context->partialState = LS_NONE;
+    context->isFinished = 0;
+    context->error = E_OK;
+    context->isQuiet = 0;
+    context->currentString = 0;
+    context->currentStringLength = 0;
+    context->currentStringAllocated = 0;
+    context->skipRun = selectSkipRunFunction();
+    context->findInvalidUtf8 = selectFindInvalidUtf8Function();
+    context->utf8CarryLength = 0;
+    context->lastLineBreak = 0;
+    context->tokenIndex = 0;
+    context->isSourceEdited = 1;
+    // The arrays of the result are filled up, they are grown on the first addition.
+    context->stringsAllocated = lexerResult->stringCount;
+    context->linesAllocated = lexerResult->lineCount;
+    context->textsAllocated = lexerResult->textCount;
+    context->symbolsAllocated = lexerResult->symbolCount;
+    context->numbersAllocated = lexerResult->numberCount;
+    context->docCommentsAllocated = lexerResult->docCommentCount;
+
+    for (i = 1; i < lexerResult->symbolCount; i++)
+    {
+        struct LEX_Symbol *symbol = &lexerResult->symbols[i];
+        symbol->name = copyToTextArena(lexerResult, symbol->name, symbol->length);
+    }
+    for (i = 0; i < lexerResult->tokenCount; i++)
+    {
+        const struct LEX_LexerToken *token = &lexerResult->tokens[i];
+        if (isNumberToken(token->tokenType))
+        {
+            struct LEX_Number *number = &lexerResult->numbers[token->value];
+            number->text = copyToTextArena(lexerResult, number->text, token->length);
+        }
+    }
+
+    // growSymbolSlots builds the table at the double size.
+    context->symbolSlotCount = 512;
+    while (lexerResult->symbolCount > context->symbolSlotCount)
+    {
+        context->symbolSlotCount <<= 1;
+    }
+    context->symbolSlots = 0;
+    growSymbolSlots(context);
+
+    // Equal strings share the slot of the first one.
+    context->stringSlotCount = 256;
+    while (lexerResult->stringCount * 2 > context->stringSlotCount)
+    {
+        context->stringSlotCount <<= 1;
+    }
+    context->stringSlots = calloc(context->stringSlotCount, sizeof(*context->stringSlots));
+    context->distinctStringCount = 0;
+    mask = context->stringSlotCount - 1;
+    for (i = 0; i < lexerResult->stringCount; i++)
+    {
+        const struct LEX_BinaryString *string = &lexerResult->strings[i];
+        unsigned slot = hashName(string->bytes, string->length) & mask;
+        while (context->stringSlots[slot])
+        {
+            const struct LEX_BinaryString *pooled = &lexerResult->strings[context->stringSlots[slot] - 1];
+            if ((pooled->length == string->length) && !memcmp(pooled->bytes, string->bytes, string->length))
+            {
+                break;
+            }
+            slot = (slot + 1) & mask;
+        }
+        if (!context->stringSlots[slot])
+        {
+            context->stringSlots[slot] = i + 1;
+            context->distinctStringCount++;
+        }
+    }
+
+    // The result doesn't tell whether it ended on an error. The error is found again from
+    // the end of the last token, the side table entries of this scan are dropped.
+    if (context->findInvalidUtf8(state->source, state->source + state->sourceLength) !=
+        state->source + state->sourceLength)
+    {
+        state->error = E_LEX_INVALID_UTF8;
+        return state;
+    }
+    context->current = state->source;
+    if (lexerResult->tokenCount > 1)
+    {
+        const struct LEX_LexerToken *lastToken = &lexerResult->tokens[lexerResult->tokenCount - 2];
+        context->current += lastToken->offset + lastToken->length;
+    }
+    context->isQuiet = 1;
+    for (;;)
+    {
+        struct LEX_LexerToken token;
+        scanToken(context, &token);
+        if (token.tokenType == LEX_SPEC_EOF) break;
+    }
+    context->isQuiet = 0;
+    state->error = context->error;
+    lexerResult->docCommentCount = docCommentCount;
+
+    return state;
+}
+
+/**
+ * Shifts the offsets of tokens.
+ *
+ * @param items The tokens.
+ * @param count The count of the tokens.
+ * @param delta The change of the offsets.
+ * @param indexDelta Not used.
+ */
+static void shiftTokenOffsets(void *items, int count, int delta, int indexDelta)
+{
+    struct LEX_LexerToken *tokens = items;
+    int i;
+
+    for (i = 0; i < count; i++)
+    {
+        tokens[i].offset += delta;
+    }
+}
+
+/**
+ * Shifts line starts.
+ *
+ * @param items The line starts.
+ * @param count The count of the line starts.
+ * @param delta The change of the line starts.
+ * @param indexDelta Not used.
+ */
+static void shiftLineStarts(void *items, int count, int delta, int indexDelta)
+{
+    int *lineStarts = items;
+    int i;
+
+    for (i = 0; i < count; i++)
+    {
+        lineStarts[i] += delta;
+    }
+}
+
+/**
+ * Shifts documentation comments.
+ *
+ * @param items The documentation comments.
+ * @param count The count of the documentation comments.
+ * @param delta The change of the offsets.
+ * @param indexDelta The change of the token indexes.
+ */
+static void shiftDocComments(void *items, int count, int delta, int indexDelta)
+{
+    struct LEX_DocComment *docComments = items;
+    int i;
+
+    for (i = 0; i < count; i++)
+    {
+        docComments[i].token.offset += delta;
+        docComments[i].tokenIndex += indexDelta;
+    }
+}
+
+/**
+ * Shifts the offsets and the token indexes of the items of an array.
+ */
+typedef void (*ShiftOffsetsFunction)(void *items, int count, int delta, int indexDelta);
+
+/**
+ * Moves the gap of an array of an edited lexer result. The items passing the gap get
+ * or lose the pending length change.
+ *
+ * @param gap The gap.
+ * @param items The array.
+ * @param itemSize The size of an item.
+ * @param shift Shifts the offsets of the items.
+ * @param index The count of the items before the gap at the new place.
+ */
+static void moveGap(struct RelexGap *gap, void *items, size_t itemSize, ShiftOffsetsFunction shift, int index)
+{
+    char *array = items;
+
+    if (index < gap->start)
+    {
+        int count = gap->start - index;
+        memmove(array + (index + gap->length) * itemSize, array + index * itemSize, count * itemSize);
+        shift(array + (index + gap->length) * itemSize, count, -gap->delta, -gap->indexDelta);
+    }
+    else if (index > gap->start)
+    {
+        int count = index - gap->start;
+        memmove(array + gap->start * itemSize, array + (gap->start + gap->length) * itemSize, count * itemSize);
+        shift(array + gap->start * itemSize, count, gap->delta, gap->indexDelta);
+    }
+    gap->start = index;
+}
+
+/**
+ * Replaces a range of the items of an array of an edited lexer result. The gap is moved
+ * to the range, and the length change of the edit is added to the pending one.
+ *
+ * @param gap The gap of the array.
+ * @param items The array.
+ * @param [in,out] count The count of the items.
+ * @param itemSize The size of an item.
+ * @param shift Shifts the offsets of the items.
+ * @param first The first replaced item.
+ * @param last The first item kept after the replaced ones.
+ * @param newItems The items replacing them. Their offsets are up to date.
+ * @param newCount The count of the new items.
+ * @param delta The change of the length of the source.
+ * @param indexDelta The change of the count of tokens.
+ *
+ * @return The array. It's reallocated if the gap was too short for the new items.
+ */
+static void *replaceGapItems(
+    struct RelexGap *gap,
+    void *items,
+    int *count,
+    size_t itemSize,
+    ShiftOffsetsFunction shift,
+    int first,
+    int last,
+    const void *newItems,
+    int newCount,
+    int delta,
+    int indexDelta)
+{
+    char *array = items;
+
+    moveGap(gap, array, itemSize, shift, first);
+    gap->length += last - first;
+    gap->delta += delta;
+    gap->indexDelta += indexDelta;
+    *count -= last - first;
+    if (gap->length < newCount)
+    {
+        int length = *count + newCount + 16;
+        array = realloc(array, (*count + length) * itemSize);
+        memmove(
+            array + (gap->start + length) * itemSize,
+            array + (gap->start + gap->length) * itemSize,
+            (*count - gap->start) * itemSize);
+        gap->length = length;
+    }
+    memcpy(array + gap->start * itemSize, newItems, newCount * itemSize);
+    gap->start += newCount;
+    gap->length -= newCount;
+    *count += newCount;
+    return array;
+}
+
+/**
+ * Gets a token of an edited lexer result.
+ *
+ * @param state The state of the edits.
+ * @param index The index of the token.
+ *
+ * @return The token with its current offset.
+ */
+static struct LEX_LexerToken getEditedToken(const struct LEX_RelexState *state, int index)
+{
+    const struct LEX_LexerResult *result = state->context.result;
+    struct LEX_LexerToken token;
+
+    if (index < state->tokenGap.start) return result->tokens[index];
+    token = result->tokens[index + state->tokenGap.length];
+    token.offset += state->tokenGap.delta;
+    return token;
+}
+
+/**
+ * Gets a line start of an edited lexer result.
+ *
+ * @param state The state of the edits.
+ * @param index The index of the line.
+ *
+ * @return The current offset of the line start.
+ */
+static int getEditedLineStart(const struct LEX_RelexState *state, int index)
+{
+    const struct LEX_LexerResult *result = state->context.result;
+
+    if (index < state->lineGap.start) return result->lineStarts[index];
+    return result->lineStarts[index + state->lineGap.length] + state->lineGap.delta;
+}
+
+/**
+ * Finds the first token ending at or after the given offset. The end of the source
+ * token is not checked, it's found if no other token matches.
+ *
+ * @param state The state of the edits.
+ * @param offset The offset.
+ *
+ * @return The index of the token.
+ */
+static int findTokenEndingAfter(const struct LEX_RelexState *state, unsigned offset)
+{
+    int low = 0;
+    int high = state->context.result->tokenCount - 1;
+
+    while (low < high)
+    {
+        int middle = (low + high) / 2;
+        struct LEX_LexerToken token = getEditedToken(state, middle);
+        if (token.offset + token.length < offset)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+/**
+ * Finds the first line starting after the given offset.
+ *
+ * @param state The state of the edits.
+ * @param offset The offset.
+ *
+ * @return The index of the line. The count of lines if all lines start before the offset.
+ */
+static int findLineStartingAfter(const struct LEX_RelexState *state, unsigned offset)
+{
+    int low = 0;
+    int high = state->context.result->lineCount;
+
+    while (low < high)
+    {
+        int middle = (low + high) / 2;
+        if ((unsigned)getEditedLineStart(state, middle) <= offset)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+/**
+ * Moves the gap of an edited source.
+ *
+ * @param state The state of the edits.
+ * @param offset The offset of the gap at the new place.
+ */
+static void moveSourceGap(struct LEX_RelexState *state, unsigned offset)
+{
+    char *source = state->source;
+
+    if (offset < state->gapStart)
+    {
+        memmove(source + offset + state->gapLength, source + offset, state->gapStart - offset);
+    }
+    else if (offset > state->gapStart)
+    {
+        memmove(source + state->gapStart, source + state->gapStart + state->gapLength, offset - state->gapStart);
+    }
+    state->gapStart = offset;
+    source[offset] = 0;
+}
+
+/**
+ * Replaces a range of an edited source. The gap is left after the inserted text.
+ *
+ * @param state The state of the edits.
+ * @param offset The offset of the range.
+ * @param removedLength The length of the range.
+ * @param text The inserted text.
+ * @param length The length of the inserted text.
+ */
+static void replaceSourceText(
+    struct LEX_RelexState *state,
+    unsigned offset,
+    unsigned removedLength,
+    const char *text,
+    unsigned length)
+{
+    moveSourceGap(state, offset);
+    state->gapLength += removedLength;
+    state->sourceLength -= removedLength;
+    if (state->gapLength < length + 1)
+    {
+        unsigned gapLength = state->sourceLength + length + RELEX_CHUNK_SIZE;
+        unsigned tailLength = state->sourceLength - offset + 1;
+        state->source = realloc(state->source, state->sourceLength + gapLength + 1);
+        memmove(state->source + offset + gapLength, state->source + offset + state->gapLength, tailLength);
+        state->gapLength = gapLength;
+    }
+    memcpy(state->source + offset, text, length);
+    state->gapStart += length;
+    state->gapLength -= length;
+    state->sourceLength += length;
+    state->source[state->gapStart] = 0;
+}
+
+/**
+ * Moves the next part of an edited source before its gap and lets the lexer scan it.
+ * The source after the gap is moved in growing chunks, so a lexing which stops soon
+ * after the edit moves only a few bytes.
+ *
+ * @param state The state of the edits.
+ * @param length The length of the part.
+ */
+static void feedEditedSource(struct LEX_RelexState *state, unsigned length)
+{
+    struct LexerContext *context = &state->context;
 
-    lexerResult.tokenCount = lexerContext.tokenCount;
-    lexerResult.linePos = getCurrentLine(&lexerContext);
-    lexerResult.columnPos = lexerContext.currentColumn;
+    if (length > state->sourceLength - state->gapStart)
+    {
+        length = state->sourceLength - state->gapStart;
+    }
+    moveSourceGap(state, state->gapStart + length);
+    context->windowEnd = state->source + state->gapStart;
+    context->isInputFinished = state->gapStart == state->sourceLength;
+}
 
-    return lexerResult;
+/**
+ * Replaces the line starts of a relexed range of the source.
+ *
+ * @param state The state of the edits. The range is before the gap of the source.
+ * @param begin The start of the range. The line starts after it are replaced.
+ * @param oldEnd The end of the range in the old source. The line starts up to it and
+ *     including it are dropped.
+ * @param newEnd The end of the range in the edited source. If null, the range ends with
+ *     the terminating zero.
+ * @param delta The change of the length of the source.
+ */
+static void replaceLineStarts(
+    struct LEX_RelexState *state,
+    unsigned begin,
+    unsigned oldEnd,
+    const char *newEnd,
+    int delta)
+{
+    struct LexerContext *context = &state->context;
+    struct LEX_LexerResult *result = context->result;
+    int firstLine = findLineStartingAfter(state, begin);
+    int lastLine = findLineStartingAfter(state, oldEnd);
+    int *lineStarts = result->lineStarts;
+    int lineCount = result->lineCount;
+    int linesAllocated = context->linesAllocated;
+    int addedCount;
+
+    // The new line starts are collected in a separate array.
+    result->lineStarts = state->addedLines;
+    result->lineCount = 0;
+    context->linesAllocated = state->addedLinesAllocated;
+    context->lastLineBreak = 0;
+    addLineStarts(context, state->source + begin, newEnd);
+    state->addedLines = result->lineStarts;
+    state->addedLinesAllocated = context->linesAllocated;
+    addedCount = result->lineCount;
+    result->lineStarts = lineStarts;
+    result->lineCount = lineCount;
+    context->linesAllocated = linesAllocated;
+
+    result->lineStarts = replaceGapItems(
+        &state->lineGap,
+        result->lineStarts,
+        &result->lineCount,
+        sizeof(int),
+        shiftLineStarts,
+        firstLine,
+        lastLine,
+        state->addedLines,
+        addedCount,
+        delta,
+        0);
+}
+
+/**
+ * Gets the token index of a documentation comment of an edited lexer result.
+ *
+ * @param state The state of the edits.
+ * @param index The index of the comment.
+ *
+ * @return The current index of the token following the comment.
+ */
+static int getEditedDocCommentToken(const struct LEX_RelexState *state, int index)
+{
+    const struct LEX_LexerResult *result = state->context.result;
+
+    if (index < state->docCommentGap.start) return result->docComments[index].tokenIndex;
+    return result->docComments[index + state->docCommentGap.length].tokenIndex + state->docCommentGap.indexDelta;
+}
+
+/**
+ * Finds the first documentation comment belonging to a token at or after the given one.
+ *
+ * @param state The state of the edits.
+ * @param tokenIndex The index of the token.
+ *
+ * @return The index of the comment. The count of comments if there is no such comment.
+ */
+static int findDocComment(const struct LEX_RelexState *state, int tokenIndex)
+{
+    int low = 0;
+    int high = state->context.result->docCommentCount;
+
+    while (low < high)
+    {
+        int middle = (low + high) / 2;
+        if (getEditedDocCommentToken(state, middle) < tokenIndex)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+/**
+ * Replaces the documentation comments of the relexed tokens with the ones found while
+ * relexing. The comments before the first relexed token and after the last one are
+ * kept, the comments before the last one were found again.
+ *
+ * @param state The state of the edits. The new comments are in addedDocComments, their
+ *     token indexes are relative to the first relexed token.
+ * @param addedCount The count of the new comments.
+ * @param firstToken The first relexed token.
+ * @param lastToken The first old token kept after the relexed ones.
+ * @param newTokenCount The count of tokens replacing the relexed ones.
+ * @param delta The change of the length of the source.
+ */
+static void replaceDocComments(
+    struct LEX_RelexState *state,
+    int addedCount,
+    int firstToken,
+    int lastToken,
+    int newTokenCount,
+    int delta)
+{
+    struct LEX_LexerResult *result = state->context.result;
+    int first = findDocComment(state, firstToken);
+    int last = findDocComment(state, lastToken + 1);
+    int i;
+
+    for (i = 0; i < addedCount; i++)
+    {
+        state->addedDocComments[i].tokenIndex += firstToken;
+    }
+    result->docComments = replaceGapItems(
+        &state->docCommentGap,
+        result->docComments,
+        &result->docCommentCount,
+        sizeof(struct LEX_DocComment),
+        shiftDocComments,
+        first,
+        last,
+        state->addedDocComments,
+        addedCount,
+        delta,
+        newTokenCount - (lastToken - firstToken));
+}
+
+/**
+ * Drops the strings and the numbers no token refers to. Each edit appends the literals
+ * it lexed again to the side tables, the old entries are dropped when the tables grew
+ * to twice the size of the live entries. The texts of the arena are copied, the ones
+ * of the dropped entries are freed with the old blocks. The symbols are kept, so the
+ * symbol ids don't change.
+ *
+ * @param state The state of the edits.
+ */
+static void compactSideTables(struct LEX_RelexState *state)
+{
+    struct LexerContext *context = &state->context;
+    struct LEX_LexerResult *result = context->result;
+    struct LEX_BinaryString *strings = result->strings;
+    struct LEX_Number *numbers = result->numbers;
+    struct LEX_TextBlock *block = result->textBlocks;
+    int *stringIndexes = malloc((result->stringCount + 1) * sizeof(int));
+    int *numberIndexes = malloc((result->numberCount + 1) * sizeof(int));
+    int end = result->tokenCount + state->tokenGap.length;
+    int i;
+
+    memset(stringIndexes, -1, result->stringCount * sizeof(int));
+    memset(numberIndexes, -1, result->numberCount * sizeof(int));
+    result->strings = 0;
+    result->stringCount = 0;
+    context->stringsAllocated = 0;
+    result->numbers = 0;
+    result->numberCount = 0;
+    context->numbersAllocated = 0;
+    result->textBlocks = 0;
+    memset(context->stringSlots, 0, context->stringSlotCount * sizeof(*context->stringSlots));
+    context->distinctStringCount = 0;
+
+    for (i = 1; i < result->symbolCount; i++)
+    {
+        result->symbols[i].name = copyToTextArena(result, result->symbols[i].name, result->symbols[i].length);
+    }
+    for (i = 0; i < end; i++)
+    {
+        struct LEX_LexerToken *token = &result->tokens[i];
+        if ((i >= state->tokenGap.start) && (i < state->tokenGap.start + state->tokenGap.length)) continue;
+        if (token->tokenType == LEX_STRING)
+        {
+            if (stringIndexes[token->value] < 0)
+            {
+                const struct LEX_BinaryString *string = &strings[token->value];
+                stringIndexes[token->value] = addBinaryString(context, string->bytes, string->length);
+            }
+            token->value = stringIndexes[token->value];
+        }
+        else if (isNumberToken(token->tokenType))
+        {
+            if (numberIndexes[token->value] < 0)
+            {
+                unsigned index;
+                struct LEX_Number *number = appendNumber(context, &index);
+                *number = numbers[token->value];
+                number->text = copyToTextArena(result, number->text, token->length);
+                numberIndexes[token->value] = index;
+            }
+            token->value = numberIndexes[token->value];
+        }
+    }
+    state->compactionLimit = 2 * (result->stringCount + result->numberCount) + RELEX_COMPACTION_MINIMUM;
+
+    free(stringIndexes);
+    free(numberIndexes);
+    free(strings);
+    free(numbers);
+    while (block)
+    {
+        struct LEX_TextBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+}
+
+void LEX_flushEdits(struct LEX_LexerResult *lexerResult)
+{
+    struct LEX_RelexState *state = lexerResult->relexState;
+
+    if (!state) return;
+    moveSourceGap(state, state->sourceLength);
+    moveGap(
+        &state->tokenGap,
+        lexerResult->tokens,
+        sizeof(struct LEX_LexerToken),
+        shiftTokenOffsets,
+        lexerResult->tokenCount);
+    moveGap(&state->lineGap, lexerResult->lineStarts, sizeof(int), shiftLineStarts, lexerResult->lineCount);
+    moveGap(
+        &state->docCommentGap,
+        lexerResult->docComments,
+        sizeof(struct LEX_DocComment),
+        shiftDocComments,
+        lexerResult->docCommentCount);
+    // No item is after the gaps.
+    state->tokenGap.delta = 0;
+    state->lineGap.delta = 0;
+    state->docCommentGap.delta = 0;
+    state->docCommentGap.indexDelta = 0;
+}
+
+int LEX_relex(
+    struct LEX_LexerResult *lexerResult,
+    unsigned editOffset,
+    unsigned removedLength,
+    const char *insertedText)
+{
+    struct LEX_RelexState *state;
+    struct LexerContext *context;
+    struct LEX_LexerToken *newTokens;
+    int newTokenCount = 0;
+    int newTokensAllocated = 16;
+    struct LEX_LexerToken token;
+    struct LEX_LexerToken oldToken;
+    unsigned insertedLength = strlen(insertedText);
+    int delta = (int)insertedLength - (int)removedLength;
+    unsigned restart;
+    unsigned feedLength = RELEX_CHUNK_SIZE;
+    int firstToken;
+    int lastToken;
+    int isSynchronized = 0;
+    struct LEX_DocComment *docComments;
+    int docCommentCount;
+    int docCommentsAllocated;
+    int addedDocCommentCount;
+    int lineCount;
+    const char *checkEnd;
+    const char *invalid;
+
+    if (!lexerResult->source) return 0;
+    if (!lexerResult->relexState)
+    {
+        lexerResult->relexState = createRelexState(lexerResult);
+    }
+    state = lexerResult->relexState;
+    if ((editOffset > state->sourceLength) || (removedLength > state->sourceLength - editOffset))
+    {
+        return 0;
+    }
+    context = &state->context;
+    // The result may have been moved since the last edit.
+    context->result = lexerResult;
+
+    replaceSourceText(state, editOffset, removedLength, insertedText, insertedLength);
+    lexerResult->source = state->source;
+    context->windowStart = state->source;
+
+    // A token ending before the edit was ended by an unchanged character, so it stays.
+    // A series of strings before the edit may go on, it's lexed again too.
+    firstToken = findTokenEndingAfter(state, editOffset);
+    while (firstToken > 0)
+    {
+        oldToken = getEditedToken(state, firstToken - 1);
+        if ((oldToken.tokenType != LEX_STRING) && (oldToken.tokenType != LEX_CHARACTER)) break;
+        firstToken--;
+    }
+    restart = 0;
+    if (firstToken)
+    {
+        oldToken = getEditedToken(state, firstToken - 1);
+        restart = oldToken.offset + oldToken.length;
+    }
+
+    // If the source was UTF-8, only the edited sequences are checked. The check starts at a
+    // token end, that's a sequence boundary, and ends with the sequence at the end of the
+    // inserted text.
+    if (state->error == E_LEX_INVALID_UTF8)
+    {
+        feedEditedSource(state, state->sourceLength);
+        checkEnd = state->source + state->sourceLength;
+        invalid = context->findInvalidUtf8(state->source, checkEnd);
+    }
+    else
+    {
+        feedEditedSource(state, 4);
+        checkEnd = state->source + editOffset + insertedLength;
+        while ((*checkEnd & 0xC0) == 0x80)
+        {
+            checkEnd++;
+        }
+        invalid = context->findInvalidUtf8(state->source + restart, checkEnd);
+    }
+    if (invalid != checkEnd)
+    {
+        // The lexer stops before the first token.
+        feedEditedSource(state, state->sourceLength);
+        replaceLineStarts(state, restart, state->sourceLength - delta, 0, delta);
+        state->docCommentGap.length += lexerResult->docCommentCount;
+        state->docCommentGap.start = 0;
+        state->docCommentGap.delta = 0;
+        state->docCommentGap.indexDelta = 0;
+        lexerResult->docCommentCount = 0;
+        state->tokenGap.length += lexerResult->tokenCount - 1;
+        state->tokenGap.start = 1;
+        state->tokenGap.delta = 0;
+        lexerResult->tokens[0].offset = invalid - state->source;
+        lexerResult->tokens[0].length = 0;
+        lexerResult->tokens[0].value = 0;
+        lexerResult->tokens[0].tokenType = LEX_SPEC_EOF;
+        lexerResult->tokenCount = 1;
+        LEX_flushEdits(lexerResult);
+        LEX_getPosition(
+            lexerResult,
+            lexerResult->tokens[0].offset,
+            &lexerResult->linePos,
+            &lexerResult->columnPos);
+        state->error = E_LEX_INVALID_UTF8;
+        ERR_raiseErrorAt(E_LEX_INVALID_UTF8, lexerResult->tokens[0].offset, -1);
+        return 1;
+    }
+
+    // Lex until a new token starts where an old token started after the edit. The lexer
+    // is in the same state there, so the rest of the tokens are the same. The source
+    // after the gap is fed to the lexer as it goes on.
+    context->current = state->source + restart;
+    context->hasPendingToken = 0;
+    context->isInSeries = 0;
+    context->partialState = LS_NONE;
+    context->isFinished = 0;
+    context->error = E_OK;
+    context->tokenIndex = 0;
+    // The lexer finds the position of the end of the source in the line starts before the
+    // gap, the ones after it are not up to date. The position is found again at the end.
+    lineCount = lexerResult->lineCount;
+    lexerResult->lineCount = state->lineGap.start;
+    // The documentation comments found are collected in a separate array.
+    docComments = lexerResult->docComments;
+    docCommentCount = lexerResult->docCommentCount;
+    docCommentsAllocated = context->docCommentsAllocated;
+    lexerResult->docComments = state->addedDocComments;
+    lexerResult->docCommentCount = 0;
+    context->docCommentsAllocated = state->addedDocCommentsAllocated;
+    lastToken = firstToken;
+    newTokens = malloc(newTokensAllocated * sizeof(struct LEX_LexerToken));
+    for (;;)
+    {
+        while (!scanToken(context, &token))
+        {
+            feedEditedSource(state, feedLength);
+            feedLength *= 2;
+        }
+        if ((token.tokenType != LEX_SPEC_EOF) && (token.offset >= editOffset + insertedLength))
+        {
+            unsigned oldOffset = token.offset - delta;
+            while ((lastToken < lexerResult->tokenCount - 1) && (getEditedToken(state, lastToken).offset < oldOffset))
+            {
+                lastToken++;
+            }
+            if ((lastToken < lexerResult->tokenCount - 1) && (getEditedToken(state, lastToken).offset == oldOffset))
+            {
+                isSynchronized = 1;
+                break;
+            }
+        }
+        if (newTokenCount == newTokensAllocated)
+        {
+            newTokensAllocated *= 2;
+            newTokens = realloc(newTokens, newTokensAllocated * sizeof(struct LEX_LexerToken));
+        }
+        newTokens[newTokenCount++] = token;
+        if (token.tokenType == LEX_SPEC_EOF) break;
+    }
+    lexerResult->lineCount = lineCount;
+    state->addedDocComments = lexerResult->docComments;
+    state->addedDocCommentsAllocated = context->docCommentsAllocated;
+    addedDocCommentCount = lexerResult->docCommentCount;
+    lexerResult->docComments = docComments;
+    lexerResult->docCommentCount = docCommentCount;
+    context->docCommentsAllocated = docCommentsAllocated;
+    if (isSynchronized)
+    {
+        // The old tokens end on the same error.
+        if (state->error)
+        {
+            ERR_raiseErrorAt(state->error, getEditedToken(state, lexerResult->tokenCount - 1).offset + delta, -1);
+        }
+    }
+    else
+    {
+        // The lexing stopped at the end of the source or at an error. The line starts are
+        // found up to the end of the source.
+        feedEditedSource(state, state->sourceLength);
+        lastToken = lexerResult->tokenCount;
+        state->error = context->error;
+    }
+
+    replaceLineStarts(
+        state,
+        restart,
+        isSynchronized ? getEditedToken(state, lastToken).offset : state->sourceLength - delta,
+        isSynchronized ? state->source + token.offset : 0,
+        delta);
+    replaceDocComments(state, addedDocCommentCount, firstToken, lastToken, newTokenCount, delta);
+    lexerResult->tokens = replaceGapItems(
+        &state->tokenGap,
+        lexerResult->tokens,
+        &lexerResult->tokenCount,
+        sizeof(struct LEX_LexerToken),
+        shiftTokenOffsets,
+        firstToken,
+        lastToken,
+        newTokens,
+        newTokenCount,
+        delta,
+        0);
+    free(newTokens);
+
+    if (lexerResult->stringCount + lexerResult->numberCount > state->compactionLimit)
+    {
+        compactSideTables(state);
+    }
+
+    // Find the last line starting before or at the end of the source.
+    token = getEditedToken(state, lexerResult->tokenCount - 1);
+    lexerResult->linePos = findLineStartingAfter(state, token.offset);
+    lexerResult->columnPos = token.offset - getEditedLineStart(state, lexerResult->linePos - 1) + 1;
+    return 1;
+}
+
+/**
+ * The header of a token cache. The sections follow it in the order of enum
+ * TokenCacheSection, each aligned to 8 bytes.
+ */
+struct TokenCacheHeader
+{
+    char magic[4]; ///< "EPLT"
+    uint32_t version; ///< LEX_TOKEN_CACHE_VERSION
+    uint32_t tokenSize; ///< Size of struct LEX_LexerToken. The tokens are stored as they are.
+    uint32_t docCommentSize; ///< Size of struct LEX_DocComment.
+    uint64_t sourceHash; ///< The LEX_hashSource of the source.
+    uint64_t sourceLength; ///< Length of the source.
+    uint32_t tokenCount; ///< Count of tokens.
+    uint32_t lineCount; ///< Count of line starts.
+    uint32_t docCommentCount; ///< Count of documentation comments.
+    uint32_t numberCount; ///< Count of number values.
+    uint32_t stringCount; ///< Count of binary strings.
+    uint32_t symbolCount; ///< Count of symbols, including id 0.
+    int32_t linePos; ///< The linePos of the result.
+    int32_t columnPos; ///< The columnPos of the result.
+    uint64_t stringByteCount; ///< Size of the string bytes.
+    uint64_t symbolByteCount; ///< Size of the symbol names.
+    /// The hashKeywordTable of the build. The token types of the keywords are stored.
+    uint64_t keywordHash;
+    /// The hashTokenCache of the cache, computed with this field set to zero.
+    uint64_t cacheHash;
+    uint32_t tokenTypeCount; ///< Count of the token types of the build.
+    uint32_t reserved; ///< Zero.
+};
+
+/**
+ * The place of a binary string or a symbol name in its byte section of the token cache.
+ */
+struct TokenCacheSpan
+{
+    uint32_t offset; ///< Offset in the section.
+    uint32_t length; ///< Length of the bytes.
+};
+
+/**
+ * The sections of a token cache.
+ */
+enum TokenCacheSection
+{
+    TCS_TOKENS, ///< The tokens.
+    TCS_LINE_STARTS, ///< The line starts.
+    TCS_DOC_COMMENTS, ///< The documentation comments.
+    TCS_NUMBERS, ///< The values of the number literals. Their texts are in the source.
+    TCS_STRINGS, ///< The spans of the binary strings.
+    TCS_SYMBOLS, ///< The spans of the symbol names.
+    TCS_STRING_BYTES, ///< The bytes of the binary strings. Equal strings are stored once.
+    TCS_SYMBOL_BYTES, ///< The bytes of the symbol names.
+    TCS_COUNT, ///< Count of sections.
+};
+
+/// Version of the token cache format. Increment it when the format or the token types change.
+#define LEX_TOKEN_CACHE_VERSION 2
+
+/**
+ * Computes the hash of the keyword table. The caches written by a build with other
+ * keywords or other token types of the keywords are not loaded.
+ *
+ * @return The hash.
+ */
+static uint64_t hashKeywordTable(void)
+{
+    uint64_t hash = LEX_SPEC_DELETED + 1;
+    int i;
+
+    for (i = 0; i < KEYWORD_TABLE_SIZE; i++)
+    {
+        const struct KeywordTokenTypePair *pair = &keywordTable[i];
+        if (!pair->keywordLength) continue;
+        hash ^= LEX_hashSource(pair->keywordText, pair->keywordText + pair->keywordLength);
+        hash = (hash ^ ((uint64_t)i << 32) ^ pair->tokenType) * 0x9E3779B97F4A7C15ull;
+    }
+    return hash;
+}
+
+/**
+ * Computes the hash of a token cache. It covers the header and all sections, so a
+ * damaged cache is not loaded.
+ *
+ * @param header The header of the cache.
+ * @param cache The cache.
+ * @param size The size of the cache.
+ *
+ * @return The hash.
+ */
+static uint64_t hashTokenCache(const struct TokenCacheHeader *header, const char *cache, uint64_t size)
+{
+    struct TokenCacheHeader copy = *header;
+
+    copy.cacheHash = 0;
+    return (LEX_hashSource((const char*)&copy, (const char*)(&copy + 1)) * 0x9E3779B97F4A7C15ull) ^
+        LEX_hashSource(cache + sizeof(copy), cache + size);
+}
+
+/**
+ * Computes the offsets of the sections of a token cache.
+ *
+ * @param header The header of the cache.
+ * @param offsets Receives the offsets of the sections.
+ *
+ * @return The size of the cache.
+ */
+static uint64_t getTokenCacheLayout(const struct TokenCacheHeader *header, uint64_t offsets[TCS_COUNT])
+{
+    uint64_t sizes[TCS_COUNT];
+    uint64_t size = sizeof(struct TokenCacheHeader);
+    int i;
+
+    sizes[TCS_TOKENS] = (uint64_t)header->tokenCount * sizeof(struct LEX_LexerToken);
+    sizes[TCS_LINE_STARTS] = (uint64_t)header->lineCount * sizeof(int);
+    sizes[TCS_DOC_COMMENTS] = (uint64_t)header->docCommentCount * sizeof(struct LEX_DocComment);
+    sizes[TCS_NUMBERS] = (uint64_t)header->numberCount * sizeof(uint64_t);
+    sizes[TCS_STRINGS] = (uint64_t)header->stringCount * sizeof(struct TokenCacheSpan);
+    sizes[TCS_SYMBOLS] = (uint64_t)header->symbolCount * sizeof(struct TokenCacheSpan);
+    sizes[TCS_STRING_BYTES] = header->stringByteCount;
+    sizes[TCS_SYMBOL_BYTES] = header->symbolByteCount;
+    for (i = 0; i < TCS_COUNT; i++)
+    {
+        offsets[i] = size;
+        size = (size + sizes[i] + 7) & ~(uint64_t)7;
+    }
+    return size;
+}
+
+uint64_t LEX_hashSource(const char *begin, const char *end)
+{
+    uint64_t hash = 0x243F6A8885A308D3ull ^ (uint64_t)(end - begin);
+    uint64_t word;
+
+    // Eight bytes are mixed in at a time, the tail is padded with zeros.
+    while (end - begin >= 8)
+    {
+        memcpy(&word, begin, 8);
+        hash = (hash ^ word) * 0x9E3779B97F4A7C15ull;
+        hash ^= hash >> 29;
+        begin += 8;
+    }
+    word = 0;
+    memcpy(&word, begin, end - begin);
+    hash = (hash ^ word) * 0x9E3779B97F4A7C15ull;
+    hash ^= hash >> 29;
+    return hash;
+}
+
+void *LEX_saveTokenCache(const struct LEX_LexerResult *lexerResult, size_t *size)
+{
+    struct TokenCacheHeader header;
+    uint64_t offsets[TCS_COUNT];
+    uint64_t cacheSize;
+    struct TokenCacheSpan *stringSpans;
+    struct TokenCacheSpan *symbolSpans;
+    unsigned *stringSlots;
+    unsigned slotCount = 16;
+    unsigned mask;
+    char *cache;
+    uint64_t *numbers;
+    int i;
+
+    if (!lexerResult->source) return 0;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "EPLT", 4);
+    header.version = LEX_TOKEN_CACHE_VERSION;
+    header.tokenSize = sizeof(struct LEX_LexerToken);
+    header.docCommentSize = sizeof(struct LEX_DocComment);
+    header.sourceLength = strlen(lexerResult->source);
+    header.sourceHash = LEX_hashSource(lexerResult->source, lexerResult->source + header.sourceLength);
+    header.tokenCount = lexerResult->tokenCount;
+    header.lineCount = lexerResult->lineCount;
+    header.docCommentCount = lexerResult->docCommentCount;
+    header.numberCount = lexerResult->numberCount;
+    header.stringCount = lexerResult->stringCount;
+    header.symbolCount = lexerResult->symbolCount;
+    header.linePos = lexerResult->linePos;
+    header.columnPos = lexerResult->columnPos;
+    header.keywordHash = hashKeywordTable();
+    header.tokenTypeCount = LEX_SPEC_DELETED + 1;
+
+    // Equal strings are written once.
+    while (slotCount < (unsigned)lexerResult->stringCount * 2)
+    {
+        slotCount <<= 1;
+    }
+    mask = slotCount - 1;
+    stringSlots = calloc(slotCount, sizeof(unsigned));
+    stringSpans = malloc((lexerResult->stringCount + 1) * sizeof(struct TokenCacheSpan));
+    for (i = 0; i < lexerResult->stringCount; i++)
+    {
+        const struct LEX_BinaryString *string = &lexerResult->strings[i];
+        unsigned slot = hashName(string->bytes, string->length) & mask;
+        stringSpans[i].length = string->length;
+        while (stringSlots[slot])
+        {
+            const struct LEX_BinaryString *other = &lexerResult->strings[stringSlots[slot] - 1];
+            if ((other->length == string->length) && !memcmp(other->bytes, string->bytes, string->length)) break;
+            slot = (slot + 1) & mask;
+        }
+        if (stringSlots[slot])
+        {
+            stringSpans[i].offset = stringSpans[stringSlots[slot] - 1].offset;
+        }
+        else
+        {
+            stringSlots[slot] = i + 1;
+            stringSpans[i].offset = header.stringByteCount;
+            header.stringByteCount += string->length;
+        }
+    }
+    free(stringSlots);
+    symbolSpans = malloc((lexerResult->symbolCount + 1) * sizeof(struct TokenCacheSpan));
+    for (i = 0; i < lexerResult->symbolCount; i++)
+    {
+        symbolSpans[i].offset = header.symbolByteCount;
+        symbolSpans[i].length = lexerResult->symbols[i].length;
+        header.symbolByteCount += lexerResult->symbols[i].length;
+    }
+
+    cacheSize = getTokenCacheLayout(&header, offsets);
+    cache = calloc(cacheSize, 1);
+    memcpy(cache + offsets[TCS_TOKENS], lexerResult->tokens, lexerResult->tokenCount * sizeof(struct LEX_LexerToken));
+    memcpy(cache + offsets[TCS_LINE_STARTS], lexerResult->lineStarts, lexerResult->lineCount * sizeof(int));
+    if (lexerResult->docCommentCount)
+    {
+        memcpy(
+            cache + offsets[TCS_DOC_COMMENTS],
+            lexerResult->docComments,
+            lexerResult->docCommentCount * sizeof(struct LEX_DocComment));
+    }
+    numbers = (uint64_t*)(cache + offsets[TCS_NUMBERS]);
+    for (i = 0; i < lexerResult->numberCount; i++)
+    {
+        numbers[i] = lexerResult->numbers[i].integer;
+    }
+    memcpy(cache + offsets[TCS_STRINGS], stringSpans, lexerResult->stringCount * sizeof(struct TokenCacheSpan));
+    memcpy(cache + offsets[TCS_SYMBOLS], symbolSpans, lexerResult->symbolCount * sizeof(struct TokenCacheSpan));
+    for (i = 0; i < lexerResult->stringCount; i++)
+    {
+        memcpy(
+            cache + offsets[TCS_STRING_BYTES] + stringSpans[i].offset,
+            lexerResult->strings[i].bytes,
+            stringSpans[i].length);
+    }
+    for (i = 0; i < lexerResult->symbolCount; i++)
+    {
+        memcpy(
+            cache + offsets[TCS_SYMBOL_BYTES] + symbolSpans[i].offset,
+            lexerResult->symbols[i].name,
+            symbolSpans[i].length);
+    }
+    free(stringSpans);
+    free(symbolSpans);
+    header.cacheHash = hashTokenCache(&header, cache, cacheSize);
+    memcpy(cache, &header, sizeof(header));
+
+    *size = cacheSize;
+    return cache;
+}
+
+/**
+ * Checks the spans of a token cache.
+ *
+ * @param spans The spans.
+ * @param count Count of spans.
+ * @param byteCount Size of the byte section they point into.
+ *
+ * @return Nonzero if all spans are in the byte section.
+ */
+static int areTokenCacheSpansValid(const struct TokenCacheSpan *spans, unsigned count, uint64_t byteCount)
+{
+    unsigned i;
+    for (i = 0; i < count; i++)
+    {
+        if ((uint64_t)spans[i].offset + spans[i].length > byteCount) return 0;
+    }
+    return 1;
+}
+
+int LEX_loadTokenCache(
+    struct LEX_LexerResult *lexerResult,
+    const void *cache,
+    size_t size,
+    const char *begin,
+    const char *end)
+{
+    struct TokenCacheHeader header;
+    uint64_t offsets[TCS_COUNT];
+    const char *bytes = cache;
+    const struct LEX_LexerToken *tokens;
+    const int *lineStarts;
+    const struct LEX_DocComment *docComments;
+    const uint64_t *numbers;
+    const struct TokenCacheSpan *stringSpans;
+    const struct TokenCacheSpan *symbolSpans;
+    unsigned i;
+
+    // The cache is checked before use, a stale or damaged cache is not loaded.
+    if ((size < sizeof(header)) || ((uintptr_t)cache & 7)) return 0;
+    memcpy(&header, cache, sizeof(header));
+    if (memcmp(header.magic, "EPLT", 4) ||
+        (header.version != LEX_TOKEN_CACHE_VERSION) ||
+        (header.tokenSize != sizeof(struct LEX_LexerToken)) ||
+        (header.docCommentSize != sizeof(struct LEX_DocComment)) ||
+        (header.tokenTypeCount != LEX_SPEC_DELETED + 1) ||
+        (header.keywordHash != hashKeywordTable()) ||
+        (header.sourceLength != (uint64_t)(end - begin)) ||
+        !header.tokenCount ||
+        !header.lineCount ||
+        !header.symbolCount ||
+        (header.tokenCount > INT32_MAX) ||
+        (header.lineCount > INT32_MAX) ||
+        (header.docCommentCount > INT32_MAX) ||
+        (header.numberCount > INT32_MAX) ||
+        (header.stringCount > INT32_MAX) ||
+        (header.symbolCount > INT32_MAX) ||
+        (header.stringByteCount > size) ||
+        (header.symbolByteCount > size) ||
+        (getTokenCacheLayout(&header, offsets) != size) ||
+        (header.sourceHash != LEX_hashSource(begin, end)) ||
+        (header.cacheHash != hashTokenCache(&header, bytes, size)))
+    {
+        return 0;
+    }
+    tokens = (const struct LEX_LexerToken*)(bytes + offsets[TCS_TOKENS]);
+    lineStarts = (const int*)(bytes + offsets[TCS_LINE_STARTS]);
+    docComments = (const struct LEX_DocComment*)(bytes + offsets[TCS_DOC_COMMENTS]);
+    numbers = (const uint64_t*)(bytes + offsets[TCS_NUMBERS]);
+    stringSpans = (const struct TokenCacheSpan*)(bytes + offsets[TCS_STRINGS]);
+    symbolSpans = (const struct TokenCacheSpan*)(bytes + offsets[TCS_SYMBOLS]);
+    if (!areTokenCacheSpansValid(stringSpans, header.stringCount, header.stringByteCount) ||
+        !areTokenCacheSpansValid(symbolSpans, header.symbolCount, header.symbolByteCount) ||
+        (tokens[header.tokenCount - 1].tokenType != LEX_SPEC_EOF))
+    {
+        return 0;
+    }
+    for (i = 0; i < header.lineCount; i++)
+    {
+        if ((lineStarts[i] < 0) || ((uint64_t)lineStarts[i] > header.sourceLength)) return 0;
+    }
+    for (i = 0; i < header.docCommentCount; i++)
+    {
+        const struct LEX_LexerToken *token = &docComments[i].token;
+        if (((uint64_t)token->offset + token->length > header.sourceLength) ||
+            (docComments[i].tokenIndex >= header.tokenCount))
+        {
+            return 0;
+        }
+    }
+    for (i = 0; i < header.tokenCount; i++)
+    {
+        const struct LEX_LexerToken *token = &tokens[i];
+        if (((uint64_t)token->offset + token->length > header.sourceLength) ||
+            ((token->tokenType == LEX_IDENTIFIER) && (token->value >= header.symbolCount)) ||
+            ((token->tokenType == LEX_STRING) && (token->value >= header.stringCount)) ||
+            (isNumberToken(token->tokenType) && (token->value >= header.numberCount)))
+        {
+            return 0;
+        }
+    }
+
+    memset(lexerResult, 0, sizeof(*lexerResult));
+    lexerResult->source = begin;
+    lexerResult->isMapped = 1;
+    lexerResult->tokens = (struct LEX_LexerToken*)tokens;
+    lexerResult->tokenCount = header.tokenCount;
+    lexerResult->lineStarts = (int*)lineStarts;
+    lexerResult->lineCount = header.lineCount;
+    lexerResult->docComments = (struct LEX_DocComment*)docComments;
+    lexerResult->docCommentCount = header.docCommentCount;
+    lexerResult->linePos = header.linePos;
+    lexerResult->columnPos = header.columnPos;
+
+    // The side tables hold pointers, they are rebuilt.
+    lexerResult->numberCount = header.numberCount;
+    lexerResult->numbers = calloc(header.numberCount + 1, sizeof(struct LEX_Number));
+    for (i = 0; i < header.numberCount; i++)
+    {
+        lexerResult->numbers[i].integer = numbers[i];
+    }
+    for (i = 0; i < header.tokenCount; i++)
+    {
+        if (isNumberToken(tokens[i].tokenType))
+        {
+            lexerResult->numbers[tokens[i].value].text = begin + tokens[i].offset;
+        }
+    }
+    lexerResult->stringCount = header.stringCount;
+    lexerResult->strings = malloc((header.stringCount + 1) * sizeof(struct LEX_BinaryString));
+    for (i = 0; i < header.stringCount; i++)
+    {
+        lexerResult->strings[i].bytes = bytes + offsets[TCS_STRING_BYTES] + stringSpans[i].offset;
+        lexerResult->strings[i].length = stringSpans[i].length;
+    }
+    lexerResult->symbolCount = header.symbolCount;
+    lexerResult->symbols = malloc(header.symbolCount * sizeof(struct LEX_Symbol));
+    for (i = 0; i < header.symbolCount; i++)
+    {
+        lexerResult->symbols[i].name = bytes + offsets[TCS_SYMBOL_BYTES] + symbolSpans[i].offset;
+        lexerResult->symbols[i].length = symbolSpans[i].length;
+    }
+    return 1;
 }
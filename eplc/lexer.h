@@ -27,6 +27,9 @@
 #ifndef LEXER_H
 #define LEXER_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 /**
  * Stores the token types.
  */
@@ -121,18 +124,75 @@ enum LEX_TokenType
 
 /**
  * Stores info about a lexer token.
+ *
+ * The token refers to the source by offset. The line and column of an offset is
+ * computed by LEX_getPosition when needed.
  */
 struct LEX_LexerToken
 {
-    const char *start; ///< First character of the token.
-    int length; ///< Length of the token.
-    int beginLine; ///< Line of the first character.
-    int beginColumn; ///< Column of the first character.
-    int endLine; ///< Line of the character after the last character.
-    int endColumn; ///< Column of the character after the last character.
-    enum LEX_TokenType tokenType; ///< The type of the token.
+    unsigned offset; ///< Offset of the first character in the source.
+    unsigned length; ///< Length of the token in the source.
+    /// Symbol id for identifiers, index of the binary string for string tokens, index of
+    /// the decoded number for number tokens. For lexers fed in chunks it's the index of
+    /// the saved text for the other tokens.
+    unsigned value;
+    unsigned char tokenType; ///< The type of the token. (enum LEX_TokenType)
+};
+
+/**
+ * A string literal in binary form.
+ */
+struct LEX_BinaryString
+{
+    /// The bytes of the string in the text arena. Identical strings share the bytes.
+    const char *bytes;
+    int length; ///< Length of the string.
+};
+
+/**
+ * The decoded value of a number literal.
+ */
+struct LEX_Number
+{
+    union
+    {
+        /// The value of an integer literal. Negative literals are in two's complement.
+        uint64_t integer;
+        double real; ///< The value of a float literal.
+    };
+    const char *text; ///< The spelling of the literal.
+};
+
+/**
+ * A documentation comment. Comments are not returned as tokens, the documentation
+ * comments are collected in a side table of the lexer result instead.
+ */
+struct LEX_DocComment
+{
+    struct LEX_LexerToken token; ///< The comment. Its text is returned by LEX_getTokenText.
+    unsigned tokenIndex; ///< The index of the token following the comment.
+};
+
+/**
+ * The name of an interned identifier.
+ */
+struct LEX_Symbol
+{
+    const char *name; ///< The name.
+    int length; ///< Length of the name.
 };
 
+/**
+ * A block of the text arena which stores the binary strings and the token texts of the
+ * lexers fed in chunks.
+ */
+struct LEX_TextBlock;
+
+/**
+ * The state kept by LEX_relex between the edits of a lexer result.
+ */
+struct LEX_RelexState;
+
 /**
  * This struct stores the result of the lexer.
  */
@@ -142,10 +202,159 @@ struct LEX_LexerResult
     struct LEX_LexerToken *tokens; ///< The array of tokoens.
     int columnPos; ///< Column pos of the last successfully parsed character.
     int linePos; ///< Line of the last successfully parsed character.
-    char **strings; ///< Array of binary strings.
+    struct LEX_BinaryString *strings; ///< Array of binary strings.
     int stringCount; ///< Count of binary strings.
+    /// The source code the tokens refer to. Null if the lexer is fed in chunks.
+    const char *source;
+    int *lineStarts; ///< Offsets of the first characters of the lines.
+    int lineCount; ///< Count of lines.
+    /// The saved token texts if the lexer is fed in chunks. Tokens refer to them by value.
+    const char **texts;
+    int textCount; ///< Count of saved token texts.
+    struct LEX_TextBlock *textBlocks; ///< The blocks holding the binary strings and saved texts.
+    /// The names of the identifiers indexed by symbol id. Equal names have the same id.
+    /// Id 0 is not used by any identifier, its name is empty.
+    struct LEX_Symbol *symbols;
+    int symbolCount; ///< Count of symbols, including id 0.
+    struct LEX_Number *numbers; ///< The values of the number literals.
+    int numberCount; ///< Count of number literals.
+    /// The documentation comments in source order.
+    struct LEX_DocComment *docComments;
+    int docCommentCount; ///< Count of documentation comments.
+    /// The edited source and the hash tables of LEX_relex. Null until the first edit.
+    struct LEX_RelexState *relexState;
+    /// Nonzero if the tokens, the line starts and the documentation comments are in a
+    /// token cache loaded by LEX_loadTokenCache. Then they are not freed.
+    int isMapped;
 };
 
+/**
+ * The streaming lexer. Scans the tokens on demand.
+ */
+struct LEX_Lexer;
+
+/**
+ * Creates a streaming lexer.
+ *
+ * @param [in] code The code to be parsed. Must be valid until the lexer is destroyed.
+ *
+ * @return The lexer. Destroy it with LEX_destroyLexer.
+ */
+struct LEX_Lexer *LEX_createLexer(const char *code);
+/**
+ * Creates a streaming lexer on a source of known length, without scanning it for its
+ * terminating zero.
+ *
+ * The byte at end must be a readable zero, the scanning stops on it. Memory mapped
+ * files are terminated by the zeros after the end of the file on the last page, or by
+ * a zero page mapped after them. A zero before end is an invalid character.
+ *
+ * The source is checked to be UTF-8 here, but the error is raised in the error context
+ * of the first LEX_nextToken or LEX_peekToken call.
+ *
+ * @param [in] begin The first character of the source. Must be valid until the lexer
+ *     is destroyed.
+ * @param [in] end The end of the source.
+ *
+ * @return The lexer. Destroy it with LEX_destroyLexer.
+ */
+struct LEX_Lexer *LEX_createBufferLexer(const char *begin, const char *end);
+/**
+ * Called by the lexer when it needs more input. It must call LEX_feed or LEX_finish.
+ *
+ * @param [in,out] lexer The lexer.
+ * @param [in] userData The user data given to LEX_createChunkedLexer.
+ */
+typedef void (*LEX_InputCallback)(struct LEX_Lexer *lexer, void *userData);
+/**
+ * Creates a streaming lexer whose source is fed in chunks by LEX_feed. Only the
+ * unscanned part of the source is kept in memory, the texts of the tokens are saved
+ * into the lexer result.
+ *
+ * @param [in] inputCallback Called when the lexer runs out of input. If null,
+ *      LEX_nextToken and LEX_peekToken return null when they need more input.
+ * @param [in] userData Passed to the input callback.
+ *
+ * @return The lexer. Destroy it with LEX_destroyLexer.
+ */
+struct LEX_Lexer *LEX_createChunkedLexer(LEX_InputCallback inputCallback, void *userData);
+/**
+ * Creates a streaming lexer which returns the tokens of a complete lexer result instead
+ * of scanning the source, eg. the result loaded by LEX_loadTokenCache. The errors of
+ * the result are not raised again.
+ *
+ * @param [in] lexerResult The result. It's not copied, must be valid until the lexer is
+ *     destroyed. It's not cleaned up by LEX_destroyLexer.
+ *
+ * @return The lexer. Destroy it with LEX_destroyLexer.
+ */
+struct LEX_Lexer *LEX_createResultLexer(const struct LEX_LexerResult *lexerResult);
+/**
+ * Appends the next chunk of the source to a lexer created by LEX_createChunkedLexer.
+ * A token may span several chunks.
+ *
+ * @param [in,out] lexer The lexer.
+ * @param [in] buffer The chunk. It's copied, can be reused after the call.
+ * @param [in] length The length of the chunk.
+ */
+void LEX_feed(struct LEX_Lexer *lexer, const char *buffer, int length);
+/**
+ * Tells the lexer created by LEX_createChunkedLexer that there is no more input.
+ *
+ * @param [in,out] lexer The lexer.
+ */
+void LEX_finish(struct LEX_Lexer *lexer);
+/**
+ * Copies a text to the lexer. It's for texts which are not in the source, but needed as
+ * long as the token texts.
+ *
+ * @param [in,out] lexer The lexer.
+ * @param [in] text The text.
+ * @param [in] length The length of the text.
+ *
+ * @return The copy. It's valid until the lexer is destroyed.
+ */
+const char *LEX_saveText(struct LEX_Lexer *lexer, const char *text, int length);
+/**
+ * Reads the next token.
+ *
+ * Adjacent strings are merged into a single token, and the last token is
+ * LEX_SPEC_EOF which is returned over and over again at the end. On error the
+ * error is raised and LEX_SPEC_EOF is returned. Comments are skipped, the
+ * documentation comments are added to the docComments of the lexer result.
+ *
+ * @param [in,out] lexer The lexer.
+ *
+ * @return The token. It's valid until the 8th next token is read. Null if a chunked
+ *      lexer without input callback needs more input.
+ */
+const struct LEX_LexerToken *LEX_nextToken(struct LEX_Lexer *lexer);
+/**
+ * Looks ahead in the token stream without reading the tokens.
+ *
+ * @param [in,out] lexer The lexer.
+ * @param [in] ahead How many tokens to look ahead. 0 is the token LEX_nextToken will return.
+ *      Must be less than 8.
+ *
+ * @return The token. Null if a chunked lexer without input callback needs more input.
+ */
+const struct LEX_LexerToken *LEX_peekToken(struct LEX_Lexer *lexer, int ahead);
+/**
+ * Returns the lexer result of a streaming lexer. It has no tokens but its binary
+ * strings and line table can be used to get the text and position of the tokens.
+ * The linePos and columnPos are set when the end is reached or an error occurs.
+ *
+ * @param [in] lexer The lexer.
+ *
+ * @return The result. It's valid until the lexer is destroyed.
+ */
+const struct LEX_LexerResult *LEX_getLexerResult(const struct LEX_Lexer *lexer);
+/**
+ * Destroys the lexer and its binary strings.
+ *
+ * @param [in] lexer The lexer.
+ */
+void LEX_destroyLexer(struct LEX_Lexer *lexer);
 /**
  * Parses the source code into tokens
  *
@@ -154,6 +363,152 @@ struct LEX_LexerResult
  * @return The tokens
  */
 struct LEX_LexerResult LEX_tokenizeString(const char *code);
+/**
+ * Parses a source of known length into tokens. See LEX_createBufferLexer for the
+ * requirements of the buffer.
+ *
+ * @param [in] begin The first character of the source.
+ * @param [in] end The end of the source. The byte at end must be a readable zero.
+ *
+ * @return The tokens
+ */
+struct LEX_LexerResult LEX_tokenizeBuffer(const char *begin, const char *end);
+/**
+ * Parses the source code into tokens on several threads.
+ *
+ * The source is split into chunks at line starts and the chunks are lexed at the same
+ * time as if no comment or string literal spanned the chunk boundaries. When joining,
+ * the part of a chunk that started in the middle of a token is lexed again. The result
+ * is the same as the result of LEX_tokenizeString.
+ *
+ * @param [in] code The code to be parsed.
+ * @param [in] threadCount The maximum count of threads. Short sources use fewer.
+ *
+ * @return The tokens
+ */
+struct LEX_LexerResult LEX_tokenizeStringParallel(const char *code, int threadCount);
+/**
+ * Parses a source of known length into tokens on several threads, like
+ * LEX_tokenizeStringParallel. The result is the same as the result of
+ * LEX_tokenizeBuffer. Sources with a zero before the end are lexed by LEX_tokenizeBuffer.
+ *
+ * @param [in] begin The first character of the source.
+ * @param [in] end The end of the source. The byte at end must be a readable zero.
+ * @param [in] threadCount The maximum count of threads. Short sources use fewer.
+ *
+ * @return The tokens
+ */
+struct LEX_LexerResult LEX_tokenizeBufferParallel(const char *begin, const char *end, int threadCount);
+/**
+ * Applies an edit to the source of a lexer result and updates its tokens.
+ *
+ * Only the tokens from the one containing the edit are lexed again, until the new tokens
+ * meet a token of the old result at the same place in the unchanged text. The source,
+ * the tokens and the line starts have a gap at the last edit, and the offsets after it
+ * are shifted when they are moved before a later gap, so an edit costs about as much as
+ * the text between it and the previous edit. The documentation comments are shifted
+ * right away. After LEX_flushEdits the result is the same as the result of
+ * LEX_tokenizeString on the edited source, except that the side tables may have the
+ * values of replaced literals, until they are dropped when they outnumber the used ones.
+ * Symbol ids are kept.
+ *
+ * The counts, the side tables, the documentation comments and the position of the end
+ * are up to date after each edit, the source, the tokens and the line starts only after
+ * LEX_flushEdits.
+ *
+ * On the first edit the source is copied, then the result owns it, so the source given
+ * to the lexer may be freed. Lexical errors are raised as by LEX_tokenizeString.
+ *
+ * @param [in,out] lexerResult The result of LEX_tokenizeString or
+ *     LEX_tokenizeStringParallel.
+ * @param [in] editOffset The offset of the edit in the current source.
+ * @param [in] removedLength The count of characters removed from editOffset.
+ * @param [in] insertedText The text inserted at editOffset.
+ *
+ * @return Nonzero on success. Zero if the result has no source or the edit is out of it.
+ */
+int LEX_relex(
+    struct LEX_LexerResult *lexerResult,
+    unsigned editOffset,
+    unsigned removedLength,
+    const char *insertedText);
+/**
+ * Closes the gaps left by the edits of LEX_relex, so the source, the tokens and the line
+ * starts of the result can be read. It moves the text and the items after the last edit.
+ *
+ * @param [in,out] lexerResult The lexer result. Nothing is done if it was not edited.
+ */
+void LEX_flushEdits(struct LEX_LexerResult *lexerResult);
+/**
+ * Computes the hash of a source which identifies it in the token cache. It's a fast
+ * non-cryptographic hash.
+ *
+ * @param [in] begin The first character of the source.
+ * @param [in] end The end of the source.
+ *
+ * @return The hash.
+ */
+uint64_t LEX_hashSource(const char *begin, const char *end);
+/**
+ * Serializes a lexer result into a token cache.
+ *
+ * The cache is a versioned binary image of the tokens, the line starts, the
+ * documentation comments, the number values, the binary strings and the symbol names
+ * with the hash of the source, the count of token types and the hash of the keyword
+ * table of the build, and a hash of the whole cache. Only results without lexical
+ * errors should be saved, the error is not stored.
+ *
+ * @param [in] lexerResult The result of LEX_tokenizeBuffer or an other lexer result
+ *     having a source and a token array.
+ * @param [out] size The size of the cache.
+ *
+ * @return The cache allocated by malloc. Null if the result has no source.
+ */
+void *LEX_saveTokenCache(const struct LEX_LexerResult *lexerResult, size_t *size);
+/**
+ * Loads a lexer result from a token cache instead of lexing the source.
+ *
+ * The tokens, the line starts and the documentation comments are used in place, the
+ * binary strings and the symbol names point into the cache, so the cache must stay
+ * valid until the result is cleaned up. The cache is rejected if it's from another
+ * format version or a build with other token types or keywords, its source hash
+ * doesn't match, or its hash doesn't match its contents.
+ *
+ * @param [out] lexerResult Receives the result. Clean it up by LEX_cleanUpLexerResult.
+ * @param [in] cache The cache, eg. a mapped file. Must be aligned to 8 bytes.
+ * @param [in] size The size of the cache.
+ * @param [in] begin The first character of the source.
+ * @param [in] end The end of the source.
+ *
+ * @return Nonzero if the cache is loaded, zero if the source must be lexed.
+ */
+int LEX_loadTokenCache(
+    struct LEX_LexerResult *lexerResult,
+    const void *cache,
+    size_t size,
+    const char *begin,
+    const char *end);
+/**
+ * Returns the text of a token.
+ *
+ * @param [in] lexerResult The lexer result the token belongs to.
+ * @param [in] token The token.
+ * @param [out] length The length of the text.
+ *
+ * @return The source text of the token, the binary string for string tokens.
+ */
+const char *LEX_getTokenText(
+    const struct LEX_LexerResult *lexerResult,
+    const struct LEX_LexerToken *token,
+    int *length);
+/**
+ * Computes the line and column of a source offset. Both are counted from 1.
+ *
+ * @param [in] lexerResult The lexer result of the source.
+ * @param [in] offset The offset.
+ * @param [out] line,column The position of the offset.
+ */
+void LEX_getPosition(const struct LEX_LexerResult *lexerResult, int offset, int *line, int *column);
 /**
  * Cleans up the lexer result
  *
@@ -0,0 +1,431 @@
+/**
+ * Copyright (c) 2012, Csirmaz Dávid
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file
+ * Tests of the lexer: the results of the parallel lexer, the incremental relexing and
+ * the token cache must equal the result of LEX_tokenizeString, a damaged token cache
+ * must not be loaded, and the errors must be raised in the error context of the
+ * scanning at the right place.
+ *
+ * Build: gcc -pthread lextest.c lexer.c error.c
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <assert.h>
+#include <string.h>
+
+#include "lexer.h"
+#include "error.h"
+
+/**
+ * A growing source text.
+ */
+struct Source
+{
+    char *text; ///< The text terminated by zero.
+    int length; ///< Length of the text.
+    int allocated; ///< Allocated size of the text.
+};
+
+/**
+ * Appends formatted text to the source.
+ */
+void appendSource(struct Source *source, const char *format, ...)
+{
+    va_list args;
+    int length;
+
+    va_start(args, format);
+    length = vsnprintf(0, 0, format, args);
+    va_end(args);
+    while (source->length + length + 1 > source->allocated)
+    {
+        source->allocated = source->allocated ? source->allocated * 2 : 4096;
+        source->text = realloc(source->text, source->allocated);
+    }
+    va_start(args, format);
+    vsnprintf(source->text + source->length, length + 1, format, args);
+    va_end(args);
+    source->length += length;
+}
+
+/**
+ * Generates a source of at least the given size. Its long block comments and strings
+ * make some chunk boundaries of the parallel lexer fall inside them. The names in the
+ * block comments are declared later, so a chunk may see them before their first use.
+ */
+void generateSource(struct Source *source, int size)
+{
+    int i = 0;
+
+    while (source->length < size)
+    {
+        appendSource(source, "/** Doc comment of unit %d */\n", i);
+        appendSource(source, "vardecl $i32 name%d := 0x%X + 0%o - %d;\n", i % 1000, i, i % 512, i);
+        appendSource(source, "vardecl $f64 real%d := %d.%de-3; ///< back comment\n", i % 700, i, i % 97);
+        appendSource(source, "vardecl staticptr to $u8 text%d := \"str%d\" #32 \"more\" #10;\n", i % 300, i % 50);
+        appendSource(source, "vardecl $i32 part%d := %d;\n", i, i);
+        appendSource(
+            source, "/* block comment\n   spanning\n   part%d\n   %d\n   and\n   more\n   lines */\n", i + 1, i);
+        appendSource(source, "// eol comment %d\n", i);
+        i++;
+    }
+}
+
+/**
+ * Checks that two lexer results have the same tokens and side tables.
+ */
+void assertSameResults(const struct LEX_LexerResult *a, const struct LEX_LexerResult *b)
+{
+    int i;
+
+    assert(a->tokenCount == b->tokenCount);
+    for (i = 0; i < a->tokenCount; i++)
+    {
+        assert(a->tokens[i].offset == b->tokens[i].offset);
+        assert(a->tokens[i].length == b->tokens[i].length);
+        assert(a->tokens[i].value == b->tokens[i].value);
+        assert(a->tokens[i].tokenType == b->tokens[i].tokenType);
+    }
+    assert(a->lineCount == b->lineCount);
+    assert(!memcmp(a->lineStarts, b->lineStarts, a->lineCount * sizeof(int)));
+    assert(a->stringCount == b->stringCount);
+    for (i = 0; i < a->stringCount; i++)
+    {
+        assert(a->strings[i].length == b->strings[i].length);
+        assert(!memcmp(a->strings[i].bytes, b->strings[i].bytes, a->strings[i].length));
+    }
+    assert(a->numberCount == b->numberCount);
+    for (i = 0; i < a->numberCount; i++)
+    {
+        assert(a->numbers[i].integer == b->numbers[i].integer);
+    }
+    assert(a->symbolCount == b->symbolCount);
+    for (i = 0; i < a->symbolCount; i++)
+    {
+        assert(a->symbols[i].length == b->symbols[i].length);
+        assert(!memcmp(a->symbols[i].name, b->symbols[i].name, a->symbols[i].length));
+    }
+    assert(a->docCommentCount == b->docCommentCount);
+    for (i = 0; i < a->docCommentCount; i++)
+    {
+        assert(a->docComments[i].token.offset == b->docComments[i].token.offset);
+        assert(a->docComments[i].token.length == b->docComments[i].token.length);
+        assert(a->docComments[i].tokenIndex == b->docComments[i].tokenIndex);
+    }
+}
+
+/**
+ * Lexes a source of several chunks in parallel, and compares it to the serial result.
+ */
+void testParallelLexer()
+{
+    struct Source source = {0, 0, 0};
+    struct LEX_LexerResult serial;
+    struct LEX_LexerResult parallel;
+    int threadCount;
+
+    generateSource(&source, 5 << 20);
+    serial = LEX_tokenizeString(source.text);
+    assert(!ERR_isError());
+    for (threadCount = 2; threadCount <= 5; threadCount++)
+    {
+        parallel = LEX_tokenizeStringParallel(source.text, threadCount);
+        assert(!ERR_isError());
+        assertSameResults(&serial, &parallel);
+        LEX_cleanUpLexerResult(&parallel);
+    }
+    parallel = LEX_tokenizeBufferParallel(source.text, source.text + source.length, 4);
+    assert(!ERR_isError());
+    assertSameResults(&serial, &parallel);
+    LEX_cleanUpLexerResult(&parallel);
+    LEX_cleanUpLexerResult(&serial);
+    free(source.text);
+    printf("Parallel lexer OK.\n");
+}
+
+/**
+ * Checks that an edited lexer result has the same tokens as the result of lexing the
+ * edited source again. The side tables of the edited result may have extra entries, so
+ * the values of the tokens are compared by what they refer to.
+ */
+void assertSameTokens(const struct LEX_LexerResult *edited, const struct LEX_LexerResult *full)
+{
+    int i;
+
+    assert(edited->tokenCount == full->tokenCount);
+    for (i = 0; i < edited->tokenCount; i++)
+    {
+        const struct LEX_LexerToken *a = &edited->tokens[i];
+        const struct LEX_LexerToken *b = &full->tokens[i];
+
+        assert(a->offset == b->offset);
+        assert(a->length == b->length);
+        assert(a->tokenType == b->tokenType);
+        switch (a->tokenType)
+        {
+            case LEX_IDENTIFIER:
+                assert(edited->symbols[a->value].length == full->symbols[b->value].length);
+                assert(!memcmp(edited->symbols[a->value].name, full->symbols[b->value].name, full->symbols[b->value].length));
+                break;
+            case LEX_STRING:
+                assert(edited->strings[a->value].length == full->strings[b->value].length);
+                assert(!memcmp(edited->strings[a->value].bytes, full->strings[b->value].bytes, full->strings[b->value].length));
+                break;
+            case LEX_FLOAT_NUMBER:
+            case LEX_HEXA_INTEGER:
+            case LEX_DECIMAL_INTEGER:
+            case LEX_OCTAL_INTEGER:
+                assert(edited->numbers[a->value].integer == full->numbers[b->value].integer);
+                break;
+        }
+    }
+    assert(edited->lineCount == full->lineCount);
+    assert(!memcmp(edited->lineStarts, full->lineStarts, full->lineCount * sizeof(int)));
+    assert(edited->docCommentCount == full->docCommentCount);
+    for (i = 0; i < full->docCommentCount; i++)
+    {
+        assert(edited->docComments[i].token.offset == full->docComments[i].token.offset);
+        assert(edited->docComments[i].token.length == full->docComments[i].token.length);
+        assert(edited->docComments[i].tokenIndex == full->docComments[i].tokenIndex);
+    }
+}
+
+/**
+ * Edits a source at random places, relexes it after each edit, and compares the result
+ * to the result of lexing the edited source from scratch. Several edits are made before
+ * most comparisons, so the gaps of the edited result move back and forth.
+ */
+void testRelex()
+{
+    static const char *insertions[] =
+    {
+        "x", "name ", " ", "\n", "\r\n", ";", ":=", "0x1F", "42", "3.5", "\"text\"", " #32 ",
+        "/* new comment */", "/** doc */", "// eol\n", "/*", "*/", "\"", "vardecl $i32 y;\n",
+    };
+    struct Source source = {0, 0, 0};
+    struct LEX_LexerResult edited;
+    struct LEX_LexerResult full;
+    const struct ERR_Error *error;
+    enum ERR_ErrorCode editedError;
+    const char *insertion;
+    unsigned length;
+    unsigned offset;
+    unsigned removed;
+    int editCount = 0;
+    int errorCount = 0;
+    int i;
+
+    srand(12345);
+    generateSource(&source, 20000);
+    edited = LEX_tokenizeString(source.text);
+    assert(!ERR_isError());
+    length = source.length;
+    for (i = 0; i < 3000; i++)
+    {
+        offset = rand() % (length + 1);
+        removed = rand() % 4 ? 0 : rand() % 8;
+        if (removed > length - offset)
+        {
+            removed = length - offset;
+        }
+        insertion = insertions[rand() % (sizeof(insertions) / sizeof(insertions[0]))];
+        assert(LEX_relex(&edited, offset, removed, insertion));
+        length += strlen(insertion) - removed;
+        error = ERR_getFirstError();
+        editedError = error ? error->errorCode : E_OK;
+        ERR_clearErrors();
+        if ((editedError == E_OK) && (rand() % 4)) continue;
+
+        LEX_flushEdits(&edited);
+        assert(strlen(edited.source) == length);
+        full = LEX_tokenizeString(edited.source);
+        error = ERR_getFirstError();
+        assert(editedError == (error ? error->errorCode : E_OK));
+        ERR_clearErrors();
+        if (editedError == E_OK)
+        {
+            assertSameTokens(&edited, &full);
+            editCount++;
+        }
+        LEX_cleanUpLexerResult(&full);
+        if (editedError != E_OK)
+        {
+            // The edits go on from a valid source.
+            LEX_cleanUpLexerResult(&edited);
+            edited = LEX_tokenizeString(source.text);
+            length = source.length;
+            errorCount++;
+        }
+    }
+    LEX_cleanUpLexerResult(&edited);
+    free(source.text);
+    printf("Relex OK, %d edits compared, %d edits made the source invalid.\n", editCount, errorCount);
+}
+
+/**
+ * Edits the same literals of a source many times, and checks that the values of the
+ * replaced literals are dropped from the side tables.
+ */
+void testRelexCompaction()
+{
+    const char *code = "a := 42;\nb := \"text\";\n";
+    struct LEX_LexerResult edited;
+    struct LEX_LexerResult full;
+    int i;
+
+    edited = LEX_tokenizeString(code);
+    assert(!ERR_isError());
+    for (i = 0; i < 20000; i++)
+    {
+        assert(LEX_relex(&edited, 5, 2, i % 2 ? "42" : "43"));
+        assert(LEX_relex(&edited, 14, 6, i % 2 ? "\"text\"" : "\"txet\""));
+        assert(!ERR_isError());
+        // The tables are compacted when they have 4096 more entries than twice the used ones.
+        assert(edited.stringCount + edited.numberCount <= 2 * 2 + 4096);
+    }
+    LEX_flushEdits(&edited);
+    full = LEX_tokenizeString(edited.source);
+    assertSameTokens(&edited, &full);
+    LEX_cleanUpLexerResult(&full);
+    LEX_cleanUpLexerResult(&edited);
+    printf("Relex compaction OK.\n");
+}
+
+/**
+ * Saves a lexer result into a token cache and loads it back, then checks that the cache
+ * is not loaded after any bit of it is flipped.
+ */
+void testTokenCache()
+{
+    struct Source source = {0, 0, 0};
+    struct LEX_LexerResult full;
+    struct LEX_LexerResult loaded;
+    char *cache;
+    size_t size;
+    size_t bit;
+    int i;
+
+    srand(54321);
+    generateSource(&source, 100000);
+    full = LEX_tokenizeString(source.text);
+    assert(!ERR_isError());
+    cache = LEX_saveTokenCache(&full, &size);
+    assert(cache);
+    assert(LEX_loadTokenCache(&loaded, cache, size, source.text, source.text + source.length));
+    assertSameResults(&full, &loaded);
+    LEX_cleanUpLexerResult(&loaded);
+    for (i = 0; i < 300; i++)
+    {
+        bit = (size_t)rand() % (size * 8);
+        cache[bit / 8] ^= 1 << (bit % 8);
+        assert(!LEX_loadTokenCache(&loaded, cache, size, source.text, source.text + source.length));
+        cache[bit / 8] ^= 1 << (bit % 8);
+    }
+    free(cache);
+    LEX_cleanUpLexerResult(&full);
+    free(source.text);
+    printf("Token cache OK.\n");
+}
+
+/**
+ * Checks that the UTF-8 error of a buffer lexer is raised in the error context set after
+ * the lexer is created, as the compiler instances do, not in the context current at the
+ * creation.
+ */
+void testDeferredUtf8Error()
+{
+    const char *code = "module exe;\n// \xe2\x28\xa1\nmain\n{\n}\n";
+    struct ERR_Context errorContext;
+    struct ERR_Context *previousContext;
+    struct LEX_Lexer *lexer;
+    const struct ERR_Error *error;
+
+    lexer = LEX_createLexer(code);
+    assert(!ERR_isError());
+    ERR_initializeContext(&errorContext);
+    previousContext = ERR_setContext(&errorContext);
+    while (LEX_nextToken(lexer)->tokenType != LEX_SPEC_EOF);
+    error = ERR_getFirstError();
+    assert(error && (error->errorCode == E_LEX_INVALID_UTF8));
+    assert(error->offset == 15);
+    ERR_catchError(E_LEX_INVALID_UTF8);
+    assert(!ERR_isError());
+    ERR_setContext(previousContext);
+    assert(!ERR_isError());
+    LEX_destroyLexer(lexer);
+    printf("Deferred UTF-8 error OK.\n");
+}
+
+/**
+ * Checks that a too large integer literal is reported at its start, by the serial, the
+ * parallel and the incremental lexer.
+ */
+void testIntegerTooLarge()
+{
+    const char *literal = "vardecl $i32 a := 99999999999999999999999;\n";
+    struct Source source = {0, 0, 0};
+    struct LEX_LexerResult lexerResult;
+    const struct ERR_Error *error;
+    unsigned offset;
+
+    lexerResult = LEX_tokenizeString(literal);
+    error = ERR_getFirstError();
+    assert(error && (error->errorCode == E_LEX_INTEGER_TOO_LARGE));
+    assert(error->offset == 18);
+    assert((lexerResult.linePos == 1) && (lexerResult.columnPos == 19));
+    ERR_clearErrors();
+    LEX_cleanUpLexerResult(&lexerResult);
+
+    generateSource(&source, 3 << 20);
+    offset = source.length;
+    appendSource(&source, "%s", literal);
+    generateSource(&source, 6 << 20);
+    lexerResult = LEX_tokenizeStringParallel(source.text, 3);
+    error = ERR_getFirstError();
+    assert(error && (error->errorCode == E_LEX_INTEGER_TOO_LARGE));
+    assert(error->offset == offset + 18);
+    ERR_clearErrors();
+    LEX_relex(&lexerResult, 0, 0, " ");
+    error = ERR_getFirstError();
+    assert(error && (error->errorCode == E_LEX_INTEGER_TOO_LARGE));
+    assert(error->offset == offset + 19);
+    ERR_clearErrors();
+    LEX_cleanUpLexerResult(&lexerResult);
+    free(source.text);
+    printf("Integer too large OK.\n");
+}
+
+int main()
+{
+    testDeferredUtf8Error();
+    testIntegerTooLarge();
+    testParallelLexer();
+    testRelex();
+    testRelexCompaction();
+    testTokenCache();
+    return 0;
+}
@@ -22,44 +22,360 @@
  * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
+#include <inttypes.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+/// The source files are mapped into the memory instead of reading them.
+#define MAP_SOURCE_FILES
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+/// eplc can run as a compile server listening on a Unix socket.
+#define COMPILE_SERVER
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+/// The messages of the compilations can be kept in a cache directory.
+#define COMPILATION_CACHE
+#include <dirent.h>
+#include <errno.h>
+#include <sys/time.h>
+#endif
 
 #include "lexer.h"
 #include "error.h"
 #include "syntax.h"
 #include "assocarray.h"
 #include "semantic.h"
+#include "compiler.h"
+#include "timing.h"
+
+#if defined(EPLC_COUNT_ALLOCATIONS) && defined(__GLIBC__) && \
+    !defined(__SANITIZE_ADDRESS__) && !defined(__SANITIZE_THREAD__)
+/// The allocations are counted for the time report by wrapping the allocator of glibc.
+/// Opt in with -DEPLC_COUNT_ALLOCATIONS, the wrappers replace malloc in the whole
+/// program. Otherwise the time report has no allocation counts.
+#define COUNT_ALLOCATIONS
+#endif
+
+/**
+ * Receives the messages of the compilation of a source file.
+ *
+ * @param msg The message.
+ * @param userData The user data given with the callback.
+ */
+typedef void (*NotificationCallback)(const char *msg, void *userData);
+
+/**
+ * The formats of the diagnostics.
+ */
+enum DiagnosticFormat
+{
+    DF_TEXT, ///< One line of text per diagnostic.
+    DF_JSON, ///< One JSON object per line. (--json-diagnostics)
+};
+
+/// Size of the buffer of the dump files.
+#define DUMP_BUFFER_SIZE (1 << 20)
+
+/// Version of the binary dump format.
+#define DUMP_VERSION 1
+
+/**
+ * The format of the time report. (--time-report[=json])
+ */
+enum TimeReportFormat
+{
+    TRF_NONE, ///< No time report.
+    TRF_TABLE, ///< A human readable table.
+    TRF_JSON, ///< A JSON object on one line.
+};
+
+/// Version of the format of the compilation cache entries.
+#define CACHE_VERSION 2
+
+/// The default size limit of the compilation cache in megabytes.
+#define DEFAULT_CACHE_SIZE 256
+
+/// Temporary files of the compilation cache older than this many seconds are left by
+/// writers that crashed, they are removed.
+#define CACHE_TEMPORARY_FILE_AGE 3600
+
+/// Sources of at least this many bytes are lexed ahead on several threads when there
+/// are more threads than files.
+#define PARALLEL_LEX_MIN_SIZE (4 << 20)
+
+/**
+ * The dumps written next to the source file. None of them are written by default.
+ */
+enum DumpFlags
+{
+    DUMP_TOKENS = 1, ///< The tokens to .tokens. (--dump-tokens)
+    DUMP_RAW_TREE = 2, ///< The syntax tree before semantic checking to .rawtree. (--dump-raw-tree)
+    DUMP_TREE = 4, ///< The syntax tree after semantic checking to .tree. (--dump-tree)
+    DUMP_SCOPES = 8, ///< The symbols of the scopes to .scopes. (--dump-scopes)
+};
+
+/**
+ * The format of the token and tree dumps. (--dump-format=text|json|binary)
+ */
+enum DumpFormat
+{
+    DUMP_TEXT, ///< Human readable text.
+    DUMP_JSON, ///< One JSON object per token or node. .jsonl is appended to the file name.
+    DUMP_BINARY, ///< Fixed size records after a header. .bin is appended to the file name.
+};
+
+/**
+ * The options of the compilation given on the command line.
+ */
+struct CompileOptions
+{
+    /// Nonzero if the tokens are loaded from the token cache of the source file, and
+    /// the cache is written when it's missing or stale. (--token-cache)
+    int useTokenCache;
+    enum DiagnosticFormat diagnosticFormat; ///< The format of the diagnostics.
+    int dumps; ///< The dumps to write. (enum DumpFlags)
+    enum DumpFormat dumpFormat; ///< The format of the token and tree dumps.
+    /// The directory of the compilation cache. Null if it's not used. (--cache-dir)
+    const char *cacheDirectory;
+    /// The size in bytes the compilation cache is trimmed to after the build. (--cache-size)
+    int64_t cacheSizeLimit;
+    int cacheFileMode; ///< The permissions of the compilation cache entries.
+    /// The format of the time report written to the standard error after the build.
+    enum TimeReportFormat timeReport;
+    /// The count of threads a large source is lexed on. The threads not needed by the
+    /// files are shared among them.
+    int lexerThreadCount;
+    /// The directory the relative paths are resolved against. Null for the working
+    /// directory of the process. The compile server resolves them against the working
+    /// directory of the client.
+    const char *workingDirectory;
+};
+
+#ifdef COUNT_ALLOCATIONS
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+
+/**
+ * Counts the allocation and forwards it to glibc. The memory is freed by the free of
+ * glibc, it's not wrapped.
+ */
+void *malloc(size_t size)
+{
+    TIM_countAllocation(size);
+    return __libc_malloc(size);
+}
+
+/**
+ * Counts the allocation and forwards it to glibc.
+ */
+void *calloc(size_t count, size_t size)
+{
+    TIM_countAllocation(count * size);
+    return __libc_calloc(count, size);
+}
+
+/**
+ * Counts the reallocation as an allocation of the new size and forwards it to glibc.
+ */
+void *realloc(void *ptr, size_t size)
+{
+    TIM_countAllocation(size);
+    return __libc_realloc(ptr, size);
+}
+#endif
+
+/**
+ * A file in the memory, eg. a source file. It's followed by a terminating zero.
+ */
+struct LoadedFile
+{
+    const char *begin; ///< The first character.
+    const char *end; ///< The end of the file. It points to the terminating zero.
+    void *mapping; ///< The mapped pages. Null if the file is read into the heap.
+    size_t mappingSize; ///< The size of the mapping.
+};
 
-typedef void (*NotificationCallback)(const char *msg);
+/**
+ * Maps a regular file read-only, so the file is not copied and its pages are shared
+ * with the page cache and the other processes reading it.
+ *
+ * One more byte than the file is mapped. The rest of the last page of a file is zero,
+ * and if the file ends on a page boundary, an anonymous zero page follows it. So the
+ * source is terminated, and the aligned loads of the lexer stay in mapped pages.
+ *
+ * @param fileName The name of the file.
+ * @param [out] file The mapped file.
+ *
+ * @return Nonzero on success. Zero if the file can't be mapped, then it should be read.
+ */
+int mapFile(const char *fileName, struct LoadedFile *file)
+{
+#ifdef MAP_SOURCE_FILES
+    int fd = open(fileName, O_RDONLY);
+    struct stat status;
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    size_t size;
+    char *mapping;
 
-static char *sourceCode = 0;
+    if (fd < 0)
+    {
+        return 0;
+    }
+    if (fstat(fd, &status) || !S_ISREG(status.st_mode) || !status.st_size)
+    {
+        close(fd);
+        return 0;
+    }
+    size = status.st_size;
+    file->mappingSize = (size / pageSize + 1) * pageSize;
+    mapping = mmap(0, file->mappingSize, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED)
+    {
+        close(fd);
+        return 0;
+    }
+    if (mmap(mapping, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)
+    {
+        munmap(mapping, file->mappingSize);
+        close(fd);
+        return 0;
+    }
+    close(fd);
+    file->mapping = mapping;
+    file->begin = mapping;
+    file->end = mapping + size;
+    return 1;
+#else
+    (void)fileName;
+    (void)file;
+    return 0;
+#endif
+}
 
-const char *readFileContents(const char *filename)
+/**
+ * Loads a file. It's mapped if possible, otherwise it's read into the heap.
+ *
+ * @param fileName The name of the file.
+ * @param [out] file The loaded file. Free it with unloadFile.
+ *
+ * @return Nonzero on success. Zero if the file can't be opened.
+ */
+int loadFile(const char *fileName, struct LoadedFile *file)
 {
-    FILE *f = fopen(filename,"rb");
+    FILE *f;
+    char *code;
     int size;
     int read;
 
+    if (mapFile(fileName, file))
+    {
+        return 1;
+    }
+
+    f = fopen(fileName,"rb");
     if (!f)
     {
-        ERR_raiseError(E_FILE_NOT_FOUND);
         return 0;
     }
 
     fseek(f, 0, SEEK_END);
     size = ftell(f);
     fseek(f, 0, SEEK_SET);
-    sourceCode = malloc(size + 1);
-    read = fread(sourceCode, size, 1, f);
+    code = malloc(size + 1);
+    read = size ? fread(code, size, 1, f) : 1;
     assert(read);
     fclose(f);
-    sourceCode[size] = 0;
+    code[size] = 0;
+
+    file->begin = code;
+    file->end = code + size;
+    file->mapping = 0;
+    file->mappingSize = 0;
+    return 1;
+}
+
+/**
+ * Frees a file loaded by loadFile.
+ *
+ * @param file The file.
+ */
+void unloadFile(struct LoadedFile *file)
+{
+#ifdef MAP_SOURCE_FILES
+    if (file->mapping)
+    {
+        munmap(file->mapping, file->mappingSize);
+        return;
+    }
+#endif
+    free((char *)file->begin);
+}
+
+/**
+ * Resolves a path against a directory.
+ *
+ * @param directory The directory. Null for the working directory.
+ * @param path The path. Absolute paths are not changed.
+ *
+ * @return The resolved path, allocated by malloc.
+ */
+char *resolvePath(const char *directory, const char *path)
+{
+    char *resolved;
+
+    if (!directory || (path[0] == '/'))
+    {
+        return strdup(path);
+    }
+    resolved = malloc(strlen(directory) + strlen(path) + 2);
+    sprintf(resolved, "%s/%s", directory, path);
+    return resolved;
+}
 
-    return sourceCode;
+/**
+ * Size of the chunks the standard input is read in.
+ */
+#define INPUT_CHUNK_SIZE 65536
 
+/**
+ * Feeds the next chunk of a file to the lexer. Input callback of the chunked lexer.
+ *
+ * @param lexer The lexer.
+ * @param userData The FILE to read.
+ */
+void readInputChunk(struct LEX_Lexer *lexer, void *userData)
+{
+    static char chunk[INPUT_CHUNK_SIZE];
+    int length = fread(chunk, 1, INPUT_CHUNK_SIZE, userData);
+    if (length)
+    {
+        LEX_feed(lexer, chunk, length);
+    }
+    else
+    {
+        LEX_finish(lexer);
+    }
 }
 
 #define STRINGCASE(x) case x : return #x;
@@ -209,9 +525,19 @@ const char *termTypeToString(enum STX_TermType type)
 
 #undef STRINGCASE
 
-const char *attributeToString(struct STX_SyntaxTreeNode *node)
+/// Size of the buffer of attributeToString.
+#define ATTRIBUTE_TEXT_SIZE 500
+
+/**
+ * Renders the attributes of a node.
+ *
+ * @param node The node.
+ * @param buffer The buffer of ATTRIBUTE_TEXT_SIZE characters to render into.
+ *
+ * @return The buffer.
+ */
+const char *attributeToString(struct STX_SyntaxTreeNode *node, char *buffer)
 {
-    static char buffer[500];
     char *ptr = buffer;
     const struct STX_NodeAttribute *attribute = STX_getNodeAttribute(node);
 
@@ -295,7 +621,7 @@ const char *attributeToString(struct STX_SyntaxTreeNode *node)
             {
                 ptr += sprintf(
                     ptr,
-                    "caseValue = %d ",
+                    "caseValue = %" PRId64 " ",
                     attribute->caseAttributes.caseValue
                 );
 
@@ -435,395 +761,3207 @@ const char *attributeToString(struct STX_SyntaxTreeNode *node)
     return buffer;
 }
 
-int dumpTreeCallback(struct STX_SyntaxTreeNode *node, int level, void *userData)
+/**
+ * A growing text. The diagnostics are rendered into it, then written at once.
+ */
+struct TextBuffer
 {
-    FILE *f = (FILE *)userData;
-    fprintf(
-        f,
-        "#%d %*s %s %s (%d:%d) - (%d:%d) [%d - %d, <= %d  %d => {in: %d, defines: %d}]\n",
-        node->id,
-        level*4,
-        "",
-        STX_nodeTypeToString(node->nodeType),
-        attributeToString(node),
-        node->beginLine,
-        node->beginColumn,
-        node->endLine,
-        node->endColumn,
-        node->firstChildIndex,
-        node->lastChildIndex,
-        node->previousSiblingIndex,
-        node->nextSiblingIndex,
-        node->inScopeId,
-        node->definesScopeId
-    );
-    return 1;
-}
+    char *text; ///< The text terminated by zero.
+    int length; ///< Length of the text.
+    int allocated; ///< Allocated size of the text.
+};
 
-void compileFile(const char *fileName, NotificationCallback callback)
+/**
+ * Appends formatted text to the buffer.
+ *
+ * @param buffer The buffer.
+ * @param format The printf format.
+ */
+void appendText(struct TextBuffer *buffer, const char *format, ...)
 {
-    const char *fileContent = readFileContents(fileName);
-    struct LEX_LexerResult lexerResult;
-    struct STX_ParserResult parserResult;
-    struct SMC_CheckerResult checkerResult;
-    char buffer[200];
-    char *fn = malloc(strlen(fileName) + 10);
-
-    setbuf(stdout, 0);
+    va_list args;
+    int length;
 
-    if (ERR_isError())
+    va_start(args, format);
+    length = vsnprintf(0, 0, format, args);
+    va_end(args);
+    if (buffer->length + length + 1 > buffer->allocated)
     {
-        return;
+        while (buffer->length + length + 1 > buffer->allocated)
+        {
+            buffer->allocated = buffer->allocated ? buffer->allocated * 2 : 256;
+        }
+        buffer->text = realloc(buffer->text, buffer->allocated);
     }
+    va_start(args, format);
+    vsnprintf(buffer->text + buffer->length, length + 1, format, args);
+    va_end(args);
+    buffer->length += length;
+}
 
-    if (callback)
-    {
-        callback("File opened.\n");
-    }
+/**
+ * Appends a JSON string literal to the buffer.
+ *
+ * @param buffer The buffer.
+ * @param text The text of the string.
+ * @param length Length of the text.
+ */
+void appendJsonString(struct TextBuffer *buffer, const char *text, int length)
+{
+    int i;
 
-    lexerResult = LEX_tokenizeString(fileContent);
-    if (ERR_isError())
+    appendText(buffer, "\"");
+    for (i = 0; i < length; i++)
     {
-        sprintf(buffer, "At line %d, column %d:", lexerResult.linePos, lexerResult.columnPos);
-        callback(buffer);
-        if (ERR_catchError(E_LEX_INVALID_CHARACTER))
+        unsigned char c = text[i];
+        if ((c == '"') || (c == '\\'))
         {
-            sprintf(buffer, "Invalid character.\n");
+            appendText(buffer, "\\%c", c);
         }
-        else if (ERR_catchError(E_LEX_INVALID_BUILT_IN_TYPE_LETTER))
+        else if (c < 0x20)
         {
-            sprintf(buffer, "Invalid built in type.\n");
+            appendText(buffer, "\\u%04x", c);
         }
-        else if (ERR_catchError(E_LEX_INVALID_OPERATOR))
+        else
         {
-            sprintf(buffer, "Invalid operator\n");
+            appendText(buffer, "%c", c);
         }
-        else if (ERR_catchError(E_LEX_MISSING_EXPONENTIAL_PART))
+    }
+    appendText(buffer, "\"");
+}
+
+/**
+ * @param errorCode An error code.
+ *
+ * @return Nonzero if it's a lexical error.
+ */
+int isLexerError(enum ERR_ErrorCode errorCode)
+{
+    return (errorCode >= E_LEX_INVALID_CHARACTER) && (errorCode < E_STX_MODULE_EXPECTED);
+}
+
+/**
+ * Writes the diagnostics through the callback in one call.
+ *
+ * The diagnostics are written with the file name. The lexer and parser diagnostics are
+ * written with their line and column, the semantic checker's ones with the place and name
+ * of their node. The syntax errors after a
+ * lexical error are not interesting, they are left out.
+ *
+ * @param fileName The name of the source file.
+ * @param result The result of the compilation. Its tokens give the positions, its tree
+ *      the nodes.
+ * @param format The format of the diagnostics.
+ * @param callback Receives the diagnostics.
+ * @param userData The user data of the callback.
+ */
+void writeDiagnostics(
+    const char *fileName,
+    const struct EPL_CompileResult *result,
+    enum DiagnosticFormat format,
+    NotificationCallback callback,
+    void *userData)
+{
+    const struct LEX_LexerResult *lexerResult = result->lexerResult;
+    const struct STX_SyntaxTree *tree = result->tree;
+    struct TextBuffer buffer = {0, 0, 0};
+    int hasLexerError = 0;
+    int i;
+
+    for (i = 0; i < result->diagnosticCount; i++)
+    {
+        hasLexerError |= isLexerError(result->diagnostics[i].errorCode);
+    }
+    for (i = 0; i < result->diagnosticCount; i++)
+    {
+        const struct EPL_Diagnostic *diagnostic = &result->diagnostics[i];
+        const struct ERR_ErrorDescription *description = ERR_describeError(diagnostic->errorCode);
+        const struct STX_SyntaxTreeNode *node = 0;
+        const struct STX_NodeAttribute *attr = 0;
+        int beginLine = lexerResult->linePos;
+        int beginColumn = lexerResult->columnPos;
+        int endLine = 0;
+        int endColumn = 0;
+
+        if (hasLexerError && !isLexerError(diagnostic->errorCode)) continue;
+        if ((diagnostic->errorCode >= E_SMC_CORRUPT_SYNTAX_TREE) && tree && (diagnostic->nodeId >= 0))
         {
-            sprintf(buffer, "Missing exponential part.\n");
+            node = &tree->nodes[diagnostic->nodeId];
+            attr = STX_getNodeAttribute((struct STX_SyntaxTreeNode *)node);
+            LEX_getPosition(lexerResult, node->beginOffset, &beginLine, &beginColumn);
+            LEX_getPosition(lexerResult, node->endOffset, &endLine, &endColumn);
         }
-        else if (ERR_catchError(E_LEX_HEXA_FLOATING_POINT_NOT_ALLOWED))
+        else if (diagnostic->offset >= 0)
         {
-            sprintf(buffer, "Hexa floating point is not allowed.\n");
+            LEX_getPosition(lexerResult, diagnostic->offset, &beginLine, &beginColumn);
         }
-        else if (ERR_catchError(E_LEX_INVALID_HEXA_LITERAL))
+
+        if (format == DF_JSON)
         {
-            sprintf(buffer, "Invalid hexa literal.\n");
+            appendText(&buffer, "{\"file\": ");
+            appendJsonString(&buffer, fileName, strlen(fileName));
+            appendText(&buffer, ", \"line\": %d, \"column\": %d", beginLine, beginColumn);
+            if (node)
+            {
+                appendText(&buffer, ", \"endLine\": %d, \"endColumn\": %d, \"node\": \"%s\", \"name\": ",
+                    endLine,
+                    endColumn,
+                    STX_nodeTypeToString(node->nodeType));
+                appendJsonString(&buffer, attr ? attr->name : "", attr ? attr->nameLength : 0);
+            }
+            appendText(
+                &buffer,
+                ", \"severity\": \"%s\", \"code\": \"%s\", \"message\": ",
+                diagnostic->severity == ERR_SEVERITY_ERROR ? "error" : "warning",
+                description->name);
+            appendJsonString(&buffer, description->message, strlen(description->message));
+            appendText(&buffer, "}\n");
+        }
+        else if (node)
+        {
+            appendText(
+                &buffer,
+                "%s: [%d; %d] - [%d; %d] %.*s (node: %s): %s\n",
+                fileName,
+                beginLine,
+                beginColumn,
+                endLine,
+                endColumn,
+                attr ? attr->nameLength : 0,
+                attr ? attr->name : "",
+                STX_nodeTypeToString(node->nodeType),
+                description->message);
         }
-        else if (ERR_catchError(E_LEX_INVALID_DECIMAL_NUMBER))
+        else
         {
-            sprintf(buffer, "Invalid decimal number.\n");
+            appendText(
+                &buffer,
+                "%s: At line %d, column %d: %s\n",
+                fileName,
+                beginLine,
+                beginColumn,
+                description->message);
         }
-        callback(buffer);
-        goto cleanup;
     }
-    if (callback)
-    {
-        int i;
-        struct LEX_LexerToken *tokens = lexerResult.tokens;
-        sprintf(fn, "%s.tokens", fileName);
-        FILE *f = fopen(fn, "w+t");
-
-        callback("Source code tokenized.\n");
-        sprintf(buffer, "    %d tokens found.\n", lexerResult.tokenCount);
-        callback(buffer);
-        for (i = 0; i < lexerResult.tokenCount; i++)
-        {
-            struct LEX_LexerToken *token = &tokens[i];
-            fprintf(
-                f,
-                "    %-40s  %20.*s (%-5d:%-3d) - (%-5d:%-3d)\n",
-                tokenTypeToString(token->tokenType),
-                token->length > 20 ? 20 : token->length,
-                token->start,
-                token->beginLine,
-                token->beginColumn,
-                token->endLine,
-                token->endColumn
-                );
-        }
-        fclose(f);
+    if (buffer.length)
+    {
+        callback(buffer.text, userData);
+    }
+    free(buffer.text);
+}
+
+/**
+ * A dump file. The dumps are written through a large buffer, because they are written
+ * in many small pieces.
+ */
+struct DumpWriter
+{
+    FILE *file; ///< The dump file.
+    enum DumpFormat format; ///< The format of the dump.
+    const struct LEX_LexerResult *lexerResult; ///< To get the line and column of the tokens and nodes.
+    struct TextBuffer line; ///< The JSON lines are rendered into it.
+};
+
+/**
+ * The header of the binary dumps. It's followed by the records, the fields of the
+ * header and the records are in the byte order of the machine.
+ */
+struct DumpHeader
+{
+    char magic[4]; ///< "EPLD"
+    uint32_t version; ///< DUMP_VERSION
+    uint32_t recordType; ///< What the records are. (enum DumpRecordType)
+    uint32_t recordSize; ///< The size of a record in bytes.
+};
+
+/**
+ * The record types of the binary dumps.
+ */
+enum DumpRecordType
+{
+    DRT_TOKEN, ///< struct TokenDumpRecord
+    DRT_NODE, ///< struct NodeDumpRecord
+};
+
+/**
+ * A token in the binary dump.
+ */
+struct TokenDumpRecord
+{
+    int32_t tokenType; ///< enum LEX_TokenType
+    int32_t offset; ///< Source offset of the token.
+    int32_t length; ///< Length of the token in the source.
+    int32_t line; ///< Line of the first character.
+    int32_t column; ///< Column of the first character.
+};
+
+/**
+ * A syntax tree node in the binary dump.
+ */
+struct NodeDumpRecord
+{
+    int32_t id; ///< Id of the node.
+    int32_t nodeType; ///< enum STX_NodeType
+    int32_t level; ///< Depth of the node, the root is at 0.
+    int32_t beginOffset; ///< Source offset of the beginning character of the node.
+    int32_t endOffset; ///< Source offset of the first character after the node.
+    int32_t firstChildIndex; ///< Id of the first child.
+    int32_t lastChildIndex; ///< Id of the last child.
+    int32_t previousSiblingIndex; ///< Id of the previous sibling.
+    int32_t nextSiblingIndex; ///< Id of the next sibling.
+    int32_t inScopeId; ///< The id of the scope the node is in.
+    int32_t definesScopeId; ///< The id of the scope the node defines.
+};
+
+/**
+ * Opens a dump file and writes the header of the binary dumps.
+ *
+ * The name is the source file name followed by the extension, followed by .jsonl for
+ * JSON lines and .bin for binary dumps.
+ *
+ * @param writer [out] The writer to initialize.
+ * @param fileName The name of the source file.
+ * @param extension The extension of the dump, without the dot.
+ * @param format The format of the dump.
+ * @param recordType The record type written to the header of the binary dump.
+ * @param recordSize The record size written to the header of the binary dump.
+ * @param lexerResult The lexer result of the source.
+ *
+ * @return Nonzero on success.
+ */
+int openDumpFile(
+    struct DumpWriter *writer,
+    const char *fileName,
+    const char *extension,
+    enum DumpFormat format,
+    enum DumpRecordType recordType,
+    size_t recordSize,
+    const struct LEX_LexerResult *lexerResult)
+{
+    static const char *formatExtensions[] = {"", ".jsonl", ".bin"};
+    char *fn = malloc(strlen(fileName) + strlen(extension) + 10);
+    struct DumpHeader header;
+
+    sprintf(fn, "%s.%s%s", fileName, extension, formatExtensions[format]);
+    writer->file = fopen(fn, format == DUMP_TEXT ? "wt" : "wb");
+    free(fn);
+    if (!writer->file)
+    {
+        return 0;
+    }
+    setvbuf(writer->file, 0, _IOFBF, DUMP_BUFFER_SIZE);
+    writer->format = format;
+    writer->lexerResult = lexerResult;
+    writer->line.text = 0;
+    writer->line.length = 0;
+    writer->line.allocated = 0;
+    if (format == DUMP_BINARY)
+    {
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, "EPLD", 4);
+        header.version = DUMP_VERSION;
+        header.recordType = recordType;
+        header.recordSize = recordSize;
+        fwrite(&header, sizeof(header), 1, writer->file);
+    }
+    return 1;
+}
+
+/**
+ * Flushes and closes a dump file.
+ *
+ * @param writer The writer.
+ */
+void closeDumpFile(struct DumpWriter *writer)
+{
+    fclose(writer->file);
+    free(writer->line.text);
+}
+
+/**
+ * Writes the line rendered into the line buffer of the writer and empties the buffer.
+ *
+ * @param writer The writer.
+ */
+void flushDumpLine(struct DumpWriter *writer)
+{
+    fwrite(writer->line.text, 1, writer->line.length, writer->file);
+    writer->line.length = 0;
+}
+
+/**
+ * Writes a token to the token dump.
+ *
+ * @param writer The writer.
+ * @param token The token.
+ */
+void dumpToken(struct DumpWriter *writer, const struct LEX_LexerToken *token)
+{
+    int length;
+    const char *text;
+    int beginLine, beginColumn, endLine, endColumn;
+    struct TokenDumpRecord record;
+
+    LEX_getPosition(writer->lexerResult, token->offset, &beginLine, &beginColumn);
+    if (writer->format == DUMP_BINARY)
+    {
+        record.tokenType = token->tokenType;
+        record.offset = token->offset;
+        record.length = token->length;
+        record.line = beginLine;
+        record.column = beginColumn;
+        fwrite(&record, sizeof(record), 1, writer->file);
+        return;
+    }
+    text = LEX_getTokenText(writer->lexerResult, token, &length);
+    LEX_getPosition(writer->lexerResult, token->offset + token->length, &endLine, &endColumn);
+    if (writer->format == DUMP_JSON)
+    {
+        appendText(
+            &writer->line,
+            "{\"type\": \"%s\", \"offset\": %d, \"length\": %d, "
+            "\"line\": %d, \"column\": %d, \"endLine\": %d, \"endColumn\": %d, \"text\": ",
+            tokenTypeToString(token->tokenType),
+            (int)token->offset,
+            (int)token->length,
+            beginLine,
+            beginColumn,
+            endLine,
+            endColumn);
+        appendJsonString(&writer->line, text, length);
+        appendText(&writer->line, "}\n");
+        flushDumpLine(writer);
+        return;
     }
-    // Syntax analysis
-    parserResult = STX_buildSyntaxTree(lexerResult.tokens, lexerResult.tokenCount);
+    fprintf(
+        writer->file,
+        "    %-40s  %20.*s (%-5d:%-3d) - (%-5d:%-3d)\n",
+        tokenTypeToString(token->tokenType),
+        length > 20 ? 20 : length,
+        text,
+        beginLine,
+        beginColumn,
+        endLine,
+        endColumn
+        );
+}
+
+/**
+ * Writes the tokens of a source file to the file name followed by .tokens.
+ *
+ * @param fileName The name of the source file.
+ * @param lexer A new lexer of the source. The tokens are read from it.
+ * @param format The format of the dump.
+ *
+ * @return The count of the tokens. -1 if there is a lexical error, the error is left to
+ *      the compilation to report.
+ */
+int dumpTokens(const char *fileName, struct LEX_Lexer *lexer, enum DumpFormat format)
+{
+    const struct LEX_LexerResult *lexerResult = LEX_getLexerResult(lexer);
+    const struct LEX_LexerToken *token;
+    int tokenCount = 0;
+    int docCommentIndex = 0;
+    int isOpen;
+    int isError;
+    struct DumpWriter writer;
+    struct ERR_Context errorContext;
+    struct ERR_Context *previousContext;
+
+    ERR_initializeContext(&errorContext);
+    previousContext = ERR_setContext(&errorContext);
 
-    if (ERR_isError())
+    isOpen = openDumpFile(
+        &writer,
+        fileName,
+        "tokens",
+        format,
+        DRT_TOKEN,
+        sizeof(struct TokenDumpRecord),
+        lexerResult);
+    do
     {
-        sprintf(buffer, "At line %d, column %d: ", parserResult.line, parserResult.column);
-        callback(buffer);
-        if (ERR_catchError(E_STX_MAIN_EXPECTED))
+        token = LEX_nextToken(lexer);
+        // The documentation comments are listed before the token they precede.
+        while (
+            (docCommentIndex < lexerResult->docCommentCount) &&
+            ((int)lexerResult->docComments[docCommentIndex].tokenIndex <= tokenCount))
         {
-            sprintf(buffer, "main expected. \n");
-        }
-        else if (ERR_catchError(E_STX_MODULE_EXPECTED))
-        {
-            sprintf(buffer, "module expected. \n");
+            if (isOpen)
+            {
+                dumpToken(&writer, &lexerResult->docComments[docCommentIndex].token);
+            }
+            docCommentIndex++;
         }
-        else if (ERR_catchError(E_STX_MODULE_TYPE_EXPECTED))
+        if (isOpen)
         {
-            sprintf(buffer, "exe, dll or lib expected. \n");
+            dumpToken(&writer, token);
         }
-        else if (ERR_catchError(E_STX_SEMICOLON_EXPECTED))
+        tokenCount++;
+    }
+    while (token->tokenType != LEX_SPEC_EOF);
+    if (isOpen)
+    {
+        closeDumpFile(&writer);
+    }
+    isError = ERR_isError();
+    ERR_setContext(previousContext);
+
+    return isError ? -1 : tokenCount;
+}
+
+/**
+ * Writes a node to the tree dump.
+ *
+ * This is a callback function of the tree transverser.
+ */
+int dumpTreeCallback(struct STX_SyntaxTreeNode *node, int level, void *userData)
+{
+    struct DumpWriter *writer = (struct DumpWriter *)userData;
+    int beginLine, beginColumn, endLine, endColumn;
+    struct NodeDumpRecord record;
+    char attributeText[ATTRIBUTE_TEXT_SIZE];
+
+    if (writer->format == DUMP_BINARY)
+    {
+        record.id = node->id;
+        record.nodeType = node->nodeType;
+        record.level = level;
+        record.beginOffset = node->beginOffset;
+        record.endOffset = node->endOffset;
+        record.firstChildIndex = node->firstChildIndex;
+        record.lastChildIndex = node->lastChildIndex;
+        record.previousSiblingIndex = node->previousSiblingIndex;
+        record.nextSiblingIndex = node->nextSiblingIndex;
+        record.inScopeId = node->inScopeId;
+        record.definesScopeId = node->definesScopeId;
+        fwrite(&record, sizeof(record), 1, writer->file);
+        return 1;
+    }
+    LEX_getPosition(writer->lexerResult, node->beginOffset, &beginLine, &beginColumn);
+    LEX_getPosition(writer->lexerResult, node->endOffset, &endLine, &endColumn);
+    if (writer->format == DUMP_JSON)
+    {
+        const struct STX_NodeAttribute *attr = STX_getNodeAttribute(node);
+        appendText(
+            &writer->line,
+            "{\"id\": %d, \"type\": \"%s\", \"level\": %d, \"line\": %d, \"column\": %d, "
+            "\"endLine\": %d, \"endColumn\": %d, \"firstChild\": %d, \"lastChild\": %d, "
+            "\"previousSibling\": %d, \"nextSibling\": %d, \"inScope\": %d, \"definesScope\": %d",
+            node->id,
+            STX_nodeTypeToString(node->nodeType),
+            level,
+            beginLine,
+            beginColumn,
+            endLine,
+            endColumn,
+            node->firstChildIndex,
+            node->lastChildIndex,
+            node->previousSiblingIndex,
+            node->nextSiblingIndex,
+            node->inScopeId,
+            node->definesScopeId);
+        if (attr && attr->name)
+        {
+            appendText(&writer->line, ", \"name\": ");
+            appendJsonString(&writer->line, attr->name, attr->nameLength);
+        }
+        appendText(&writer->line, "}\n");
+        flushDumpLine(writer);
+        return 1;
+    }
+    fprintf(
+        writer->file,
+        "#%d %*s %s %s (%d:%d) - (%d:%d) [%d - %d, <= %d  %d => {in: %d, defines: %d}]\n",
+        node->id,
+        level*4,
+        "",
+        STX_nodeTypeToString(node->nodeType),
+        attributeToString(node, attributeText),
+        beginLine,
+        beginColumn,
+        endLine,
+        endColumn,
+        node->firstChildIndex,
+        node->lastChildIndex,
+        node->previousSiblingIndex,
+        node->nextSiblingIndex,
+        node->inScopeId,
+        node->definesScopeId
+    );
+    return 1;
+}
+
+/**
+ * Writes the syntax tree to the source file name followed by the extension.
+ *
+ * @param fileName The name of the source file.
+ * @param extension The extension of the dump, without the dot.
+ * @param tree The syntax tree.
+ * @param lexerResult The lexer result of the source.
+ * @param format The format of the dump.
+ */
+void dumpTree(
+    const char *fileName,
+    const char *extension,
+    struct STX_SyntaxTree *tree,
+    const struct LEX_LexerResult *lexerResult,
+    enum DumpFormat format)
+{
+    struct DumpWriter writer;
+
+    if (!openDumpFile(&writer, fileName, extension, format, DRT_NODE, sizeof(struct NodeDumpRecord), lexerResult))
+    {
+        return;
+    }
+    STX_transversePreorder(tree, dumpTreeCallback, &writer);
+    closeDumpFile(&writer);
+}
+
+/**
+ * Lexes a source ahead of the parsing. Sources of at least PARALLEL_LEX_MIN_SIZE bytes
+ * are lexed on several threads.
+ *
+ * @param source The source.
+ * @param threadCount The count of threads the source may be lexed on.
+ * @param [out] lexerResult The tokens.
+ *
+ * @return Nonzero on success. Zero on lexical error, then there is nothing to clean up
+ *      and the error is left to the compilation to report.
+ */
+int tokenizeSource(const struct LoadedFile *source, int threadCount, struct LEX_LexerResult *lexerResult)
+{
+    struct ERR_Context errorContext;
+    struct ERR_Context *previousContext;
+    int isError;
+
+    ERR_initializeContext(&errorContext);
+    previousContext = ERR_setContext(&errorContext);
+    if ((threadCount > 1) && (source->end - source->begin >= PARALLEL_LEX_MIN_SIZE))
+    {
+        *lexerResult = LEX_tokenizeBufferParallel(source->begin, source->end, threadCount);
+    }
+    else
+    {
+        *lexerResult = LEX_tokenizeBuffer(source->begin, source->end);
+    }
+    isError = ERR_isError();
+    ERR_setContext(previousContext);
+    if (isError)
+    {
+        LEX_cleanUpLexerResult(lexerResult);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Gets the tokens of a source file from its token cache, the file name followed by
+ * .tokcache. If the cache is missing or it's of an other version of the source, the
+ * source is lexed and the cache is written, unless there is a lexical error.
+ *
+ * @param fileName The name of the source file.
+ * @param source The source.
+ * @param threadCount The count of threads the source may be lexed on.
+ * @param [out] cache The loaded cache if the tokens are loaded from it.
+ * @param [out] isCacheLoaded Set to nonzero if the tokens are loaded from the cache, then
+ *      the cache must be unloaded after the lexer result is cleaned up.
+ * @param [out] lexerResult The tokens.
+ *
+ * @return Nonzero if the tokens are got. Zero on lexical error, then there is nothing to
+ *      clean up and the error is left to the compilation to report.
+ */
+int loadTokens(
+    const char *fileName,
+    const struct LoadedFile *source,
+    int threadCount,
+    struct LoadedFile *cache,
+    int *isCacheLoaded,
+    struct LEX_LexerResult *lexerResult)
+{
+    char *fn = malloc(strlen(fileName) + 10);
+    void *data;
+    size_t size;
+    FILE *f;
+
+    *isCacheLoaded = 0;
+    sprintf(fn, "%s.tokcache", fileName);
+    if (loadFile(fn, cache))
+    {
+        if (LEX_loadTokenCache(lexerResult, cache->begin, cache->end - cache->begin, source->begin, source->end))
         {
-            sprintf(buffer, "; expected. \n");
+            free(fn);
+            *isCacheLoaded = 1;
+            return 1;
         }
-        else if (ERR_catchError(E_STX_TYPE_EXPECTED))
+        unloadFile(cache);
+    }
+
+    if (!tokenizeSource(source, threadCount, lexerResult))
+    {
+        free(fn);
+        return 0;
+    }
+    data = LEX_saveTokenCache(lexerResult, &size);
+    f = fopen(fn, "wb");
+    if (f)
+    {
+        fwrite(data, 1, size, f);
+        fclose(f);
+    }
+    free(data);
+    free(fn);
+    return 1;
+}
+
+/**
+ * A source file being compiled. The phases of the compilation are run on it one after
+ * the other, either by the same thread, or by the stages of the pipeline.
+ */
+struct SourceFile
+{
+    const char *fileName; ///< The name of the source file. The messages contain it.
+    /// The file name resolved against the working directory of the options. The source
+    /// is read from it, the dumps and the token cache are written next to it.
+    char *path;
+    int isStandardInput; ///< Nonzero if the source is read from the standard input.
+    int isOpened; ///< Nonzero if the source file is opened.
+    struct LoadedFile source; ///< The source. Valid if the source is not the standard input.
+    struct LoadedFile cache; ///< The token cache.
+    int isCacheLoaded; ///< Nonzero if the tokens are loaded from the token cache.
+    struct LEX_LexerResult tokens; ///< The tokens got before the parsing.
+    int hasTokens; ///< Nonzero if the tokens are got before the parsing.
+    struct EPL_CompileResult result; ///< The result of the compilation.
+    int isParsed; ///< Nonzero if the syntax tree is built.
+    NotificationCallback callback; ///< Receives the messages of the file.
+    void *userData; ///< The user data of the callback.
+};
+
+/**
+ * Runs the parsing or the checking of source files. Each thread has its own.
+ */
+struct SourceCompiler
+{
+    const struct CompileOptions *options; ///< The options.
+    struct EPL_Compiler *compiler; ///< The compiler instance, it's reused for all the files.
+    struct EPL_CompilerOptions compilerOptions; ///< The options of the instance, set for each file.
+    struct SourceFile *file; ///< The file being processed.
+};
+
+/**
+ * Writes a progress message of a source file. The progress is written only with text
+ * diagnostics, the JSON diagnostics are read line by line.
+ *
+ * @param file The file.
+ * @param options The options.
+ * @param message The message.
+ */
+void reportProgress(const struct SourceFile *file, const struct CompileOptions *options, const char *message)
+{
+    if (options->diagnosticFormat == DF_TEXT)
+    {
+        file->callback(message, file->userData);
+    }
+}
+
+/**
+ * Reports the syntax tree and writes its dump before the semantic checking.
+ *
+ * This is a callback function of the compiler.
+ */
+void syntaxTreeBuilt(const struct EPL_CompileResult *result, void *userData)
+{
+    const struct SourceCompiler *sourceCompiler = (const struct SourceCompiler *)userData;
+    const struct CompileOptions *options = sourceCompiler->options;
+    const struct SourceFile *file = sourceCompiler->file;
+
+    reportProgress(file, options, "Syntax checking finished.\n");
+    if (!file->isStandardInput && (options->dumps & DUMP_RAW_TREE))
+    {
+        int previousPhase = TIM_enterPhase(TIM_DUMPS);
+        dumpTree(file->path, "rawtree", result->tree, result->lexerResult, options->dumpFormat);
+        TIM_leavePhase(previousPhase);
+    }
+}
+
+/**
+ * Initializes a source compiler.
+ *
+ * @param sourceCompiler The source compiler.
+ * @param options The options. Must be valid until the source compiler is cleaned up.
+ */
+void initializeSourceCompiler(struct SourceCompiler *sourceCompiler, const struct CompileOptions *options)
+{
+    memset(sourceCompiler, 0, sizeof(struct SourceCompiler));
+    sourceCompiler->options = options;
+    sourceCompiler->compilerOptions.syntaxTreeBuilt = syntaxTreeBuilt;
+    sourceCompiler->compilerOptions.userData = sourceCompiler;
+    sourceCompiler->compiler = EPL_create(&sourceCompiler->compilerOptions);
+}
+
+/**
+ * Releases the compiler instance of a source compiler.
+ *
+ * @param sourceCompiler The source compiler.
+ */
+void cleanUpSourceCompiler(struct SourceCompiler *sourceCompiler)
+{
+    EPL_destroy(sourceCompiler->compiler);
+}
+
+/**
+ * Opens a source file without getting its tokens. The compilation caches use it to
+ * identify the source before anything is done with it, prepareSourceFile finishes the
+ * opening.
+ *
+ * @param [out] file The file.
+ * @param fileName The name of the source file. "-" reads the source from the standard
+ *      input in chunks while parsing, then no dump files are written and no token cache
+ *      is used.
+ * @param options The options. Relative names are resolved against their working directory.
+ * @param callback Receives the messages.
+ * @param userData The user data of the callback.
+ *
+ * @return Nonzero on success. Zero if the file is not found, then E_FILE_NOT_FOUND is
+ *      raised and there is nothing to clean up.
+ */
+int loadSourceFile(
+    struct SourceFile *file,
+    const char *fileName,
+    const struct CompileOptions *options,
+    NotificationCallback callback,
+    void *userData)
+{
+    int previousPhase;
+    int isLoaded;
+
+    memset(file, 0, sizeof(struct SourceFile));
+    file->fileName = fileName;
+    file->isStandardInput = !strcmp(fileName, "-");
+    file->callback = callback;
+    file->userData = userData;
+    if (!file->isStandardInput)
+    {
+        file->path = resolvePath(options->workingDirectory, fileName);
+        previousPhase = TIM_enterPhase(TIM_READ);
+        isLoaded = loadFile(file->path, &file->source);
+        TIM_leavePhase(previousPhase);
+        if (!isLoaded)
+        {
+            free(file->path);
+            ERR_raiseError(E_FILE_NOT_FOUND);
+            return 0;
+        }
+    }
+    file->isOpened = 1;
+    return 1;
+}
+
+/**
+ * Gets the tokens of a source file opened by loadSourceFile from the token cache or by
+ * lexing them ahead if needed. The tokens are dumped if they are asked for.
+ *
+ * @param file The file.
+ * @param options The options.
+ * @param lexAhead Nonzero to lex the source before the parsing. It's lexed ahead for the
+ *      time report anyway, to measure the lexing and the parsing separately, and if it's
+ *      large enough to be lexed on several threads.
+ */
+void prepareSourceFile(struct SourceFile *file, const struct CompileOptions *options, int lexAhead)
+{
+    struct LEX_Lexer *lexer;
+    char buffer[100];
+    int tokenCount;
+    int previousPhase;
+
+    if (!file->isStandardInput)
+    {
+        previousPhase = TIM_enterPhase(TIM_LEX);
+        if (options->useTokenCache)
+        {
+            file->hasTokens = loadTokens(
+                file->path,
+                &file->source,
+                options->lexerThreadCount,
+                &file->cache,
+                &file->isCacheLoaded,
+                &file->tokens);
+        }
+        else if (
+            lexAhead ||
+            options->timeReport ||
+            ((options->lexerThreadCount > 1) && (file->source.end - file->source.begin >= PARALLEL_LEX_MIN_SIZE)))
+        {
+            file->hasTokens = tokenizeSource(&file->source, options->lexerThreadCount, &file->tokens);
+        }
+        TIM_leavePhase(previousPhase);
+    }
+
+    reportProgress(file, options, "File opened.\n");
+    if (!file->isStandardInput && (options->dumps & DUMP_TOKENS))
+    {
+        previousPhase = TIM_enterPhase(TIM_DUMPS);
+        lexer = file->hasTokens ?
+            LEX_createResultLexer(&file->tokens) :
+            LEX_createBufferLexer(file->source.begin, file->source.end);
+        tokenCount = dumpTokens(file->path, lexer, options->dumpFormat);
+        LEX_destroyLexer(lexer);
+        TIM_leavePhase(previousPhase);
+        if (tokenCount >= 0)
+        {
+            sprintf(buffer, "Source code tokenized.\n    %d tokens found.\n", tokenCount);
+            reportProgress(file, options, buffer);
+        }
+    }
+}
+
+/**
+ * Opens a source file, and gets its tokens from the token cache or by lexing them
+ * ahead if needed. The tokens are dumped if they are asked for.
+ *
+ * @param [out] file The file.
+ * @param fileName The name of the source file. See loadSourceFile.
+ * @param options The options.
+ * @param lexAhead See prepareSourceFile.
+ * @param callback Receives the messages.
+ * @param userData The user data of the callback.
+ *
+ * @return Nonzero on success. Zero if the file is not found, then E_FILE_NOT_FOUND is
+ *      raised and there is nothing to clean up.
+ */
+int openSourceFile(
+    struct SourceFile *file,
+    const char *fileName,
+    const struct CompileOptions *options,
+    int lexAhead,
+    NotificationCallback callback,
+    void *userData)
+{
+    if (!loadSourceFile(file, fileName, options, callback, userData))
+    {
+        return 0;
+    }
+    prepareSourceFile(file, options, lexAhead);
+    return 1;
+}
+
+/**
+ * Builds the syntax tree of an opened source file.
+ *
+ * @param sourceCompiler The source compiler.
+ * @param file The file.
+ */
+void parseSourceFile(struct SourceCompiler *sourceCompiler, struct SourceFile *file)
+{
+    struct LEX_Lexer *lexer;
+
+    if (file->isStandardInput)
+    {
+        lexer = LEX_createChunkedLexer(readInputChunk, stdin);
+    }
+    else if (file->hasTokens)
+    {
+        lexer = LEX_createResultLexer(&file->tokens);
+    }
+    else
+    {
+        lexer = LEX_createBufferLexer(file->source.begin, file->source.end);
+    }
+    sourceCompiler->file = file;
+    file->isParsed = EPL_parse(sourceCompiler->compiler, lexer, &file->result);
+    sourceCompiler->file = 0;
+}
+
+/**
+ * Checks the syntax tree of a parsed source file, and writes its diagnostics.
+ *
+ * @param sourceCompiler The source compiler.
+ * @param file The file.
+ */
+void checkSourceFile(struct SourceCompiler *sourceCompiler, struct SourceFile *file)
+{
+    const struct CompileOptions *options = sourceCompiler->options;
+    FILE *scopeDumpFile = 0;
+    int previousPhase;
+    char *fn;
+
+    if (file->isParsed)
+    {
+        if (!file->isStandardInput && (options->dumps & DUMP_SCOPES))
+        {
+            fn = malloc(strlen(file->path) + 10);
+            sprintf(fn, "%s.scopes", file->path);
+            scopeDumpFile = fopen(fn, "wt");
+            free(fn);
+            if (scopeDumpFile)
+            {
+                setvbuf(scopeDumpFile, 0, _IOFBF, DUMP_BUFFER_SIZE);
+            }
+        }
+        sourceCompiler->file = file;
+        sourceCompiler->compilerOptions.scopeDumpFile = scopeDumpFile;
+        if (EPL_check(sourceCompiler->compiler, &file->result) &&
+            !file->isStandardInput && (options->dumps & DUMP_TREE))
+        {
+            previousPhase = TIM_enterPhase(TIM_DUMPS);
+            dumpTree(file->path, "tree", file->result.tree, file->result.lexerResult, options->dumpFormat);
+            TIM_leavePhase(previousPhase);
+        }
+        sourceCompiler->compilerOptions.scopeDumpFile = 0;
+        sourceCompiler->file = 0;
+        if (scopeDumpFile)
+        {
+            previousPhase = TIM_enterPhase(TIM_DUMPS);
+            fclose(scopeDumpFile);
+            TIM_leavePhase(previousPhase);
+        }
+    }
+    if (file->result.diagnosticCount)
+    {
+        previousPhase = TIM_enterPhase(TIM_DIAGNOSTICS);
+        writeDiagnostics(file->fileName, &file->result, options->diagnosticFormat, file->callback, file->userData);
+        TIM_leavePhase(previousPhase);
+    }
+}
+
+/**
+ * Releases everything of a source file.
+ *
+ * @param file The file.
+ */
+void closeSourceFile(struct SourceFile *file)
+{
+    int previousPhase;
+
+    if (!file->isOpened)
+    {
+        return;
+    }
+    previousPhase = TIM_enterPhase(TIM_CLEAN_UP);
+    EPL_cleanUpResult(&file->result);
+    if (file->hasTokens)
+    {
+        LEX_cleanUpLexerResult(&file->tokens);
+    }
+    if (file->isCacheLoaded)
+    {
+        unloadFile(&file->cache);
+    }
+    if (!file->isStandardInput)
+    {
+        unloadFile(&file->source);
+        free(file->path);
+    }
+    file->isOpened = 0;
+    TIM_leavePhase(previousPhase);
+}
+
+/**
+ * @param file A checked source file.
+ *
+ * @return Nonzero if the file has a diagnostic of error severity.
+ */
+int hasErrors(const struct SourceFile *file)
+{
+    int i;
+
+    for (i = 0; i < file->result.diagnosticCount; i++)
+    {
+        if (file->result.diagnostics[i].severity == ERR_SEVERITY_ERROR)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Compiles a source file.
+ *
+ * @param sourceCompiler The source compiler.
+ * @param fileName The name of the source file. See openSourceFile.
+ * @param callback Receives the messages.
+ * @param userData The user data of the callback.
+ *
+ * @return Nonzero if the file has errors. Zero if it's not found, then E_FILE_NOT_FOUND
+ *      is raised.
+ */
+int compileFile(
+    struct SourceCompiler *sourceCompiler,
+    const char *fileName,
+    NotificationCallback callback,
+    void *userData)
+{
+    struct SourceFile file;
+    int isFailed;
+
+    if (!openSourceFile(&file, fileName, sourceCompiler->options, 0, callback, userData))
+    {
+        return 0;
+    }
+    parseSourceFile(sourceCompiler, &file);
+    checkSourceFile(sourceCompiler, &file);
+    isFailed = hasErrors(&file);
+    closeSourceFile(&file);
+    return isFailed;
+}
+
+/**
+ * The output of the compilation of a source file. The outputs are written in the order
+ * of the files, so the output doesn't depend on which thread compiles which file when.
+ */
+struct SourceOutput
+{
+    struct TextBuffer text; ///< The messages.
+    int isNotFound; ///< Nonzero if the file is not found.
+    int hasErrors; ///< Nonzero if the file has a diagnostic of error severity.
+    int isDone; ///< Nonzero if the compilation is finished.
+};
+
+/**
+ * Receives the output of a build.
+ */
+struct OutputSink
+{
+    /**
+     * Writes a piece of the output.
+     *
+     * @param text The text.
+     * @param length Length of the text.
+     * @param isError Nonzero if the text belongs to the standard error.
+     * @param userData The user data of the sink.
+     */
+    void (*write)(const char *text, int length, int isError, void *userData);
+    void *userData; ///< The user data of the sink.
+};
+
+/**
+ * Writes the output to the standard output and error.
+ *
+ * This is the write function of the sink of the builds run from the command line.
+ */
+void writeStandardOutput(const char *text, int length, int isError, void *userData)
+{
+    if (isError)
+    {
+        fflush(stdout);
+        fwrite(text, 1, length, stderr);
+    }
+    else
+    {
+        fwrite(text, 1, length, stdout);
+    }
+}
+
+/**
+ * Formats text and writes it to a sink.
+ *
+ * @param sink The sink.
+ * @param isError Nonzero if the text belongs to the standard error.
+ * @param format The printf format.
+ */
+void writeToSink(const struct OutputSink *sink, int isError, const char *format, ...)
+{
+    char buffer[512];
+    va_list args;
+    int length;
+
+    va_start(args, format);
+    length = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (length >= (int)sizeof(buffer))
+    {
+        length = sizeof(buffer) - 1;
+    }
+    sink->write(buffer, length, isError, sink->userData);
+}
+
+/**
+ * Writes that a source file or a manifest is not found. With JSON diagnostics it's an
+ * E_FILE_NOT_FOUND diagnostic on the standard output, like the other diagnostics.
+ *
+ * @param sink The sink.
+ * @param format The format of the diagnostics.
+ * @param fileName The name of the file.
+ */
+void writeNotFound(const struct OutputSink *sink, enum DiagnosticFormat format, const char *fileName)
+{
+    const struct ERR_ErrorDescription *description = ERR_describeError(E_FILE_NOT_FOUND);
+    struct TextBuffer buffer = {0, 0, 0};
+
+    if (format != DF_JSON)
+    {
+        writeToSink(sink, 1, "%s not found. \n", fileName);
+        return;
+    }
+    appendText(&buffer, "{\"file\": ");
+    appendJsonString(&buffer, fileName, strlen(fileName));
+    appendText(&buffer, ", \"severity\": \"error\", \"code\": \"%s\", \"message\": ", description->name);
+    appendJsonString(&buffer, description->message, strlen(description->message));
+    appendText(&buffer, "}\n");
+    sink->write(buffer.text, buffer.length, 0, sink->userData);
+    free(buffer.text);
+}
+
+/**
+ * The files of a worker not compiled yet. The worker takes them from the beginning of
+ * the range, the other workers steal from the end of it.
+ */
+struct WorkQueue
+{
+    pthread_mutex_t lock; ///< Guards the range.
+    int begin; ///< Index of the next file to compile.
+    int end; ///< Index of the first file after the range.
+};
+
+/**
+ * A thread compiling the files of a build.
+ */
+struct Worker
+{
+    struct Build *build; ///< The build the worker belongs to.
+    int index; ///< Index of the worker.
+    struct WorkQueue queue; ///< The files of the worker.
+    struct SourceCompiler sourceCompiler; ///< Compiles the files of the worker.
+    pthread_t thread; ///< The thread of the worker. The first worker runs on the main thread.
+    int isThreadStarted; ///< Nonzero if the thread is started.
+    struct TIM_Report report; ///< The phases measured on the thread for the time report.
+};
+
+/**
+ * Compiles a list of files on a pool of workers.
+ */
+struct Build
+{
+    const struct CompileOptions *options; ///< The options.
+    char **fileNames; ///< The files to compile.
+    int fileCount; ///< Count of files.
+    struct SourceOutput *outputs; ///< The outputs of the files.
+    int nextOutput; ///< Index of the first output not written yet.
+    int isFailed; ///< Nonzero if a written output is of a file not found or with errors.
+    pthread_mutex_t outputLock; ///< Guards the outputs.
+    struct Worker *workers; ///< The workers.
+    int workerCount; ///< Count of workers.
+    const struct OutputSink *sink; ///< Receives the outputs.
+    struct CompileServer *server; ///< Has the compiled files to reuse. Null if not run by a server.
+};
+
+/**
+ * Appends a message to the output of a file.
+ *
+ * This is the notification callback of the files of a build.
+ */
+void appendOutput(const char *msg, void *userData)
+{
+    struct SourceOutput *output = (struct SourceOutput *)userData;
+    appendText(&output->text, "%s", msg);
+}
+
+/**
+ * Appends a message to a text buffer.
+ *
+ * This is the notification callback of the files compiled into a buffer first.
+ */
+void appendToBuffer(const char *msg, void *userData)
+{
+    appendText((struct TextBuffer *)userData, "%s", msg);
+}
+
+#ifdef COMPILATION_CACHE
+/**
+ * The header of a compilation cache entry. It's followed by the key text and the
+ * messages of the compilation. The fields are in the byte order of the machine.
+ */
+struct CacheEntryHeader
+{
+    char magic[4]; ///< "EPLC"
+    uint32_t version; ///< CACHE_VERSION
+    uint64_t sourceHash; ///< The hash of the source.
+    uint64_t sourceSize; ///< The size of the source.
+    uint32_t keyLength; ///< Length of the key text.
+    uint32_t outputLength; ///< Length of the messages.
+    uint32_t hasErrors; ///< Nonzero if the messages have a diagnostic of error severity.
+    uint32_t reserved; ///< Zero.
+};
+
+/**
+ * Looks up an entry of the compilation cache. On a hit the modification time of the
+ * entry is updated, it's the time of the last use for the eviction.
+ *
+ * @param entryName The file name of the entry.
+ * @param sourceHash,sourceSize The hash and the size of the source.
+ * @param key The key text. It must match the key text of the entry.
+ * @param output Receives the messages of the entry on a hit, and whether they have
+ *      errors.
+ *
+ * @return Nonzero on a hit.
+ */
+int loadCacheEntry(
+    const char *entryName,
+    uint64_t sourceHash,
+    uint64_t sourceSize,
+    const struct TextBuffer *key,
+    struct SourceOutput *output)
+{
+    struct LoadedFile entry;
+    const struct CacheEntryHeader *header;
+    size_t size;
+    int isHit;
+
+    if (!loadFile(entryName, &entry))
+    {
+        return 0;
+    }
+    header = (const struct CacheEntryHeader *)entry.begin;
+    size = entry.end - entry.begin;
+    isHit =
+        (size >= sizeof(struct CacheEntryHeader)) &&
+        !memcmp(header->magic, "EPLC", 4) &&
+        (header->version == CACHE_VERSION) &&
+        (header->sourceHash == sourceHash) &&
+        (header->sourceSize == sourceSize) &&
+        (header->keyLength == (uint32_t)key->length) &&
+        (size == sizeof(struct CacheEntryHeader) + (uint64_t)header->keyLength + header->outputLength) &&
+        !memcmp(header + 1, key->text, key->length);
+    if (isHit)
+    {
+        if (header->outputLength)
+        {
+            appendText(&output->text, "%.*s", (int)header->outputLength, (const char *)(header + 1) + header->keyLength);
+        }
+        output->hasErrors = header->hasErrors != 0;
+        utimes(entryName, 0);
+    }
+    unloadFile(&entry);
+    return isHit;
+}
+
+/**
+ * Saves an entry into the compilation cache. The entry is written into a temporary file
+ * which is renamed to the name of the entry, so the builds sharing the cache never see
+ * a partial entry.
+ *
+ * @param entryName The file name of the entry.
+ * @param directory The directory of the cache.
+ * @param fileMode The permissions of the entry.
+ * @param sourceHash,sourceSize The hash and the size of the source.
+ * @param key The key text.
+ * @param messages The messages of the compilation.
+ * @param hasErrors Nonzero if the messages have a diagnostic of error severity.
+ */
+void saveCacheEntry(
+    const char *entryName,
+    const char *directory,
+    int fileMode,
+    uint64_t sourceHash,
+    uint64_t sourceSize,
+    const struct TextBuffer *key,
+    const struct TextBuffer *messages,
+    int hasErrors)
+{
+    struct CacheEntryHeader header;
+    char *temporaryName = malloc(strlen(directory) + 16);
+    int isWritten;
+    FILE *f;
+    int fd;
+
+    sprintf(temporaryName, "%s/tmp-XXXXXX", directory);
+    fd = mkstemp(temporaryName);
+    if (fd < 0)
+    {
+        free(temporaryName);
+        return;
+    }
+    f = fdopen(fd, "wb");
+    if (!f)
+    {
+        close(fd);
+        unlink(temporaryName);
+        free(temporaryName);
+        return;
+    }
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "EPLC", 4);
+    header.version = CACHE_VERSION;
+    header.sourceHash = sourceHash;
+    header.sourceSize = sourceSize;
+    header.keyLength = key->length;
+    header.outputLength = messages->length;
+    header.hasErrors = hasErrors;
+    // The temporary file is only readable by its owner, the entry must be as readable as
+    // the other files.
+    isWritten =
+        !fchmod(fd, fileMode) &&
+        (fwrite(&header, sizeof(header), 1, f) == 1) &&
+        (fwrite(key->text, 1, key->length, f) == (size_t)key->length) &&
+        (fwrite(messages->text, 1, messages->length, f) == (size_t)messages->length);
+    if (fclose(f) || !isWritten || rename(temporaryName, entryName))
+    {
+        unlink(temporaryName);
+    }
+    free(temporaryName);
+}
+
+/**
+ * Gets the file mode creation mask of the process. It can only be read by setting it, so
+ * it must not be called while other threads create files.
+ *
+ * @return The mask.
+ */
+mode_t getFileCreationMask(void)
+{
+    mode_t mask = umask(0);
+
+    umask(mask);
+    return mask;
+}
+
+/**
+ * Compiles a source file with the compilation cache.
+ *
+ * The entries are named after the hash of the source and the hash of the key text, which
+ * is made of the build of the compiler, the options affecting the messages and the file
+ * name. On a hit the messages of the entry are reused, the file is not lexed, parsed or
+ * checked. On a miss the file is compiled, and its messages are saved into a new entry.
+ * Files with dumps, token caches or from the standard input are compiled without the
+ * cache, since they have side effects or can't be identified.
+ *
+ * @param sourceCompiler The source compiler of the thread.
+ * @param fileName The name of the source file.
+ * @param output Receives the messages, and whether they have errors.
+ */
+void compileCachedFile(struct SourceCompiler *sourceCompiler, const char *fileName, struct SourceOutput *output)
+{
+    const struct CompileOptions *options = sourceCompiler->options;
+    struct TextBuffer key = {0, 0, 0};
+    struct TextBuffer messages = {0, 0, 0};
+    struct SourceFile file;
+    uint64_t sourceHash;
+    uint64_t sourceSize;
+    char *entryName;
+
+    if (options->dumps || options->useTokenCache || !strcmp(fileName, "-"))
+    {
+        output->hasErrors = compileFile(sourceCompiler, fileName, appendOutput, output);
+        return;
+    }
+    if (!loadSourceFile(&file, fileName, options, appendToBuffer, &messages))
+    {
+        return;
+    }
+    appendText(&key, "eplc %d %s %s\n%d\n%s", CACHE_VERSION, __DATE__, __TIME__, options->diagnosticFormat, fileName);
+    sourceHash = LEX_hashSource(file.source.begin, file.source.end);
+    sourceSize = file.source.end - file.source.begin;
+    entryName = malloc(strlen(options->cacheDirectory) + 40);
+    sprintf(
+        entryName,
+        "%s/%016" PRIx64 "%016" PRIx64 ".eplc",
+        options->cacheDirectory,
+        sourceHash,
+        LEX_hashSource(key.text, key.text + key.length));
+
+    if (loadCacheEntry(entryName, sourceHash, sourceSize, &key, output))
+    {
+        closeSourceFile(&file);
+    }
+    else
+    {
+        prepareSourceFile(&file, options, 0);
+        parseSourceFile(sourceCompiler, &file);
+        checkSourceFile(sourceCompiler, &file);
+        output->hasErrors = hasErrors(&file);
+        closeSourceFile(&file);
+        if (messages.length)
+        {
+            appendText(&output->text, "%s", messages.text);
+        }
+        saveCacheEntry(
+            entryName,
+            options->cacheDirectory,
+            options->cacheFileMode,
+            sourceHash,
+            sourceSize,
+            &key,
+            &messages,
+            output->hasErrors);
+    }
+    free(entryName);
+    free(messages.text);
+    free(key.text);
+}
+
+/**
+ * A file of the compilation cache directory.
+ */
+struct CacheFile
+{
+    char *name; ///< The path of the file.
+    int64_t size; ///< The size of the file.
+    time_t lastUse; ///< The modification time of the file.
+};
+
+/**
+ * Compares the cache files by their last use.
+ *
+ * This is a qsort callback.
+ */
+int compareCacheFiles(const void *a, const void *b)
+{
+    time_t lastUseA = ((const struct CacheFile *)a)->lastUse;
+    time_t lastUseB = ((const struct CacheFile *)b)->lastUse;
+    return (lastUseA > lastUseB) - (lastUseA < lastUseB);
+}
+
+/**
+ * Removes the least recently used entries of the compilation cache until the entries
+ * fit into the size limit. The abandoned temporary files are removed too.
+ *
+ * @param directory The directory of the cache.
+ * @param sizeLimit The size limit in bytes.
+ */
+void trimCache(const char *directory, int64_t sizeLimit)
+{
+    DIR *dir = opendir(directory);
+    struct dirent *dirEntry;
+    struct CacheFile *files = 0;
+    int fileCount = 0;
+    int allocated = 0;
+    int64_t totalSize = 0;
+    time_t now = time(0);
+    struct stat status;
+    char *name;
+    int nameLength;
+    int i;
+
+    if (!dir)
+    {
+        return;
+    }
+    while ((dirEntry = readdir(dir)))
+    {
+        nameLength = strlen(dirEntry->d_name);
+        if (strncmp(dirEntry->d_name, "tmp-", 4) &&
+            ((nameLength < 5) || strcmp(dirEntry->d_name + nameLength - 5, ".eplc")))
+        {
+            continue;
+        }
+        name = malloc(strlen(directory) + nameLength + 2);
+        sprintf(name, "%s/%s", directory, dirEntry->d_name);
+        if (stat(name, &status) || !S_ISREG(status.st_mode))
+        {
+            free(name);
+            continue;
+        }
+        if (!strncmp(dirEntry->d_name, "tmp-", 4))
+        {
+            if (now - status.st_mtime > CACHE_TEMPORARY_FILE_AGE)
+            {
+                unlink(name);
+            }
+            free(name);
+            continue;
+        }
+        if (fileCount == allocated)
+        {
+            allocated = allocated ? allocated * 2 : 256;
+            files = realloc(files, allocated * sizeof(struct CacheFile));
+        }
+        files[fileCount].name = name;
+        files[fileCount].size = status.st_size;
+        files[fileCount].lastUse = status.st_mtime;
+        totalSize += status.st_size;
+        fileCount++;
+    }
+    closedir(dir);
+
+    qsort(files, fileCount, sizeof(struct CacheFile), compareCacheFiles);
+    for (i = 0; i < fileCount; i++)
+    {
+        if (totalSize > sizeLimit)
+        {
+            // An other build may have removed it already.
+            unlink(files[i].name);
+            totalSize -= files[i].size;
+        }
+        free(files[i].name);
+    }
+    free(files);
+}
+#endif
+
+#ifdef COMPILE_SERVER
+/// The most files the compile server keeps the messages of. The least recently used one
+/// is dropped to make room for a new one.
+#define MAX_COMPILED_FILES 4096
+
+/**
+ * A file compiled by the compile server. Only the messages of its compilation are kept,
+ * they are reused until its source changes.
+ */
+struct CompiledFile
+{
+    char *path; ///< The real path of the file, the key of the entry.
+    char *fileName; ///< The name of the file as given in the request. The messages contain it.
+    enum DiagnosticFormat diagnosticFormat; ///< The format of the diagnostics in the messages.
+    uint64_t sourceHash; ///< The hash of the source.
+    size_t sourceSize; ///< The size of the source.
+    uint64_t lastUse; ///< The use counter of the server when the entry was last used.
+    struct TextBuffer output; ///< The messages of the compilation.
+    int hasErrors; ///< Nonzero if the messages have a diagnostic of error severity.
+};
+
+/**
+ * The state kept by the compile server between the requests.
+ */
+struct CompileServer
+{
+    struct ASSOC_Array files; ///< The compiled files (struct CompiledFile) by real path.
+    int fileCount; ///< Count of the compiled files.
+    uint64_t useCount; ///< Incremented on each use of a compiled file.
+    pthread_mutex_t lock; ///< Guards the files and the counters.
+};
+
+/**
+ * Releases a compiled file.
+ *
+ * @param compiledFile The compiled file.
+ */
+void releaseCompiledFile(struct CompiledFile *compiledFile)
+{
+    free(compiledFile->output.text);
+    free(compiledFile->fileName);
+    free(compiledFile->path);
+    free(compiledFile);
+}
+
+/**
+ * Releases the compiled file of an entry.
+ *
+ * This is a traversal callback of the compiled files.
+ */
+int releaseCompiledFileEntry(struct ASSOC_KeyValuePair *kvp, int level, int index, void *userData)
+{
+    releaseCompiledFile((struct CompiledFile *)kvp->value);
+    return 1;
+}
+
+/**
+ * Finds the least recently used compiled file.
+ *
+ * This is a traversal callback of the compiled files, the user data points to the least
+ * recently used file found so far.
+ */
+int findLeastRecentlyUsedFile(struct ASSOC_KeyValuePair *kvp, int level, int index, void *userData)
+{
+    struct CompiledFile **oldest = (struct CompiledFile **)userData;
+    struct CompiledFile *compiledFile = (struct CompiledFile *)kvp->value;
+
+    if (!*oldest || (compiledFile->lastUse < (*oldest)->lastUse))
+    {
+        *oldest = compiledFile;
+    }
+    return 1;
+}
+
+/**
+ * Initializes the state of a compile server.
+ *
+ * @param server The server.
+ */
+void initializeCompileServer(struct CompileServer *server)
+{
+    ASSOC_initializeArray(&server->files);
+    server->fileCount = 0;
+    server->useCount = 0;
+    pthread_mutex_init(&server->lock, 0);
+}
+
+/**
+ * Releases the compiled files of a compile server.
+ *
+ * @param server The server.
+ */
+void cleanUpCompileServer(struct CompileServer *server)
+{
+    ASSOC_preorderTransversal(&server->files, releaseCompiledFileEntry, 0);
+    ASSOC_cleanupArray(&server->files);
+    pthread_mutex_destroy(&server->lock);
+}
+
+/**
+ * Compiles a source file for a request of the compile server.
+ *
+ * If an earlier request compiled the file under the same name with the same options and
+ * its source has the same hash, the messages of that compilation are reused. Otherwise
+ * the file is compiled, and its messages are kept instead of the earlier ones. Files
+ * with dumps, token caches or from the standard input are compiled every time, since
+ * they have side effects or can't be identified.
+ *
+ * @param server The server.
+ * @param sourceCompiler The source compiler of the thread.
+ * @param fileName The name of the source file.
+ * @param output Receives the messages, and whether they have errors.
+ */
+void compileServedFile(
+    struct CompileServer *server,
+    struct SourceCompiler *sourceCompiler,
+    const char *fileName,
+    struct SourceOutput *output)
+{
+    const struct CompileOptions *options = sourceCompiler->options;
+    struct CompiledFile *compiledFile;
+    struct CompiledFile *oldFile;
+    struct SourceFile file;
+    char *resolvedPath;
+    char *path = 0;
+    int isReused = 0;
+
+    if (!options->dumps && !options->useTokenCache && strcmp(fileName, "-"))
+    {
+        resolvedPath = resolvePath(options->workingDirectory, fileName);
+        path = realpath(resolvedPath, 0);
+        free(resolvedPath);
+    }
+    if (!path)
+    {
+        output->hasErrors = compileFile(sourceCompiler, fileName, appendOutput, output);
+        return;
+    }
+    compiledFile = calloc(1, sizeof(struct CompiledFile));
+    compiledFile->path = path;
+    compiledFile->fileName = strdup(fileName);
+    compiledFile->diagnosticFormat = options->diagnosticFormat;
+    if (!loadSourceFile(&file, fileName, options, appendToBuffer, &compiledFile->output))
+    {
+        releaseCompiledFile(compiledFile);
+        return;
+    }
+    compiledFile->sourceHash = LEX_hashSource(file.source.begin, file.source.end);
+    compiledFile->sourceSize = file.source.end - file.source.begin;
+
+    pthread_mutex_lock(&server->lock);
+    oldFile = ASSOC_find(&server->files, path, strlen(path));
+    if (oldFile &&
+        (oldFile->sourceHash == compiledFile->sourceHash) &&
+        (oldFile->sourceSize == compiledFile->sourceSize) &&
+        (oldFile->diagnosticFormat == compiledFile->diagnosticFormat) &&
+        !strcmp(oldFile->fileName, compiledFile->fileName))
+    {
+        if (oldFile->output.length)
         {
-            sprintf(buffer, "data type expected. \n");
+            appendText(&output->text, "%s", oldFile->output.text);
         }
-        else if (ERR_catchError(E_STX_IDENTIFIER_EXPECTED))
+        output->hasErrors = oldFile->hasErrors;
+        oldFile->lastUse = ++server->useCount;
+        isReused = 1;
+    }
+    pthread_mutex_unlock(&server->lock);
+    if (isReused)
+    {
+        closeSourceFile(&file);
+        releaseCompiledFile(compiledFile);
+        return;
+    }
+
+    prepareSourceFile(&file, options, 0);
+    parseSourceFile(sourceCompiler, &file);
+    checkSourceFile(sourceCompiler, &file);
+    compiledFile->hasErrors = hasErrors(&file);
+    closeSourceFile(&file);
+    if (compiledFile->output.length)
+    {
+        appendText(&output->text, "%s", compiledFile->output.text);
+    }
+    output->hasErrors = compiledFile->hasErrors;
+
+    // An other thread may have replaced the file since, so it's looked up again.
+    pthread_mutex_lock(&server->lock);
+    oldFile = ASSOC_find(&server->files, path, strlen(path));
+    if (!oldFile && (server->fileCount == MAX_COMPILED_FILES))
+    {
+        ASSOC_preorderTransversal(&server->files, findLeastRecentlyUsedFile, &oldFile);
+    }
+    if (oldFile)
+    {
+        ASSOC_remove(&server->files, oldFile->path, strlen(oldFile->path));
+        server->fileCount--;
+    }
+    compiledFile->lastUse = ++server->useCount;
+    ASSOC_insert(&server->files, path, strlen(path), compiledFile);
+    server->fileCount++;
+    pthread_mutex_unlock(&server->lock);
+    if (oldFile)
+    {
+        releaseCompiledFile(oldFile);
+    }
+}
+#endif
+
+/**
+ * Gets the next file for a worker. If the worker has no more files, it steals the
+ * second half of the files of an other worker.
+ *
+ * @param worker The worker.
+ *
+ * @return The index of the file. -1 if there are no files left.
+ */
+int takeFile(struct Worker *worker)
+{
+    struct Build *build = worker->build;
+    struct WorkQueue *queue = &worker->queue;
+    int fileIndex = -1;
+    int i;
+
+    pthread_mutex_lock(&queue->lock);
+    if (queue->begin < queue->end)
+    {
+        fileIndex = queue->begin++;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    for (i = 1; (fileIndex < 0) && (i < build->workerCount); i++)
+    {
+        struct WorkQueue *victim = &build->workers[(worker->index + i) % build->workerCount].queue;
+        int middle, end = 0;
+
+        // The locks are never held at the same time, so the workers can't deadlock.
+        pthread_mutex_lock(&victim->lock);
+        if (victim->begin < victim->end)
         {
-            sprintf(buffer, "identifier expected. \n");
+            middle = victim->begin + (victim->end - victim->begin) / 2;
+            end = victim->end;
+            victim->end = middle;
+            fileIndex = middle;
         }
-        else if (ERR_catchError(E_STX_VARDECL_EXPECTED))
+        pthread_mutex_unlock(&victim->lock);
+        if (fileIndex >= 0)
         {
-            sprintf(buffer, "variable declaration expected. \n");
+            pthread_mutex_lock(&queue->lock);
+            queue->begin = fileIndex + 1;
+            queue->end = end;
+            pthread_mutex_unlock(&queue->lock);
         }
-        else if (ERR_catchError(E_STX_OF_EXPECTED))
+    }
+    return fileIndex;
+}
+
+/**
+ * Marks the output of a file finished, and writes the finished outputs that follow the
+ * written ones.
+ *
+ * @param build The build.
+ * @param fileIndex The index of the file.
+ */
+void finishOutput(struct Build *build, int fileIndex)
+{
+    pthread_mutex_lock(&build->outputLock);
+    build->outputs[fileIndex].isDone = 1;
+    while ((build->nextOutput < build->fileCount) && build->outputs[build->nextOutput].isDone)
+    {
+        struct SourceOutput *output = &build->outputs[build->nextOutput];
+        if (output->text.length)
         {
-            sprintf(buffer, "of expected. \n");
+            build->sink->write(output->text.text, output->text.length, 0, build->sink->userData);
         }
-        else if (ERR_catchError(E_STX_LEFT_BRACKET_EXPECTED))
+        if (output->isNotFound)
         {
-            sprintf(buffer, "[ expected. \n");
+            writeNotFound(build->sink, build->options->diagnosticFormat, build->fileNames[build->nextOutput]);
         }
-        else if (ERR_catchError(E_STX_RIGHT_BRACKET_EXPECTED))
+        build->isFailed |= output->isNotFound || output->hasErrors;
+        free(output->text.text);
+        output->text.text = 0;
+        build->nextOutput++;
+    }
+    pthread_mutex_unlock(&build->outputLock);
+}
+
+/**
+ * Compiles files until there are no files left.
+ *
+ * @param userData The worker.
+ *
+ * @return Null.
+ */
+void *runWorker(void *userData)
+{
+    struct Worker *worker = (struct Worker *)userData;
+    struct Build *build = worker->build;
+    int fileIndex;
+
+    if (build->options->timeReport)
+    {
+        TIM_startReport(&worker->report);
+    }
+    while ((fileIndex = takeFile(worker)) >= 0)
+    {
+        struct SourceOutput *output = &build->outputs[fileIndex];
+#ifdef COMPILE_SERVER
+        if (build->server)
         {
-            sprintf(buffer, "] expected. \n");
+            compileServedFile(build->server, &worker->sourceCompiler, build->fileNames[fileIndex], output);
         }
-        else if (ERR_catchError(E_STX_INTEGER_NUMBER_EXPECTED))
+        else
+#endif
+#ifdef COMPILATION_CACHE
+        if (build->options->cacheDirectory)
         {
-            sprintf(buffer, "integer number expected. \n");
+            compileCachedFile(&worker->sourceCompiler, build->fileNames[fileIndex], output);
         }
-        else if (ERR_catchError(E_STX_TO_EXPECTED))
+        else
+#endif
         {
-            sprintf(buffer, "to expected. \n");
+            output->hasErrors = compileFile(&worker->sourceCompiler, build->fileNames[fileIndex], appendOutput, output);
         }
-        else if (ERR_catchError(E_STX_PARAMETER_DIRECTION_EXPECTED))
-        {
-            sprintf(buffer, "parameter direction expected. \n");
+        output->isNotFound = ERR_catchError(E_FILE_NOT_FOUND);
+        finishOutput(build, fileIndex);
+    }
+    TIM_stopReport();
+    return 0;
+}
+
+/**
+ * @return The time in seconds from an arbitrary point, to measure intervals.
+ */
+double getTime()
+{
+#ifdef CLOCK_MONOTONIC
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+#else
+    return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+/**
+ * Writes the time report of a build.
+ *
+ * @param report The phases summed over the threads.
+ * @param wallTime The time the build ran for.
+ * @param threadCount Count of threads the phases ran on.
+ * @param format The format of the report.
+ * @param sink Receives the report. It's written to the standard error.
+ */
+void writeTimeReport(
+    const struct TIM_Report *report,
+    double wallTime,
+    int threadCount,
+    enum TimeReportFormat format,
+    const struct OutputSink *sink)
+{
+    struct TextBuffer text = {0, 0, 0};
+    struct TIM_PhaseStatistics total;
+    const char *name;
+    int i;
+#ifdef COUNT_ALLOCATIONS
+    int isCountingAllocations = 1;
+#else
+    int isCountingAllocations = 0;
+#endif
+
+    memset(&total, 0, sizeof(total));
+    if (format == TRF_JSON)
+    {
+        appendText(&text, "{\"wallTime\":%.6f,\"threads\":%d,\"phases\":[", wallTime, threadCount);
+    }
+    else
+    {
+        appendText(&text, "phase              count     wall s      cpu s     allocs   alloc MB  peak RSS MB\n");
+    }
+    for (i = 0; i < TIM_PHASE_COUNT; i++)
+    {
+        const struct TIM_PhaseStatistics *statistics = &report->phases[i];
+
+        total.wallTime += statistics->wallTime;
+        total.cpuTime += statistics->cpuTime;
+        total.allocationCount += statistics->allocationCount;
+        total.allocatedBytes += statistics->allocatedBytes;
+        if (statistics->peakRss > total.peakRss)
+        {
+            total.peakRss = statistics->peakRss;
+        }
+        name = TIM_getPhaseName(i);
+        if (format == TRF_JSON)
+        {
+            appendText(&text, "%s{\"name\":", i ? "," : "");
+            appendJsonString(&text, name, strlen(name));
+            appendText(
+                &text,
+                ",\"count\":%d,\"wallTime\":%.6f,\"cpuTime\":%.6f",
+                statistics->count,
+                statistics->wallTime,
+                statistics->cpuTime);
+            if (isCountingAllocations)
+            {
+                appendText(
+                    &text,
+                    ",\"allocationCount\":%" PRIu64 ",\"allocatedBytes\":%" PRIu64,
+                    statistics->allocationCount,
+                    statistics->allocatedBytes);
+            }
+            appendText(&text, ",\"peakRss\":%" PRIu64 "}", statistics->peakRss);
         }
-        else if (ERR_catchError(E_STX_LEFT_PARENTHESIS_EXPECTED))
+        else
         {
-            sprintf(buffer, "( expected. \n");
+            appendText(&text, "%-17s %6d %10.3f %10.3f", name, statistics->count, statistics->wallTime, statistics->cpuTime);
+            if (isCountingAllocations)
+            {
+                appendText(&text, " %10" PRIu64 " %10.2f", statistics->allocationCount, statistics->allocatedBytes / 1048576.0);
+            }
+            else
+            {
+                appendText(&text, " %10s %10s", "-", "-");
+            }
+            appendText(&text, " %12.2f\n", statistics->peakRss / 1048576.0);
         }
-        else if (ERR_catchError(E_STX_RIGHT_PARENTHESIS_EXPECTED))
+    }
+    if (format == TRF_JSON)
+    {
+        appendText(&text, "]}\n");
+    }
+    else
+    {
+        appendText(&text, "%-17s %6s %10.3f %10.3f", "total", "", total.wallTime, total.cpuTime);
+        if (isCountingAllocations)
         {
-            sprintf(buffer, ") expected. \n");
+            appendText(&text, " %10" PRIu64 " %10.2f", total.allocationCount, total.allocatedBytes / 1048576.0);
         }
-        else if (ERR_catchError(E_STX_COMMA_EXPECTED))
+        else
         {
-            sprintf(buffer, ", expected. \n");
+            appendText(&text, " %10s %10s", "-", "-");
         }
-        else if (ERR_catchError(E_STX_FUNCTION_EXPECTED))
+        appendText(&text, " %12.2f\n", total.peakRss / 1048576.0);
+        appendText(&text, "%.3f s on %d thread%s\n", wallTime, threadCount, threadCount > 1 ? "s" : "");
+    }
+    sink->write(text.text, text.length, 1, sink->userData);
+    free(text.text);
+}
+
+/**
+ * Compiles files on several threads. Each thread has its own compiler instance. The
+ * files are split evenly between the threads, a thread that finished its files takes
+ * over files from an other one. The messages are written in the order of the files.
+ *
+ * @param fileNames The files to compile.
+ * @param fileCount Count of files.
+ * @param options The options.
+ * @param threadCount The maximum count of threads.
+ * @param sink Receives the output.
+ * @param server The server to reuse the compiled files of. Null if not needed.
+ *
+ * @return Nonzero if all the files are found and none of them has errors.
+ */
+int compileFiles(
+    char **fileNames,
+    int fileCount,
+    const struct CompileOptions *options,
+    int threadCount,
+    const struct OutputSink *sink,
+    struct CompileServer *server)
+{
+    struct Build build;
+    struct TIM_Report report;
+    double start = getTime();
+    int i;
+
+    if (threadCount > fileCount)
+    {
+        threadCount = fileCount;
+    }
+    if (threadCount < 1)
+    {
+        threadCount = 1;
+    }
+    build.options = options;
+    build.fileNames = fileNames;
+    build.fileCount = fileCount;
+    build.outputs = calloc(fileCount, sizeof(struct SourceOutput));
+    build.nextOutput = 0;
+    build.isFailed = 0;
+    pthread_mutex_init(&build.outputLock, 0);
+    build.workers = calloc(threadCount, sizeof(struct Worker));
+    build.workerCount = threadCount;
+    build.sink = sink;
+    build.server = server;
+    for (i = 0; i < threadCount; i++)
+    {
+        struct Worker *worker = &build.workers[i];
+        worker->build = &build;
+        worker->index = i;
+        pthread_mutex_init(&worker->queue.lock, 0);
+        worker->queue.begin = (int)((int64_t)fileCount * i / threadCount);
+        worker->queue.end = (int)((int64_t)fileCount * (i + 1) / threadCount);
+        initializeSourceCompiler(&worker->sourceCompiler, options);
+    }
+    // The files of a worker that couldn't be started are stolen by the others.
+    for (i = 1; i < threadCount; i++)
+    {
+        build.workers[i].isThreadStarted = !pthread_create(&build.workers[i].thread, 0, runWorker, &build.workers[i]);
+    }
+    runWorker(&build.workers[0]);
+    for (i = 1; i < threadCount; i++)
+    {
+        if (build.workers[i].isThreadStarted)
         {
-            sprintf(buffer, "function expected. \n");
+            pthread_join(build.workers[i].thread, 0);
         }
-        else if (ERR_catchError(E_STX_LEFT_BRACE_EXPECTED))
+    }
+    if (options->timeReport)
+    {
+        memset(&report, 0, sizeof(report));
+        for (i = 0; i < threadCount; i++)
         {
-            sprintf(buffer, "{ expected. \n");
+            TIM_addReport(&report, &build.workers[i].report);
         }
-        else if (ERR_catchError(E_STX_RIGHT_BRACE_EXPECTED))
+        writeTimeReport(&report, getTime() - start, threadCount, options->timeReport, sink);
+    }
+    for (i = 0; i < threadCount; i++)
+    {
+        cleanUpSourceCompiler(&build.workers[i].sourceCompiler);
+        pthread_mutex_destroy(&build.workers[i].queue.lock);
+    }
+    pthread_mutex_destroy(&build.outputLock);
+    free(build.workers);
+    free(build.outputs);
+    return !build.isFailed;
+}
+
+/**
+ * The statistics of a stage of the pipeline.
+ */
+struct StageStatistics
+{
+    int fileCount; ///< Count of files processed.
+    uint64_t byteCount; ///< Size of the sources processed.
+    double busyTime; ///< Time spent on processing the files.
+    double starvedTime; ///< Time spent on waiting for the previous stage.
+    double blockedTime; ///< Time spent on waiting for the next stage to make room.
+};
+
+/// Count of checks a stage makes on a full or empty queue before it goes to sleep.
+#define QUEUE_SPIN_COUNT 100
+
+/**
+ * A bounded queue of file indices between two stages of the pipeline. It has one
+ * producer and one consumer thread, so it needs no lock: only the producer moves the
+ * tail and only the consumer moves the head. A thread that waits for the other one
+ * longer than a short spin sleeps on the condition variable, the lock is only taken
+ * then.
+ */
+struct StageQueue
+{
+    int *items; ///< Ring buffer of the file indices.
+    unsigned capacity; ///< Size of the ring buffer.
+    atomic_uint head; ///< Count of the items taken.
+    atomic_uint tail; ///< Count of the items put.
+    /// Count of the threads sleeping or about to sleep on the queue. Both threads may be
+    /// counted: a woken thread may not run until the other one goes to sleep.
+    atomic_int waiterCount;
+    pthread_mutex_t lock; ///< Guards the sleeping.
+    pthread_cond_t changed; ///< Signaled when the head or the tail moves while a thread waits.
+};
+
+/**
+ * @param queue The queue.
+ * @param tail The tail of the producer.
+ *
+ * @return Nonzero if the queue has room for an item.
+ */
+int hasRoom(struct StageQueue *queue, unsigned tail)
+{
+    return tail - atomic_load(&queue->head) != queue->capacity;
+}
+
+/**
+ * @param queue The queue.
+ * @param head The head of the consumer.
+ *
+ * @return Nonzero if the queue has an item.
+ */
+int hasItem(struct StageQueue *queue, unsigned head)
+{
+    return atomic_load(&queue->tail) != head;
+}
+
+/**
+ * Waits until the other thread of the queue moves its end. The end is checked a few
+ * times, then the thread sleeps until it's woken by wakeQueue.
+ *
+ * @param queue The queue.
+ * @param isReady Returns nonzero if the wait is over.
+ * @param end The end of the queue moved by the waiting thread.
+ */
+void waitForQueue(struct StageQueue *queue, int (*isReady)(struct StageQueue *, unsigned), unsigned end)
+{
+    int i;
+
+    for (i = 0; i < QUEUE_SPIN_COUNT; i++)
+    {
+        if (isReady(queue, end))
         {
-            sprintf(buffer, "} expected. \n");
+            return;
         }
-        else if (ERR_catchError(E_STX_RETURN_EXPECTED))
+    }
+    // The waiter is counted before the last check, and the other thread moves its end
+    // before it checks the count, so it either sees the waiter or the move is seen here.
+    pthread_mutex_lock(&queue->lock);
+    atomic_fetch_add(&queue->waiterCount, 1);
+    while (!isReady(queue, end))
+    {
+        pthread_cond_wait(&queue->changed, &queue->lock);
+    }
+    atomic_fetch_sub(&queue->waiterCount, 1);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+/**
+ * Wakes the other thread of the queue if it sleeps. Called after moving an end.
+ *
+ * @param queue The queue.
+ */
+void wakeQueue(struct StageQueue *queue)
+{
+    if (atomic_load(&queue->waiterCount))
+    {
+        pthread_mutex_lock(&queue->lock);
+        pthread_cond_broadcast(&queue->changed);
+        pthread_mutex_unlock(&queue->lock);
+    }
+}
+
+/**
+ * Puts an item to the queue. Waits while the queue is full.
+ *
+ * @param queue The queue.
+ * @param item The item.
+ * @param statistics The waiting time is added to it.
+ */
+void putItem(struct StageQueue *queue, int item, struct StageStatistics *statistics)
+{
+    unsigned tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+
+    if (!hasRoom(queue, tail))
+    {
+        double start = getTime();
+        waitForQueue(queue, hasRoom, tail);
+        statistics->blockedTime += getTime() - start;
+    }
+    queue->items[tail % queue->capacity] = item;
+    atomic_store(&queue->tail, tail + 1);
+    wakeQueue(queue);
+}
+
+/**
+ * Takes an item from the queue. Waits while the queue is empty.
+ *
+ * @param queue The queue.
+ * @param statistics The waiting time is added to it.
+ *
+ * @return The item.
+ */
+int takeItem(struct StageQueue *queue, struct StageStatistics *statistics)
+{
+    unsigned head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    int item;
+
+    if (!hasItem(queue, head))
+    {
+        double start = getTime();
+        waitForQueue(queue, hasItem, head);
+        statistics->starvedTime += getTime() - start;
+    }
+    item = queue->items[head % queue->capacity];
+    atomic_store(&queue->head, head + 1);
+    wakeQueue(queue);
+    return item;
+}
+
+/**
+ * The stages of the pipeline.
+ */
+enum PipelineStageType
+{
+    PS_LEX, ///< Opens the files and lexes them.
+    PS_PARSE, ///< Builds the syntax trees.
+    PS_CHECK, ///< Checks the syntax trees and writes the outputs in the order of the files.
+    PS_COUNT
+};
+
+/**
+ * A stage of the pipeline. Each stage runs on its own thread.
+ */
+struct PipelineStage
+{
+    enum PipelineStageType type; ///< The type of the stage.
+    struct Pipeline *pipeline; ///< The pipeline the stage belongs to.
+    struct StageQueue *input; ///< The files from the previous stage. Null for the first stage.
+    struct StageQueue *output; ///< The files to the next stage. Null for the last stage.
+    struct SourceCompiler sourceCompiler; ///< Compiles the files in the stage.
+    struct StageStatistics statistics; ///< The statistics of the stage.
+    struct TIM_Report report; ///< The phases measured on the thread for the time report.
+    pthread_t thread; ///< The thread of the stage. The last stage runs on the main thread.
+};
+
+/**
+ * Compiles a list of files in a pipeline. While a file is checked, the next one is
+ * parsed and the one after it is lexed.
+ */
+struct Pipeline
+{
+    struct Build build; ///< The files and their outputs.
+    struct SourceFile *files; ///< The files in the pipeline.
+    struct StageQueue queues[PS_COUNT - 1]; ///< The queues between the stages.
+    struct PipelineStage stages[PS_COUNT]; ///< The stages.
+};
+
+/**
+ * Runs a stage of the pipeline on a file.
+ *
+ * @param stage The stage.
+ * @param fileIndex The index of the file.
+ */
+void processFile(struct PipelineStage *stage, int fileIndex)
+{
+    struct Build *build = &stage->pipeline->build;
+    struct SourceFile *file = &stage->pipeline->files[fileIndex];
+    struct SourceOutput *output = &build->outputs[fileIndex];
+
+    switch (stage->type)
+    {
+        case PS_LEX:
+            if (!openSourceFile(file, build->fileNames[fileIndex], build->options, 1, appendOutput, output))
+            {
+                output->isNotFound = ERR_catchError(E_FILE_NOT_FOUND);
+            }
+        break;
+        case PS_PARSE:
+            if (file->isOpened)
+            {
+                parseSourceFile(&stage->sourceCompiler, file);
+            }
+        break;
+        default:
+            if (file->isOpened)
+            {
+                checkSourceFile(&stage->sourceCompiler, file);
+                output->hasErrors = hasErrors(file);
+            }
+            stage->statistics.byteCount += file->source.end - file->source.begin;
+            closeSourceFile(file);
+            finishOutput(build, fileIndex);
+            return;
+    }
+    stage->statistics.byteCount += file->source.end - file->source.begin;
+}
+
+/**
+ * Runs a stage of the pipeline until the files run out. The end of the files is passed
+ * to the next stage as -1.
+ *
+ * @param userData The stage.
+ *
+ * @return Null.
+ */
+void *runStage(void *userData)
+{
+    struct PipelineStage *stage = (struct PipelineStage *)userData;
+    int nextFile = 0;
+    int fileIndex;
+    double start;
+
+    if (stage->pipeline->build.options->timeReport)
+    {
+        TIM_startReport(&stage->report);
+    }
+    for (;;)
+    {
+        if (stage->input)
         {
-            sprintf(buffer, "return expected. \n");
+            fileIndex = takeItem(stage->input, &stage->statistics);
         }
-        else if (ERR_catchError(E_STX_TERM_EXPECTED))
+        else
         {
-            sprintf(buffer, "term expected. \n");
+            fileIndex = nextFile < stage->pipeline->build.fileCount ? nextFile++ : -1;
         }
-        else if (ERR_catchError(E_STX_IF_EXPECTED))
+        if (fileIndex < 0)
         {
-            sprintf(buffer, "if expected. \n");
+            break;
         }
-        else if (ERR_catchError(E_STX_UNKNOWN_STATEMENT))
+        start = getTime();
+        processFile(stage, fileIndex);
+        stage->statistics.busyTime += getTime() - start;
+        stage->statistics.fileCount++;
+        if (stage->output)
         {
-            sprintf(buffer, "unknown statement. \n");
+            putItem(stage->output, fileIndex, &stage->statistics);
         }
-        else if (ERR_catchError(E_STX_LOOP_EXPECTED))
+    }
+    if (stage->output)
+    {
+        putItem(stage->output, -1, &stage->statistics);
+    }
+    TIM_stopReport();
+    return 0;
+}
+
+/**
+ * Writes the statistics of the stages of the pipeline to the standard error.
+ *
+ * @param pipeline The pipeline.
+ * @param wallTime The time the pipeline ran for.
+ * @param sink Receives the statistics.
+ */
+void writeStageStatistics(const struct Pipeline *pipeline, double wallTime, const struct OutputSink *sink)
+{
+    static const char *stageNames[PS_COUNT] = {"lex", "parse", "check"};
+    int i;
+
+    writeToSink(sink, 1, "stage     files         MB   busy s  starved s  blocked s    files/s       MB/s\n");
+    for (i = 0; i < PS_COUNT; i++)
+    {
+        const struct StageStatistics *statistics = &pipeline->stages[i].statistics;
+        double busyTime = statistics->busyTime > 0 ? statistics->busyTime : 1e-9;
+        writeToSink(
+            sink,
+            1,
+            "%-6s %8d %10.2f %8.3f %10.3f %10.3f %10.1f %10.2f\n",
+            stageNames[i],
+            statistics->fileCount,
+            statistics->byteCount / 1048576.0,
+            statistics->busyTime,
+            statistics->starvedTime,
+            statistics->blockedTime,
+            statistics->fileCount / busyTime,
+            statistics->byteCount / 1048576.0 / busyTime);
+    }
+    writeToSink(sink, 1, "total  %8d files in %.3f s\n", pipeline->build.fileCount, wallTime);
+}
+
+/**
+ * Compiles files in a pipeline of the lexing, the parsing and the checking stages, each
+ * on its own thread, connected by bounded queues. The messages are written in the order
+ * of the files, the statistics of the stages to the standard error.
+ *
+ * @param fileNames The files to compile.
+ * @param fileCount Count of files.
+ * @param options The options.
+ * @param queueDepth The capacity of the queues between the stages.
+ * @param sink Receives the output.
+ *
+ * @return Nonzero if all the files are found and none of them has errors.
+ */
+int compileFilesInPipeline(
+    char **fileNames,
+    int fileCount,
+    const struct CompileOptions *options,
+    int queueDepth,
+    const struct OutputSink *sink)
+{
+    struct Pipeline pipeline;
+    struct TIM_Report report;
+    double start = getTime();
+    int isStarted[PS_COUNT - 1] = {0, 0};
+    int isSucceeded;
+    int i;
+
+    memset(&pipeline, 0, sizeof(struct Pipeline));
+    pipeline.build.options = options;
+    pipeline.build.sink = sink;
+    pipeline.build.fileNames = fileNames;
+    pipeline.build.fileCount = fileCount;
+    pipeline.build.outputs = calloc(fileCount, sizeof(struct SourceOutput));
+    pthread_mutex_init(&pipeline.build.outputLock, 0);
+    pipeline.files = calloc(fileCount, sizeof(struct SourceFile));
+    for (i = 0; i < PS_COUNT - 1; i++)
+    {
+        pipeline.queues[i].items = malloc(queueDepth * sizeof(int));
+        pipeline.queues[i].capacity = queueDepth;
+        atomic_init(&pipeline.queues[i].head, 0);
+        atomic_init(&pipeline.queues[i].tail, 0);
+        atomic_init(&pipeline.queues[i].waiterCount, 0);
+        pthread_mutex_init(&pipeline.queues[i].lock, 0);
+        pthread_cond_init(&pipeline.queues[i].changed, 0);
+    }
+    for (i = 0; i < PS_COUNT; i++)
+    {
+        struct PipelineStage *stage = &pipeline.stages[i];
+        stage->type = i;
+        stage->pipeline = &pipeline;
+        stage->input = i > 0 ? &pipeline.queues[i - 1] : 0;
+        stage->output = i < PS_COUNT - 1 ? &pipeline.queues[i] : 0;
+        initializeSourceCompiler(&stage->sourceCompiler, options);
+    }
+
+    // The stages are started from the end, so a stage that couldn't be started only
+    // has to stop the ones after it.
+    for (i = PS_COUNT - 2; i >= 0; i--)
+    {
+        isStarted[i] = !pthread_create(&pipeline.stages[i].thread, 0, runStage, &pipeline.stages[i]);
+        if (!isStarted[i])
         {
-            sprintf(buffer, "loop expected. \n");
+            break;
         }
-        else if (ERR_catchError(E_STX_ASSIGNMENT_OR_EXPRESSION_STATEMENT_EXPECTED))
+    }
+    if (i < 0)
+    {
+        runStage(&pipeline.stages[PS_COUNT - 1]);
+    }
+    else if (i < PS_COUNT - 2)
+    {
+        putItem(&pipeline.queues[i], -1, &pipeline.stages[i].statistics);
+        while (takeItem(&pipeline.queues[PS_COUNT - 2], &pipeline.stages[PS_COUNT - 1].statistics) >= 0);
+    }
+    for (i = 0; i < PS_COUNT - 1; i++)
+    {
+        if (isStarted[i])
         {
-            sprintf(buffer, "Assignment or expression statement expected. \n");
+            pthread_join(pipeline.stages[i].thread, 0);
         }
-        else if (ERR_catchError(E_STX_UNEXPECTED_END_OF_FILE))
+    }
+    if (pipeline.build.nextOutput < fileCount)
+    {
+        // The threads couldn't be started, the files are compiled on the main thread.
+        isSucceeded = compileFiles(fileNames, fileCount, options, 1, sink, 0);
+    }
+    else
+    {
+        isSucceeded = !pipeline.build.isFailed;
+        writeStageStatistics(&pipeline, getTime() - start, sink);
+        if (options->timeReport)
         {
-            sprintf(buffer, "Unexpected end of file. \n");
+            memset(&report, 0, sizeof(report));
+            for (i = 0; i < PS_COUNT; i++)
+            {
+                TIM_addReport(&report, &pipeline.stages[i].report);
+            }
+            writeTimeReport(&report, getTime() - start, PS_COUNT, options->timeReport, sink);
         }
-        else if (ERR_catchError(E_STX_NAMESPACE_EXPECTED))
+    }
+
+    for (i = 0; i < PS_COUNT; i++)
+    {
+        cleanUpSourceCompiler(&pipeline.stages[i].sourceCompiler);
+    }
+    for (i = 0; i < PS_COUNT - 1; i++)
+    {
+        free(pipeline.queues[i].items);
+        pthread_mutex_destroy(&pipeline.queues[i].lock);
+        pthread_cond_destroy(&pipeline.queues[i].changed);
+    }
+    free(pipeline.files);
+    pthread_mutex_destroy(&pipeline.build.outputLock);
+    free(pipeline.build.outputs);
+    return isSucceeded;
+}
+
+/**
+ * A growing list of file names.
+ */
+struct FileList
+{
+    char **names; ///< The file names. They are owned by the list.
+    int count; ///< Count of the file names.
+    int allocated; ///< Allocated size of the array.
+};
+
+/**
+ * Adds a copy of a file name to the list.
+ *
+ * @param list The list.
+ * @param name The file name.
+ * @param length Length of the file name.
+ */
+void addFileName(struct FileList *list, const char *name, int length)
+{
+    if (list->count == list->allocated)
+    {
+        list->allocated = list->allocated ? list->allocated * 2 : 16;
+        list->names = realloc(list->names, list->allocated * sizeof(char*));
+    }
+    list->names[list->count] = malloc(length + 1);
+    memcpy(list->names[list->count], name, length);
+    list->names[list->count][length] = 0;
+    list->count++;
+}
+
+/**
+ * Adds the files listed in a manifest to the list. The manifest has one file name per
+ * line. The whitespace around the names, the empty lines and the lines starting with #
+ * are ignored. The names are relative to the working directory.
+ *
+ * @param list The list.
+ * @param fileName The name of the manifest.
+ *
+ * @return Nonzero on success, zero if the manifest can't be opened.
+ */
+int readManifest(struct FileList *list, const char *fileName)
+{
+    struct LoadedFile manifest;
+    const char *line;
+
+    if (!loadFile(fileName, &manifest))
+    {
+        return 0;
+    }
+    for (line = manifest.begin; line < manifest.end;)
+    {
+        const char *lineEnd = memchr(line, '\n', manifest.end - line);
+        const char *begin = line;
+        const char *end;
+
+        if (!lineEnd)
         {
-            sprintf(buffer, "namespace expected. \n");
+            lineEnd = manifest.end;
         }
-        else if (ERR_catchError(E_STX_USING_EXPECTED))
+        end = lineEnd;
+        while ((begin < end) && ((*begin == ' ') || (*begin == '\t')))
         {
-            sprintf(buffer, "using expected. \n");
+            begin++;
         }
-        else if (ERR_catchError(E_STX_PERIOD_EXPECTED))
+        while ((end > begin) && ((end[-1] == ' ') || (end[-1] == '\t') || (end[-1] == '\r')))
         {
-            sprintf(buffer, ". expected. \n");
+            end--;
         }
-        else if (ERR_catchError(E_STX_STRUCT_EXPECTED))
+        if ((begin < end) && (*begin != '#'))
         {
-            sprintf(buffer, "struct expected. \n");
+            addFileName(list, begin, end - begin);
         }
-        else if (ERR_catchError(E_STX_FUNCPTR_EXPECTED))
+        line = lineEnd + 1;
+    }
+    unloadFile(&manifest);
+    return 1;
+}
+
+/**
+ * @return The count of the processors, the default count of threads.
+ */
+int getProcessorCount()
+{
+#ifdef _SC_NPROCESSORS_ONLN
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+#else
+    return 1;
+#endif
+}
+
+/**
+ * Writes the usage of eplc.
+ *
+ * @param sink Receives the text.
+ */
+void printUsage(const struct OutputSink *sink)
+{
+    static const char *usage =
+        "Usage: eplc [--token-cache] [--json-diagnostics] [--dump-...] [--jobs=N]\n"
+        "            [--pipeline] [--queue-depth=N] [--manifest=listfile] [--time-report[=json]]\n"
+        "            [--server=socket | --client=socket] filename...\n"
+        "Use - as filename to read the source from the standard input, and -- before the\n"
+        "filenames starting with --. The exit status is nonzero if a file is not found or\n"
+        "has errors.\n"
+        "--token-cache loads the tokens from filename.tokcache if it's of the same source,\n"
+        "otherwise writes it.\n"
+        "--json-diagnostics writes the errors as JSON objects, one per line.\n"
+        "--dump-tokens, --dump-raw-tree, --dump-tree, --dump-scopes, --dump-all write\n"
+        "filename.tokens, .rawtree (before semantic checking), .tree and .scopes.\n"
+        "--dump-format=text|json|binary sets the format of the token and tree dumps.\n"
+        "--jobs=N compiles the files on N threads, the default is the processor count.\n"
+        "--pipeline lexes, parses and checks different files at the same time on three\n"
+        "threads instead, and writes the statistics of the stages to the standard error.\n"
+        "--queue-depth=N sets the count of files waiting between the stages. (default: 4)\n"
+        "--manifest=listfile compiles the files listed in listfile, one per line.\n"
+        "--time-report writes the wall time, CPU time, allocations and peak RSS of the\n"
+        "phases of the compilation to the standard error as a table, =json as JSON.\n"
+        "--cache-dir=directory reuses the messages of the files compiled earlier with the\n"
+        "same source and options, and saves the new ones there. The builds can share it.\n"
+        "--cache-size=MB trims the cache by removing the least recently used entries.\n"
+        "(default: 256)\n"
+        "--server=socket stays resident and compiles the requests sent to the Unix socket,\n"
+        "reusing the results of the files not changed since the previous requests.\n"
+        "--client=socket sends the rest of the command line to the server listening on the\n"
+        "socket, or compiles locally if there is no server.\n";
+
+    sink->write(usage, strlen(usage), 0, sink->userData);
+}
+
+/**
+ * Runs a compilation command line.
+ *
+ * @param argc,argv The command line. --server and --client are ignored, they are
+ *      handled by main. On the compile server argv[0] is the working directory of the
+ *      client, the relative paths are resolved against it.
+ * @param sink Receives the output.
+ * @param server The compile server running the command line. Null if run locally.
+ *
+ * @return Nonzero on success. Zero if an option is unknown, the manifest or the standard
+ *      input can't be read, or a file is not found or has errors.
+ */
+int runCommandLine(int argc, char **argv, const struct OutputSink *sink, struct CompileServer *server)
+{
+    struct CompileOptions options;
+    struct FileList files = {0, 0, 0};
+    char *cacheDirectory = 0;
+    int threadCount = getProcessorCount();
+    int usePipeline = 0;
+    int queueDepth = 4;
+    int argIndex = 1;
+    int isSucceeded = 1;
+    int i;
+
+    options.useTokenCache = 0;
+    options.diagnosticFormat = DF_TEXT;
+    options.dumps = 0;
+    options.dumpFormat = DUMP_TEXT;
+    options.cacheDirectory = 0;
+    options.cacheSizeLimit = (int64_t)DEFAULT_CACHE_SIZE << 20;
+    options.cacheFileMode = 0;
+    options.timeReport = TRF_NONE;
+    options.lexerThreadCount = 1;
+    options.workingDirectory = server ? argv[0] : 0;
+    for (; (argIndex < argc) && !strncmp(argv[argIndex], "--", 2); argIndex++)
+    {
+        if (!strcmp(argv[argIndex], "--token-cache"))
         {
-            sprintf(buffer, "funcptr expected. \n");
+            options.useTokenCache = 1;
         }
-        else if (ERR_catchError(E_STX_CASE_EXPECTED))
+        else if (!strcmp(argv[argIndex], "--json-diagnostics"))
         {
-            sprintf(buffer, "case expected. \n");
+            options.diagnosticFormat = DF_JSON;
         }
-        else if (ERR_catchError(E_STX_COLON_EXPECTED))
+        else if (!strcmp(argv[argIndex], "--dump-tokens"))
         {
-            sprintf(buffer, ": expected. \n");
+            options.dumps |= DUMP_TOKENS;
         }
-        else if (ERR_catchError(E_STX_BREAK_OR_CONTINUE_EXPECTED))
+        else if (!strcmp(argv[argIndex], "--dump-raw-tree"))
         {
-            sprintf(buffer, "break or continue expected. \n");
+            options.dumps |= DUMP_RAW_TREE;
         }
-        else if (ERR_catchError(E_STX_SWITCH_EXPECTED))
+        else if (!strcmp(argv[argIndex], "--dump-tree"))
         {
-            sprintf(buffer, "switch expected. \n");
+            options.dumps |= DUMP_TREE;
         }
-        else if (ERR_catchError(E_STX_CASE_OR_DEFAULT_EXPECTED))
+        else if (!strcmp(argv[argIndex], "--dump-scopes"))
         {
-            sprintf(buffer, "case or default expected. \n");
+            options.dumps |= DUMP_SCOPES;
         }
-        else if (ERR_catchError(E_STX_DECLARATION_EXPECTED))
+        else if (!strcmp(argv[argIndex], "--dump-all"))
         {
-            sprintf(buffer, "declaration expected. \n");
+            options.dumps = DUMP_TOKENS | DUMP_RAW_TREE | DUMP_TREE | DUMP_SCOPES;
         }
-        else if (ERR_catchError(E_STX_UNEXPECTED_END_OF_FILE))
+        else if (!strcmp(argv[argIndex], "--dump-format=text"))
         {
-            sprintf(buffer, "Unexpected end of file. \n");
+            options.dumpFormat = DUMP_TEXT;
         }
-        else if (ERR_catchError(E_STX_PRECEDENCE_TYPE_EXPECTED))
+        else if (!strcmp(argv[argIndex], "--dump-format=json"))
         {
-            sprintf(buffer, "Precedence type expected.");
+            options.dumpFormat = DUMP_JSON;
         }
-        else if (ERR_catchError(E_STX_BLOCK_OR_IF_STATEMENT_EXPECTED))
+        else if (!strcmp(argv[argIndex], "--dump-format=binary"))
         {
-            sprintf(buffer, "Block or if statement expected.");
+            options.dumpFormat = DUMP_BINARY;
         }
-        else if (ERR_catchError(E_STX_CORRUPT_TOKEN))
+        else if (!strncmp(argv[argIndex], "--jobs=", 7))
         {
-            sprintf(buffer, "Corrupt token (this error should never happen)");
+            threadCount = atoi(argv[argIndex] + 7);
         }
-        else
+        else if (!strcmp(argv[argIndex], "--pipeline"))
         {
-            sprintf(buffer, "Unhandled syntax error.\n");
+            usePipeline = 1;
         }
-        callback(buffer);
-        goto cleanup;
-    }
-    printf("Syntax checking finished.\n");
-    sprintf(fn,"%s.rawtree", fileName);
-    FILE *f = fopen(fn, "w+t");
-    STX_transversePreorder(parserResult.tree, dumpTreeCallback, f);
-    fclose(f);
-    // Semantic checking
-    checkerResult = SMC_checkSyntaxTree(parserResult.tree);
-    if (ERR_isError())
-    {
-        const struct STX_NodeAttribute *attr = STX_getNodeAttribute(checkerResult.lastNode);
-        struct STX_SyntaxTreeNode *node = checkerResult.lastNode;
-        sprintf(
-            buffer,
-            "[%d; %d] - [%d; %d] %.*s (node: %s): ",
-            node->beginLine,
-            node->beginColumn,
-            node->endLine,
-            node->endColumn,
-            attr ? attr->nameLength : 0,
-            attr ? attr->name : "",
-            STX_nodeTypeToString(node->nodeType)
-        );
-        callback(buffer);
-        if (ERR_catchError(E_SMC_CORRUPT_SYNTAX_TREE))
+        else if (!strncmp(argv[argIndex], "--queue-depth=", 14))
         {
-            sprintf(buffer, "Syntax tree is corrupt!\n");
+            queueDepth = atoi(argv[argIndex] + 14);
+            if (queueDepth < 1)
+            {
+                queueDepth = 1;
+            }
         }
-        else if (ERR_catchError(E_SMC_REDEFINITION_OF_SYMBOL))
+        else if (!strcmp(argv[argIndex], "--time-report"))
         {
-            sprintf(buffer, "Redefinition of symbol!\n");
+            options.timeReport = TRF_TABLE;
         }
-        else if (ERR_catchError(E_SMC_TOO_FEW_PARAMETERS))
+        else if (!strcmp(argv[argIndex], "--time-report=json"))
         {
-            sprintf(buffer, "Too few parameters given to this function. \n");
+            options.timeReport = TRF_JSON;
         }
-        else if (ERR_catchError(E_SMC_TOO_MANY_PARAMETERS))
+        else if (!strncmp(argv[argIndex], "--manifest=", 11))
         {
-            sprintf(buffer, "Too many parameters given to this function. \n");
+            char *manifestPath = resolvePath(options.workingDirectory, argv[argIndex] + 11);
+            int isRead = readManifest(&files, manifestPath);
+            free(manifestPath);
+            if (!isRead)
+            {
+                writeNotFound(sink, options.diagnosticFormat, argv[argIndex] + 11);
+                isSucceeded = 0;
+                goto cleanup;
+            }
         }
-        else if (ERR_catchError(E_SMC_EMPTY_PLATFORM_BLOCK))
+#ifdef COMPILATION_CACHE
+        else if (!strncmp(argv[argIndex], "--cache-dir=", 12))
         {
-            sprintf(buffer, "Platform block is empty. \n");
+            free(cacheDirectory);
+            cacheDirectory = resolvePath(options.workingDirectory, argv[argIndex] + 12);
+            options.cacheDirectory = cacheDirectory;
         }
-        else if (ERR_catchError(E_SMC_BREAK_IS_NOT_IN_LOOP_OR_CASE_BLOCK))
+        else if (!strncmp(argv[argIndex], "--cache-size=", 13))
         {
-            sprintf(buffer, "Break is not in loop or case block. \n");
+            options.cacheSizeLimit = (int64_t)atoi(argv[argIndex] + 13) << 20;
         }
-        else if (ERR_catchError(E_SMC_UNDEFINED_SYMBOL))
+#endif
+        else if (!strcmp(argv[argIndex], "--"))
         {
-            sprintf(buffer, "Undefined symbol. \n");
+            argIndex++;
+            break;
         }
-        else if (ERR_catchError(E_SMC_NOT_AN_OPERATOR))
+        else if (strncmp(argv[argIndex], "--server=", 9) && strncmp(argv[argIndex], "--client=", 9))
         {
-            sprintf(buffer, "The symbol is used like an operator, but it's not an operator. \n");
+            writeToSink(sink, 1, "Unknown option %s.\n", argv[argIndex]);
+            printUsage(sink);
+            isSucceeded = 0;
+            goto cleanup;
         }
-        else if (ERR_catchError(E_SMC_NOT_A_NAMESPACE))
+    }
+    for (; argIndex < argc; argIndex++)
+    {
+        addFileName(&files, argv[argIndex], strlen(argv[argIndex]));
+    }
+    if (!files.count)
+    {
+        printUsage(sink);
+        goto cleanup;
+    }
+    for (i = 0; server && (i < files.count); i++)
+    {
+        if (!strcmp(files.names[i], "-"))
         {
-            sprintf(buffer, "The symbol is not a namespace. \n");
+            // The standard input of the server is not the one of the client.
+            writeToSink(sink, 1, "The compile server can't read the standard input.\n");
+            isSucceeded = 0;
+            goto cleanup;
         }
-        else if (ERR_catchError(E_SMC_AMBIGUOS_NAME))
+    }
+#ifdef COMPILATION_CACHE
+    if (options.cacheDirectory && mkdir(options.cacheDirectory, 0777) && (errno != EEXIST))
+    {
+        writeToSink(sink, 1, "Can't create the cache directory %s.\n", options.cacheDirectory);
+        options.cacheDirectory = 0;
+    }
+    if (options.cacheDirectory)
+    {
+        options.cacheFileMode = 0644 & ~getFileCreationMask();
+    }
+#endif
+    if (!usePipeline && (threadCount > files.count))
+    {
+        options.lexerThreadCount = threadCount / files.count;
+    }
+    if (usePipeline)
+    {
+        isSucceeded = compileFilesInPipeline(files.names, files.count, &options, queueDepth, sink);
+    }
+    else
+    {
+        isSucceeded = compileFiles(files.names, files.count, &options, threadCount, sink, server);
+    }
+#ifdef COMPILATION_CACHE
+    if (options.cacheDirectory)
+    {
+        trimCache(options.cacheDirectory, options.cacheSizeLimit);
+    }
+#endif
+
+cleanup:
+    for (i = 0; i < files.count; i++)
+    {
+        free(files.names[i]);
+    }
+    free(files.names);
+    free(cacheDirectory);
+    return isSucceeded;
+}
+
+#ifdef COMPILE_SERVER
+/// The longest frame accepted from the other side of the socket.
+#define MAX_FRAME_SIZE (1<<24)
+
+/// The server drops a client that sends nothing for this many seconds while a frame is
+/// expected, or takes no output for this long.
+#define CLIENT_TIMEOUT 10
+
+/**
+ * The types of the frames sent between the compile server and its clients.
+ */
+enum FrameType
+{
+    FT_REQUEST, ///< The working directory and the arguments of the client, each terminated by zero.
+    FT_OUTPUT, ///< Text for the standard output.
+    FT_ERROR, ///< Text for the standard error.
+    FT_EXIT, ///< The end of the request. The payload is the int32_t exit status.
+};
+
+/**
+ * Precedes the payload of each frame. The fields are in the native byte order, the
+ * socket is local.
+ */
+struct FrameHeader
+{
+    uint32_t length; ///< The length of the payload.
+    uint32_t type; ///< The type of the frame. (enum FrameType)
+};
+
+/**
+ * Writes a buffer to a socket completely.
+ *
+ * @return Nonzero on success.
+ */
+int writeAll(int fd, const void *buffer, size_t length)
+{
+    const char *ptr = (const char *)buffer;
+
+    while (length)
+    {
+        ssize_t written = write(fd, ptr, length);
+        if (written < 0)
         {
-            sprintf(buffer, "Ambiguous symbol name. \n");
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return 0;
         }
-        else
+        ptr += written;
+        length -= written;
+    }
+    return 1;
+}
+
+/**
+ * Reads a buffer from a socket completely.
+ *
+ * @return Nonzero on success, zero on error, on timeout or if the other side closed the
+ *      socket.
+ */
+int readAll(int fd, void *buffer, size_t length)
+{
+    char *ptr = (char *)buffer;
+
+    while (length)
+    {
+        ssize_t received = read(fd, ptr, length);
+        if (received <= 0)
         {
-            sprintf(buffer, "Unknown error. \n");
+            if ((received < 0) && (errno == EINTR))
+            {
+                continue;
+            }
+            return 0;
         }
+        ptr += received;
+        length -= received;
+    }
+    return 1;
+}
 
-        callback(buffer);
-        goto cleanup;
+/**
+ * Sends a frame.
+ *
+ * @param fd The socket.
+ * @param type The type of the frame.
+ * @param payload The payload.
+ * @param length Length of the payload.
+ *
+ * @return Nonzero on success.
+ */
+int sendFrame(int fd, enum FrameType type, const void *payload, size_t length)
+{
+    struct FrameHeader header;
+
+    header.length = length;
+    header.type = type;
+    return writeAll(fd, &header, sizeof(header)) && writeAll(fd, payload, length);
+}
+
+/**
+ * Receives a frame.
+ *
+ * @param fd The socket.
+ * @param [out] header The header of the frame.
+ * @param [out] payload The payload terminated by an extra zero, allocated by malloc.
+ *
+ * @return Nonzero on success. Zero if the frame can't be read or it's too long, then
+ *      there is nothing to free.
+ */
+int receiveFrame(int fd, struct FrameHeader *header, char **payload)
+{
+    if (!readAll(fd, header, sizeof(struct FrameHeader)) || (header->length > MAX_FRAME_SIZE))
+    {
+        return 0;
     }
-    sprintf(fn,"%s.tree", fileName);
-    f = fopen(fn, "w+t");
-    STX_transversePreorder(parserResult.tree, dumpTreeCallback, f);
-    fclose(f);
-cleanup:
-    free(fn);
-    LEX_cleanUpLexerResult(&lexerResult);
+    *payload = malloc(header->length + 1);
+    if (!readAll(fd, *payload, header->length))
+    {
+        free(*payload);
+        return 0;
+    }
+    (*payload)[header->length] = 0;
+    return 1;
 }
 
-void notificationCallback(const char *msg)
+/**
+ * Sends the output to the client as frames.
+ *
+ * This is the write function of the sink of the requests run by the server.
+ */
+void writeToClient(const char *text, int length, int isError, void *userData)
 {
-    printf("%s",msg);
+    // A client that went away is noticed when the next request is accepted.
+    sendFrame(*(int *)userData, isError ? FT_ERROR : FT_OUTPUT, text, length);
 }
 
-int main(int argc, char **argv)
+/**
+ * Serves a request of a client.
+ *
+ * @param server The server.
+ * @param fd The socket of the client.
+ */
+void serveRequest(struct CompileServer *server, int fd)
 {
-    if (argc < 2)
+    struct OutputSink sink = {writeToClient, &fd};
+    struct FrameHeader header;
+    char *payload;
+    char **argv;
+    char *ptr;
+    int argc = 0;
+    int32_t status = 1;
+
+    if (!receiveFrame(fd, &header, &payload))
     {
-        printf("Usage: eplc filename\n");
-        goto cleanup;
+        return;
+    }
+    if ((header.type != FT_REQUEST) || !header.length || payload[header.length - 1])
+    {
+        free(payload);
+        return;
+    }
+    // The working directory takes the place of the program name. The paths are
+    // resolved against it, the server doesn't change its own working directory.
+    argv = malloc((header.length + 1) * sizeof(char*));
+    for (ptr = payload; ptr < payload + header.length; ptr += strlen(ptr) + 1)
+    {
+        argv[argc++] = ptr;
+    }
+    argv[argc] = 0;
+    if (argv[0][0] != '/')
+    {
+        writeToSink(&sink, 1, "The working directory %s of the client is not absolute.\n", argv[0]);
     }
-    compileFile(argv[1], notificationCallback);
-    if (ERR_catchError(E_FILE_NOT_FOUND))
+    else
     {
-        fprintf(stderr, "%s not found. \n", argv[1]);
+        status = !runCommandLine(argc, argv, &sink, server);
     }
+    sendFrame(fd, FT_EXIT, &status, sizeof(status));
+    free(argv);
+    free(payload);
+}
 
-cleanup:
-    free(sourceCode);
+/**
+ * Fills the address of a Unix socket.
+ *
+ * @return Nonzero on success, zero if the path is too long.
+ */
+int getSocketAddress(const char *path, struct sockaddr_un *address)
+{
+    memset(address, 0, sizeof(struct sockaddr_un));
+    address->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address->sun_path))
+    {
+        return 0;
+    }
+    strcpy(address->sun_path, path);
+    return 1;
+}
 
-    fgetc(stdin);
+/**
+ * Runs the compile server. It serves the requests one after the other until it's
+ * killed. The messages of the compiled files are kept between the requests, see
+ * compileServedFile.
+ *
+ * @param path The path of the socket. A socket left there by an earlier server is
+ *      replaced, the server isn't started if there is any other kind of file.
+ *
+ * @return Zero if the server can't be started.
+ */
+int runServer(const char *path)
+{
+    struct CompileServer server;
+    struct sockaddr_un address;
+    struct timeval timeout = {CLIENT_TIMEOUT, 0};
+    struct stat status;
+    int fd;
+    int clientFd;
 
+    if (!getSocketAddress(path, &address))
+    {
+        fprintf(stderr, "The socket path %s is too long.\n", path);
+        return 0;
+    }
+    if (!lstat(path, &status) && !S_ISSOCK(status.st_mode))
+    {
+        fprintf(stderr, "%s exists and it's not a socket.\n", path);
+        return 0;
+    }
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Can't create the socket.\n");
+        return 0;
+    }
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) || listen(fd, 16))
+    {
+        fprintf(stderr, "Can't listen on %s.\n", path);
+        close(fd);
+        return 0;
+    }
+    // Writing to a client that went away must not kill the server.
+    signal(SIGPIPE, SIG_IGN);
+    initializeCompileServer(&server);
+    printf("Listening on %s.\n", path);
+    fflush(stdout);
+    for (;;)
+    {
+        clientFd = accept(fd, 0, 0);
+        if (clientFd < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            break;
+        }
+        // A client that stops sending or reading must not stall the server.
+        setsockopt(clientFd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(clientFd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        serveRequest(&server, clientFd);
+        close(clientFd);
+    }
+    cleanUpCompileServer(&server);
+    close(fd);
+    unlink(path);
     return 0;
 }
+
+/**
+ * Sends a command line to the compile server and writes its output.
+ *
+ * @param path The path of the socket of the server.
+ * @param argc,argv The command line. The --client options are not sent.
+ * @param [out] status The exit status of the request.
+ *
+ * @return Nonzero if the request is served, zero if the server can't be reached.
+ */
+int runClient(const char *path, int argc, char **argv, int *status)
+{
+    struct TextBuffer request = {0, 0, 0};
+    struct sockaddr_un address;
+    struct FrameHeader header;
+    char directory[PATH_MAX];
+    char *payload;
+    int isExited = 0;
+    int fd;
+    int i;
+
+    if (!getSocketAddress(path, &address) || !getcwd(directory, sizeof(directory)))
+    {
+        return 0;
+    }
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        return 0;
+    }
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)))
+    {
+        close(fd);
+        return 0;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    // The terminating zeros are part of the payload.
+    appendText(&request, "%s", directory);
+    request.length++;
+    for (i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--client=", 9))
+        {
+            appendText(&request, "%s", argv[i]);
+            request.length++;
+        }
+    }
+    if (sendFrame(fd, FT_REQUEST, request.text, request.length))
+    {
+        while (!isExited && receiveFrame(fd, &header, &payload))
+        {
+            switch (header.type)
+            {
+                case FT_OUTPUT:
+                    fwrite(payload, 1, header.length, stdout);
+                    break;
+                case FT_ERROR:
+                    fflush(stdout);
+                    fwrite(payload, 1, header.length, stderr);
+                    break;
+                case FT_EXIT:
+                    *status = (header.length == sizeof(int32_t)) ? *(int32_t *)payload : 1;
+                    isExited = 1;
+                    break;
+            }
+            free(payload);
+        }
+    }
+    if (!isExited)
+    {
+        fprintf(stderr, "The compile server closed the connection.\n");
+        *status = 1;
+    }
+    free(request.text);
+    close(fd);
+    return 1;
+}
+#endif
+
+int main(int argc, char **argv)
+{
+    struct OutputSink sink = {writeStandardOutput, 0};
+    int status;
+#ifdef COMPILE_SERVER
+    const char *serverPath = 0;
+    const char *clientPath = 0;
+    int i;
+
+    for (i = 1; (i < argc) && !strncmp(argv[i], "--", 2) && strcmp(argv[i], "--"); i++)
+    {
+        if (!strncmp(argv[i], "--server=", 9))
+        {
+            serverPath = argv[i] + 9;
+        }
+        else if (!strncmp(argv[i], "--client=", 9))
+        {
+            clientPath = argv[i] + 9;
+        }
+    }
+    if (serverPath)
+    {
+        return !runServer(serverPath);
+    }
+    if (clientPath)
+    {
+        if (runClient(clientPath, argc, argv, &status))
+        {
+            return status;
+        }
+        fprintf(stderr, "No compile server on %s, compiling locally.\n", clientPath);
+    }
+#endif
+    status = !runCommandLine(argc, argv, &sink, 0);
+
+    return status;
+}
@@ -54,6 +54,7 @@
 #include "error.h"
 #include "assocarray.h"
 #include "error.h"
+#include "timing.h"
 
 /**
  * A struct for scope.
@@ -73,6 +74,16 @@ struct Scope
     int usedNameSpaceCount; ///< count of entries in the dynamic array.
 };
 
+/**
+ * An entry of the symbol hash table. It maps a symbol id in a scope to its declaring node.
+ */
+struct SymbolEntry
+{
+    int scopeId; ///< The scope the symbol is declared in.
+    unsigned symbolId; ///< The symbol id of the name from the lexer.
+    struct STX_SyntaxTreeNode *node; ///< The declaring node. Null if the slot is empty.
+};
+
 /**
  * Context struct storing everything about the semantic checking.
  */
@@ -90,6 +101,14 @@ struct SemanticContext
     int scopePointersAllocated;
     int scopeCount;
 
+    /// Open addressing hash table of the declared symbols of all scopes.
+    /// Its size is always power of 2.
+    struct SymbolEntry *symbolTable;
+    int symbolTableSize; ///< Number of slots in the table.
+    int symbolEntryCount; ///< Number of used slots.
+    /// Nonzero if the scopes are dumped. Only then are the symbols also kept by name in
+    /// the associative arrays of the scopes.
+    int isDumpingScopes;
 };
 
 enum PrecedenceLevel
@@ -158,6 +177,25 @@ static struct Scope *allocateScope(
     return newScope;
 }
 
+/**
+ * Releases the scopes.
+ *
+ * @param context The semantic context.
+ */
+static void freeScopes(struct SemanticContext *context)
+{
+    int i;
+    for (i = 0; i < context->scopeCount; i++)
+    {
+        struct Scope *scope = context->scopePointers[i];
+        ASSOC_cleanupArray(scope->symbols);
+        free(scope->symbols);
+        free(scope->usedNamespaces);
+        free(scope);
+    }
+    free(context->scopePointers);
+}
+
 static struct STX_SyntaxTreeNode *getCurrentNode(struct SemanticContext *context)
 {
     return context->currentNode;
@@ -168,6 +206,18 @@ static enum STX_NodeType getCurrentNodeType(struct SemanticContext *context)
     return getCurrentNode(context)->nodeType;
 }
 
+/**
+ * Raises an error at the current node.
+ *
+ * @param [in] context The semantic context.
+ * @param [in] errorCode The error to raise.
+ */
+static void raiseCheckerError(struct SemanticContext *context, enum ERR_ErrorCode errorCode)
+{
+    const struct STX_SyntaxTreeNode *node = context->currentNode;
+    ERR_raiseErrorAt(errorCode, node ? node->beginOffset : -1, node ? node->id : -1);
+}
+
 /**
  * Creates a new scope as a child scope of the current scope, and makes it current.
  */
@@ -186,6 +236,83 @@ static void ascendToParentScope(struct SemanticContext *context)
     context->currentScope = context->currentScope->parentScope;
 }
 
+/**
+ * Computes the hash table slot where the lookup of a symbol in a scope starts.
+ */
+static unsigned getSymbolSlot(const struct SemanticContext *context, int scopeId, unsigned symbolId)
+{
+    unsigned hash = symbolId * 2654435761u ^ (unsigned)scopeId * 40503u;
+
+    return (hash ^ (hash >> 15)) & (context->symbolTableSize - 1);
+}
+
+/**
+ * Finds the declaration of a symbol in the given scope only.
+ *
+ * @return The declaring node, null if the symbol is not declared in the scope.
+ */
+static struct STX_SyntaxTreeNode *findSymbolInScope(
+    const struct SemanticContext *context,
+    int scopeId,
+    unsigned symbolId)
+{
+    unsigned slot;
+
+    if (!context->symbolTableSize) return 0;
+    slot = getSymbolSlot(context, scopeId, symbolId);
+    while (context->symbolTable[slot].node)
+    {
+        const struct SymbolEntry *entry = &context->symbolTable[slot];
+        if ((entry->symbolId == symbolId) && (entry->scopeId == scopeId))
+        {
+            return entry->node;
+        }
+        slot = (slot + 1) & (context->symbolTableSize - 1);
+    }
+    return 0;
+}
+
+/**
+ * Puts a symbol into the hash table. The symbol must not be in the table yet.
+ * The table is doubled when it becomes half full.
+ */
+static void insertSymbol(
+    struct SemanticContext *context,
+    int scopeId,
+    unsigned symbolId,
+    struct STX_SyntaxTreeNode *node)
+{
+    unsigned slot;
+
+    if (context->symbolEntryCount * 2 >= context->symbolTableSize)
+    {
+        struct SymbolEntry *oldTable = context->symbolTable;
+        int oldSize = context->symbolTableSize;
+        int i;
+
+        context->symbolTableSize = oldSize ? oldSize * 2 : 256;
+        context->symbolTable = calloc(context->symbolTableSize, sizeof(struct SymbolEntry));
+        context->symbolEntryCount = 0;
+        for (i = 0; i < oldSize; i++)
+        {
+            if (oldTable[i].node)
+            {
+                insertSymbol(context, oldTable[i].scopeId, oldTable[i].symbolId, oldTable[i].node);
+            }
+        }
+        free(oldTable);
+    }
+    slot = getSymbolSlot(context, scopeId, symbolId);
+    while (context->symbolTable[slot].node)
+    {
+        slot = (slot + 1) & (context->symbolTableSize - 1);
+    }
+    context->symbolTable[slot].scopeId = scopeId;
+    context->symbolTable[slot].symbolId = symbolId;
+    context->symbolTable[slot].node = node;
+    context->symbolEntryCount++;
+}
+
 /**
  * Adds the name of the current node to the current scope.
  * The name is the 'name' attribute of the current node.
@@ -196,13 +323,11 @@ static int addSymbolToCurrentScope(
     struct STX_SyntaxTreeNode *node = getCurrentNode(context);
     const struct STX_NodeAttribute *attr = STX_getNodeAttribute(node);
     struct Scope *currentScope = context->currentScope;
-    const char *name = attr->name;
-    int length = attr->nameLength;
     int found = 0;
 
     for(;;)
     {
-        if (ASSOC_find(currentScope->symbols, name, length))
+        if (findSymbolInScope(context, currentScope->id, attr->symbolId))
         {
             found = 1;
             break;
@@ -219,11 +344,16 @@ static int addSymbolToCurrentScope(
 
     if (!found)
     {
-        ASSOC_insert(context->currentScope->symbols, attr->name, attr->nameLength, node);
+        insertSymbol(context, context->currentScope->id, attr->symbolId, node);
+        if (context->isDumpingScopes)
+        {
+            // The associative array is kept only for dumping the scopes by name.
+            ASSOC_insert(context->currentScope->symbols, attr->name, attr->nameLength, node);
+        }
     }
     else
     {
-        ERR_raiseError(E_SMC_REDEFINITION_OF_SYMBOL);
+        raiseCheckerError(context, E_SMC_REDEFINITION_OF_SYMBOL);
         return 0;
     }
     return 1;
@@ -236,7 +366,8 @@ static int addSymbolToCurrentScope(
  */
 static int handleSymbol(struct ASSOC_KeyValuePair *kvp, int level, int index, void *userData)
 {
-    printf(
+    fprintf(
+        (FILE*)userData,
         "%.*s : %s\n",
         kvp->keyLength,
         kvp->key,
@@ -246,16 +377,19 @@ static int handleSymbol(struct ASSOC_KeyValuePair *kvp, int level, int index, vo
 }
 
 /**
- * Dumps symbols of the scopes to the stdout.
+ * Dumps symbols of the scopes.
+ *
+ * @param f The file to dump to.
  */
-static void dumpScopes(struct SemanticContext *context)
+static void dumpScopes(struct SemanticContext *context, FILE *f)
 {
     int i;
     for (i = 0; i < context->scopeCount; i++)
     {
         struct Scope *scope = context->scopePointers[i];
         const struct STX_NodeAttribute *attr = STX_getNodeAttribute(scope->node);
-        printf(
+        fprintf(
+            f,
             "Scope %p, parentScope: %p, nodeType : %s, name : %.*s\n",
             scope,
             scope->parentScope,
@@ -263,7 +397,7 @@ static void dumpScopes(struct SemanticContext *context)
             attr ? attr->nameLength : 0,
             attr ? attr->name : ""
         );
-        ASSOC_transverseInorder(scope->symbols, handleSymbol, 0);
+        ASSOC_transverseInorder(scope->symbols, handleSymbol, f);
     }
 }
 
@@ -282,7 +416,7 @@ static int enterCurrentNode(struct SemanticContext *context, int needError)
     {
         if (needError)
         {
-            ERR_raiseError(E_SMC_CORRUPT_SYNTAX_TREE);
+            raiseCheckerError(context, E_SMC_CORRUPT_SYNTAX_TREE);
         }
         return 0;
     }
@@ -305,7 +439,7 @@ static int assertNodeType(struct SemanticContext *context, enum STX_NodeType typ
 {
     if (getCurrentNodeType(context) != type)
     {
-        ERR_raiseError(E_SMC_CORRUPT_SYNTAX_TREE);
+        raiseCheckerError(context, E_SMC_CORRUPT_SYNTAX_TREE);
         return 0;
     }
     return 1;
@@ -326,7 +460,7 @@ static int moveToNextNode(struct SemanticContext *context, int needError)
     {
         if (needError)
         {
-            ERR_raiseError(E_SMC_CORRUPT_SYNTAX_TREE);
+            raiseCheckerError(context, E_SMC_CORRUPT_SYNTAX_TREE);
         }
         return 0;
     }
@@ -390,7 +524,7 @@ static int checkParameterList(
             if (count < minParameterCount)
             {
                 leaveCurrentNode(context);
-                ERR_raiseError(E_SMC_TOO_FEW_PARAMETERS);
+                raiseCheckerError(context, E_SMC_TOO_FEW_PARAMETERS);
                 return 0;
             }
         }
@@ -399,7 +533,7 @@ static int checkParameterList(
             if (count > maxParameterCount)
             {
                 leaveCurrentNode(context);
-                ERR_raiseError(E_SMC_TOO_MANY_PARAMETERS);
+                raiseCheckerError(context, E_SMC_TOO_MANY_PARAMETERS);
                 return 0;
             }
         }
@@ -455,7 +589,7 @@ static int checkIfStatement(struct SemanticContext *context)
                 if (!checkIfStatement(context)) return 0;
             break;
             default:
-                ERR_raiseError(E_SMC_CORRUPT_SYNTAX_TREE);
+                raiseCheckerError(context, E_SMC_CORRUPT_SYNTAX_TREE);
                 return 0;
             break;
         }
@@ -544,7 +678,7 @@ static int checkBreakContinueStatement(struct SemanticContext *context)
         case STX_CONTINUE:
         break;
         default:
-            ERR_raiseError(E_SMC_CORRUPT_SYNTAX_TREE);
+            raiseCheckerError(context, E_SMC_CORRUPT_SYNTAX_TREE);
             return 0;
     }
     currentNodeAttr = STX_getNodeAttribute(getCurrentNode(context));
@@ -586,10 +720,10 @@ static int checkBreakContinueStatement(struct SemanticContext *context)
     switch (type)
     {
         case STX_BREAK:
-            ERR_raiseError(E_SMC_BREAK_IS_NOT_IN_LOOP_OR_CASE_BLOCK);
+            raiseCheckerError(context, E_SMC_BREAK_IS_NOT_IN_LOOP_OR_CASE_BLOCK);
         break;
         case STX_CONTINUE:
-            ERR_raiseError(E_SMC_CONTINUE_IS_NOT_IN_LOOP_OR_CASE_BLOCK);
+            raiseCheckerError(context, E_SMC_CONTINUE_IS_NOT_IN_LOOP_OR_CASE_BLOCK);
         break;
         default:
         break;
@@ -668,7 +802,7 @@ static int checkStatement(struct SemanticContext *context)
             if (!checkLoopStatement(context)) return 0;
         break;
         default:
-            ERR_raiseError(E_SMC_CORRUPT_SYNTAX_TREE);
+            raiseCheckerError(context, E_SMC_CORRUPT_SYNTAX_TREE);
             return 0;
         break;
     }
@@ -756,7 +890,7 @@ static int checkForPlatformDeclaration(struct SemanticContext *context)
         if (!assertNodeType(context, STX_DECLARATIONS)) return 0;
         if (!enterCurrentNode(context, 0))
         {
-            ERR_raiseError(E_SMC_EMPTY_PLATFORM_BLOCK);
+            raiseCheckerError(context, E_SMC_EMPTY_PLATFORM_BLOCK);
             return 0;
         }
         {
@@ -813,7 +947,7 @@ static int addNodeToUsedNamespaces(
 
     if (node->nodeType != STX_NAMESPACE)
     {
-        ERR_raiseError(E_SMC_NOT_A_NAMESPACE);
+        raiseCheckerError(context, E_SMC_NOT_A_NAMESPACE);
         return 0;
     }
 
@@ -862,7 +996,7 @@ static int checkUsingDeclaration(struct SemanticContext *context)
     if (!declarationNode)
     {
         if (ERR_isError()) return 0;
-        ERR_raiseError(E_SMC_UNDEFINED_SYMBOL);
+        raiseCheckerError(context, E_SMC_UNDEFINED_SYMBOL);
         return 0;
     }
 
@@ -905,7 +1039,7 @@ static int checkDeclaration(struct SemanticContext *context)
             if (!checkUsingDeclaration(context)) return 0;
         break;
         default:
-            ERR_raiseError(E_SMC_CORRUPT_SYNTAX_TREE);
+            raiseCheckerError(context, E_SMC_CORRUPT_SYNTAX_TREE);
             return 0;
         break;
     }
@@ -965,8 +1099,7 @@ struct STX_SyntaxTreeNode *STX_getRootNode(struct STX_SyntaxTree *tree);
  *
  * @param [in,out] context The semantic context.
  * @param startScopeId The id of the scope where the lookup start.
- * @param varName The name of the symbol to look up.
- * @param varNameLength The length of the name.
+ * @param symbolId The symbol id of the name to look up.
  * @param lookupOptions It can be a conbination of the following values:
  *      - SLO_CHECK_PARENT_SCOPES: checks the parent scopes of the target scopes.
  *      - SLO_CHECK_USED_NAMESPACES: checks the used namespaces to (using declaration).
@@ -981,8 +1114,7 @@ struct STX_SyntaxTreeNode *STX_getRootNode(struct STX_SyntaxTree *tree);
 static struct STX_SyntaxTreeNode *lookUpSymbol(
     struct SemanticContext *context,
     int startScopeId,
-    const char *varName,
-    int varNameLength,
+    unsigned symbolId,
     int lookupOptions
 )
 {
@@ -991,7 +1123,7 @@ static struct STX_SyntaxTreeNode *lookUpSymbol(
 
     assert(startScopeId >= 0);
     scope = context->scopePointers[startScopeId];
-    node = ASSOC_find(scope->symbols, varName, varNameLength);
+    node = findSymbolInScope(context, startScopeId, symbolId);
     if (node)
     {
         // symbol found, return it.
@@ -1012,14 +1144,13 @@ static struct STX_SyntaxTreeNode *lookUpSymbol(
                 foundNode = lookUpSymbol(
                     context,
                     namespaceNode->definesScopeId,
-                    varName,
-                    varNameLength,
+                    symbolId,
                     0
                 );
                 foundCount++;
                 if (foundCount > 1)
                 {
-                    ERR_raiseError(E_SMC_AMBIGUOS_NAME);
+                    raiseCheckerError(context, E_SMC_AMBIGUOS_NAME);
                     return 0;
                 }
             }
@@ -1035,8 +1166,7 @@ static struct STX_SyntaxTreeNode *lookUpSymbol(
             return lookUpSymbol(
                 context,
                 scope->parentScope->id,
-                varName,
-                varNameLength,
+                symbolId,
                 lookupOptions
             );
         }
@@ -1073,7 +1203,7 @@ static struct STX_SyntaxTreeNode *findSymbolDeclarationFromFullyQualifiedName(
     assert(node);
     if (node->nodeType != STX_QUALIFIED_NAME)
     {
-        ERR_raiseError(E_SMC_CORRUPT_SYNTAX_TREE);
+        raiseCheckerError(context, E_SMC_CORRUPT_SYNTAX_TREE);
         return 0;
     }
 
@@ -1087,8 +1217,7 @@ static struct STX_SyntaxTreeNode *findSymbolDeclarationFromFullyQualifiedName(
         currentNameSpace = lookUpSymbol(
             context,
             currentScope->id,
-            currentAttribute->name,
-            currentAttribute->nameLength,
+            currentAttribute->symbolId,
             0
         );
         if (currentNameSpace)
@@ -1097,7 +1226,7 @@ static struct STX_SyntaxTreeNode *findSymbolDeclarationFromFullyQualifiedName(
             if (currentNameSpace->nodeType != STX_NAMESPACE)
             {
                 context->currentNode = currentChild;
-                ERR_raiseError(E_SMC_NOT_A_NAMESPACE);
+                raiseCheckerError(context, E_SMC_NOT_A_NAMESPACE);
                 return 0;
             }
             // So this is a namespace, set it's scope as current.
@@ -1109,7 +1238,7 @@ static struct STX_SyntaxTreeNode *findSymbolDeclarationFromFullyQualifiedName(
         {
             // Not found, error.
             context->currentNode = currentChild;
-            ERR_raiseError(E_SMC_UNDEFINED_SYMBOL);
+            raiseCheckerError(context, E_SMC_UNDEFINED_SYMBOL);
             return 0;
         }
     }
@@ -1119,8 +1248,7 @@ static struct STX_SyntaxTreeNode *findSymbolDeclarationFromFullyQualifiedName(
     declarationNode = lookUpSymbol(
         context,
         currentScope->id,
-        currentAttribute->name,
-        currentAttribute->nameLength,
+        currentAttribute->symbolId,
         0
     );
     return declarationNode;
@@ -1178,8 +1306,7 @@ static int checkQualifiedName(
         declarationNode = lookUpSymbol(
             context,
             node->inScopeId,
-            firstChildAttr->name,
-            firstChildAttr->nameLength,
+            firstChildAttr->symbolId,
             SLO_CHECK_PARENT_SCOPES | SLO_CHECK_USED_NAMESPACES
         );
 
@@ -1205,7 +1332,7 @@ static int checkQualifiedName(
     {
         // Symbol not defined, error.
         context->currentNode = node;
-        ERR_raiseError(E_SMC_UNDEFINED_SYMBOL);
+        raiseCheckerError(context, E_SMC_UNDEFINED_SYMBOL);
         return 0;
     }
     if (parentNodeType == STX_OPERATOR)
@@ -1214,7 +1341,7 @@ static int checkQualifiedName(
         if (declarationNode->nodeType != STX_OPERATOR_FUNCTION)
         {
             context->currentNode = node;
-            ERR_raiseError(E_SMC_NOT_AN_OPERATOR);
+            raiseCheckerError(context, E_SMC_NOT_AN_OPERATOR);
             return 0;
         }
     }
@@ -1640,21 +1767,39 @@ static void setScopeIdsOnAllNodes(struct SemanticContext *context)
     }
 }
 
-struct SMC_CheckerResult SMC_checkSyntaxTree(struct STX_SyntaxTree *syntaxTree)
+struct SMC_CheckerResult SMC_checkSyntaxTree(struct STX_SyntaxTree *syntaxTree, FILE *scopeDumpFile)
 {
     struct SemanticContext sc = {0};
     int ok;
     struct SMC_CheckerResult result;
+    int previousPhase;
 
     sc.tree = syntaxTree;
+    sc.isDumpingScopes = scopeDumpFile != 0;
     sc.currentNode = STX_getRootNode(syntaxTree);
     descendNewScope(&sc);
     sc.rootScope = sc.currentScope;
+    previousPhase = TIM_enterPhase(TIM_CHECK_ROOT);
     ok = checkRootNode(&sc);
+    TIM_leavePhase(previousPhase);
     ascendToParentScope(&sc);
+    previousPhase = TIM_enterPhase(TIM_SET_SCOPE_IDS);
     setScopeIdsOnAllNodes(&sc);
-    if (ok) ok = checkExpressions(&sc);
-    dumpScopes(&sc);
+    TIM_leavePhase(previousPhase);
+    if (ok)
+    {
+        previousPhase = TIM_enterPhase(TIM_CHECK_EXPRESSIONS);
+        ok = checkExpressions(&sc);
+        TIM_leavePhase(previousPhase);
+    }
+    if (scopeDumpFile)
+    {
+        previousPhase = TIM_enterPhase(TIM_DUMPS);
+        dumpScopes(&sc, scopeDumpFile);
+        TIM_leavePhase(previousPhase);
+    }
+    freeScopes(&sc);
+    free(sc.symbolTable);
     result.lastNode = sc.currentNode;
     return result;
 }
@@ -25,6 +25,8 @@
 #ifndef SEMANTIC_H
 #define SEMANTIC_H
 
+#include <stdio.h>
+
 #include "syntax.h"
 
 /**
@@ -41,8 +43,11 @@ struct SMC_CheckerResult
 /**
  * Checks the syntax tree provided.
  *
+ * @param syntaxTree The syntax tree.
+ * @param scopeDumpFile The symbols of the scopes are written to it. Null if not needed.
+ *
  * @return The result which contains the node the checker stopped on.
  */
-struct SMC_CheckerResult SMC_checkSyntaxTree(struct STX_SyntaxTree *syntaxTree);
+struct SMC_CheckerResult SMC_checkSyntaxTree(struct STX_SyntaxTree *syntaxTree, FILE *scopeDumpFile);
 
 #endif // SEMANTIC_H
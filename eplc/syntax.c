@@ -44,14 +44,19 @@ struct SyntaxContext
 {
     struct STX_SyntaxTree *tree; ///< Stores the syntax tree being built.
 
-    const struct LEX_LexerToken *tokens; ///< The array with the tokens.
-    int tokenCount; ///< Count of tokens in that array.
-    int tokensRemaining; ///< Remaining tokens
+    struct LEX_Lexer *lexer; ///< The lexer the tokens are read from.
+    /// The lexer result of the lexer. Used to get the text of the tokens.
+    const struct LEX_LexerResult *lexerResult;
 
-    const struct LEX_LexerToken  *current; ///< current token
+    const struct LEX_LexerToken *current; ///< current token, 0 after the end of file.
     int currentNodeIndex; ///< Index of the curent node.
 
-    const struct LEX_LexerToken *latestComment; ///< The latest comment token.
+    unsigned currentTokenIndex; ///< The index of the current token in the token stream.
+    /// The next documentation comment of the lexer result to attach to a node.
+    int nextDocComment;
+    /// The latest comment token. It's a copy since the lexer's comment table can grow.
+    struct LEX_LexerToken latestComment;
+    int hasLatestComment; ///< Nonzero if there is a latest comment.
 };
 
 static struct STX_SyntaxTreeNode *allocateNode(struct STX_SyntaxTree *tree);
@@ -184,10 +189,8 @@ static void initializeNode(struct STX_SyntaxTreeNode *node)
     node->lastChildIndex = -1;
     node->nextSiblingIndex = -1;
     node->previousSiblingIndex = -1;
-    node->beginColumn = 0;
-    node->beginLine = 0;
-    node->endColumn = 0;
-    node->endLine = 0;
+    node->beginOffset = 0;
+    node->endOffset = 0;
 
     memset(&node->attribute, 0, sizeof(node->attribute));
     node->attribute.symbolDefinitionNodeId = -1;
@@ -203,41 +206,65 @@ static const struct LEX_LexerToken *getCurrentToken(struct SyntaxContext *contex
     return context->current;
 }
 
+/**
+ * Raises an error at the current token and node.
+ *
+ * @param context context
+ * @param errorCode The error to raise.
+ */
+static void raiseParserError(struct SyntaxContext *context, enum ERR_ErrorCode errorCode)
+{
+    ERR_raiseErrorAt(
+        errorCode,
+        context->current ? (int)context->current->offset : -1,
+        context->currentNodeIndex);
+}
+
 /**
  * @param context context
+ * @param token subject.
+ * @param [out] length The length of the text.
  *
- * @return The type of the current token. LEX_SPEC_EOF if there is no
- *      current token (read past the last)
+ * @return The text of the token. For strings it's the binary string.
  */
-static enum LEX_TokenType getCurrentTokenType(struct SyntaxContext *context)
+static const char *getTokenText(
+    struct SyntaxContext *context,
+    const struct LEX_LexerToken *token,
+    int *length)
 {
-    if (!context->current)
-    {
-        return LEX_SPEC_EOF;
-    }
-    return context->current->tokenType;
+    return LEX_getTokenText(context->lexerResult, token, length);
 }
 
 /**
- * @param tokenType subject.
+ * Sets the name of a node to the text of a token. The symbol id is set too if the token
+ * is an identifier.
  *
- * @retval true The token is a comment token.
- * @retval false otherwise.
+ * @param context context
+ * @param [out] attribute The attribute of the node.
+ * @param token The token.
  */
-static int isCommentTokenType(enum LEX_TokenType tokenType)
+static void setNameFromToken(
+    struct SyntaxContext *context,
+    struct STX_NodeAttribute *attribute,
+    const struct LEX_LexerToken *token)
 {
-    switch (tokenType)
+    attribute->name = getTokenText(context, token, &attribute->nameLength);
+    attribute->symbolId = token->tokenType == LEX_IDENTIFIER ? token->value : 0;
+}
+
+/**
+ * @param context context
+ *
+ * @return The type of the current token. LEX_SPEC_EOF if there is no
+ *      current token (read past the last)
+ */
+static enum LEX_TokenType getCurrentTokenType(struct SyntaxContext *context)
+{
+    if (!context->current)
     {
-        case LEX_EOL_COMMENT:
-        case LEX_BLOCK_COMMENT:
-        case LEX_DOCUMENTATION_BLOCK_COMMENT:
-        case LEX_DOCUMENTATION_EOL_BACK_COMMENT:
-        case LEX_DOCUMENTATION_EOL_COMMENT:
-            return 1;
-        default:
-            return 0;
+        return LEX_SPEC_EOF;
     }
-    return 0;
+    return context->current->tokenType;
 }
 
 static void descendNewNode(struct SyntaxContext *context, enum STX_NodeType type);
@@ -252,15 +279,14 @@ static void ascendToParent(struct SyntaxContext *context);
 static void advance(struct SyntaxContext *context)
 {
     assert(context->current);
-    if (context->tokensRemaining)
+    if (context->current->tokenType == LEX_SPEC_EOF)
     {
-        assert(context->tokensRemaining);
-        context->tokensRemaining--;
-        context->current++;
+        context->current = 0;
     }
-    if (!context->tokensRemaining)
+    else
     {
-        context->current = 0;
+        context->current = LEX_nextToken(context->lexer);
+        context->currentTokenIndex++;
     }
 }
 
@@ -312,41 +338,41 @@ static struct STX_SyntaxTreeNode *getCurrentNode(struct SyntaxContext *context)
 }
 
 /**
- * Skips comments. Documentation comments are set as attributes on the
- * appropriate nodes.
+ * Processes the documentation comments before the current token. They are set as
+ * attributes on the appropriate nodes. The lexer doesn't return comments as tokens, it
+ * collects the documentation comments with the index of the following token.
  *
  * @param [in,out] context context.
  */
-static void skipComments(struct SyntaxContext *context)
+static void attachDocComments(struct SyntaxContext *context)
 {
-    // Skip tokens while the current is a comment.
-    while (isCommentTokenType(getCurrentTokenType(context)))
+    const struct LEX_LexerResult *lexerResult = context->lexerResult;
+
+    while (
+        (context->nextDocComment < lexerResult->docCommentCount) &&
+        (lexerResult->docComments[context->nextDocComment].tokenIndex <= context->currentTokenIndex))
     {
-        if (isForwardDocumentationCommentType(getCurrentTokenType(context)))
+        const struct LEX_LexerToken *token = &lexerResult->docComments[context->nextDocComment].token;
+        if (isForwardDocumentationCommentType(token->tokenType))
         {
             // On forward documentation the latest comment, it will set as attribute
             // on the next node.
-            context->latestComment = getCurrentToken(context);
+            context->latestComment = *token;
+            context->hasLatestComment = 1;
         }
-        else if (isBackDocumentationCommentType(getCurrentTokenType(context)))
+        else if (isBackDocumentationCommentType(token->tokenType))
         {
-            struct STX_SyntaxTreeNode *currentNode = getCurrentNode(context);
-            struct STX_NodeAttribute *attr;
-            const struct LEX_LexerToken *token = getCurrentToken(context);
-
             // Back comments are set as attribute on the current node.
-            attr = getCurrentAttribute(context);
-            currentNode->attribute = *attr;
-            attr->comment = token->start;
-            attr->commentLength = token->length;
+            struct STX_NodeAttribute *attr = getCurrentAttribute(context);
+            attr->comment = getTokenText(context, token, &attr->commentLength);
         }
-        // Move to the next token.
-        advance(context);
+        context->nextDocComment++;
     }
 }
 
 /**
- * Accepts current token, moves to the next token (after skipped the comment tokens)
+ * Accepts current token, moves to the next token and processes the documentation
+ * comments before it.
  *
  * @param context context.
  */
@@ -354,10 +380,9 @@ static void acceptCurrent(struct SyntaxContext *context)
 {
     struct STX_SyntaxTreeNode *node = getCurrentNode(context);
     const struct LEX_LexerToken *token = getCurrentToken(context);
-    node->endColumn = token->endColumn;
-    node->endLine = token->endLine;
+    node->endOffset = token->offset + token->length;
     advance(context);
-    skipComments(context);
+    attachDocComments(context);
 }
 
 /**
@@ -385,7 +410,7 @@ static int expect(
     if (!token)
     {
         // We are at the end of file.
-        ERR_raiseError(E_STX_UNEXPECTED_END_OF_FILE);
+        raiseParserError(context, E_STX_UNEXPECTED_END_OF_FILE);
         return 0;
     }
     if (token->tokenType == type)
@@ -397,7 +422,7 @@ static int expect(
     else
     {
         // Not the expected one: raise error.
-        ERR_raiseError(errorToRaise);
+        raiseParserError(context, errorToRaise);
         return 0;
     }
 }
@@ -417,8 +442,7 @@ static void ascendToParent(struct SyntaxContext *context)
     assert(node->parentIndex != -1);
     context->currentNodeIndex = getCurrentNode(context)->parentIndex;
     parentNode = getCurrentNode(context);
-    parentNode->endColumn = node->endColumn;
-    parentNode->endLine = node->endLine;
+    parentNode->endOffset = node->endOffset;
 }
 
 /**
@@ -436,18 +460,16 @@ static void descendNewNode(struct SyntaxContext *context, enum STX_NodeType type
     const struct LEX_LexerToken *token = getCurrentToken(context);
     initializeNode(node);
     node->nodeType = type;
-    node->beginColumn = token->beginColumn;
-    node->beginLine = token->beginLine;
+    node->beginOffset = token->offset;
     STX_appendChild(context->tree, getCurrentNode(context), node);
     context->currentNodeIndex = node->id;
-    if (context->latestComment)
+    if (context->hasLatestComment)
     {
         // Sets the comment attribute on the node, if preceded by a comment token.
         struct STX_NodeAttribute *attr;
         attr = getCurrentAttribute(context);
-        attr->comment = context->latestComment->start;
-        attr->commentLength = context->latestComment->length;
-        context->latestComment = 0;
+        attr->comment = getTokenText(context, &context->latestComment, &attr->commentLength);
+        context->hasLatestComment = 0;
     }
 }
 
@@ -472,6 +494,20 @@ static int isNumber(const struct LEX_LexerToken *token)
     return 0;
 }
 
+/**
+ * Gets the decoded value of a number token.
+ *
+ * @param [in] context context.
+ * @param [in] token subject.
+ *
+ * @return The value of the token.
+ */
+static const struct LEX_Number *getNumber(struct SyntaxContext *context, const struct LEX_LexerToken *token)
+{
+    assert(isNumber(token));
+    return &context->lexerResult->numbers[token->value];
+}
+
 /**
  * @param token subject.
  *
@@ -582,10 +618,17 @@ static int parseTerm(struct SyntaxContext *context)
     if (isNumber(token) || (token->tokenType == LEX_STRING))
     {
         attribute = getCurrentAttribute(context);
-        attribute->name = token->start;
-        attribute->nameLength = token->length;
+        setNameFromToken(context, attribute, token);
         attribute->termAttributes.termType = STX_TT_SIMPLE;
         attribute->termAttributes.tokenType = context->current->tokenType;
+        if (token->tokenType == LEX_FLOAT_NUMBER)
+        {
+            attribute->termAttributes.floatValue = getNumber(context, token)->real;
+        }
+        else if (isNumber(token))
+        {
+            attribute->termAttributes.integerValue = getNumber(context, token)->integer;
+        }
         acceptCurrent(context);
     }
     else if (token->tokenType == LEX_LEFT_PARENTHESIS)
@@ -624,7 +667,7 @@ static int parseTerm(struct SyntaxContext *context)
     }
     else
     {
-        ERR_raiseError(E_STX_TERM_EXPECTED);
+        raiseParserError(context, E_STX_TERM_EXPECTED);
         return 0;
     }
 
@@ -827,7 +870,7 @@ static int parseIfStatement(struct SyntaxContext *context)
                 if (!parseIfStatement(context)) return 0;
             break;
             default:
-                ERR_raiseError(E_STX_BLOCK_OR_IF_STATEMENT_EXPECTED);
+                raiseParserError(context, E_STX_BLOCK_OR_IF_STATEMENT_EXPECTED);
                 return 0;
             break;
         }
@@ -943,54 +986,6 @@ static int isIntegerNumberToken(enum LEX_TokenType tokenType)
         (tokenType == LEX_HEXA_INTEGER);
 }
 
-/**
- * Gets the integer value of an integer number token.
- *
- * @param [in] token subject.
- *
- * @return The integer value of the token.
- */
-static int getIntegerValue(const struct LEX_LexerToken *token)
-{
-    const char *current = token->start;
-    const char *end = token->start + token->length;
-    int value = 0;
-    int radix = 0;
-
-    switch (token->tokenType)
-    {
-        case LEX_DECIMAL_INTEGER:
-            radix = 10;
-        break;
-        case LEX_OCTAL_INTEGER:
-            radix = 8;
-        break;
-        case LEX_HEXA_INTEGER:
-            current += 2; // skip 0x
-            radix = 16;
-        break;
-        default:
-            assert(0);
-    }
-
-    while (current < end)
-    {
-        char c = *current;
-        int digit;
-        if (('0' <= c) && (c <= '9')) digit = c - '0';
-        else if (radix > 10)
-        {
-            digit = (c | 0x20) - 'a' + 10;
-        }
-        if (digit < 0) break;
-        if (digit >= radix) break;
-        value *= radix;
-        value += digit;
-        current++;
-    }
-
-    return value;
-}
 /**
  * Parses on case block of the switch statement.
  *
@@ -1020,10 +1015,10 @@ static int parseCaseBlock(struct SyntaxContext *context)
             if (!expect(context, LEX_KW_CASE, E_STX_CASE_EXPECTED)) return 0;
             if (!isIntegerNumberToken(getCurrentTokenType(context)))
             {
-                ERR_raiseError(E_STX_INTEGER_NUMBER_EXPECTED);
+                raiseParserError(context, E_STX_INTEGER_NUMBER_EXPECTED);
                 return 0;
             }
-            attr->caseAttributes.caseValue = getIntegerValue(getCurrentToken(context));
+            attr->caseAttributes.caseValue = getNumber(context, getCurrentToken(context))->integer;
             attr->caseAttributes.isDefault = 0;
             acceptCurrent(context);
         }
@@ -1035,7 +1030,7 @@ static int parseCaseBlock(struct SyntaxContext *context)
         }
         break;
         default:
-            ERR_raiseError(E_STX_CASE_OR_DEFAULT_EXPECTED);
+            raiseParserError(context, E_STX_CASE_OR_DEFAULT_EXPECTED);
             return 0;
     }
 
@@ -1048,7 +1043,7 @@ static int parseCaseBlock(struct SyntaxContext *context)
             acceptCurrent(context);
         break;
         default:
-            ERR_raiseError(E_STX_BREAK_OR_CONTINUE_EXPECTED);
+            raiseParserError(context, E_STX_BREAK_OR_CONTINUE_EXPECTED);
             return 0;
     }
     if (!expect(context, LEX_SEMICOLON, E_STX_SEMICOLON_EXPECTED)) return 0;
@@ -1140,7 +1135,7 @@ static int parseBreakContinueStatement(struct SyntaxContext *context, enum LEX_T
     if (!expect(context, type, E_STX_BREAK_OR_CONTINUE_EXPECTED)) return 0;
     if (isIntegerNumberToken(getCurrentTokenType(context)))
     {
-        int level = getIntegerValue(getCurrentToken(context));
+        int level = getNumber(context, getCurrentToken(context))->integer;
         attr->breakContinueAttributes.levels = level;
         acceptCurrent(context);
     }
@@ -1310,12 +1305,12 @@ static int parseTypePrefix(struct SyntaxContext *context)
         token = getCurrentToken(context);
         if (isIntegerNumberToken(token->tokenType))
         {
-            elements = getIntegerValue(token);
+            elements = getNumber(context, token)->integer;
             acceptCurrent(context);
         }
         else
         {
-            ERR_raiseError(E_STX_INTEGER_NUMBER_EXPECTED);
+            raiseParserError(context, E_STX_INTEGER_NUMBER_EXPECTED);
             return 0;
         }
         if (!expect(context, LEX_RIGHT_BRACKET, E_STX_RIGHT_BRACKET_EXPECTED)) return 0;
@@ -1347,6 +1342,11 @@ static int parseTypePrefix(struct SyntaxContext *context)
                 assert(0); //< something is really screwed up.
         }
     }
+    else
+    {
+        raiseParserError(context, E_STX_TYPE_EXPECTED);
+        return 0;
+    }
 
     ascendToParent(context);
     return 1;
@@ -1461,8 +1461,7 @@ static int parseType(struct SyntaxContext *context)
 
     if (token->tokenType == LEX_BUILT_IN_TYPE)
     {
-        attr->name = token->start;
-        attr->nameLength = token->length;
+        setNameFromToken(context, attr, token);
         attr->typeAttributes.isPrimitive = 1;
         if (!parseTypeToken(attr)) return 0;
         acceptCurrent(context);
@@ -1506,13 +1505,12 @@ static int parseVariableDeclaration(struct SyntaxContext *context)
     if (current->tokenType == LEX_IDENTIFIER)
     {
         attr = getCurrentAttribute(context);
-        attr->name = current->start;
-        attr->nameLength = current->length;
+        setNameFromToken(context, attr, current);
         acceptCurrent(context);
     }
     else
     {
-        ERR_raiseError(E_STX_IDENTIFIER_EXPECTED);
+        raiseParserError(context, E_STX_IDENTIFIER_EXPECTED);
         return 0;
     }
     if (getCurrentTokenType(context) == LEX_ASSIGN_OPERATOR)
@@ -1586,7 +1584,7 @@ static int parseParameter(struct SyntaxContext *context)
         (token->tokenType != LEX_KW_OUT) &&
         (token->tokenType != LEX_KW_REF))
     {
-        ERR_raiseError(E_STX_PARAMETER_DIRECTION_EXPECTED);
+        raiseParserError(context, E_STX_PARAMETER_DIRECTION_EXPECTED);
         return 0;
     }
     attribute = getCurrentAttribute(context);
@@ -1596,12 +1594,11 @@ static int parseParameter(struct SyntaxContext *context)
     token = getCurrentToken(context);
     if (token->tokenType != LEX_IDENTIFIER)
     {
-        ERR_raiseError(E_STX_IDENTIFIER_EXPECTED);
+        raiseParserError(context, E_STX_IDENTIFIER_EXPECTED);
         return 0;
     }
     attribute = getCurrentAttribute(context);
-    attribute->name = token->start;
-    attribute->nameLength = token->length;
+    setNameFromToken(context, attribute, token);
     acceptCurrent(context);
 
     ascendToParent(context);
@@ -1706,12 +1703,12 @@ static int parseFunctionDeclaration(struct SyntaxContext *context)
             }
             else
             {
-                ERR_raiseError(E_STX_PRECEDENCE_TYPE_EXPECTED);
+                raiseParserError(context, E_STX_PRECEDENCE_TYPE_EXPECTED);
                 return 0;
             }
         break;
         default:
-            ERR_raiseError(E_STX_FUNCTION_EXPECTED);
+            raiseParserError(context, E_STX_FUNCTION_EXPECTED);
             return 0;
 
     }
@@ -1719,16 +1716,17 @@ static int parseFunctionDeclaration(struct SyntaxContext *context)
     token = getCurrentToken(context);
     if (token->tokenType != LEX_IDENTIFIER)
     {
-        ERR_raiseError(E_STX_IDENTIFIER_EXPECTED);
+        raiseParserError(context, E_STX_IDENTIFIER_EXPECTED);
         return 0;
     }
     attribute = getCurrentAttribute(context);
-    attribute->name = token->start;
-    attribute->nameLength = token->length;
+    setNameFromToken(context, attribute, token);
     acceptCurrent(context);
     if (!expect(context, LEX_LEFT_PARENTHESIS, E_STX_LEFT_PARENTHESIS_EXPECTED)) return 0;
     if (!parseParameterList(context)) return 0;
     if (!expect(context, LEX_RIGHT_PARENTHESIS, E_STX_RIGHT_PARENTHESIS_EXPECTED)) return 0;
+    // The nodes of the parameters may have reallocated the nodes.
+    attribute = getCurrentAttribute(context);
     switch (getCurrentTokenType(context))
     {
         case LEX_LEFT_BRACE:
@@ -1749,16 +1747,14 @@ static int parseFunctionDeclaration(struct SyntaxContext *context)
             if (getCurrentTokenType(context) == LEX_STRING)
             {
                 const struct LEX_LexerToken *token = getCurrentToken(context);
-                attribute->functionAttributes.externalLocation = token->start;
-                attribute->functionAttributes.externalLocationLength = token->length;
+                attribute->functionAttributes.externalLocation = getTokenText(context, token, &attribute->functionAttributes.externalLocationLength);
             }
             if (!expect(context, LEX_STRING, E_STX_STRING_EXPECTED)) return 0;
             if (!expect(context, LEX_COLON, E_STX_COLON_EXPECTED)) return 0;
             if (getCurrentTokenType(context) == LEX_STRING)
             {
                 const struct LEX_LexerToken *token = getCurrentToken(context);
-                attribute->functionAttributes.externalFileType = token->start;
-                attribute->functionAttributes.externalFileTypeLength = token->length;
+                attribute->functionAttributes.externalFileType = getTokenText(context, token, &attribute->functionAttributes.externalFileTypeLength);
             }
             if (!expect(context, LEX_STRING, E_STX_STRING_EXPECTED)) return 0;
             if (!expect(context, LEX_SEMICOLON, E_STX_SEMICOLON_EXPECTED)) return 0;
@@ -1766,7 +1762,7 @@ static int parseFunctionDeclaration(struct SyntaxContext *context)
         break;
         default:
         {
-            ERR_raiseError(E_STX_BLOCK_OR_EXTERNAL_EXPECTED);
+            raiseParserError(context, E_STX_BLOCK_OR_EXTERNAL_EXPECTED);
             return 0;
         }
     }
@@ -1798,13 +1794,12 @@ static int parseNamespaceDeclaration(struct SyntaxContext *context)
     {
         const struct LEX_LexerToken *token = getCurrentToken(context);
         struct STX_NodeAttribute *attr = getCurrentAttribute(context);
-        attr->name = token->start;
-        attr->nameLength = token->length;
+        setNameFromToken(context, attr, token);
         acceptCurrent(context);
     }
     else
     {
-        ERR_raiseError(E_STX_IDENTIFIER_EXPECTED);
+        raiseParserError(context, E_STX_IDENTIFIER_EXPECTED);
         return 0;
     }
     if (!expect(context, LEX_LEFT_BRACE, E_STX_LEFT_BRACE_EXPECTED)) return 0;
@@ -1818,6 +1813,42 @@ static int parseNamespaceDeclaration(struct SyntaxContext *context)
     return 1;
 }
 
+/**
+ * Sets the name of the current qualified name node to its parts joined by ::. It's used
+ * when the parts are not next to each other in memory: the source is fed in chunks.
+ *
+ * @param context context.
+ */
+static void joinQualifiedName(struct SyntaxContext *context)
+{
+    struct STX_SyntaxTreeNode *node = getCurrentNode(context);
+    struct STX_NodeAttribute *attribute = getCurrentAttribute(context);
+    struct STX_SyntaxTreeNode *part;
+    char *name;
+    int length = 0;
+
+    for (part = STX_getFirstChild(node); part; part = STX_getNext(part))
+    {
+        length += STX_getNodeAttribute(part)->nameLength + 2;
+    }
+    name = malloc(length);
+    length = 0;
+    for (part = STX_getFirstChild(node); part; part = STX_getNext(part))
+    {
+        const struct STX_NodeAttribute *partAttribute = STX_getNodeAttribute(part);
+        if (length)
+        {
+            name[length++] = ':';
+            name[length++] = ':';
+        }
+        memcpy(name + length, partAttribute->name, partAttribute->nameLength);
+        length += partAttribute->nameLength;
+    }
+    attribute->name = LEX_saveText(context->lexer, name, length);
+    attribute->nameLength = length;
+    free(name);
+}
+
 /**
  * Parses a qualified name.
  *
@@ -1832,31 +1863,30 @@ static int parseNamespaceDeclaration(struct SyntaxContext *context)
  *
  * @return Nonzero on success, zero on error.
  */
-
 static int parseQualifiedName(struct SyntaxContext *context)
  {
     descendNewNode(context, STX_QUALIFIED_NAME);
     struct STX_NodeAttribute *attribute;
-    const char *startPos;
-    const char *lastTokenPos;
-    int lastTokenLength;
+    unsigned startOffset;
+    unsigned endOffset;
+    unsigned symbolId;
+    int partCount = 1;
 
     if (getCurrentTokenType(context) == LEX_IDENTIFIER)
     {
         const struct LEX_LexerToken *current = getCurrentToken(context);
         descendNewNode(context, STX_QUALIFIED_NAME_PART);
         attribute = getCurrentAttribute(context);
-        lastTokenPos =
-        startPos =
-        attribute->name = current->start;
-        lastTokenLength =
-        attribute->nameLength = current->length;
+        setNameFromToken(context, attribute, current);
+        startOffset = current->offset;
+        endOffset = current->offset + current->length;
+        symbolId = attribute->symbolId;
         acceptCurrent(context);
         ascendToParent(context);
     }
     else
     {
-        ERR_raiseError(E_STX_IDENTIFIER_EXPECTED);
+        raiseParserError(context, E_STX_IDENTIFIER_EXPECTED);
         return 0;
     }
     while (getCurrentTokenType(context) == LEX_SCOPE_SEPARATOR)
@@ -1867,24 +1897,38 @@ static int parseQualifiedName(struct SyntaxContext *context)
             const struct LEX_LexerToken *current = getCurrentToken(context);
             descendNewNode(context, STX_QUALIFIED_NAME_PART);
             attribute = getCurrentAttribute(context);
-            attribute->name = current->start;
-            attribute->nameLength = current->length;
-            lastTokenPos = current->start;
-            lastTokenLength = current->length;
+            setNameFromToken(context, attribute, current);
+            endOffset = current->offset + current->length;
+            partCount++;
             acceptCurrent(context);
             ascendToParent(context);
         }
         else
         {
-            ERR_raiseError(E_STX_IDENTIFIER_EXPECTED);
+            raiseParserError(context, E_STX_IDENTIFIER_EXPECTED);
             return 0;
         }
     }
     // assign the complete name to the qualified name node.
 
     attribute = getCurrentAttribute(context);
-    attribute->name = startPos;
-    attribute->nameLength = (size_t)(lastTokenPos + lastTokenLength) - (size_t)(startPos);
+    if (context->lexerResult->source)
+    {
+        attribute->name = context->lexerResult->source + startOffset;
+        attribute->nameLength = endOffset - startOffset;
+    }
+    else if (partCount == 1)
+    {
+        struct STX_NodeAttribute *partAttribute = STX_getNodeAttribute(STX_getFirstChild(getCurrentNode(context)));
+        attribute->name = partAttribute->name;
+        attribute->nameLength = partAttribute->nameLength;
+    }
+    else
+    {
+        joinQualifiedName(context);
+    }
+    // Only a simple name has symbol id.
+    attribute->symbolId = partCount == 1 ? symbolId : 0;
 
     ascendToParent(context);
     return 1;
@@ -1941,13 +1985,12 @@ static int parseStructDeclaration(struct SyntaxContext *context)
     {
         struct STX_NodeAttribute *attr = getCurrentAttribute(context);
         const struct LEX_LexerToken *token = getCurrentToken(context);
-        attr->name = token->start;
-        attr->nameLength = token->length;
+        setNameFromToken(context, attr, token);
         acceptCurrent(context);
     }
     else
     {
-        ERR_raiseError(E_STX_IDENTIFIER_EXPECTED);
+        raiseParserError(context, E_STX_IDENTIFIER_EXPECTED);
         return 0;
     }
     if (!expect(context, LEX_LEFT_BRACE, E_STX_LEFT_BRACE_EXPECTED)) return 0;
@@ -1959,13 +2002,12 @@ static int parseStructDeclaration(struct SyntaxContext *context)
         {
             const struct LEX_LexerToken *token = getCurrentToken(context);
             struct STX_NodeAttribute *attr = getCurrentAttribute(context);
-            attr->name = token->start;
-            attr->nameLength = token->length;
+            setNameFromToken(context, attr, token);
             acceptCurrent(context);
         }
         else
         {
-            ERR_raiseError(E_STX_IDENTIFIER_EXPECTED);
+            raiseParserError(context, E_STX_IDENTIFIER_EXPECTED);
             return 0;
         }
 
@@ -2002,13 +2044,12 @@ static int parseFuncPtrDeclaration(struct SyntaxContext *context)
     {
         struct STX_NodeAttribute *attr = getCurrentAttribute(context);
         const struct LEX_LexerToken *token = getCurrentToken(context);
-        attr->name = token->start;
-        attr->nameLength = token->length;
+        setNameFromToken(context, attr, token);
         acceptCurrent(context);
     }
     else
     {
-        ERR_raiseError(E_STX_IDENTIFIER_EXPECTED);
+        raiseParserError(context, E_STX_IDENTIFIER_EXPECTED);
         return 0;
     }
     if (!expect(context, LEX_LEFT_PARENTHESIS, E_STX_LEFT_PARENTHESIS_EXPECTED)) return 0;
@@ -2053,13 +2094,12 @@ static int parsePlatformDeclaration(struct SyntaxContext *context)
                 {
                     const struct LEX_LexerToken *token = getCurrentToken(context);
                     struct STX_NodeAttribute *attr = getCurrentAttribute(context);
-                    attr->name = token->start;
-                    attr->nameLength = token->length;
+                    setNameFromToken(context, attr, token);
                     acceptCurrent(context);
                 }
                 else
                 {
-                    ERR_raiseError(E_STX_STRING_EXPECTED);
+                    raiseParserError(context, E_STX_STRING_EXPECTED);
                     return  0;
                 }
             }
@@ -2073,13 +2113,12 @@ static int parsePlatformDeclaration(struct SyntaxContext *context)
                     {
                         const struct LEX_LexerToken *token = getCurrentToken(context);
                         struct STX_NodeAttribute *attr = getCurrentAttribute(context);
-                        attr->name = token->start;
-                        attr->nameLength = token->length;
+                        setNameFromToken(context, attr, token);
                         acceptCurrent(context);
                     }
                     else
                     {
-                        ERR_raiseError(E_STX_STRING_EXPECTED);
+                        raiseParserError(context, E_STX_STRING_EXPECTED);
                         return  0;
                     }
                 }
@@ -2148,7 +2187,7 @@ static int parseDeclaration(struct SyntaxContext *context)
             if (!parsePlatformDeclaration(context)) return 0;
         break;
         default:
-            ERR_raiseError(E_STX_DECLARATION_EXPECTED);
+            raiseParserError(context, E_STX_DECLARATION_EXPECTED);
             return 0;
         break;
     }
@@ -2212,7 +2251,7 @@ static int parseModule(struct SyntaxContext *context)
     }
     else
     {
-        ERR_raiseError(E_STX_MODULE_TYPE_EXPECTED);
+        raiseParserError(context, E_STX_MODULE_TYPE_EXPECTED);
         return 0;
     }
     if (!expect(context, LEX_SEMICOLON, E_STX_SEMICOLON_EXPECTED)) return 0;
@@ -2227,10 +2266,7 @@ static int parseModule(struct SyntaxContext *context)
     return 1;
 }
 
-struct STX_ParserResult STX_buildSyntaxTree(
-    const struct LEX_LexerToken *tokens,
-    int tokenCount
-)
+struct STX_ParserResult STX_buildSyntaxTree(struct LEX_Lexer *lexer)
 {
     struct STX_SyntaxTree *tree = malloc(sizeof(struct STX_SyntaxTree));
     struct SyntaxContext context;
@@ -2238,13 +2274,15 @@ struct STX_ParserResult STX_buildSyntaxTree(
 
     initializeSyntaxTree(tree);
 
-    context.tokens = tokens;
-    context.tokenCount = tokenCount;
-    context.tokensRemaining = tokenCount;
-    context.current = tokens;
+    context.lexer = lexer;
+    context.lexerResult = LEX_getLexerResult(lexer);
+    context.current = LEX_nextToken(lexer);
     context.tree = tree;
     context.currentNodeIndex = tree->rootNodeIndex;
-    context.latestComment = 0;
+    context.currentTokenIndex = 0;
+    context.nextDocComment = 0;
+    context.hasLatestComment = 0;
+    attachDocComments(&context);
 
     parseModule(&context);
 
@@ -2253,8 +2291,7 @@ struct STX_ParserResult STX_buildSyntaxTree(
         const struct LEX_LexerToken *current = getCurrentToken(&context);
         if (current)
         {
-            result.line = current->beginLine;
-            result.column = current->beginColumn;
+            LEX_getPosition(context.lexerResult, current->offset, &result.line, &result.column);
         }
         else
         {
@@ -2266,6 +2303,12 @@ struct STX_ParserResult STX_buildSyntaxTree(
     return result;
 }
 
+void STX_destroySyntaxTree(struct STX_SyntaxTree *tree)
+{
+    free(tree->nodes);
+    free(tree);
+}
+
 struct STX_SyntaxTreeNode *STX_getRootNode(struct STX_SyntaxTree *tree)
 {
     return &tree->nodes[tree->rootNodeIndex];
@@ -195,10 +195,17 @@ struct STX_NodeAttribute
         {
             enum STX_TermType termType; ///<  Type of the term
             enum LEX_TokenType tokenType; ///< Token type of the term.
+            /// The value of a number literal term. Decoded by the lexer.
+            union
+            {
+                /// Value of an integer literal. Negative values are in two's complement.
+                uint64_t integerValue;
+                double floatValue; ///< Value of a float literal.
+            };
         } termAttributes; ///< for the TERM node
         struct
         {
-            int caseValue; ///< The value in the case label.
+            int64_t caseValue; ///< The value in the case label.
             int isDefault; ///< Nonzero if the case bock is the 'default' block
         } caseAttributes; ///< for the CASE node
         struct
@@ -229,6 +236,7 @@ struct STX_NodeAttribute
      */
     const char *name;
     int nameLength; ///< Length of the name
+    unsigned symbolId; ///< Symbol id of the name if it's an identifier, 0 otherwise. Equal names have equal ids.
     /**
      * Comment of the node. The contents of the documentation comments before the node, or
      * documentation back comments after the node is set in this field.
@@ -253,10 +261,8 @@ struct STX_SyntaxTreeNode
     int nextSiblingIndex; ///< Id of the next sibling.
     int previousSiblingIndex; ///< Id of the previous sibling.
     struct STX_NodeAttribute attribute; ///< Attribute of the node.
-    int beginLine; ///< Line of the beginning character position of the node.
-    int beginColumn; ///< Column of the beginning character position of the node.
-    int endLine; ///< Line of the first character after the node
-    int endColumn; ///< Column of the first character after the node
+    int beginOffset; ///< Source offset of the beginning character of the node.
+    int endOffset; ///< Source offset of the first character after the node.
     enum STX_NodeType nodeType; ///< Type of the node.
     struct STX_SyntaxTree *belongsTo; ///< Reference to the syntax tree the node belongs to.
     int inScopeId; ///< The id of the scope the node is in.
@@ -301,17 +307,15 @@ struct STX_TreeIterator
 /**
  * Builds the syntax tree
  *
- * @param [in] tokens The array of tokens to build the tree from.
- * @param [in] tokenCount The count of tokens in the array.
+ * @param [in,out] lexer The lexer to read the tokens from. The nodes refer to the
+ *      source and the binary strings of the lexer, use LEX_getPosition on the result of
+ *      the lexer to get the line and column of them. Destroy the lexer after the tree.
  *
  * @return The parser result which stores the syntax tree. On error the syntax
  *      tree will be invalid. Use the global ERR module to query the error.
  *      The line and column in the result refers to the location of the error.
  */
-struct STX_ParserResult STX_buildSyntaxTree(
-    const struct LEX_LexerToken *tokens,
-    int tokenCount
-);
+struct STX_ParserResult STX_buildSyntaxTree(struct LEX_Lexer *lexer);
 
 /**
  * Callback function to transverse the syntax tree.
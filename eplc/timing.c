@@ -0,0 +1,215 @@
+/**
+ * Copyright (c) 2012, Csirmaz Dávid
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file
+ * Measures the phases of the compilation for the time report.
+ *
+ * Each thread charges the resources used since the last phase change to the phase it
+ * was in, so the phases are measured exclusively and nothing is lost between them.
+ */
+#include <string.h>
+#include <time.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+/// The peak resident set size is got by getrusage.
+#define HAS_RUSAGE
+#include <sys/resource.h>
+#endif
+
+#include "timing.h"
+
+#if defined(_MSC_VER)
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+/**
+ * The counters of the thread at a phase change.
+ */
+struct Sample
+{
+    double wallTime; ///< The monotonic time in seconds.
+    double cpuTime; ///< The CPU time of the thread in seconds.
+    uint64_t allocationCount; ///< The allocations of the thread so far.
+    uint64_t allocatedBytes; ///< The bytes allocated by the thread so far.
+};
+
+static THREAD_LOCAL struct TIM_Report *currentReport; ///< The report of the thread. Null if not measured.
+static THREAD_LOCAL int currentPhase; ///< The phase the thread is in.
+static THREAD_LOCAL struct Sample lastSample; ///< The counters at the last phase change.
+static THREAD_LOCAL uint64_t allocationCount; ///< The allocations of the thread.
+static THREAD_LOCAL uint64_t allocatedBytes; ///< The bytes allocated by the thread.
+
+/**
+ * The names of the phases in the report.
+ */
+static const char *phaseNames[TIM_PHASE_COUNT] =
+{
+    [TIM_OTHER] = "other",
+    [TIM_READ] = "read",
+    [TIM_LEX] = "lex",
+    [TIM_PARSE] = "parse",
+    [TIM_CHECK] = "check",
+    [TIM_CHECK_ROOT] = "check root",
+    [TIM_SET_SCOPE_IDS] = "set scope ids",
+    [TIM_CHECK_EXPRESSIONS] = "check expressions",
+    [TIM_DIAGNOSTICS] = "diagnostics",
+    [TIM_DUMPS] = "dumps",
+    [TIM_CLEAN_UP] = "clean up",
+};
+
+/**
+ * Gets the counters of the current thread.
+ *
+ * @param [out] sample The counters.
+ */
+static void takeSample(struct Sample *sample)
+{
+#if defined(CLOCK_MONOTONIC) || defined(CLOCK_THREAD_CPUTIME_ID)
+    struct timespec now;
+#endif
+
+#ifdef CLOCK_MONOTONIC
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    sample->wallTime = now.tv_sec + now.tv_nsec * 1e-9;
+#else
+    sample->wallTime = (double)clock() / CLOCKS_PER_SEC;
+#endif
+#ifdef CLOCK_THREAD_CPUTIME_ID
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    sample->cpuTime = now.tv_sec + now.tv_nsec * 1e-9;
+#else
+    sample->cpuTime = (double)clock() / CLOCKS_PER_SEC;
+#endif
+    sample->allocationCount = allocationCount;
+    sample->allocatedBytes = allocatedBytes;
+}
+
+/**
+ * Charges the resources used since the last phase change to the current phase.
+ */
+static void chargeCurrentPhase(void)
+{
+    struct TIM_PhaseStatistics *statistics = &currentReport->phases[currentPhase];
+    struct Sample sample;
+#ifdef HAS_RUSAGE
+    struct rusage usage;
+    uint64_t peakRss;
+#endif
+
+    takeSample(&sample);
+    statistics->wallTime += sample.wallTime - lastSample.wallTime;
+    statistics->cpuTime += sample.cpuTime - lastSample.cpuTime;
+    statistics->allocationCount += sample.allocationCount - lastSample.allocationCount;
+    statistics->allocatedBytes += sample.allocatedBytes - lastSample.allocatedBytes;
+#ifdef HAS_RUSAGE
+    if (!getrusage(RUSAGE_SELF, &usage))
+    {
+#ifdef __APPLE__
+        peakRss = usage.ru_maxrss;
+#else
+        peakRss = (uint64_t)usage.ru_maxrss * 1024;
+#endif
+        if (peakRss > statistics->peakRss)
+        {
+            statistics->peakRss = peakRss;
+        }
+    }
+#endif
+    lastSample = sample;
+}
+
+void TIM_startReport(struct TIM_Report *report)
+{
+    memset(report, 0, sizeof(struct TIM_Report));
+    currentReport = report;
+    currentPhase = TIM_OTHER;
+    report->phases[TIM_OTHER].count = 1;
+    takeSample(&lastSample);
+}
+
+void TIM_stopReport(void)
+{
+    if (currentReport)
+    {
+        chargeCurrentPhase();
+        currentReport = 0;
+    }
+}
+
+int TIM_enterPhase(enum TIM_Phase phase)
+{
+    int previousPhase = currentPhase;
+
+    if (currentReport)
+    {
+        chargeCurrentPhase();
+        currentPhase = phase;
+        currentReport->phases[phase].count++;
+    }
+    return previousPhase;
+}
+
+void TIM_leavePhase(int previousPhase)
+{
+    if (currentReport)
+    {
+        chargeCurrentPhase();
+        currentPhase = previousPhase;
+    }
+}
+
+void TIM_addReport(struct TIM_Report *total, const struct TIM_Report *report)
+{
+    int i;
+
+    for (i = 0; i < TIM_PHASE_COUNT; i++)
+    {
+        struct TIM_PhaseStatistics *sum = &total->phases[i];
+        const struct TIM_PhaseStatistics *statistics = &report->phases[i];
+
+        sum->count += statistics->count;
+        sum->wallTime += statistics->wallTime;
+        sum->cpuTime += statistics->cpuTime;
+        sum->allocationCount += statistics->allocationCount;
+        sum->allocatedBytes += statistics->allocatedBytes;
+        if (statistics->peakRss > sum->peakRss)
+        {
+            sum->peakRss = statistics->peakRss;
+        }
+    }
+}
+
+void TIM_countAllocation(size_t size)
+{
+    allocationCount++;
+    allocatedBytes += size;
+}
+
+const char *TIM_getPhaseName(enum TIM_Phase phase)
+{
+    return phaseNames[phase];
+}
@@ -0,0 +1,120 @@
+/**
+ * Copyright (c) 2012, Csirmaz Dávid
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * The phases of the compilation measured by the time report. The time of a nested phase
+ * is not counted in the phase it's nested in.
+ */
+enum TIM_Phase
+{
+    TIM_OTHER, ///< Everything outside of the phases below, eg. scheduling the files.
+    TIM_READ, ///< Reading or mapping the source file.
+    TIM_LEX, ///< Lexing the source ahead of the parsing, or loading its token cache.
+    TIM_PARSE, ///< Building the syntax tree. It includes the lexing if it's not done ahead.
+    TIM_CHECK, ///< The semantic checking outside of its passes below.
+    TIM_CHECK_ROOT, ///< Building the scopes and the symbol table of the declarations.
+    TIM_SET_SCOPE_IDS, ///< Setting the scope ids on the nodes.
+    TIM_CHECK_EXPRESSIONS, ///< Checking the expressions and resolving their symbols.
+    TIM_DIAGNOSTICS, ///< Rendering the diagnostics.
+    TIM_DUMPS, ///< Writing the dumps.
+    TIM_CLEAN_UP, ///< Freeing the tokens, the syntax tree and the source.
+    TIM_PHASE_COUNT ///< Count of phases.
+};
+
+/**
+ * The resources used by a phase.
+ */
+struct TIM_PhaseStatistics
+{
+    int count; ///< How many times the phase is entered.
+    double wallTime; ///< The elapsed time in seconds.
+    double cpuTime; ///< The CPU time of the thread in seconds.
+    uint64_t allocationCount; ///< Count of allocations, if they are counted.
+    uint64_t allocatedBytes; ///< Bytes allocated, if the allocations are counted.
+    /// The peak resident set size of the process at the end of the phase in bytes.
+    /// Zero if it's not known.
+    uint64_t peakRss;
+};
+
+/**
+ * The resources used by the phases, either on one thread or summed over the threads.
+ */
+struct TIM_Report
+{
+    struct TIM_PhaseStatistics phases[TIM_PHASE_COUNT]; ///< The phases.
+};
+
+/**
+ * Starts measuring the phases on the current thread. The time until the first phase is
+ * charged to TIM_OTHER.
+ *
+ * @param [out] report The report. It's cleared, and filled until TIM_stopReport.
+ */
+void TIM_startReport(struct TIM_Report *report);
+/**
+ * Stops measuring the phases on the current thread.
+ */
+void TIM_stopReport(void);
+/**
+ * Enters a phase on the current thread. Does nothing if the thread has no report.
+ *
+ * @param phase The phase.
+ *
+ * @return The phase being left, pass it to TIM_leavePhase.
+ */
+int TIM_enterPhase(enum TIM_Phase phase);
+/**
+ * Leaves the phase entered last on the current thread.
+ *
+ * @param previousPhase The return value of TIM_enterPhase.
+ */
+void TIM_leavePhase(int previousPhase);
+/**
+ * Adds a report to a total. The peak resident set sizes are maximized.
+ *
+ * @param [in,out] total The total.
+ * @param report The report to add.
+ */
+void TIM_addReport(struct TIM_Report *total, const struct TIM_Report *report);
+/**
+ * Counts an allocation of the current thread. It's called by the allocator wrappers of
+ * the program if it has any.
+ *
+ * @param size The size of the allocation.
+ */
+void TIM_countAllocation(size_t size);
+/**
+ * @param phase The phase.
+ *
+ * @return The name of the phase, eg. "parse".
+ */
+const char *TIM_getPhaseName(enum TIM_Phase phase);
+
+#endif // TIMING_H